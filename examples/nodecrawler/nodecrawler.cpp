@@ -22,18 +22,18 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
-#include <CoinNodeAbstractListener.h>
+#include <CoinNodePeerManager.h>
 
 #include <signal.h>
+#include <unistd.h>
 
 #include <set>
-#include <map>
-#include <queue>
-#include <memory>
+#include <deque>
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 
-#include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
 
@@ -68,132 +68,128 @@ void lineOut(const string& line)
     cout << line << endl;
 }
 
-class AddrListener : public CoinNodeAbstractListener
+class AddrListener : public CoinNodePeerListener
 {
-private:
-    string name;
-    time_t time_connected;
-    
 public:
-    AddrListener(const string& hostname, uint16_t port)
-        : CoinNodeAbstractListener(listener_network::MAGIC_BYTES, listener_network::PROTOCOL_VERSION, hostname, port)
-    {
-        name = getNodeName(hostname, port);
-    }
-    
-    void start() { CoinNodeAbstractListener::start(); time_connected = time(NULL); }
-    void stop() { CoinNodeAbstractListener::stop(); lineOut(("Closed connection to ") + name); }
-    
-    virtual void onAddr(AddrMessage& addr);
-    
-    virtual void onSocketClosed(int code);
+    void setManager(CoinNodePeerManager* pManager) { m_pManager = pManager; }
+
+    void tryConnecting(const string& ip, uint16_t port);
+
+    virtual void onPeerConnected(CoinNodePeerPtr peer);
+    virtual void onPeerClosed(CoinNodePeerPtr peer, int code);
+    virtual void onAddr(CoinNodePeerPtr peer, AddrMessage& addr);
+
+private:
+    CoinNodePeerManager* m_pManager;
 };
 
 set<string> g_peerSet;
 set<string> g_successfulConnectionSet;
-queue<string> g_connectionQueue;
-map<string, unique_ptr<AddrListener> > g_connectionMap;
+set<string> g_pendingSet;
+deque<CoinNodePeerPtr> g_connectedPeers; // completed handshakes, oldest first
 
 boost::mutex insertion_deletion_mutex;
 
-void tryConnecting(const string& ip, uint16_t port, const string& nodeName)
+void AddrListener::tryConnecting(const string& ip, uint16_t port)
 {
     if (bShuttingDown) return;
 
-    AddrListener* pListener = new AddrListener(ip, port);
-
-    try
+    string nodeName = getNodeName(ip, port);
+    stringstream ss;
     {
-        stringstream ss;
-        {
-            boost::unique_lock<boost::mutex> lock(insertion_deletion_mutex);
-            ss << "Trying " << nodeName + "... "
-               << "(# of open connections: " << g_connectionMap.size() << ", # of known peers: " << g_peerSet.size()
-               << ", # of successful connections: " << g_successfulConnectionSet.size() << ")";
-        }
-        lineOut(ss.str());
-        pListener->start();
-        if (bShuttingDown) {
-            pListener->stop();
-            delete pListener;
-            return;
-        }
+        boost::unique_lock<boost::mutex> lock(insertion_deletion_mutex);
+        if (g_pendingSet.count(nodeName)) return;
+        g_pendingSet.insert(nodeName);
+        ss << "Trying " << nodeName << "... "
+           << "(# of open connections: " << m_pManager->getPeerCount() << ", # of known peers: " << g_peerSet.size()
+           << ", # of successful connections: " << g_successfulConnectionSet.size() << ")";
+    }
+    lineOut(ss.str());
 
-        lineOut(string("Opened connection to ") + nodeName);
-        {
-            boost::unique_lock<boost::mutex> lock(insertion_deletion_mutex);
-            g_successfulConnectionSet.insert(nodeName);
-            g_connectionMap[nodeName] = unique_ptr<AddrListener>(pListener);
-            g_connectionQueue.push(nodeName); 
-            while (g_connectionMap.size() > MAX_CONNECTIONS) {
-                string disconnectPeerName = g_connectionQueue.front();
-                g_connectionMap[disconnectPeerName]->stop();
-                g_connectionMap.erase(disconnectPeerName);
-                g_connectionQueue.pop();
-            }
-        }
-        pListener->askForPeers();
+    try {
+        m_pManager->connect(ip, port);
     }
-    catch (const exception& e)
-    {
-        delete pListener;
+    catch (const exception& e) {
         lineOut(nodeName + " " + e.what());
     }
 }
 
-void AddrListener::onAddr(AddrMessage& addr)
+void AddrListener::onPeerConnected(CoinNodePeerPtr peer)
 {
     if (bShuttingDown) return;
 
-    vector<string> ips;
-    vector<uint16_t> ports;
-    vector<string> nodeNames;
-    for (uint i = 0; i < addr.addrList.size(); i++)
+    lineOut(string("Opened connection to ") + peer->getName());
+    peer->askForPeers();
+
+    // The oldest connections are dropped once we are over the limit - they've already given us their addresses.
+    // Peers still handshaking aren't counted or closed.
+    vector<CoinNodePeerPtr> oldPeers;
     {
-        // Only look at ipv4 nodes
-        if (!addr.addrList[i].ipv6.isIPv4()) continue;
-        
-        string ip = addr.addrList[i].ipv6.toIPv4String();
-        ips.push_back(ip);
-        ports.push_back(addr.addrList[i].port);
-        
-        string nodeName = getNodeName(ip, addr.addrList[i].port);
-        nodeNames.push_back(nodeName);
-        g_peerSet.insert(nodeName);
+        boost::unique_lock<boost::mutex> lock(insertion_deletion_mutex);
+        g_successfulConnectionSet.insert(peer->getName());
+        g_connectedPeers.push_back(peer);
+        while (g_connectedPeers.size() > MAX_CONNECTIONS) {
+            oldPeers.push_back(g_connectedPeers.front());
+            g_connectedPeers.pop_front();
+        }
     }
+    for (size_t i = 0; i < oldPeers.size(); i++) oldPeers[i]->close();
+}
 
-    if (nodeNames.size() == 0) return;
-
-    stringstream ss;
-    ss << "Added " << nodeNames.size() << " address(es) from " << name;
-    lineOut(ss.str());
-    for (uint i = 0; i < nodeNames.size(); i++)
+void AddrListener::onPeerClosed(CoinNodePeerPtr peer, int code)
+{
     {
-        if (g_connectionMap.count(nodeNames[i]) == 0)
-            boost::thread t(tryConnecting, ips[i], ports[i], nodeNames[i]);
+        boost::unique_lock<boost::mutex> lock(insertion_deletion_mutex);
+        g_pendingSet.erase(peer->getName());
+        g_connectedPeers.erase(remove(g_connectedPeers.begin(), g_connectedPeers.end(), peer), g_connectedPeers.end());
     }
+    stringstream ss;
+    ss << "Closed connection to " << peer->getName() << " with code " << code;
+    lineOut(ss.str());
 }
 
-void AddrListener::onSocketClosed(int code)
+void AddrListener::onAddr(CoinNodePeerPtr peer, AddrMessage& addr)
 {
+    if (bShuttingDown) return;
+
+    vector<string> ips;
+    vector<uint16_t> ports;
+    {
+        boost::unique_lock<boost::mutex> lock(insertion_deletion_mutex);
+        for (uint i = 0; i < addr.addrList.size(); i++)
+        {
+            // Only look at ipv4 nodes
+            if (!addr.addrList[i].ipv6.isIPv4()) continue;
+
+            string ip = addr.addrList[i].ipv6.toIPv4String();
+            ips.push_back(ip);
+            ports.push_back(addr.addrList[i].port);
+
+            g_peerSet.insert(getNodeName(ip, addr.addrList[i].port));
+        }
+    }
+
+    if (ips.size() == 0) return;
+
     stringstream ss;
-    ss << "Closed connection to " << name << " with code " << code;
+    ss << "Added " << ips.size() << " address(es) from " << peer->getName();
     lineOut(ss.str());
-    g_connectionMap.erase(name);
+    for (uint i = 0; i < ips.size(); i++)
+        tryConnecting(ips[i], ports[i]);
 }
 
+AddrListener g_listener;
+CoinNodePeerManager g_peerManager(&g_listener, listener_network::MAGIC_BYTES, listener_network::PROTOCOL_VERSION);
+
 void ShutDown(int param)
 {
     bShuttingDown = true;
     lineOut("Shutting down...");
 
-    boost::unique_lock<boost::mutex> lock(insertion_deletion_mutex);
-
     lineOut("Stopping all connections...");
-    for (map<string, unique_ptr<AddrListener> >::iterator it = g_connectionMap.begin(); it != g_connectionMap.end(); ++it)
-        it->second->stop();
+    g_peerManager.stop();
 
-    g_connectionMap.clear();
+    boost::unique_lock<boost::mutex> lock(insertion_deletion_mutex);
 
     stringstream ssSize;
     ssSize << g_successfulConnectionSet.size();
@@ -228,13 +224,12 @@ int main(int argc, char* argv[])
     SetMultiSigAddressVersion(listener_network::MULTISIG_ADDRESS_VERSION);
 	
     uint32_t port = strtoul(argv[2], NULL, 0);
-    AddrListener listener(argv[1], port);
     try
     {
-        cout << "Starting listener..." << flush;
-        listener.start();
-        cout << "started." << endl << endl;
-        listener.askForPeers();
+        g_listener.setManager(&g_peerManager);
+        g_peerManager.start();
+        cout << "Starting listener..." << endl;
+        g_listener.tryConnecting(argv[1], port);
     }
     catch (const exception& e)
     {
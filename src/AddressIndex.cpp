@@ -0,0 +1,706 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// AddressIndex.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "AddressIndex.h"
+#include "Base58Check.h"
+#include "hash.h"
+#include "ParallelFor.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <queue>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+
+using namespace Coin;
+
+namespace
+{
+    const uint32_t RUN_MAGIC = 0x4e555241;      // "ARUN"
+    const uint32_t MANIFEST_MAGIC = 0x4e4d4441; // "ADMN"
+
+    // Run files: header, entries grouped by key, then the key directory.
+    const std::size_t RUN_HEADER_SIZE = 32;     // magic, pad, key count, entry count, directory offset
+    const std::size_t DIRECTORY_RECORD_SIZE = 36; // key, pad, entry count, offset of the key's entries
+
+    // Same varint as UtxoSet - base 128, most significant group first.
+    void writeVarInt(uchar_vector& out, uint64_t n)
+    {
+        unsigned char tmp[10];
+        int len = 0;
+        while (true) {
+            tmp[len] = (n & 0x7f) | (len ? 0x80 : 0x00);
+            if (n <= 0x7f) break;
+            n = (n >> 7) - 1;
+            len++;
+        }
+        do {
+            out.push_back(tmp[len]);
+        } while (len--);
+    }
+
+    inline const unsigned char* readVarInt(const unsigned char* p, uint64_t& n)
+    {
+        n = 0;
+        while (true) {
+            unsigned char ch = *p++;
+            n = (n << 7) | (ch & 0x7f);
+            if (!(ch & 0x80)) return p;
+            n++;
+        }
+    }
+
+    // Heights are stored as the difference from the previous entry of the same key.
+    class EntryEncoder
+    {
+    public:
+        EntryEncoder() : m_prevHeight(0), m_count(0) { }
+
+        void add(const AddressHistoryEntry& entry)
+        {
+            writeVarInt(m_data, entry.height - m_prevHeight);
+            m_data.insert(m_data.end(), entry.txid, entry.txid + 32);
+            writeVarInt(m_data, ((uint64_t)entry.index << 1) | (entry.bSpend ? 1 : 0));
+            writeVarInt(m_data, entry.value);
+            m_prevHeight = entry.height;
+            m_count++;
+        }
+
+        void clear() { m_data.clear(); m_prevHeight = 0; m_count = 0; }
+
+        const uchar_vector& getData() const { return m_data; }
+        uint32_t getCount() const { return m_count; }
+
+    private:
+        uchar_vector m_data;
+        uint32_t m_prevHeight;
+        uint32_t m_count;
+    };
+
+    inline const unsigned char* decodeEntry(const unsigned char* p, uint32_t& height, AddressHistoryEntry& entry)
+    {
+        uint64_t n;
+        p = readVarInt(p, n);
+        height += n;
+        entry.height = height;
+        memcpy(entry.txid, p, 32);
+        p = readVarInt(p + 32, n);
+        entry.index = n >> 1;
+        entry.bSpend = n & 1;
+        return readVarInt(p, entry.value);
+    }
+
+    // Writes the entries straight to the run file and the directory to a side file, which is appended at the end.
+    class RunWriter
+    {
+    public:
+        RunWriter(const std::string& path) : m_path(path), m_keyCount(0), m_entryCount(0), m_offset(RUN_HEADER_SIZE)
+        {
+            m_data = fopen((path + ".tmp").c_str(), "wb+");
+            m_directory = fopen((path + ".dir").c_str(), "wb+");
+            if (!m_data || !m_directory) {
+                close();
+                throw std::runtime_error("AddressIndex - cannot create " + path);
+            }
+            unsigned char header[RUN_HEADER_SIZE] = { 0 };
+            write(m_data, header, RUN_HEADER_SIZE);
+        }
+
+        ~RunWriter()
+        {
+            close();
+            unlink((m_path + ".tmp").c_str());
+            unlink((m_path + ".dir").c_str());
+        }
+
+        void addKey(const AddressKey& key, const EntryEncoder& entries)
+        {
+            if (entries.getCount() == 0) return;
+
+            unsigned char record[DIRECTORY_RECORD_SIZE] = { 0 };
+            memcpy(record, key.bytes, 21);
+            uint32_t count = entries.getCount();
+            memcpy(record + 24, &count, 4);
+            memcpy(record + 28, &m_offset, 8);
+            write(m_directory, record, DIRECTORY_RECORD_SIZE);
+
+            write(m_data, &entries.getData()[0], entries.getData().size());
+            m_offset += entries.getData().size();
+            m_keyCount++;
+            m_entryCount += count;
+        }
+
+        // Appends the directory, fills in the header and moves the file into place.
+        void finish()
+        {
+            rewind(m_directory);
+            unsigned char buffer[65536];
+            std::size_t n;
+            while ((n = fread(buffer, 1, sizeof(buffer), m_directory)) > 0) {
+                write(m_data, buffer, n);
+            }
+
+            uint32_t header[8] = { RUN_MAGIC, 0 };
+            memcpy(&header[2], &m_keyCount, 8);
+            memcpy(&header[4], &m_entryCount, 8);
+            memcpy(&header[6], &m_offset, 8);
+            fseek(m_data, 0, SEEK_SET);
+            write(m_data, header, RUN_HEADER_SIZE);
+
+            if (fflush(m_data) != 0 || fsync(fileno(m_data)) != 0) throw std::runtime_error("AddressIndex - cannot write " + m_path);
+            close();
+            if (rename((m_path + ".tmp").c_str(), m_path.c_str()) != 0) throw std::runtime_error("AddressIndex - cannot rename " + m_path);
+        }
+
+    private:
+        void write(FILE* f, const void* data, std::size_t size)
+        {
+            if (fwrite(data, 1, size, f) != size) throw std::runtime_error("AddressIndex - cannot write " + m_path);
+        }
+
+        void close()
+        {
+            if (m_data) { fclose(m_data); m_data = NULL; }
+            if (m_directory) { fclose(m_directory); m_directory = NULL; }
+        }
+
+        std::string m_path;
+        FILE* m_data;
+        FILE* m_directory;
+        uint64_t m_keyCount;
+        uint64_t m_entryCount;
+        uint64_t m_offset;
+    };
+
+    void syncDir(const std::string& dir)
+    {
+        int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+        if (fd != -1) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class AddressKey implementation
+//
+AddressKey::AddressKey(const std::string& address)
+{
+    std::vector<unsigned char> payload;
+    unsigned int version;
+    if (!fromBase58Check(address, payload, version) || payload.size() != 20) throw std::runtime_error("AddressKey - invalid address.");
+    bytes[0] = version;
+    memcpy(bytes + 1, &payload[0], 20);
+}
+
+std::string AddressKey::getAddress() const
+{
+    return toBase58Check(getHash160(), bytes[0]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class AddressIndex implementation
+//
+AddressIndex::AddressIndex(const std::string& dir, unsigned char pubKeyHashVersion, unsigned char scriptHashVersion)
+    : m_dir(dir), m_pubKeyHashVersion(pubKeyHashVersion), m_scriptHashVersion(scriptHashVersion),
+      m_nextSeq(0), m_height(0), m_flushedHeight(0), m_bufferEntries(0)
+{
+    if (!m_dir.empty() && m_dir[m_dir.size() - 1] != '/') m_dir += "/";
+    readManifest();
+
+    // Runs written after the last manifest never got committed, and a merge that was interrupted
+    // can leave one behind below m_nextSeq as well.
+    std::vector<bool> bCommitted(m_nextSeq, false);
+    for (std::size_t i = 0; i < m_runs.size(); i++) {
+        if (m_runs[i]->seq < m_nextSeq) bCommitted[m_runs[i]->seq] = true;
+    }
+    for (uint32_t seq = 0; seq < m_nextSeq; seq++) {
+        if (!bCommitted[seq]) unlink(getRunPath(seq).c_str());
+    }
+    for (uint32_t seq = m_nextSeq; access(getRunPath(seq).c_str(), F_OK) == 0; seq++) {
+        unlink(getRunPath(seq).c_str());
+    }
+}
+
+AddressIndex::~AddressIndex()
+{
+    try {
+        flush();
+    }
+    catch (...) { }
+}
+
+bool AddressIndex::getAddressKey(const uchar_vector& script, AddressKey& key) const
+{
+    if (script.size() == 25 && script[0] == 0x76 && script[1] == 0xa9 && script[2] == 0x14 && script[23] == 0x88 && script[24] == 0xac) {
+        key = AddressKey(m_pubKeyHashVersion, &script[3]);
+        return true;
+    }
+    if (script.size() == 23 && script[0] == 0xa9 && script[1] == 0x14 && script[22] == 0x87) {
+        key = AddressKey(m_scriptHashVersion, &script[2]);
+        return true;
+    }
+    if ((script.size() == 35 && script[0] == 0x21 && script[34] == 0xac) ||
+        (script.size() == 67 && script[0] == 0x41 && script[66] == 0xac)) {
+        uchar_vector hash160 = mdsha(uchar_vector(script.begin() + 1, script.end() - 1));
+        key = AddressKey(m_pubKeyHashVersion, &hash160[0]);
+        return true;
+    }
+    return false;
+}
+
+void AddressIndex::extractEntries(const CoinBlock& block, uint32_t height, const UtxoUndo* pSpent, std::vector<KeyedEntry>& entries) const
+{
+    if (pSpent) {
+        std::size_t inputCount = 0;
+        for (std::size_t i = 1; i < block.txs.size(); i++) {
+            inputCount += block.txs[i].inputs.size();
+        }
+        if (inputCount != pSpent->spentCoins.size()) throw std::runtime_error("AddressIndex - undo data does not match block.");
+    }
+
+    std::size_t spent = 0;
+    AddressKey key;
+    for (std::size_t i = 0; i < block.txs.size(); i++) {
+        const Transaction& tx = block.txs[i];
+        unsigned char txid[32];
+        uchar_vector serialized = tx.getSerialized();
+        sha256_2(&serialized[0], serialized.size(), txid);
+        std::reverse(txid, txid + 32);
+
+        if (pSpent && i > 0) {
+            for (std::size_t j = 0; j < tx.inputs.size(); j++) {
+                UtxoCoin coin(pSpent->spentCoins[spent++].coin);
+                if (getAddressKey(coin.scriptPubKey, key)) {
+                    entries.push_back(KeyedEntry(key, AddressHistoryEntry(height, txid, j, true, coin.value)));
+                }
+            }
+        }
+        for (std::size_t j = 0; j < tx.outputs.size(); j++) {
+            if (getAddressKey(tx.outputs[j].scriptPubKey, key)) {
+                entries.push_back(KeyedEntry(key, AddressHistoryEntry(height, txid, j, false, tx.outputs[j].value)));
+            }
+        }
+    }
+}
+
+void AddressIndex::extractBlocks(const std::vector<CoinBlock>& blocks, uint32_t firstHeight, const std::vector<UtxoUndo>* pSpent,
+                                 std::vector<std::vector<KeyedEntry> >* pEntries, std::size_t chunk, std::size_t begin, std::size_t end) const
+{
+    for (std::size_t i = begin; i < end; i++) {
+        extractEntries(blocks[i], firstHeight + i, pSpent ? &(*pSpent)[i] : NULL, (*pEntries)[chunk]);
+    }
+}
+
+void AddressIndex::addEntries(const std::vector<KeyedEntry>& entries)
+{
+    for (std::size_t i = 0; i < entries.size(); i++) {
+        m_buffer[entries[i].first].push_back(entries[i].second);
+    }
+    m_bufferEntries += entries.size();
+}
+
+void AddressIndex::addBlock(const CoinBlock& block, uint32_t height, const UtxoUndo* pSpent)
+{
+    std::vector<KeyedEntry> entries;
+    extractEntries(block, height, pSpent, entries);
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        if (height < m_height) throw std::runtime_error("AddressIndex::addBlock() - height already indexed, rewind first.");
+        addEntries(entries);
+        m_height = height + 1;
+        if (m_bufferEntries < MAX_ADDRESS_BUFFER_ENTRIES) return;
+        flushBuffer();
+    }
+    mergeRuns();
+}
+
+void AddressIndex::addBlocks(const std::vector<CoinBlock>& blocks, uint32_t firstHeight, const std::vector<UtxoUndo>* pSpent, unsigned int nThreads)
+{
+    if (blocks.empty()) return;
+    if (pSpent && pSpent->size() != blocks.size()) throw std::runtime_error("AddressIndex::addBlocks() - need undo data for each block.");
+
+    std::size_t count = blocks.size();
+    std::size_t nChunks = getChunkCount(count, MIN_ADDRESS_BLOCKS_PER_THREAD, nThreads);
+    std::vector<std::vector<KeyedEntry> > entries(nChunks);
+    parallelFor(count, nChunks, boost::bind(&AddressIndex::extractBlocks, this, boost::cref(blocks), firstHeight, pSpent, &entries, _1, _2, _3));
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        if (firstHeight < m_height) throw std::runtime_error("AddressIndex::addBlocks() - height already indexed, rewind first.");
+        for (std::size_t i = 0; i < nChunks; i++) {
+            addEntries(entries[i]);
+            std::vector<KeyedEntry>().swap(entries[i]);
+        }
+        m_height = firstHeight + count;
+        if (m_bufferEntries < MAX_ADDRESS_BUFFER_ENTRIES) return;
+        flushBuffer();
+    }
+    mergeRuns();
+}
+
+void AddressIndex::rewind(uint32_t height)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (height >= m_height) return;
+
+    for (Buffer::iterator it = m_buffer.begin(); it != m_buffer.end();) {
+        AddressHistory& history = it->second;
+        std::size_t n = history.size();
+        while (n > 0 && history[n - 1].height >= height) n--;
+        m_bufferEntries -= history.size() - n;
+        history.resize(n);
+        if (n == 0) m_buffer.erase(it++);
+        else ++it;
+    }
+
+    m_height = height;
+    if (height < m_flushedHeight) {
+        for (std::size_t i = 0; i < m_runs.size(); i++) {
+            m_runs[i]->endHeight = std::min(m_runs[i]->endHeight, height);
+        }
+        m_flushedHeight = height;
+        writeManifest();
+    }
+}
+
+void AddressIndex::readRun(const Run& run, uint32_t endHeight, const AddressKey& key, uint32_t fromHeight, uint32_t toHeight, AddressHistory& history) const
+{
+    const unsigned char* data = run.view->data();
+    uint64_t directoryOffset;
+    memcpy(&directoryOffset, data + 24, 8);
+    const unsigned char* directory = data + directoryOffset;
+
+    // Binary search the directory
+    uint64_t lo = 0, hi = run.keyCount;
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        if (memcmp(directory + mid * DIRECTORY_RECORD_SIZE, key.bytes, 21) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == run.keyCount) return;
+    const unsigned char* record = directory + lo * DIRECTORY_RECORD_SIZE;
+    if (memcmp(record, key.bytes, 21) != 0) return;
+
+    uint32_t count;
+    uint64_t offset;
+    memcpy(&count, record + 24, 4);
+    memcpy(&offset, record + 28, 8);
+
+    const unsigned char* p = data + offset;
+    uint32_t height = 0;
+    AddressHistoryEntry entry;
+    for (uint32_t i = 0; i < count; i++) {
+        p = decodeEntry(p, height, entry);
+        if (height >= endHeight || height > toHeight) break;
+        if (height >= fromHeight) history.push_back(entry);
+    }
+}
+
+void AddressIndex::getHistory(const AddressKey& key, AddressHistory& history, uint32_t fromHeight, uint32_t toHeight) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (std::size_t i = 0; i < m_runs.size(); i++) {
+        readRun(*m_runs[i], m_runs[i]->endHeight, key, fromHeight, toHeight, history);
+    }
+
+    Buffer::const_iterator it = m_buffer.find(key);
+    if (it == m_buffer.end()) return;
+    for (std::size_t i = 0; i < it->second.size(); i++) {
+        const AddressHistoryEntry& entry = it->second[i];
+        if (entry.height > toHeight) break;
+        if (entry.height >= fromHeight) history.push_back(entry);
+    }
+}
+
+AddressHistory AddressIndex::getHistory(const std::string& address, uint32_t fromHeight, uint32_t toHeight) const
+{
+    AddressHistory history;
+    getHistory(AddressKey(address), history, fromHeight, toHeight);
+    return history;
+}
+
+uint64_t AddressIndex::getBalance(const AddressKey& key) const
+{
+    AddressHistory history;
+    getHistory(key, history);
+    uint64_t balance = 0;
+    for (std::size_t i = 0; i < history.size(); i++) {
+        if (history[i].bSpend) balance -= history[i].value;
+        else balance += history[i].value;
+    }
+    return balance;
+}
+
+uint32_t AddressIndex::getHeight() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_height;
+}
+
+std::string AddressIndex::getRunPath(uint32_t seq) const
+{
+    char name[32];
+    sprintf(name, "addr%06u.run", seq);
+    return m_dir + name;
+}
+
+AddressIndex::RunPtr AddressIndex::openRun(uint32_t seq, uint32_t endHeight)
+{
+    RunPtr run(new Run());
+    run->seq = seq;
+    run->endHeight = endHeight;
+    run->file.open(getRunPath(seq));
+    if (run->file.size() < RUN_HEADER_SIZE) throw std::runtime_error("AddressIndex - " + getRunPath(seq) + " is missing or truncated.");
+    run->view = run->file.getView();
+
+    const unsigned char* data = run->view->data();
+    uint32_t magic;
+    uint64_t directoryOffset;
+    memcpy(&magic, data, 4);
+    memcpy(&run->keyCount, data + 8, 8);
+    memcpy(&directoryOffset, data + 24, 8);
+    if (magic != RUN_MAGIC || directoryOffset + run->keyCount * DIRECTORY_RECORD_SIZE != run->file.size()) {
+        throw std::runtime_error("AddressIndex - " + getRunPath(seq) + " is corrupt.");
+    }
+    return run;
+}
+
+void AddressIndex::writeRun(uint32_t seq, const Buffer& buffer)
+{
+    RunWriter writer(getRunPath(seq));
+    EntryEncoder encoder;
+    for (Buffer::const_iterator it = buffer.begin(); it != buffer.end(); ++it) {
+        encoder.clear();
+        for (std::size_t i = 0; i < it->second.size(); i++) {
+            encoder.add(it->second[i]);
+        }
+        writer.addKey(it->first, encoder);
+    }
+    writer.finish();
+}
+
+bool AddressIndex::selectMerge(std::size_t& begin, std::size_t& end) const
+{
+    // The newest runs, for as long as each older run is no bigger than the ones after it combined.
+    end = m_runs.size();
+    if (end < 2) return false;
+    begin = end - 1;
+    uint64_t total = m_runs[begin]->file.size();
+    while (begin > 0 && m_runs[begin - 1]->file.size() <= total) {
+        begin--;
+        total += m_runs[begin]->file.size();
+    }
+    if (end - begin >= ADDRESS_MERGE_RUNS) return true;
+    if (m_runs.size() <= MAX_ADDRESS_RUNS) return false;
+
+    // Too many runs of very different sizes - merge the smallest adjacent pair.
+    uint64_t smallest = 0;
+    for (std::size_t i = 0; i + 1 < m_runs.size(); i++) {
+        uint64_t size = m_runs[i]->file.size() + m_runs[i + 1]->file.size();
+        if (i == 0 || size < smallest) {
+            smallest = size;
+            begin = i;
+        }
+    }
+    end = begin + 2;
+    return true;
+}
+
+void AddressIndex::writeMergedRun(uint32_t seq, const std::vector<RunPtr>& runs, const std::vector<uint32_t>& endHeights) const
+{
+    // Merge the directories in key order. For each key, the runs' entries are concatenated oldest run first,
+    // which keeps them in height order since a run only covers heights its predecessors don't.
+    typedef std::pair<AddressKey, std::size_t> Cursor; // next key, run
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor> > cursors;
+    std::vector<uint64_t> positions(runs.size(), 0);
+
+    struct Local
+    {
+        static AddressKey keyAt(const Run& run, uint64_t i)
+        {
+            const unsigned char* data = run.view->data();
+            uint64_t directoryOffset;
+            memcpy(&directoryOffset, data + 24, 8);
+            AddressKey key;
+            memcpy(key.bytes, data + directoryOffset + i * DIRECTORY_RECORD_SIZE, 21);
+            return key;
+        }
+    };
+
+    for (std::size_t i = 0; i < runs.size(); i++) {
+        if (runs[i]->keyCount > 0) cursors.push(Cursor(Local::keyAt(*runs[i], 0), i));
+    }
+
+    RunWriter writer(getRunPath(seq));
+    EntryEncoder encoder;
+    AddressHistory history;
+    while (!cursors.empty()) {
+        AddressKey key = cursors.top().first;
+        history.clear();
+        std::vector<std::size_t> keyRuns;
+        while (!cursors.empty() && cursors.top().first == key) {
+            keyRuns.push_back(cursors.top().second);
+            cursors.pop();
+        }
+        std::sort(keyRuns.begin(), keyRuns.end());
+        for (std::size_t i = 0; i < keyRuns.size(); i++) {
+            std::size_t r = keyRuns[i];
+            readRun(*runs[r], endHeights[r], key, 0, 0xffffffff, history);
+            if (++positions[r] < runs[r]->keyCount) cursors.push(Cursor(Local::keyAt(*runs[r], positions[r]), r));
+        }
+
+        // a key whose entries were all rewound is dropped
+        if (history.empty()) continue;
+        encoder.clear();
+        for (std::size_t i = 0; i < history.size(); i++) {
+            encoder.add(history[i]);
+        }
+        writer.addKey(key, encoder);
+    }
+    writer.finish();
+}
+
+void AddressIndex::mergeRuns()
+{
+    boost::lock_guard<boost::mutex> mergeLock(m_mergeMutex);
+    while (true) {
+        // Take the runs to merge. Run files never change once written, so they can be read without the lock.
+        std::vector<RunPtr> runs;
+        std::vector<uint32_t> endHeights;
+        uint32_t seq;
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            std::size_t begin, end;
+            if (!selectMerge(begin, end)) return;
+            runs.assign(m_runs.begin() + begin, m_runs.begin() + end);
+            for (std::size_t i = 0; i < runs.size(); i++) {
+                endHeights.push_back(runs[i]->endHeight);
+            }
+            seq = m_nextSeq++;
+        }
+
+        writeMergedRun(seq, runs, endHeights);
+        RunPtr merged = openRun(seq, 0xffffffff);
+
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+
+            // New runs may have been flushed after these, but a rewind in the meantime means starting over.
+            std::vector<RunPtr>::iterator it = std::find(m_runs.begin(), m_runs.end(), runs[0]);
+            bool bCurrent = (std::size_t)(m_runs.end() - it) >= runs.size();
+            for (std::size_t i = 0; bCurrent && i < runs.size(); i++) {
+                bCurrent = it[i] == runs[i] && runs[i]->endHeight == endHeights[i];
+            }
+            if (!bCurrent) {
+                unlink(getRunPath(seq).c_str());
+                continue;
+            }
+
+            it = m_runs.erase(it, it + runs.size());
+            m_runs.insert(it, merged);
+            writeManifest();
+        }
+
+        for (std::size_t i = 0; i < runs.size(); i++) {
+            unlink(getRunPath(runs[i]->seq).c_str());
+        }
+    }
+}
+
+void AddressIndex::readManifest()
+{
+    FILE* f = fopen((m_dir + "addresses.manifest").c_str(), "rb");
+    if (!f) return;
+
+    uint32_t header[4];
+    bool bValid = fread(header, sizeof(header), 1, f) == 1 && header[0] == MANIFEST_MAGIC;
+    std::vector<uint32_t> runs;
+    if (bValid) {
+        runs.resize(2 * header[3]);
+        bValid = runs.empty() || fread(&runs[0], 4, runs.size(), f) == runs.size();
+    }
+    fclose(f);
+    if (!bValid) throw std::runtime_error("AddressIndex - " + m_dir + "addresses.manifest is invalid.");
+
+    m_nextSeq = header[1];
+    m_height = m_flushedHeight = header[2];
+    for (std::size_t i = 0; i < runs.size(); i += 2) {
+        m_runs.push_back(openRun(runs[i], runs[i + 1]));
+    }
+}
+
+void AddressIndex::writeManifest()
+{
+    std::vector<uint32_t> data;
+    data.push_back(MANIFEST_MAGIC);
+    data.push_back(m_nextSeq);
+    data.push_back(m_flushedHeight);
+    data.push_back(m_runs.size());
+    for (std::size_t i = 0; i < m_runs.size(); i++) {
+        data.push_back(m_runs[i]->seq);
+        data.push_back(m_runs[i]->endHeight);
+    }
+
+    std::string path = m_dir + "addresses.manifest";
+    std::string tempPath = path + ".tmp";
+    FILE* f = fopen(tempPath.c_str(), "wb");
+    if (!f) throw std::runtime_error("AddressIndex - cannot create " + tempPath);
+    bool bWritten = fwrite(&data[0], 4, data.size(), f) == data.size() && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    fclose(f);
+    if (!bWritten || rename(tempPath.c_str(), path.c_str()) != 0) throw std::runtime_error("AddressIndex - cannot write " + path);
+    syncDir(m_dir);
+}
+
+void AddressIndex::flushBuffer()
+{
+    bool bChanged = m_flushedHeight != m_height;
+    if (!m_buffer.empty()) {
+        uint32_t seq = m_nextSeq++;
+        writeRun(seq, m_buffer);
+        m_runs.push_back(openRun(seq, 0xffffffff));
+        Buffer().swap(m_buffer);
+        m_bufferEntries = 0;
+        bChanged = true;
+    }
+    m_flushedHeight = m_height;
+    if (bChanged) writeManifest();
+}
+
+void AddressIndex::flush()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        flushBuffer();
+    }
+    mergeRuns();
+}
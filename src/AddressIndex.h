@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// AddressIndex.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Transaction history by address. Addresses are keyed by version byte + hash160,
+// so nothing is base58 encoded until a caller asks for it.
+//
+// New blocks go into an in-memory buffer. flush() writes the buffer out as a
+// sorted run file (addr000000.run, ...) - a directory of keys followed by each
+// key's entries, delta encoded by height - and records it in the manifest, which
+// is replaced atomically. Queries merge the runs and the buffer.
+//
+// Runs are merged by size tier: once ADDRESS_MERGE_RUNS of the newest runs are
+// about as big as each other, they are merged into one, so an entry is rewritten
+// only a logarithmic number of times however long the index grows. Past
+// MAX_ADDRESS_RUNS, the smallest adjacent pair is merged as well. Merges are
+// written without holding the query lock; the new run list is swapped in at the end.
+
+#ifndef _ADDRESS_INDEX_H__
+#define _ADDRESS_INDEX_H__
+
+#include "CoinNodeData.h"
+#include "MappedFile.h"
+#include "UtxoSet.h"
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/thread.hpp>
+
+#define MAX_ADDRESS_BUFFER_ENTRIES  0x00100000 // flush the buffer once it holds this many entries
+#define MAX_ADDRESS_RUNS            8
+#define ADDRESS_MERGE_RUNS          4          // newest runs merged together once each is no bigger than the ones after it combined
+#define MIN_ADDRESS_BLOCKS_PER_THREAD 16
+
+namespace Coin
+{
+
+class AddressKey
+{
+public:
+    unsigned char bytes[21]; // version, hash160
+
+    AddressKey() { memset(bytes, 0, 21); }
+    AddressKey(unsigned char version, const unsigned char* hash160) { bytes[0] = version; memcpy(bytes + 1, hash160, 20); }
+
+    // Throws if address isn't valid base58check with a 20 byte payload.
+    explicit AddressKey(const std::string& address);
+
+    unsigned char getVersion() const { return bytes[0]; }
+    uchar_vector getHash160() const { return uchar_vector(bytes + 1, bytes + 21); }
+    std::string getAddress() const;
+
+    bool operator<(const AddressKey& rhs) const { return memcmp(bytes, rhs.bytes, 21) < 0; }
+    bool operator==(const AddressKey& rhs) const { return memcmp(bytes, rhs.bytes, 21) == 0; }
+    bool operator!=(const AddressKey& rhs) const { return !(*this == rhs); }
+};
+
+class AddressHistoryEntry
+{
+public:
+    uint32_t height;
+    unsigned char txid[32]; // display order, like OutPoint::hash
+    uint32_t index;         // output index, or input index for spends
+    bool bSpend;
+    uint64_t value;
+
+    AddressHistoryEntry() : height(0), index(0), bSpend(false), value(0) { memset(txid, 0, 32); }
+    AddressHistoryEntry(uint32_t _height, const unsigned char* _txid, uint32_t _index, bool _bSpend, uint64_t _value)
+        : height(_height), index(_index), bSpend(_bSpend), value(_value) { memcpy(txid, _txid, 32); }
+
+    uchar_vector getTxHash() const { return uchar_vector(txid, txid + 32); }
+};
+
+typedef std::vector<AddressHistoryEntry> AddressHistory;
+
+class AddressIndex
+{
+public:
+    // Opens or creates an index in dir, which must already exist.
+    AddressIndex(const std::string& dir, unsigned char pubKeyHashVersion = 0x00, unsigned char scriptHashVersion = 0x05);
+    ~AddressIndex();
+
+    // Gets the address a pay-to-pubkey-hash, pay-to-script-hash or pay-to-pubkey script pays to.
+    bool getAddressKey(const uchar_vector& scriptPubKey, AddressKey& key) const;
+
+    // Adds the block's outputs. With the undo data UtxoSet::applyBlock produced for the block, inputs are
+    // added as spends too. Blocks must be added in height order - use rewind() to go back after a reorg.
+    void addBlock(const CoinBlock& block, uint32_t height, const UtxoUndo* pSpent = NULL);
+
+    // Same as addBlock for consecutive blocks starting at firstHeight, extracting the entries on nThreads
+    // threads - 0 to use one per core. pSpent, if given, holds undo data for each block.
+    void addBlocks(const std::vector<CoinBlock>& blocks, uint32_t firstHeight, const std::vector<UtxoUndo>* pSpent = NULL, unsigned int nThreads = 0);
+
+    // Drops everything at height and above.
+    void rewind(uint32_t height);
+
+    // Entries for key between fromHeight and toHeight inclusive, in height and block order.
+    void getHistory(const AddressKey& key, AddressHistory& history, uint32_t fromHeight = 0, uint32_t toHeight = 0xffffffff) const;
+    AddressHistory getHistory(const std::string& address, uint32_t fromHeight = 0, uint32_t toHeight = 0xffffffff) const;
+
+    // Received minus spent - only meaningful if spends were indexed.
+    uint64_t getBalance(const AddressKey& key) const;
+
+    // Height the next block is expected at - blocks below it are indexed. After reopening, only flushed blocks count.
+    uint32_t getHeight() const;
+
+    // Writes buffered entries to a new run and commits it.
+    void flush();
+
+private:
+    AddressIndex(const AddressIndex&);
+    AddressIndex& operator=(const AddressIndex&);
+
+    typedef std::pair<AddressKey, AddressHistoryEntry> KeyedEntry;
+    typedef std::map<AddressKey, AddressHistory> Buffer;
+
+    struct Run
+    {
+        uint32_t seq;
+        uint32_t endHeight;  // entries at and above this were rewound
+        MappedFile file;
+        MappedRegionPtr view;
+        uint64_t keyCount;
+    };
+    typedef boost::shared_ptr<Run> RunPtr;
+
+    void extractEntries(const CoinBlock& block, uint32_t height, const UtxoUndo* pSpent, std::vector<KeyedEntry>& entries) const;
+    void extractBlocks(const std::vector<CoinBlock>& blocks, uint32_t firstHeight, const std::vector<UtxoUndo>* pSpent,
+                       std::vector<std::vector<KeyedEntry> >* pEntries, std::size_t chunk, std::size_t begin, std::size_t end) const;
+    void addEntries(const std::vector<KeyedEntry>& entries);
+
+    std::string getRunPath(uint32_t seq) const;
+    RunPtr openRun(uint32_t seq, uint32_t endHeight);
+    void readRun(const Run& run, uint32_t endHeight, const AddressKey& key, uint32_t fromHeight, uint32_t toHeight, AddressHistory& history) const;
+    void writeRun(uint32_t seq, const Buffer& buffer);
+
+    // Picks runs [begin, end) to merge, if any are due. Called with m_mutex held.
+    bool selectMerge(std::size_t& begin, std::size_t& end) const;
+    void writeMergedRun(uint32_t seq, const std::vector<RunPtr>& runs, const std::vector<uint32_t>& endHeights) const;
+
+    // Merges runs until none are due. Called without m_mutex held.
+    void mergeRuns();
+    void readManifest();
+    void writeManifest();
+    void flushBuffer();
+
+    std::string m_dir;
+    unsigned char m_pubKeyHashVersion;
+    unsigned char m_scriptHashVersion;
+
+    mutable boost::mutex m_mutex;
+    boost::mutex m_mergeMutex;  // one merge at a time
+    std::vector<RunPtr> m_runs; // oldest first
+    uint32_t m_nextSeq;
+    uint32_t m_height;          // next height expected
+    uint32_t m_flushedHeight;
+    Buffer m_buffer;
+    std::size_t m_bufferEntries;
+};
+
+}; // namespace Coin
+
+#endif // _ADDRESS_INDEX_H__
@@ -26,11 +26,14 @@
 #define BASE58CHECK_H_INCLUDED
 
 #include "uchar_vector.h"
-#include "BigInt.h"
 #include "hash.h"
 
 #include "encodings.h"
 
+// Buffer sizes for the allocation-free versions below, for payloads of n bytes plus a one byte version.
+#define BASE58CHECK_MAX_ENCODED_SIZE(n) (BASE58_MAX_ENCODED_SIZE((n) + 5) + 1)    // including the terminating NUL
+#define BASE58CHECK_ADDRESS_SIZE        BASE58CHECK_MAX_ENCODED_SIZE(20)          // room for any 20-byte hash address
+
 // unsecure versions, suitable for public keys
 inline unsigned int countLeading0s(const std::vector<unsigned char>& data)
 {
@@ -46,32 +49,108 @@ inline unsigned int countLeading0s(const std::string& numeral, char zeroSymbol)
     return i;
 }
 
+// Encodes version + data + checksum into out, which needs room for BASE58_MAX_ENCODED_SIZE(versionLen + len + 4) + 1
+// characters, and NUL-terminates it. Returns the length of the string.
+inline size_t toBase58Check(const unsigned char* version, size_t versionLen, const unsigned char* payload, size_t len, char* out, const char* _base58chars = DEFAULT_BASE58_CHARS)
+{
+    unsigned char stackData[BASE58_MAX_STACK_SIZE];
+    std::vector<unsigned char> heapData;
+    unsigned char* data = stackData;
+    size_t dataLen = versionLen + len + 4;
+    if (dataLen > sizeof(stackData)) {
+        heapData.resize(dataLen);
+        data = &heapData[0];
+    }
+    if (versionLen) memcpy(data, version, versionLen);                 // prepend version byte
+    if (len) memcpy(data + versionLen, payload, len);
+    unsigned char checksum[32];
+    sha256_2(data, versionLen + len, checksum);
+    memcpy(data + versionLen + len, checksum, 4);                      // append checksum
+    size_t outLen = encodeBase58(data, dataLen, out, _base58chars);    // convert to base58
+    out[outLen] = 0;
+    return outLen;
+}
+
+// Allocation-free version for addresses and keys: out needs BASE58CHECK_MAX_ENCODED_SIZE(len) characters.
+inline size_t toBase58Check(const unsigned char* payload, size_t len, unsigned char version, char* out, const char* _base58chars = DEFAULT_BASE58_CHARS)
+{
+    return toBase58Check(&version, 1, payload, len, out, _base58chars);
+}
+
+// Encodes count 20-byte hashes stored back to back, all with the same version. Address i is written
+// NUL-terminated at out + i * stride, so stride must be at least BASE58CHECK_ADDRESS_SIZE.
+inline void toBase58CheckBatch(const unsigned char* hashes, size_t count, unsigned char version, char* out, size_t stride = BASE58CHECK_ADDRESS_SIZE, const char* _base58chars = DEFAULT_BASE58_CHARS)
+{
+    for (size_t i = 0; i < count; i++) {
+        toBase58Check(&version, 1, hashes + 20 * i, 20, out + i * stride, _base58chars);
+    }
+}
+
+inline std::vector<std::string> toBase58CheckBatch(const std::vector<uchar_vector>& hashes, unsigned char version, const char* _base58chars = DEFAULT_BASE58_CHARS)
+{
+    std::vector<std::string> addresses;
+    addresses.reserve(hashes.size());
+    char buffer[BASE58CHECK_ADDRESS_SIZE];
+    for (size_t i = 0; i < hashes.size(); i++) {
+        if (hashes[i].size() == 20) {
+            toBase58Check(&version, 1, &hashes[i][0], 20, buffer, _base58chars);
+            addresses.push_back(buffer);
+        }
+        else {
+            std::string address(BASE58CHECK_MAX_ENCODED_SIZE(hashes[i].size()), '\0');
+            address.resize(toBase58Check(&version, 1, hashes[i].empty() ? NULL : &hashes[i][0], hashes[i].size(), &address[0], _base58chars));
+            addresses.push_back(address);
+        }
+    }
+    return addresses;
+}
+
 inline std::string toBase58Check(const std::vector<unsigned char>& payload, unsigned char version, const char* _base58chars = DEFAULT_BASE58_CHARS)
 {
-    uchar_vector data;
-    data.push_back(version);                                        // prepend version byte
-    data += payload;
-    uchar_vector checksum = sha256_2(data);
-    checksum.assign(checksum.begin(), checksum.begin() + 4);        // compute checksum
-    data += checksum;                                               // append checksum
-    BigInt bn(data);
-    std::string base58check = bn.getInBase(58, _base58chars);             // convert to base58
-    std::string leading0s(countLeading0s(data), _base58chars[0]);         // prepend leading 0's (1 in base58)
-    return leading0s + base58check;
+    std::string base58check(BASE58CHECK_MAX_ENCODED_SIZE(payload.size()), '\0');
+    base58check.resize(toBase58Check(&version, 1, payload.empty() ? NULL : &payload[0], payload.size(), &base58check[0], _base58chars));
+    return base58check;
 }
 
 inline std::string toBase58Check(const std::vector<unsigned char>& payload, const std::vector<unsigned char>& version = std::vector<unsigned char>(), const char* _base58chars = DEFAULT_BASE58_CHARS)
 {
-    uchar_vector data;
-    data += version;                                            // prepend version byte
-    data += payload;
-    uchar_vector checksum = sha256_2(data);
-    checksum.assign(checksum.begin(), checksum.begin() + 4);        // compute checksum
-    data += checksum;                                               // append checksum
-    BigInt bn(data);
-    std::string base58check = bn.getInBase(58, _base58chars);             // convert to base58
-    std::string leading0s(countLeading0s(data), _base58chars[0]);         // prepend leading 0's (1 in base58)
-    return leading0s + base58check;
+    std::string base58check(BASE58_MAX_ENCODED_SIZE(version.size() + payload.size() + 4) + 1, '\0');
+    base58check.resize(toBase58Check(version.empty() ? NULL : &version[0], version.size(),
+                                     payload.empty() ? NULL : &payload[0], payload.size(), &base58check[0], _base58chars));
+    return base58check;
+}
+
+// Decodes and checks the checksum. bytes needs room for BASE58_MAX_DECODED_SIZE(len) bytes; on success
+// bytesLen is the length without the checksum.
+inline bool decodeBase58Check(const char* base58check, size_t len, unsigned char* bytes, size_t& bytesLen, const char* _base58chars = DEFAULT_BASE58_CHARS)
+{
+    size_t decodedLen;
+    if (!decodeBase58(base58check, len, bytes, decodedLen, _base58chars)) return false;   // convert from base58
+    if (decodedLen < 4) return false;                                                       // not enough bytes
+    unsigned char hash[32];
+    sha256_2(bytes, decodedLen - 4, hash);
+    if (memcmp(hash, bytes + decodedLen - 4, 4) != 0) return false;                         // verify checksum
+    bytesLen = decodedLen - 4;
+    return true;
+}
+
+// Allocation-free fromBase58Check(): the payload is written to payload, which has room for maxLen bytes.
+// Returns false, without modifying the parameters, if the string is invalid or the payload doesn't fit.
+inline bool fromBase58Check(const char* base58check, size_t len, unsigned char* payload, size_t maxLen, size_t& payloadLen, unsigned char& version, const char* _base58chars = DEFAULT_BASE58_CHARS)
+{
+    unsigned char stackBytes[BASE58_MAX_STACK_SIZE];
+    std::vector<unsigned char> heapBytes;
+    unsigned char* bytes = stackBytes;
+    if (BASE58_MAX_DECODED_SIZE(len) > sizeof(stackBytes)) {
+        heapBytes.resize(BASE58_MAX_DECODED_SIZE(len));
+        bytes = &heapBytes[0];
+    }
+    size_t bytesLen;
+    if (!decodeBase58Check(base58check, len, bytes, bytesLen, _base58chars) || bytesLen < 1 || bytesLen - 1 > maxLen) return false;
+    version = bytes[0];
+    payloadLen = bytesLen - 1;
+    if (payloadLen) memcpy(payload, bytes + 1, payloadLen);
+    return true;
 }
 
 // fromBase58Check() - gets payload and version from a base58check string.
@@ -79,32 +158,26 @@ inline std::string toBase58Check(const std::vector<unsigned char>& payload, cons
 //    returns false and does not modify parameters if invalid.
 inline bool fromBase58Check(const std::string& base58check, std::vector<unsigned char>& payload, unsigned int& version, const char* _base58chars = DEFAULT_BASE58_CHARS)
 {
-    BigInt bn(base58check, 58, _base58chars);                                // convert from base58
-    uchar_vector bytes = bn.getBytes();
-    if (bytes.size() < 4) return false;                                     // not enough bytes
-    uchar_vector checksum = uchar_vector(bytes.end() - 4, bytes.end());
-    bytes.assign(bytes.begin(), bytes.end() - 4);                           // split string into payload part and checksum part
-    uchar_vector leading0s(countLeading0s(base58check, _base58chars[0]), 0); // prepend leading 0's
-    bytes = leading0s + bytes;
-    uchar_vector hashBytes = sha256_2(bytes);
-    hashBytes.assign(hashBytes.begin(), hashBytes.begin() + 4);
-    if (hashBytes != checksum) return false;                                // verify checksum
+    if (base58check.empty()) return false;
+    std::vector<unsigned char> bytes(BASE58_MAX_DECODED_SIZE(base58check.size()));
+    size_t bytesLen;
+    if (!decodeBase58Check(base58check.data(), base58check.size(), &bytes[0], bytesLen, _base58chars) || bytesLen < 1) return false;
     version = bytes[0];
-    payload.assign(bytes.begin() + 1, bytes.end());
+    payload.assign(bytes.begin() + 1, bytes.begin() + bytesLen);
     return true;
 }
 
 inline bool isBase58CheckValid(const std::string& base58check, const char* _base58chars = DEFAULT_BASE58_CHARS)
 {
-    BigInt bn(base58check, 58, _base58chars);                                // convert from base58
-    uchar_vector bytes = bn.getBytes();
-    uchar_vector checksum = uchar_vector(bytes.end() - 4, bytes.end());
-    bytes.assign(bytes.begin(), bytes.end() - 4);                           // split string into payload part and checksum part
-    uchar_vector leading0s(countLeading0s(base58check, _base58chars[0]), 0); // prepend leading 0's
-    bytes = leading0s + bytes;
-    uchar_vector hashBytes = sha256_2(bytes);
-    hashBytes.assign(hashBytes.begin(), hashBytes.begin() + 4);
-    return (hashBytes == checksum);                                         // verify checksum
+    unsigned char stackBytes[BASE58_MAX_STACK_SIZE];
+    std::vector<unsigned char> heapBytes;
+    unsigned char* bytes = stackBytes;
+    if (BASE58_MAX_DECODED_SIZE(base58check.size()) > sizeof(stackBytes)) {
+        heapBytes.resize(BASE58_MAX_DECODED_SIZE(base58check.size()));
+        bytes = &heapBytes[0];
+    }
+    size_t bytesLen;
+    return decodeBase58Check(base58check.data(), base58check.size(), bytes, bytesLen, _base58chars);
 }
 // and secure versions, suitable for private keys - Not done yet
 // Should use templates.
@@ -0,0 +1,473 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// BlockStore.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "BlockStore.h"
+#include "hash.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#include <unistd.h>
+
+using namespace Coin;
+
+const uint32_t BlockStore::NO_RECORD = 0xffffffff;
+
+namespace
+{
+    const uint64_t HASH_TABLE_MAGIC = 0x0000000248534b42ULL; // "BKSH", version 2
+    const std::size_t HASH_TABLE_HEADER_SIZE = 32; // magic, capacity, used slots, records indexed when last synced
+    const uint32_t EMPTY_SLOT = 0;
+
+    inline uint32_t fingerprint(const unsigned char* hash)
+    {
+        uint32_t fp;
+        memcpy(&fp, hash, 4);
+        return fp;
+    }
+
+    // First slot to probe. Raw hashes are uniformly distributed, so the bytes after the fingerprint serve as is.
+    inline uint64_t firstSlot(const unsigned char* hash, uint64_t mask)
+    {
+        uint64_t h;
+        memcpy(&h, hash + 4, 8);
+        return h & mask & ~(uint64_t)1;
+    }
+
+    // Reads a varint, throwing if it runs past end.
+    uint64_t readVarInt(const unsigned char*& p, const unsigned char* end)
+    {
+        if (p >= end) throw std::runtime_error("BlockStore - block is truncated.");
+        unsigned char prefix = *p++;
+        int n = (prefix < 0xfd) ? 0 : (prefix == 0xfd) ? 2 : (prefix == 0xfe) ? 4 : 8;
+        if (n == 0) return prefix;
+        if (end - p < n) throw std::runtime_error("BlockStore - block is truncated.");
+        uint64_t value = 0;
+        for (int i = n - 1; i >= 0; i--) value = (value << 8) | p[i];
+        p += n;
+        return value;
+    }
+
+    void skip(const unsigned char*& p, const unsigned char* end, uint64_t n)
+    {
+        if ((uint64_t)(end - p) < n) throw std::runtime_error("BlockStore - block is truncated.");
+        p += n;
+    }
+
+    // Length of the serialized transaction at p, without parsing it into a Transaction.
+    uint32_t getTxLength(const unsigned char* begin, const unsigned char* end)
+    {
+        const unsigned char* p = begin;
+        skip(p, end, 4); // version
+        uint64_t nInputs = readVarInt(p, end);
+        for (uint64_t i = 0; i < nInputs; i++) {
+            skip(p, end, 36); // outpoint
+            skip(p, end, readVarInt(p, end));
+            skip(p, end, 4); // sequence
+        }
+        uint64_t nOutputs = readVarInt(p, end);
+        for (uint64_t i = 0; i < nOutputs; i++) {
+            skip(p, end, 8); // value
+            skip(p, end, readVarInt(p, end));
+        }
+        skip(p, end, 4); // lock time
+        return p - begin;
+    }
+
+    inline const unsigned char* recordHash(const MappedRegionPtr& records, std::size_t recordSize, uint64_t record)
+    {
+        return records->data() + record * recordSize;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class BlockStore::HashTable implementation
+//
+void BlockStore::HashTable::open(const std::string& path, const MappedRegionPtr& records, std::size_t recordSize, uint64_t recordCount)
+{
+    m_file.open(path, true);
+
+    bool bValid = false;
+    if (m_file.size() >= HASH_TABLE_HEADER_SIZE) {
+        m_view = m_file.getView();
+        uint64_t capacity = header()[1];
+        bValid = header()[0] == HASH_TABLE_MAGIC && capacity >= MIN_BLOCK_STORE_SLOTS && capacity <= MAX_BLOCK_STORE_SLOTS &&
+                 (capacity & (capacity - 1)) == 0 && m_file.size() == HASH_TABLE_HEADER_SIZE + 4 * capacity && header()[3] <= recordCount;
+    }
+    if (!bValid) {
+        rebuild(records, recordSize, recordCount);
+        return;
+    }
+
+    // Anything added since the table was last synced may or may not have made it to disk - insert again.
+    m_mask = header()[1] - 1;
+    for (uint64_t i = header()[3]; i < recordCount; i++) {
+        insert(i, records, recordSize, i + 1);
+    }
+}
+
+uint64_t BlockStore::HashTable::find(const unsigned char* hash, const MappedRegionPtr& records, std::size_t recordSize, uint64_t recordCount) const
+{
+    uint32_t fp = fingerprint(hash);
+    const uint32_t* pSlots = slots();
+    // Slots are {fingerprint, record + 1} pairs.
+    for (uint64_t i = firstSlot(hash, m_mask);; i = (i + 2) & m_mask) {
+        uint32_t record = pSlots[i + 1];
+        if (record == EMPTY_SLOT) return NO_RECORD;
+        record--;
+        // Slots left behind by a discarded tail can point past the end or at a different record now.
+        if (pSlots[i] == fp && record < recordCount && memcmp(recordHash(records, recordSize, record), hash, 32) == 0) return record;
+    }
+}
+
+void BlockStore::HashTable::insert(uint64_t record, const MappedRegionPtr& records, std::size_t recordSize, uint64_t recordCount)
+{
+    if (record >= MAX_BLOCK_STORE_RECORDS) throw std::runtime_error("BlockStore - too many records for hash table.");
+
+    // Keep at least half of the slot pairs free.
+    if (2 * (header()[2] + 1) > (m_mask + 1) / 2) {
+        rebuild(records, recordSize, recordCount);
+        return;
+    }
+    if (place(record, recordHash(records, recordSize, record), records, recordSize)) header()[2]++;
+}
+
+bool BlockStore::HashTable::place(uint64_t record, const unsigned char* hash, const MappedRegionPtr& records, std::size_t recordSize)
+{
+    uint32_t fp = fingerprint(hash);
+    uint32_t* pSlots = slots();
+    for (uint64_t i = firstSlot(hash, m_mask);; i = (i + 2) & m_mask) {
+        uint32_t existing = pSlots[i + 1];
+        if (existing == EMPTY_SLOT) {
+            pSlots[i] = fp;
+            pSlots[i + 1] = record + 1;
+            return true;
+        }
+        // Same hash again (reinserted after a crash, or a duplicate txid) - point at the latest record.
+        if (pSlots[i] == fp && existing - 1 <= record && memcmp(recordHash(records, recordSize, existing - 1), hash, 32) == 0) {
+            pSlots[i + 1] = record + 1;
+            return false;
+        }
+    }
+}
+
+void BlockStore::HashTable::rebuild(const MappedRegionPtr& records, std::size_t recordSize, uint64_t recordCount)
+{
+    uint64_t capacity = MIN_BLOCK_STORE_SLOTS;
+    while (capacity < 8 * (recordCount + 1)) capacity <<= 1; // a quarter full
+    if (capacity > MAX_BLOCK_STORE_SLOTS) throw std::runtime_error("BlockStore - too many records for hash table.");
+
+    // Fill a fresh file. Nothing else maps it, so it can be sized freely.
+    std::string path = m_file.getPath();
+    std::string tmpPath = path + ".tmp";
+    MappedFile tmp;
+    tmp.open(tmpPath, true);
+    tmp.resize(0);
+    tmp.resize(HASH_TABLE_HEADER_SIZE + 4 * capacity);
+    m_view = tmp.getView();
+    m_mask = capacity - 1;
+
+    header()[0] = HASH_TABLE_MAGIC;
+    header()[1] = capacity;
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < recordCount; i++) {
+        if (place(i, recordHash(records, recordSize, i), records, recordSize)) used++;
+    }
+    header()[2] = used;
+    header()[3] = 0; // nothing synced yet
+    tmp.close();
+
+    // The old file stays intact for as long as anything still maps it.
+    if (::rename(tmpPath.c_str(), path.c_str()) != 0) throw std::runtime_error("BlockStore - cannot replace " + path);
+    m_file.open(path, true);
+    m_view = m_file.getView();
+}
+
+void BlockStore::HashTable::sync(uint64_t recordCount)
+{
+    m_file.sync();
+    header()[3] = recordCount;
+    m_file.sync();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class BlockStore implementation
+//
+BlockStore::BlockStore(const std::string& dir, uint32_t magic, bool bSync)
+    : m_dir(dir), m_magic(magic), m_bSync(bSync), m_blockCount(0), m_txCount(0)
+{
+    if (!m_dir.empty() && m_dir[m_dir.size() - 1] != '/') m_dir += "/";
+
+    m_blockIndex.open(m_dir + "blocks.idx");
+    m_txIndex.open(m_dir + "txs.idx");
+    recover();
+
+    m_blockTable.open(m_dir + "blocks.hash", getBlockRecords(), sizeof(BlockRecord), m_blockCount);
+    m_txTable.open(m_dir + "txs.hash", getTxRecords(), sizeof(TxRecord), m_txCount);
+}
+
+BlockStore::~BlockStore()
+{
+    try {
+        flush();
+    }
+    catch (...) { }
+}
+
+void BlockStore::recover()
+{
+    m_blockCount = m_blockIndex.size() / sizeof(BlockRecord);
+    uint64_t txCount = m_txIndex.size() / sizeof(TxRecord);
+
+    // Drop blocks from the end until the last one has all of its data and tx records.
+    MappedRegionPtr blockRecords = getBlockRecords();
+    while (m_blockCount > 0) {
+        const BlockRecord& last = reinterpret_cast<const BlockRecord*>(blockRecords->data())[m_blockCount - 1];
+        if (access(getDataFilePath(last.file).c_str(), F_OK) == 0 &&
+            last.offset + last.length <= getDataFile(last.file).size() &&
+            last.firstTx + last.txCount <= txCount) break;
+        m_blockCount--;
+    }
+
+    uint32_t file = 0;
+    uint64_t dataEnd = 0;
+    m_txCount = 0;
+    if (m_blockCount > 0) {
+        const BlockRecord& last = reinterpret_cast<const BlockRecord*>(blockRecords->data())[m_blockCount - 1];
+        file = last.file;
+        dataEnd = last.offset + last.length;
+        m_txCount = last.firstTx + last.txCount;
+    }
+    blockRecords.reset();
+
+    if (m_blockIndex.size() != m_blockCount * sizeof(BlockRecord)) m_blockIndex.resize(m_blockCount * sizeof(BlockRecord));
+    if (m_txIndex.size() != m_txCount * sizeof(TxRecord)) m_txIndex.resize(m_txCount * sizeof(TxRecord));
+
+    // Everything past the last committed block is garbage, including any later data files.
+    if (getDataFile(file).size() != dataEnd) getDataFile(file).resize(dataEnd);
+    for (uint32_t i = file + 1; access(getDataFilePath(i).c_str(), F_OK) == 0; i++) {
+        getDataFile(i).resize(0);
+    }
+
+    m_heights.clear();
+    const BlockRecord* pRecords = reinterpret_cast<const BlockRecord*>(getBlockRecords()->data());
+    for (uint32_t i = 0; i < m_blockCount; i++) {
+        uint32_t height = pRecords[i].height;
+        if (height >= m_heights.size()) m_heights.resize(height + 1, NO_RECORD);
+        m_heights[height] = i;
+    }
+}
+
+std::string BlockStore::getDataFilePath(uint32_t file) const
+{
+    char name[32];
+    sprintf(name, "blk%05u.dat", file);
+    return m_dir + name;
+}
+
+MappedFile& BlockStore::getDataFile(uint32_t file) const
+{
+    if (file >= m_dataFiles.size()) m_dataFiles.resize(file + 1);
+    if (!m_dataFiles[file]) {
+        m_dataFiles[file] = boost::shared_ptr<MappedFile>(new MappedFile());
+        m_dataFiles[file]->open(getDataFilePath(file));
+    }
+    return *m_dataFiles[file];
+}
+
+bool BlockStore::addBlock(const uchar_vector& serializedBlock, uint32_t height)
+{
+    if (serializedBlock.size() < MIN_COIN_BLOCK_HEADER_SIZE) throw std::runtime_error("BlockStore::addBlock() - block is too short.");
+    if (height == NO_RECORD) throw std::runtime_error("BlockStore::addBlock() - invalid height.");
+
+    BlockRecord record;
+    sha256_2(&serializedBlock[0], MIN_COIN_BLOCK_HEADER_SIZE, record.hash);
+
+    // Locate the transactions before touching any files.
+    const unsigned char* begin = &serializedBlock[0];
+    const unsigned char* end = begin + serializedBlock.size();
+    const unsigned char* p = begin + MIN_COIN_BLOCK_HEADER_SIZE;
+    uint64_t txCount = readVarInt(p, end);
+    if (txCount > (uint64_t)(end - p)) throw std::runtime_error("BlockStore::addBlock() - block is truncated.");
+
+    std::vector<TxRecord> txRecords(txCount);
+    for (uint64_t i = 0; i < txCount; i++) {
+        TxRecord& tx = txRecords[i];
+        tx.offset = p - begin;
+        tx.length = getTxLength(p, end);
+        sha256_2(p, tx.length, tx.hash);
+        p += tx.length;
+    }
+    if (p != end) throw std::runtime_error("BlockStore::addBlock() - extra bytes at end of block.");
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    if (m_blockTable.find(record.hash, getBlockRecords(), sizeof(BlockRecord), m_blockCount) != NO_RECORD) return false;
+
+    // The hash tables can't index more than this - refuse the block before anything is written.
+    if (m_blockCount >= MAX_BLOCK_STORE_RECORDS || m_txCount + txCount > MAX_BLOCK_STORE_RECORDS)
+        throw std::runtime_error("BlockStore::addBlock() - store is full.");
+
+    // Data first...
+    record.file = 0;
+    if (m_blockCount > 0) {
+        const BlockRecord& last = reinterpret_cast<const BlockRecord*>(getBlockRecords()->data())[m_blockCount - 1];
+        record.file = last.file;
+        if (getDataFile(record.file).size() + 8 + serializedBlock.size() > MAX_BLOCK_FILE_SIZE) record.file++;
+    }
+    MappedFile& dataFile = getDataFile(record.file);
+    uint32_t prefix[2] = { m_magic, (uint32_t)serializedBlock.size() };
+    dataFile.append(prefix, sizeof(prefix));
+    record.offset = dataFile.append(&serializedBlock[0], serializedBlock.size());
+    record.length = serializedBlock.size();
+    record.height = height;
+    record.txCount = txCount;
+    record.firstTx = m_txCount;
+
+    // ...then the tx records...
+    for (uint64_t i = 0; i < txCount; i++) {
+        txRecords[i].block = m_blockCount;
+    }
+    if (txCount > 0) m_txIndex.append(&txRecords[0], txCount * sizeof(TxRecord));
+    if (m_bSync) {
+        dataFile.sync();
+        m_txIndex.sync();
+    }
+
+    // ...and finally the block record, which commits the block.
+    m_blockIndex.append(&record, sizeof(record));
+    if (m_bSync) m_blockIndex.sync();
+
+    // The block is committed, so bring the counts up to date before anything else can throw.
+    uint64_t firstTx = m_txCount;
+    m_blockCount++;
+    m_txCount += txCount;
+    if (height >= m_heights.size()) m_heights.resize(height + 1, NO_RECORD);
+    m_heights[height] = m_blockCount - 1;
+
+    m_blockTable.insert(m_blockCount - 1, getBlockRecords(), sizeof(BlockRecord), m_blockCount);
+    MappedRegionPtr txRecordsView = getTxRecords();
+    for (uint64_t i = 0; i < txCount; i++) {
+        m_txTable.insert(firstTx + i, txRecordsView, sizeof(TxRecord), firstTx + i + 1);
+    }
+    return true;
+}
+
+uint32_t BlockStore::findBlock(const uchar_vector& hash) const
+{
+    if (hash.size() != 32) throw std::runtime_error("BlockStore - hash must be 32 bytes.");
+    unsigned char rawHash[32];
+    std::reverse_copy(hash.begin(), hash.end(), rawHash);
+    return m_blockTable.find(rawHash, getBlockRecords(), sizeof(BlockRecord), m_blockCount);
+}
+
+StoredData BlockStore::getBlockData(uint32_t record) const
+{
+    const BlockRecord& block = reinterpret_cast<const BlockRecord*>(getBlockRecords()->data())[record];
+    MappedFile& dataFile = getDataFile(block.file);
+    MappedRegionPtr view = dataFile.getView(block.offset + block.length);
+    return StoredData(view, view->data() + block.offset, block.length);
+}
+
+bool BlockStore::hasBlock(const uchar_vector& hash) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return findBlock(hash) != NO_RECORD;
+}
+
+StoredData BlockStore::getBlock(const uchar_vector& hash) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    uint32_t record = findBlock(hash);
+    if (record == NO_RECORD) return StoredData();
+    return getBlockData(record);
+}
+
+StoredData BlockStore::getBlockAtHeight(uint32_t height) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (height >= m_heights.size() || m_heights[height] == NO_RECORD) return StoredData();
+    return getBlockData(m_heights[height]);
+}
+
+StoredData BlockStore::getTx(const uchar_vector& txid) const
+{
+    if (txid.size() != 32) throw std::runtime_error("BlockStore::getTx() - txid must be 32 bytes.");
+    unsigned char rawHash[32];
+    std::reverse_copy(txid.begin(), txid.end(), rawHash);
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    uint64_t record = m_txTable.find(rawHash, getTxRecords(), sizeof(TxRecord), m_txCount);
+    if (record == NO_RECORD) return StoredData();
+
+    const TxRecord& tx = reinterpret_cast<const TxRecord*>(getTxRecords()->data())[record];
+    const BlockRecord& block = reinterpret_cast<const BlockRecord*>(getBlockRecords()->data())[tx.block];
+    MappedRegionPtr view = getDataFile(block.file).getView(block.offset + block.length);
+    return StoredData(view, view->data() + block.offset + tx.offset, tx.length);
+}
+
+uint32_t BlockStore::getHeight(const uchar_vector& hash) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    uint32_t record = findBlock(hash);
+    if (record == NO_RECORD) return NO_RECORD;
+    return reinterpret_cast<const BlockRecord*>(getBlockRecords()->data())[record].height;
+}
+
+uint32_t BlockStore::getBlockCount() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_blockCount;
+}
+
+uint64_t BlockStore::getTxCount() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_txCount;
+}
+
+uint32_t BlockStore::getBestHeight() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (std::size_t i = m_heights.size(); i > 0; i--) {
+        if (m_heights[i - 1] != NO_RECORD) return i - 1;
+    }
+    return NO_RECORD;
+}
+
+void BlockStore::flush()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (std::size_t i = 0; i < m_dataFiles.size(); i++) {
+        if (m_dataFiles[i]) m_dataFiles[i]->sync();
+    }
+    m_txIndex.sync();
+    m_blockIndex.sync();
+    m_blockTable.sync(m_blockCount);
+    m_txTable.sync(m_txCount);
+}
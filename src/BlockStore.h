@@ -0,0 +1,181 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// BlockStore.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Append-only block store. Serialized blocks go into flat files (blk00000.dat, ...)
+// and are indexed by hash, height and txid. Lookups return pointers into mmapped
+// files, so nothing is copied or parsed until the caller asks for it.
+//
+// Blocks are committed by appending their record to blocks.idx - the block data
+// and tx records are written first, so a crash at any point leaves at most a
+// partial tail that is discarded the next time the store is opened. The hash
+// tables (blocks.hash, txs.hash) are only caches of the record files and are
+// caught up or rebuilt on open.
+//
+// Records are stored in host byte order. Not meant to be shared between hosts.
+
+#ifndef _BLOCK_STORE_H__
+#define _BLOCK_STORE_H__
+
+#include "CoinNodeData.h"
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#define MAX_BLOCK_FILE_SIZE     0x08000000 // 128 MB - start a new data file once a block would push past this
+#define MIN_BLOCK_STORE_SLOTS   0x00010000 // initial hash table size
+#define MAX_BLOCK_STORE_RECORDS 0xfffffffeull        // blocks or txs - slots hold record + 1 in 32 bits, and NO_RECORD is reserved
+#define MAX_BLOCK_STORE_SLOTS   ((uint64_t)1 << 35) // keeps MAX_BLOCK_STORE_RECORDS records a quarter full
+
+namespace Coin
+{
+
+// Bytes inside a mapped file. Holds on to the mapping, so it stays valid after the store grows or is closed.
+class StoredData
+{
+public:
+    StoredData() : m_data(NULL), m_size(0) { }
+    StoredData(const MappedRegionPtr& region, const unsigned char* data, uint32_t size)
+        : m_region(region), m_data(data), m_size(size) { }
+
+    bool isNull() const { return m_data == NULL; }
+    const unsigned char* data() const { return m_data; }
+    uint32_t size() const { return m_size; }
+    uchar_vector getBytes() const { return uchar_vector(m_data, m_data + m_size); }
+
+private:
+    MappedRegionPtr m_region;
+    const unsigned char* m_data;
+    uint32_t m_size;
+};
+
+class BlockStore
+{
+public:
+    static const uint32_t NO_RECORD;
+
+    // Opens or creates a store in dir, which must already exist. magic is written in front of each block
+    // in the data files, like bitcoind's blk files. With bSync, each block is on disk when addBlock returns.
+    BlockStore(const std::string& dir, uint32_t magic, bool bSync = true);
+    ~BlockStore();
+
+    // Returns false if the block is already stored. Blocks can be added in any order - getBlockAtHeight
+    // returns the block stored last at a height, so after a reorg just add the new branch.
+    bool addBlock(const CoinBlock& block, uint32_t height) { return addBlock(block.getSerialized(), height); }
+    bool addBlock(const uchar_vector& serializedBlock, uint32_t height);
+
+    // Hashes are in display order (as returned by getHashLittleEndian). Lookups return null data if not found.
+    bool hasBlock(const uchar_vector& hash) const;
+    StoredData getBlock(const uchar_vector& hash) const;
+    StoredData getBlockAtHeight(uint32_t height) const;
+    StoredData getTx(const uchar_vector& txid) const;
+
+    // Height of a stored block, or NO_RECORD.
+    uint32_t getHeight(const uchar_vector& hash) const;
+
+    uint32_t getBlockCount() const;
+    uint64_t getTxCount() const;
+
+    // Highest height with a block stored, or NO_RECORD if the store is empty.
+    uint32_t getBestHeight() const;
+
+    // Writes everything to disk, including the hash tables.
+    void flush();
+
+private:
+    BlockStore(const BlockStore&);
+    BlockStore& operator=(const BlockStore&);
+
+    struct BlockRecord
+    {
+        unsigned char hash[32]; // raw, as hashed
+        uint32_t height;
+        uint32_t file;
+        uint64_t offset;        // of the block itself, past the magic and length
+        uint32_t length;
+        uint32_t txCount;
+        uint64_t firstTx;       // index of the block's first record in txs.idx
+    };
+
+    struct TxRecord
+    {
+        unsigned char hash[32]; // raw
+        uint32_t block;         // index in blocks.idx
+        uint32_t offset;        // within the block
+        uint32_t length;
+    };
+
+    // Open addressing table of {fingerprint, record + 1} slots kept in a mapped file. Records of both
+    // kinds start with their hash, which is what matches are verified against.
+    class HashTable
+    {
+    public:
+        void open(const std::string& path, const MappedRegionPtr& records, std::size_t recordSize, uint64_t recordCount);
+        uint64_t find(const unsigned char* hash, const MappedRegionPtr& records, std::size_t recordSize, uint64_t recordCount) const;
+        void insert(uint64_t record, const MappedRegionPtr& records, std::size_t recordSize, uint64_t recordCount);
+        void sync(uint64_t recordCount);
+
+    private:
+        // Builds a new table in a separate file and renames it into place, so the old file is never truncated under its mapping.
+        void rebuild(const MappedRegionPtr& records, std::size_t recordSize, uint64_t recordCount);
+        bool place(uint64_t record, const unsigned char* hash, const MappedRegionPtr& records, std::size_t recordSize);
+
+        uint64_t* header() const { return reinterpret_cast<uint64_t*>(m_view->data()); }
+        uint32_t* slots() const { return reinterpret_cast<uint32_t*>(header() + 4); }
+
+        MappedFile m_file;
+        MappedRegionPtr m_view;
+        uint64_t m_mask;
+    };
+
+    void recover();
+    MappedFile& getDataFile(uint32_t file) const;
+    std::string getDataFilePath(uint32_t file) const;
+
+    MappedRegionPtr getBlockRecords() const { return m_blockIndex.getView(); }
+    MappedRegionPtr getTxRecords() const { return m_txIndex.getView(); }
+    uint32_t findBlock(const uchar_vector& hash) const;
+    StoredData getBlockData(uint32_t record) const;
+
+    std::string m_dir;
+    uint32_t m_magic;
+    bool m_bSync;
+
+    mutable boost::mutex m_mutex;
+    mutable std::vector<boost::shared_ptr<MappedFile> > m_dataFiles;
+    mutable MappedFile m_blockIndex;
+    mutable MappedFile m_txIndex;
+    mutable HashTable m_blockTable;
+    mutable HashTable m_txTable;
+
+    std::vector<uint32_t> m_heights; // height -> record
+    uint32_t m_blockCount;
+    uint64_t m_txCount;
+};
+
+}; // namespace Coin
+
+#endif // _BLOCK_STORE_H__
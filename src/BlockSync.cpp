@@ -0,0 +1,401 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// BlockSync.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "BlockSync.h"
+#include "HeaderValidation.h"
+
+#include <algorithm>
+
+#include <boost/thread/locks.hpp>
+
+using namespace Coin;
+using namespace boost::posix_time;
+
+namespace
+{
+    typedef std::vector<std::pair<SyncPeer*, std::string> > Complaints;
+}
+
+BlockSync::BlockSync(BlockSyncListener* pListener, const CoinBlockHeader& genesis)
+    : m_pListener(pListener), m_peerWindow(DEFAULT_PEER_BLOCK_WINDOW), m_downloadWindow(DEFAULT_BLOCK_DOWNLOAD_WINDOW),
+      m_stallTimeout(milliseconds(DEFAULT_SYNC_STALL_TIMEOUT)), m_chain(genesis), m_bHeadersSynced(false),
+      m_pHeadersPeer(NULL), m_nextRequestHeight(1), m_nextDeliverHeight(1), m_bCompleteNotified(false),
+      m_bReorgPending(false), m_reorgHeight(0), m_deliveredHeight(0)
+{
+}
+
+void BlockSync::addPeer(SyncPeer* pPeer)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        PeerState& state = m_peers[pPeer];
+        state.window = m_peerWindow;
+        state.inFlight = 0;
+
+        if (!m_bHeadersSynced && !m_pHeadersPeer) requestHeaders(pPeer);
+        fillPeer(pPeer, state, microsec_clock::universal_time());
+    }
+    deliverBlocks();
+}
+
+void BlockSync::removePeer(SyncPeer* pPeer)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    if (!m_peers.erase(pPeer)) return;
+
+    std::vector<uint32_t> heights;
+    for (std::map<uint32_t, Request>::iterator it = m_requests.begin(); it != m_requests.end(); ++it) {
+        if (it->second.pPeer == pPeer) heights.push_back(it->first);
+    }
+    for (std::size_t i = 0; i < heights.size(); i++) {
+        m_requests.erase(heights[i]);
+        m_retries.insert(heights[i]);
+    }
+
+    if (m_pHeadersPeer == pPeer) {
+        m_pHeadersPeer = NULL;
+        if (!m_peers.empty()) requestHeaders(m_peers.begin()->first);
+    }
+
+    fillPeers();
+}
+
+void BlockSync::requestHeaders(SyncPeer* pPeer)
+{
+    m_pHeadersPeer = pPeer;
+    m_headersDeadline = microsec_clock::universal_time() + m_stallTimeout;
+    pPeer->getHeaders(m_chain.getLocator(), g_zero32bytes);
+}
+
+void BlockSync::onHeaders(SyncPeer* pPeer, const HeadersMessage& headers)
+{
+    Complaints complaints;
+    uint32_t bestHeight;
+    bool bAccepted = false;
+
+    // hash and check the whole batch before taking the lock
+    std::size_t count = headers.headers.size();
+    std::vector<unsigned char> data(80 * count);
+    std::vector<unsigned char> hashes(32 * count);
+    for (std::size_t i = 0; i < count; i++) serializeHeader(headers.headers[i], &data[80 * i]);
+    int firstInvalid = count ? validateHeaders(&data[0], 80, count, NULL, &hashes[0]) : -1;
+    if (firstInvalid >= 0) {
+        complaints.push_back(std::make_pair(pPeer, std::string("Header fails proof of work or doesn't link to the one before it.")));
+        count = firstInvalid;
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        uint32_t oldBest = m_chain.getBestIndex();
+        std::size_t oldSize = m_chain.size();
+        for (std::size_t i = 0; i < count; i++) {
+            try {
+                m_chain.add(&data[80 * i], &hashes[32 * i]);
+            }
+            catch (const std::exception& e) {
+                complaints.push_back(std::make_pair(pPeer, std::string(e.what())));
+                break;
+            }
+        }
+        bAccepted = (m_chain.size() > oldSize);
+        bestHeight = m_chain.getBestHeight();
+
+        uint32_t forkHeight = m_chain.getHeight(m_chain.getForkPoint(oldBest, m_chain.getBestIndex()));
+        if (forkHeight < m_chain.getHeight(oldBest)) {
+            if (forkHeight + 1 < m_nextDeliverHeight) {
+                // reported by whoever delivers next, so it can't overlap or be followed by blocks from the old branch
+                if (!m_bReorgPending || forkHeight < m_reorgHeight) m_reorgHeight = forkHeight;
+                m_bReorgPending = true;
+            }
+            rewind(forkHeight);
+        }
+
+        if (bAccepted) m_bCompleteNotified = false;
+
+        if (pPeer == m_pHeadersPeer) {
+            if (!complaints.empty()) {
+                // try someone else
+                m_pHeadersPeer = NULL;
+                for (PeerMap::iterator it = m_peers.begin(); it != m_peers.end(); ++it) {
+                    if (it->first != pPeer) { requestHeaders(it->first); break; }
+                }
+            }
+            else if (headers.headers.size() >= MAX_HEADERS_RESULTS) {
+                requestHeaders(pPeer);
+            }
+            else {
+                m_pHeadersPeer = NULL;
+                m_bHeadersSynced = true;
+            }
+        }
+
+        fillPeers();
+    }
+
+    if (m_pListener) {
+        for (std::size_t i = 0; i < complaints.size(); i++) m_pListener->onSyncPeerMisbehaving(complaints[i].first, complaints[i].second);
+        if (bAccepted) m_pListener->onSyncHeaders(bestHeight);
+    }
+    deliverBlocks();
+}
+
+void BlockSync::onBlock(SyncPeer* pPeer, const CoinBlock& block)
+{
+    Complaints complaints;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        uint32_t index = m_chain.find(block.blockHeader.getHashLittleEndian());
+        if (index == HeaderChain::NO_INDEX || !m_chain.isInBestChain(index)) return;
+        uint32_t height = m_chain.getHeight(index);
+        if (height < m_nextDeliverHeight || m_received.count(height)) return;
+
+        std::map<uint32_t, Request>::iterator request = m_requests.find(height);
+        SyncPeer* pRequestedFrom = (request != m_requests.end()) ? request->second.pPeer : NULL;
+
+        if (!block.isValidMerkleRoot()) {
+            complaints.push_back(std::make_pair(pPeer, std::string("Block merkle root does not match its transactions.")));
+            if (pRequestedFrom == pPeer) {
+                cancelRequest(height);
+                m_retries.insert(height);
+            }
+        }
+        else {
+            m_received[height] = CoinBlockPtr(new CoinBlock(block));
+            if (pRequestedFrom) {
+                PeerMap::iterator peer = m_peers.find(pRequestedFrom);
+                if (peer != m_peers.end() && pRequestedFrom == pPeer && peer->second.window < m_peerWindow)
+                    peer->second.window++;
+                cancelRequest(height);
+            }
+            m_retries.erase(height);
+        }
+
+        fillPeers();
+    }
+
+    if (m_pListener) {
+        for (std::size_t i = 0; i < complaints.size(); i++) m_pListener->onSyncPeerMisbehaving(complaints[i].first, complaints[i].second);
+    }
+    deliverBlocks();
+}
+
+void BlockSync::tick()
+{
+    std::set<SyncPeer*> stalled;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        ptime now = microsec_clock::universal_time();
+
+        std::vector<uint32_t> heights;
+        for (std::map<uint32_t, Request>::iterator it = m_requests.begin(); it != m_requests.end(); ++it) {
+            if (it->second.deadline < now) heights.push_back(it->first);
+        }
+        for (std::size_t i = 0; i < heights.size(); i++) {
+            SyncPeer* pPeer = m_requests[heights[i]].pPeer;
+            PeerMap::iterator peer = m_peers.find(pPeer);
+            if (peer != m_peers.end() && stalled.insert(pPeer).second)
+                peer->second.window = std::max(1u, peer->second.window / 2);
+            cancelRequest(heights[i]);
+            m_retries.insert(heights[i]);
+        }
+
+        if (m_pHeadersPeer && m_headersDeadline < now) {
+            stalled.insert(m_pHeadersPeer);
+            PeerMap::iterator next = m_peers.upper_bound(m_pHeadersPeer);
+            if (next == m_peers.end()) next = m_peers.begin();
+            requestHeaders(next->first);
+        }
+
+        fillPeers(stalled);
+    }
+
+    if (m_pListener) {
+        for (std::set<SyncPeer*>::iterator it = stalled.begin(); it != stalled.end(); ++it) m_pListener->onSyncPeerStalled(*it);
+    }
+}
+
+// Forgets everything above forkHeight, which is no longer in the best chain.
+void BlockSync::rewind(uint32_t forkHeight)
+{
+    std::vector<uint32_t> heights;
+    for (std::map<uint32_t, Request>::iterator it = m_requests.upper_bound(forkHeight); it != m_requests.end(); ++it)
+        heights.push_back(it->first);
+    for (std::size_t i = 0; i < heights.size(); i++) cancelRequest(heights[i]);
+
+    m_received.erase(m_received.upper_bound(forkHeight), m_received.end());
+    m_retries.erase(m_retries.upper_bound(forkHeight), m_retries.end());
+    m_nextRequestHeight = std::min(m_nextRequestHeight, forkHeight + 1);
+    m_nextDeliverHeight = std::min(m_nextDeliverHeight, forkHeight + 1);
+}
+
+void BlockSync::cancelRequest(uint32_t height)
+{
+    std::map<uint32_t, Request>::iterator it = m_requests.find(height);
+    if (it == m_requests.end()) return;
+
+    PeerMap::iterator peer = m_peers.find(it->second.pPeer);
+    if (peer != m_peers.end() && peer->second.inFlight > 0) peer->second.inFlight--;
+    m_requests.erase(it);
+}
+
+void BlockSync::fillPeer(SyncPeer* pPeer, PeerState& state, const ptime& now)
+{
+    std::vector<uchar_vector> hashes;
+    while (state.inFlight < state.window) {
+        uint32_t height;
+        if (!m_retries.empty()) {
+            height = *m_retries.begin();
+            m_retries.erase(m_retries.begin());
+            if (height < m_nextDeliverHeight || m_received.count(height) || m_requests.count(height)) continue;
+        }
+        else if (m_nextRequestHeight <= m_chain.getBestHeight() && m_nextRequestHeight < m_nextDeliverHeight + m_downloadWindow) {
+            height = m_nextRequestHeight++;
+        }
+        else {
+            break;
+        }
+
+        Request& request = m_requests[height];
+        request.pPeer = pPeer;
+        request.deadline = now + m_stallTimeout;
+        state.inFlight++;
+        hashes.push_back(getHashAtHeight(height));
+    }
+
+    if (!hashes.empty()) pPeer->askForBlocks(hashes);
+}
+
+void BlockSync::fillPeers(const std::set<SyncPeer*>& last)
+{
+    ptime now = microsec_clock::universal_time();
+    for (PeerMap::iterator it = m_peers.begin(); it != m_peers.end(); ++it) {
+        if (!last.count(it->first)) fillPeer(it->first, it->second, now);
+    }
+    for (PeerMap::iterator it = m_peers.begin(); it != m_peers.end(); ++it) {
+        if (last.count(it->first)) fillPeer(it->first, it->second, now);
+    }
+}
+
+void BlockSync::deliverBlocks()
+{
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> deliverLock(m_deliverMutex, boost::try_to_lock);
+            if (!deliverLock.owns_lock()) return; // whoever holds it will pick up our blocks
+
+            while (true) {
+                std::vector<CoinBlockPtr> blocks;
+                uint32_t firstHeight;
+                bool bComplete = false;
+                bool bReorg = false;
+                uint32_t reorgHeight = 0;
+                {
+                    boost::lock_guard<boost::mutex> lock(m_mutex);
+                    if (m_bReorgPending) {
+                        bReorg = true;
+                        reorgHeight = m_reorgHeight;
+                        m_bReorgPending = false;
+                    }
+
+                    firstHeight = m_nextDeliverHeight;
+                    std::map<uint32_t, CoinBlockPtr>::iterator it = m_received.begin();
+                    while (it != m_received.end() && it->first == m_nextDeliverHeight) {
+                        blocks.push_back(it->second);
+                        m_received.erase(it++);
+                        m_nextDeliverHeight++;
+                    }
+                    if (!blocks.empty()) fillPeers();
+
+                    if (m_bHeadersSynced && !m_bCompleteNotified && m_nextDeliverHeight == m_chain.getBestHeight() + 1) {
+                        m_bCompleteNotified = true;
+                        bComplete = true;
+                    }
+                }
+
+                if (bReorg && reorgHeight < m_deliveredHeight) {
+                    if (m_pListener) m_pListener->onSyncReorg(reorgHeight);
+                    m_deliveredHeight = reorgHeight;
+                }
+
+                for (std::size_t i = 0; i < blocks.size(); i++) {
+                    // a reorg since the blocks were taken leaves the ones above its fork on the old branch
+                    uint32_t height = firstHeight + i;
+                    {
+                        boost::lock_guard<boost::mutex> lock(m_mutex);
+                        if (m_bReorgPending && height > m_reorgHeight) {
+                            bComplete = false;
+                            break;
+                        }
+                    }
+                    if (m_pListener) m_pListener->onSyncBlock(*blocks[i], height);
+                    m_deliveredHeight = height;
+                }
+                if (bComplete && m_pListener) m_pListener->onSyncComplete(firstHeight + blocks.size() - 1);
+                if (blocks.empty() && !bReorg) break;
+            }
+        }
+
+        // blocks that arrived while we were delivering but after our last check
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        if (!m_bReorgPending && (m_received.empty() || m_received.begin()->first != m_nextDeliverHeight)) return;
+    }
+}
+
+uint32_t BlockSync::getHeaderHeight() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_chain.getBestHeight();
+}
+
+uint32_t BlockSync::getBlockHeight() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_nextDeliverHeight - 1;
+}
+
+uint256 BlockSync::getChainWork() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_chain.getChainWork(m_chain.getBestIndex());
+}
+
+uchar_vector BlockSync::getBestHash() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_chain.getHash(m_chain.getBestIndex());
+}
+
+bool BlockSync::isHeadersSynced() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_bHeadersSynced;
+}
+
+bool BlockSync::isSynced() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_bHeadersSynced && m_nextDeliverHeight == m_chain.getBestHeight() + 1;
+}
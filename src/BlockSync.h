@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// BlockSync.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Headers-first initial block download. The header chain is downloaded from one
+// peer at a time with getheaders into a HeaderChain, which checks each header's
+// proof of work and follows the branch with the most work. Blocks
+// are then fetched in parallel from every peer, each peer with its own window of
+// outstanding requests, and handed to the listener strictly in height order.
+//
+// A request that isn't answered within the stall timeout is given to another peer,
+// and the slow peer's window is halved. Each block it does deliver widens it again.
+//
+// The engine doesn't own any connections. Wrap each connection in a SyncPeer, add it
+// with addPeer(), forward its headers and block messages to onHeaders() and onBlock(),
+// and call tick() periodically (every second or so) to detect stalls.
+
+#ifndef _BLOCK_SYNC_H__
+#define _BLOCK_SYNC_H__
+
+#include "CoinNodeData.h"
+#include "HeaderChain.h"
+
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#define MAX_HEADERS_RESULTS             2000    // a full headers message - more are available
+#define DEFAULT_PEER_BLOCK_WINDOW       16      // blocks in flight per peer
+#define DEFAULT_BLOCK_DOWNLOAD_WINDOW   256     // how far past the next block to deliver we'll download
+#define DEFAULT_SYNC_STALL_TIMEOUT      10000   // milliseconds
+
+namespace Coin
+{
+
+// A connection the engine can send requests to. Hashes are in the same byte order as
+// CoinBlockHeader::prevBlockHash. Calls are made with the engine's lock held, so they
+// should only queue the message.
+class SyncPeer
+{
+public:
+    virtual ~SyncPeer() { }
+
+    virtual void getHeaders(const std::vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop) = 0;
+    virtual void askForBlocks(const std::vector<uchar_vector>& hashes) = 0;
+};
+
+// Wraps anything with getHeaders() and askForBlocks() methods, such as a CoinNodePeerPtr
+// or a CoinNodeAbstractListener*.
+template<typename PeerType>
+class SyncPeerAdapter : public SyncPeer
+{
+public:
+    SyncPeerAdapter(PeerType peer) : m_peer(peer) { }
+
+    void getHeaders(const std::vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop) { m_peer->getHeaders(locatorHashes, hashStop); }
+    void askForBlocks(const std::vector<uchar_vector>& hashes) { m_peer->askForBlocks(hashes); }
+
+    PeerType get() const { return m_peer; }
+
+private:
+    PeerType m_peer;
+};
+
+// Implement the following methods in a derived subclass. Blocks are delivered one at a time,
+// in height order, never concurrently - but not necessarily from the same thread.
+class BlockSyncListener
+{
+public:
+    virtual ~BlockSyncListener() { }
+
+    virtual void onSyncHeaders(uint32_t /*bestHeight*/) { }                  // new headers were accepted
+    virtual void onSyncBlock(const CoinBlock& /*block*/, uint32_t /*height*/) { }
+    virtual void onSyncComplete(uint32_t /*height*/) { }                     // every known block delivered
+    virtual void onSyncPeerMisbehaving(SyncPeer* /*peer*/, const std::string& /*reason*/) { }
+    virtual void onSyncPeerStalled(SyncPeer* /*peer*/) { }                   // a request to peer timed out
+
+    // Blocks above forkHeight that were already delivered are no longer in the best chain. Delivery
+    // continues from forkHeight + 1 on the new best chain.
+    virtual void onSyncReorg(uint32_t /*forkHeight*/) { }
+};
+
+class BlockSync
+{
+public:
+    // Syncing starts after genesis, which is taken as height 0 and never delivered.
+    BlockSync(BlockSyncListener* pListener, const CoinBlockHeader& genesis);
+
+    void setPeerWindow(unsigned int blocks) { m_peerWindow = blocks ? blocks : 1; }
+    void setDownloadWindow(unsigned int blocks) { m_downloadWindow = blocks ? blocks : 1; }
+    void setStallTimeout(unsigned int milliseconds) { m_stallTimeout = boost::posix_time::milliseconds(milliseconds); }
+
+    // Peers must stay valid until removed.
+    void addPeer(SyncPeer* pPeer);
+    void removePeer(SyncPeer* pPeer);
+
+    void onHeaders(SyncPeer* pPeer, const HeadersMessage& headers);
+    void onBlock(SyncPeer* pPeer, const CoinBlock& block);
+
+    // Reassigns timed out requests.
+    void tick();
+
+    uint32_t getHeaderHeight() const;
+    uint32_t getBlockHeight() const; // last block delivered
+    uint256 getChainWork() const;
+    uchar_vector getBestHash() const;
+    bool isHeadersSynced() const;
+    bool isSynced() const;
+
+private:
+    struct PeerState
+    {
+        unsigned int window;
+        unsigned int inFlight;
+    };
+
+    struct Request
+    {
+        SyncPeer* pPeer;
+        boost::posix_time::ptime deadline;
+    };
+
+    typedef std::map<SyncPeer*, PeerState> PeerMap;
+    typedef boost::shared_ptr<CoinBlock> CoinBlockPtr;
+
+    uchar_vector getHashAtHeight(uint32_t height) const { return m_chain.getHash(m_chain.getAncestor(m_chain.getBestIndex(), height)); }
+    void rewind(uint32_t forkHeight);
+    void requestHeaders(SyncPeer* pPeer);
+    void fillPeer(SyncPeer* pPeer, PeerState& state, const boost::posix_time::ptime& now);
+    void fillPeers(const std::set<SyncPeer*>& last = std::set<SyncPeer*>()); // peers in last are filled after the others
+    void cancelRequest(uint32_t height);
+    void deliverBlocks();
+
+    BlockSyncListener* m_pListener;
+
+    unsigned int m_peerWindow;
+    unsigned int m_downloadWindow;
+    boost::posix_time::time_duration m_stallTimeout;
+
+    mutable boost::mutex m_mutex;
+
+    // header chain
+    HeaderChain m_chain;
+    bool m_bHeadersSynced;
+    SyncPeer* m_pHeadersPeer;
+    boost::posix_time::ptime m_headersDeadline;
+
+    // block download
+    PeerMap m_peers;
+    std::map<uint32_t, Request> m_requests;
+    std::set<uint32_t> m_retries;           // heights to request again, lowest first
+    uint32_t m_nextRequestHeight;
+    std::map<uint32_t, CoinBlockPtr> m_received;
+    uint32_t m_nextDeliverHeight;
+    bool m_bCompleteNotified;
+
+    bool m_bReorgPending;                   // delivered blocks above m_reorgHeight left the best chain
+    uint32_t m_reorgHeight;
+
+    // only one thread delivers at a time - reorgs are reported while holding it too
+    boost::mutex m_deliverMutex;
+    uint32_t m_deliveredHeight;             // last block passed to the listener
+};
+
+}; // namespace Coin
+
+#endif // _BLOCK_SYNC_H__
@@ -17,11 +17,12 @@
 #include "Base58Check.h"
 #include "CoinKey.h"
 
-#include <openssl/ec.h>
-#include <openssl/ecdsa.h>
-#include <openssl/obj_mac.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
 
-#define EC_CURVE_NAME NID_secp256k1
+#include <string.h>
+
+using namespace Coin;
 
 bool isValidCoinAddress(const std::string& address, unsigned int addressVersion)
 {
@@ -32,102 +33,51 @@ bool isValidCoinAddress(const std::string& address, unsigned int addressVersion)
             (keyHash.size() == PUBLIC_KEY_HASH_LENGTH));
 }
 
-bool static inline EC_KEY_regenerate_key(EC_KEY* eckey, BIGNUM* priv_key)
+// ECDSA signs the leftmost 256 bits of the digest
+static void digestToHash(const uchar_vector& digest, unsigned char* hash)
 {
-    if (!eckey) return false;
-
-    const EC_GROUP *group = EC_KEY_get0_group(eckey);
-
-    bool rval = false;
-    EC_POINT* pub_key = NULL;
-    BN_CTX* ctx = BN_CTX_new();
-    if (!ctx) goto err;
-
-    pub_key = EC_POINT_new(group);
-    if (!pub_key) goto err;
-
-    if (!EC_POINT_mul(group, pub_key, priv_key, NULL, NULL, ctx)) goto err;
-
-    EC_KEY_set_private_key(eckey, priv_key);
-    EC_KEY_set_public_key(eckey, pub_key);
-
-    rval = true;
-
-err:
-    if (pub_key) EC_POINT_free(pub_key);
-    if (ctx) BN_CTX_free(ctx);
-    return rval;
+    memset(hash, 0, 32);
+    if (digest.size() >= 32)
+        memcpy(hash, &digest[0], 32);
+    else if (!digest.empty())
+        memcpy(hash + 32 - digest.size(), &digest[0], digest.size());
 }
 
-int static inline ECDSA_SIG_recover_key_GFp(EC_KEY* eckey, ECDSA_SIG* ecsig, const unsigned char* msg, int msglen, int recid, int check)
+// The 279-byte DER private key OpenSSL 1.0 wrote for uncompressed keys:
+// SEQUENCE { INTEGER 1, OCTET STRING secret, [0] explicit curve parameters, [1] BIT STRING public key }
+static const unsigned char PRIVATE_KEY_DER_BEGIN[] = {
+    0x30, 0x82, 0x01, 0x13, 0x02, 0x01, 0x01, 0x04, 0x20
+};
+
+static const unsigned char PRIVATE_KEY_DER_MIDDLE[] = {
+    0xa0, 0x81, 0xa5, 0x30, 0x81, 0xa2, 0x02, 0x01, 0x01, 0x30, 0x2c, 0x06, 0x07, 0x2a, 0x86, 0x48,
+    0xce, 0x3d, 0x01, 0x01, 0x02, 0x21, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xfe, 0xff, 0xff, 0xfc, 0x2f, 0x30, 0x06, 0x04, 0x01, 0x00, 0x04, 0x01, 0x07, 0x04,
+    0x41, 0x04, 0x79, 0xbe, 0x66, 0x7e, 0xf9, 0xdc, 0xbb, 0xac, 0x55, 0xa0, 0x62, 0x95, 0xce, 0x87,
+    0x0b, 0x07, 0x02, 0x9b, 0xfc, 0xdb, 0x2d, 0xce, 0x28, 0xd9, 0x59, 0xf2, 0x81, 0x5b, 0x16, 0xf8,
+    0x17, 0x98, 0x48, 0x3a, 0xda, 0x77, 0x26, 0xa3, 0xc4, 0x65, 0x5d, 0xa4, 0xfb, 0xfc, 0x0e, 0x11,
+    0x08, 0xa8, 0xfd, 0x17, 0xb4, 0x48, 0xa6, 0x85, 0x54, 0x19, 0x9c, 0x47, 0xd0, 0x8f, 0xfb, 0x10,
+    0xd4, 0xb8, 0x02, 0x21, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xfe, 0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b, 0xbf, 0xd2, 0x5e,
+    0x8c, 0xd0, 0x36, 0x41, 0x41, 0x02, 0x01, 0x01, 0xa1, 0x44, 0x03, 0x42, 0x00
+};
+
+// Picks the secret out of a DER private key. The rest of the structure isn't needed since
+// the public key is derived from the secret again.
+static bool getSecretFromDer(const uchar_vector_secure& der, unsigned char* secret)
 {
-    if (!eckey) return 0;
-
-    int ret = 0;
-    BN_CTX *ctx = NULL;
-
-    BIGNUM *x = NULL;
-    BIGNUM *e = NULL;
-    BIGNUM *order = NULL;
-    BIGNUM *sor = NULL;
-    BIGNUM *eor = NULL;
-    BIGNUM *field = NULL;
-    EC_POINT *R = NULL;
-    EC_POINT *O = NULL;
-    EC_POINT *Q = NULL;
-    BIGNUM *rr = NULL;
-    BIGNUM *zero = NULL;
-    int n = 0;
-    int i = recid / 2;
-
-    const EC_GROUP *group = EC_KEY_get0_group(eckey);
-    if ((ctx = BN_CTX_new()) == NULL) { ret = -1; goto err; }
-    BN_CTX_start(ctx);
-    order = BN_CTX_get(ctx);
-    if (!EC_GROUP_get_order(group, order, ctx)) { ret = -2; goto err; }
-    x = BN_CTX_get(ctx);
-    if (!BN_copy(x, order)) { ret=-1; goto err; }
-    if (!BN_mul_word(x, i)) { ret=-1; goto err; }
-    if (!BN_add(x, x, ecsig->r)) { ret=-1; goto err; }
-    field = BN_CTX_get(ctx);
-    if (!EC_GROUP_get_curve_GFp(group, field, NULL, NULL, ctx)) { ret=-2; goto err; }
-    if (BN_cmp(x, field) >= 0) { ret=0; goto err; }
-    if ((R = EC_POINT_new(group)) == NULL) { ret = -2; goto err; }
-    if (!EC_POINT_set_compressed_coordinates_GFp(group, R, x, recid % 2, ctx)) { ret=0; goto err; }
-    if (check)
-    {
-        if ((O = EC_POINT_new(group)) == NULL) { ret = -2; goto err; }
-        if (!EC_POINT_mul(group, O, NULL, R, order, ctx)) { ret=-2; goto err; }
-        if (!EC_POINT_is_at_infinity(group, O)) { ret = 0; goto err; }
-    }
-    if ((Q = EC_POINT_new(group)) == NULL) { ret = -2; goto err; }
-    n = EC_GROUP_get_degree(group);
-    e = BN_CTX_get(ctx);
-    if (!BN_bin2bn(msg, msglen, e)) { ret=-1; goto err; }
-    if (8*msglen > n) BN_rshift(e, e, 8-(n & 7));
-    zero = BN_CTX_get(ctx);
-    if (!BN_zero(zero)) { ret=-1; goto err; }
-    if (!BN_mod_sub(e, zero, e, order, ctx)) { ret=-1; goto err; }
-    rr = BN_CTX_get(ctx);
-    if (!BN_mod_inverse(rr, ecsig->r, order, ctx)) { ret=-1; goto err; }
-    sor = BN_CTX_get(ctx);
-    if (!BN_mod_mul(sor, ecsig->s, rr, order, ctx)) { ret=-1; goto err; }
-    eor = BN_CTX_get(ctx);
-    if (!BN_mod_mul(eor, e, rr, order, ctx)) { ret=-1; goto err; }
-    if (!EC_POINT_mul(group, Q, eor, R, sor, ctx)) { ret=-2; goto err; }
-    if (!EC_KEY_set_public_key(eckey, Q)) { ret=-2; goto err; }
-
-    ret = 1;
-
-err:
-    if (ctx) {
-        BN_CTX_end(ctx);
-        BN_CTX_free(ctx);
-    }
-    if (R != NULL) EC_POINT_free(R);
-    if (O != NULL) EC_POINT_free(O);
-    if (Q != NULL) EC_POINT_free(Q);
-    return ret;
+    size_t pos = 0;
+    if (der.size() < 2 || der[pos++] != 0x30) return false;
+    if (der[pos] & 0x80) pos += der[pos] & 0x7f;
+    pos++;
+    if (pos + 5 > der.size() || der[pos] != 0x02 || der[pos + 1] != 0x01 || der[pos + 2] != 0x01 || der[pos + 3] != 0x04) return false;
+    size_t len = der[pos + 4];
+    pos += 5;
+    if (len > PRIVATE_KEY_LENGTH || pos + len > der.size()) return false;
+    memset(secret, 0, PRIVATE_KEY_LENGTH);
+    memcpy(secret + PRIVATE_KEY_LENGTH - len, &der[pos], len);
+    return true;
 }
 
 CoinKey::CoinKey(unsigned int addressVersion, unsigned int walletImportVersion)
@@ -135,33 +85,30 @@ CoinKey::CoinKey(unsigned int addressVersion, unsigned int walletImportVersion)
     this->bCompressed = true;
     this->addressVersion = addressVersion;
     this->walletImportVersion = walletImportVersion;
-    this->pKey = EC_KEY_new_by_curve_name(EC_CURVE_NAME);
-    if (!this->pKey)
-        throw CoinKeyError("CoinKey::CoinKey() : EC_KEY_new_by_curve_name failed");
+    this->bPrivate = false;
     this->bSet = false;
 }
 
 CoinKey::CoinKey(const CoinKey& other)
 {
-    this->bCompressed = other.bCompressed;
-    this->pKey = EC_KEY_dup(other.pKey);
-    if (!this->pKey)
-        throw CoinKeyError("CoinKey::CoinKey(const CoinKey&) : EC_KEY_dup failed");
-    this->bSet = other.bSet;
+    this->addressVersion = other.addressVersion;
+    this->walletImportVersion = other.walletImportVersion;
+    *this = other;
 }
 
 CoinKey& CoinKey::operator=(const CoinKey& other)
 {
     this->bCompressed = other.bCompressed;
-    if (!EC_KEY_copy(this->pKey, other.pKey))
-        throw CoinKeyError("CoinKey::operator=(const CoinKey&) : EC_KEY_copy failed");
+    memcpy(this->privateKey, other.privateKey, PRIVATE_KEY_LENGTH);
+    this->publicKey = other.publicKey;
+    this->bPrivate = other.bPrivate;
     this->bSet = other.bSet;
     return (*this);
 }
 
 CoinKey::~CoinKey()
 {
-    EC_KEY_free(this->pKey);
+    OPENSSL_cleanse(this->privateKey, PRIVATE_KEY_LENGTH);
 }
 
 bool CoinKey::isSet() const
@@ -171,38 +118,40 @@ bool CoinKey::isSet() const
 
 void CoinKey::generateNewKey()
 {
-    if (!EC_KEY_generate_key(this->pKey))
-        throw CoinKeyError("CoinKey::generateNewKey() : EC_KEY_generate_key failed");
+    do {
+        if (RAND_bytes(this->privateKey, PRIVATE_KEY_LENGTH) != 1)
+            throw CoinKeyError("CoinKey::generateNewKey() : RAND_bytes failed");
+    } while (!secp256k1::derivePublicKey(this->privateKey, this->publicKey));
+    this->bPrivate = true;
     this->bSet = true;
 }
 
 // determines whether we're using a full 279-byte DER key or a shorter 32-byte one according to the length of privateKey
 bool CoinKey::setPrivateKey(const uchar_vector_secure& privateKey, bool bCompressed)
 {
+    unsigned char secret[PRIVATE_KEY_LENGTH];
     if (privateKey.size() == PRIVATE_KEY_DER_LENGTH) {
-        const unsigned char* pBegin = &privateKey[0];
-        if (!d2i_ECPrivateKey(&this->pKey, &pBegin, privateKey.size()))
+        if (!getSecretFromDer(privateKey, secret))
             return false;
-        this->bSet = true;
-        this->bCompressed = bCompressed;
-        return true;
     }
     else if (privateKey.size() == PRIVATE_KEY_LENGTH) {
-        EC_KEY_free(this->pKey);
-        this->pKey = EC_KEY_new_by_curve_name(EC_CURVE_NAME);
-        if (this->pKey == NULL)
-            throw CoinKeyError("CoinKey::setPrivateKey() : EC_KEY_new_by_curve_name failed");
-        BIGNUM* bn = BN_bin2bn(&privateKey[0], PRIVATE_KEY_LENGTH, BN_new());
-        if (!bn)
-            throw CoinKeyError("CoinKey::setPrivateKey() : BN_bin2bn failed");
-        if (!EC_KEY_regenerate_key(this->pKey, bn))
-            throw CoinKeyError("CoinKey::setPrivateKey() : EC_KEY_regenerate_key failed");
-        BN_clear_free(bn);
+        memcpy(secret, &privateKey[0], PRIVATE_KEY_LENGTH);
+    }
+    else {
+        throw CoinKeyError("CoinKey::setPrivateKey() : invalid key length");
+    }
+
+    secp256k1::PublicKey publicKey;
+    bool bValid = secp256k1::derivePublicKey(secret, publicKey);
+    if (bValid) {
+        memcpy(this->privateKey, secret, PRIVATE_KEY_LENGTH);
+        this->publicKey = publicKey;
         this->bCompressed = bCompressed;
+        this->bPrivate = true;
         this->bSet = true;
-        return true;
     }
-    throw CoinKeyError("CoinKey::setPrivateKey() : invalid key length");
+    OPENSSL_cleanse(secret, PRIVATE_KEY_LENGTH);
+    return bValid;
 }
 
 uchar_vector_secure CoinKey::getPrivateKey(unsigned int privateKeyFormat) const
@@ -210,30 +159,22 @@ uchar_vector_secure CoinKey::getPrivateKey(unsigned int privateKeyFormat) const
     if (!this->bSet) {
         throw CoinKeyError("CoinLey::getPrivateKey() : key not set.");
     }
+    if (!this->bPrivate) {
+        throw CoinKeyError("CoinKey::getPrivateKey() : only the public key is set.");
+    }
     if (privateKeyFormat == PRIVATE_KEY_DER_279) {
-        int nSize = i2d_ECPrivateKey(this->pKey, NULL);
-        if (!nSize)
-            throw CoinKeyError("CoinKey::getPrivateKey() : i2d_ECPrivateKey failed");
-        uchar_vector_secure privateKey(nSize, 0);
-        unsigned char* pBegin = &privateKey[0];
-        if (i2d_ECPrivateKey(this->pKey, &pBegin) != nSize)
-            throw CoinKeyError("CoinKey::getPrivateKey() : i2d_ECPrivateKey returned unexpected size");
+        uchar_vector_secure privateKey(PRIVATE_KEY_DER_BEGIN, sizeof(PRIVATE_KEY_DER_BEGIN));
+        privateKey.insert(privateKey.end(), this->privateKey, this->privateKey + PRIVATE_KEY_LENGTH);
+        privateKey.insert(privateKey.end(), PRIVATE_KEY_DER_MIDDLE, PRIVATE_KEY_DER_MIDDLE + sizeof(PRIVATE_KEY_DER_MIDDLE));
+        privateKey.resize(PRIVATE_KEY_DER_LENGTH);
+        secp256k1::serializePublicKey(this->publicKey, false, &privateKey[PRIVATE_KEY_DER_LENGTH - SECP256K1_UNCOMPRESSED_PUBKEY_SIZE]);
         return privateKey;
     }
     else if (privateKeyFormat == PRIVATE_KEY_32) {
-        uchar_vector_secure privateKey(PRIVATE_KEY_LENGTH, 0);
-        const BIGNUM *bn = EC_KEY_get0_private_key(this->pKey);
-        if (!bn)
-            throw CoinKeyError("CoinKey::getPrivateKey() : EC_KEY_get0_private_key failed");
-        int nBytes = BN_num_bytes(bn);
-        int n = BN_bn2bin(bn, &privateKey[PRIVATE_KEY_LENGTH - nBytes]);
-        if (n != nBytes)
-            throw CoinKeyError("CoinKey::getPrivateKey(): BN_bn2bin failed");
-        return privateKey;
+        return uchar_vector_secure(this->privateKey, PRIVATE_KEY_LENGTH);
     }
     throw CoinKeyError("CoinKey::getPrivateKey() : invalid key format");
 }
-
 bool CoinKey::setWalletImport(const string_secure& walletImport)
 {
     uchar_vector_secure privateKey;
@@ -265,10 +206,10 @@ string_secure CoinKey::getWalletImport() const
 
 bool CoinKey::setPublicKey(const uchar_vector& publicKey)
 {
-    const unsigned char* pBegin = &publicKey[0];
-    if (!o2i_ECPublicKey(&this->pKey, &pBegin, publicKey.size()))
+    if (publicKey.empty() || !secp256k1::parsePublicKey(&publicKey[0], publicKey.size(), this->publicKey))
         return false;
-    this->bCompressed = (publicKey.size() == 33);
+    this->bCompressed = (publicKey.size() == SECP256K1_COMPRESSED_PUBKEY_SIZE);
+    this->bPrivate = false;
     this->bSet = true;
     return true;
 }
@@ -278,14 +219,8 @@ uchar_vector CoinKey::getPublicKey() const
     if (!this->bSet) {
         throw CoinKeyError("CoinKey::getPublicKey() : key is not set.");
     }
-    EC_KEY_set_conv_form(this->pKey, this->bCompressed ? POINT_CONVERSION_COMPRESSED : POINT_CONVERSION_UNCOMPRESSED); 
-    int nSize = i2o_ECPublicKey(this->pKey, NULL);
-    if (nSize == 0)
-        throw CoinKeyError("CoinKey::getPublicKey() : i2o_ECPublicKey failed");
-    uchar_vector publicKey(nSize, 0);
-    unsigned char* pBegin = &publicKey[0];
-    if (i2o_ECPublicKey(this->pKey, &pBegin) != nSize)
-        throw CoinKeyError("CoinKey::getPublicKey() : i2o_ECPublicKey returned unexpected size");
+    uchar_vector publicKey(this->bCompressed ? SECP256K1_COMPRESSED_PUBKEY_SIZE : SECP256K1_UNCOMPRESSED_PUBKEY_SIZE, 0);
+    secp256k1::serializePublicKey(this->publicKey, this->bCompressed, &publicKey[0]);
     return publicKey;
 }
 
@@ -294,52 +229,37 @@ std::string CoinKey::getAddress() const
     return toBase58Check(ripemd160(sha256(this->getPublicKey())), this->addressVersion);
 }
 
-bool CoinKey::sign(const uchar_vector& digest, uchar_vector& signature)
+bool CoinKey::sign(const uchar_vector& digest, uchar_vector& signature) const
 {
     signature.clear();
-    unsigned char buffer[10000];
-    unsigned int nSize = 0;
-    if (!ECDSA_sign(0, (unsigned char*)&digest[0], digest.size(), buffer, &nSize, this->pKey))
+    if (!this->bPrivate) return false;
+
+    unsigned char hash[32];
+    unsigned char sig[64];
+    digestToHash(digest, hash);
+    if (!secp256k1::sign(this->privateKey, hash, sig))
         return false;
-    signature.resize(nSize);
-    memcpy(&signature[0], buffer, nSize);
+
+    unsigned char der[SECP256K1_MAX_DER_SIGNATURE_SIZE];
+    size_t nSize = secp256k1::encodeDerSignature(sig, der);
+    signature.assign(der, der + nSize);
     return true;
 }
 
 // create a compact signature (65 bytes), which allows reconstructing the used public key
-bool CoinKey::signCompact(const uchar_vector& digest, uchar_vector& signature)
+bool CoinKey::signCompact(const uchar_vector& digest, uchar_vector& signature) const
 {
-    bool rval = false;
-    ECDSA_SIG* pSig = ECDSA_do_sign((unsigned char*)&digest[0], digest.size(), this->pKey);
-    if (!pSig) return false;
+    if (!this->bPrivate) return false;
 
+    unsigned char hash[32];
+    int nRecId;
+    digestToHash(digest, hash);
     signature.clear();
-    signature.resize(65,0);
-    int nBitsR = BN_num_bits(pSig->r);
-    int nBitsS = BN_num_bits(pSig->s);
-    if (nBitsR <= 256 && nBitsS <= 256) {
-        int nRecId = -1;
-        for (int i = 0; i < 4; i++) {
-            CoinKey recoveredKey;
-            recoveredKey.bSet = true;
-            if (ECDSA_SIG_recover_key_GFp(recoveredKey.pKey, pSig, (unsigned char*)&digest[0], digest.size(), i, 1) == 1) {
-                if (recoveredKey.getPublicKey() == this->getPublicKey()) {
-                    nRecId = i;
-                    break;
-                }
-            }
-        }
-
-        if (nRecId == -1)
-        throw CoinKeyError("CoinKey::signCompact() : unable to construct recoverable key");
-
-        signature[0] = nRecId + 27;
-        BN_bn2bin(pSig->r, &signature[33 - (nBitsR + 7) / 8]);
-        BN_bn2bin(pSig->s, &signature[65 - (nBitsS + 7) / 8]);
-        rval = true;
-    }
-    ECDSA_SIG_free(pSig);
-    return rval;
+    signature.resize(65, 0);
+    if (!secp256k1::sign(this->privateKey, hash, &signature[1], &nRecId))
+        return false;
+    signature[0] = nRecId + 27;
+    return true;
 }
 
 // reconstruct public key from a compact signature
@@ -348,32 +268,30 @@ bool CoinKey::setCompactSignature(const uchar_vector& digest, const uchar_vector
     if (signature.size() != 65) return false;
     if (signature[0] < 27 || signature[0] >= 31) return false;
 
-    ECDSA_SIG *pSig = ECDSA_SIG_new();
-    BN_bin2bn(&signature[1], 32, pSig->r);
-    BN_bin2bn(&signature[33], 32, pSig->s);
-
-    EC_KEY_free(this->pKey);
-    this->pKey = EC_KEY_new_by_curve_name(EC_CURVE_NAME);
-    if (ECDSA_SIG_recover_key_GFp(this->pKey, pSig, (unsigned char*)&digest[0], digest.size(), signature[0] - 27, 0) == 1) {
-        this->bSet = true;
-        ECDSA_SIG_free(pSig);
-        return true;
-    }
-    return false;
+    unsigned char hash[32];
+    digestToHash(digest, hash);
+    if (!secp256k1::recover(hash, &signature[1], signature[0] - 27, this->publicKey))
+        return false;
+    this->bPrivate = false;
+    this->bSet = true;
+    return true;
 }
 
 // Return values: -1 = error, 0 = invalid signature, 1 = valid
-int CoinKey::verify(const uchar_vector& digest, const uchar_vector& signature)
+int CoinKey::verify(const uchar_vector& digest, const uchar_vector& signature) const
 {
-    return ECDSA_verify(0, (unsigned char*)&digest[0], digest.size(), &signature[0], signature.size(), this->pKey);
+    unsigned char hash[32];
+    unsigned char sig[64];
+    if (!this->bSet || signature.empty() || !secp256k1::decodeDerSignature(&signature[0], signature.size(), sig))
+        return -1;
+    digestToHash(digest, hash);
+    return secp256k1::verify(this->publicKey, hash, sig) ? 1 : 0;
 }
 
-bool CoinKey::verifyCompact(const uchar_vector& digest, const uchar_vector& signature)
+bool CoinKey::verifyCompact(const uchar_vector& digest, const uchar_vector& signature) const
 {
     CoinKey key;
-    if (!key.setCompactSignature(digest, signature))
+    if (!this->bSet || !key.setCompactSignature(digest, signature))
         return false;
-    if (this->getPublicKey() != key.getPublicKey())
-        return false;
-    return true;
+    return (key.publicKey == this->publicKey);
 }
@@ -28,6 +28,7 @@
 #include "BigInt.h"
 #include "hash.h"
 #include "uchar_vector.h"
+#include "secp256k1math.h"
 
 #include <stdexcept>
 
@@ -47,8 +48,6 @@ enum {
 
 bool isValidCoinAddress(const std::string& address, unsigned int addressVersion = DEFAULT_ADDRESS_VERSION);
 
-typedef struct ec_key_st EC_KEY;
-
 class CoinKeyError : public std::runtime_error
 {
 public:
@@ -58,7 +57,9 @@ public:
 class CoinKey
 {
 protected:
-    EC_KEY* pKey;
+    unsigned char privateKey[PRIVATE_KEY_LENGTH];
+    Coin::secp256k1::PublicKey publicKey;
+    bool bPrivate;
     bool bSet;
     bool bCompressed;
 
@@ -77,6 +78,7 @@ public:
     bool isCompressed() const { return bCompressed; }
 
     bool isSet() const;
+    bool isPrivate() const { return bSet && bPrivate; } // false if only the public key is set
     void generateNewKey();
 
     // determines whether we're using a full 279-byte DER key or a shorter 32-byte one according to the length of privateKey
@@ -91,15 +93,15 @@ public:
 
     std::string getAddress() const;
 
-    bool sign(const uchar_vector& digest, uchar_vector& signature);
+    bool sign(const uchar_vector& digest, uchar_vector& signature) const;
     // create a compact signature (65 bytes), which allows reconstructing the used public key
-    bool signCompact(const uchar_vector& digest, uchar_vector& signature);
+    bool signCompact(const uchar_vector& digest, uchar_vector& signature) const;
     // reconstruct public key from a compact signature
     bool setCompactSignature(const uchar_vector& digest, const uchar_vector& signature);
 
     // Return values: -1 = error, 0 = invalid signature, 1 = valid
-    int verify(const uchar_vector& digest, const uchar_vector& signature);
-    bool verifyCompact(const uchar_vector& digest, const uchar_vector& signature);
+    int verify(const uchar_vector& digest, const uchar_vector& signature) const;
+    bool verifyCompact(const uchar_vector& digest, const uchar_vector& signature) const;
 };
 
 #endif
@@ -25,6 +25,7 @@
 #include "CoinNodeAbstractListener.h"
 
 #include <boost/thread/locks.hpp>
+#include <boost/bind.hpp>
 
 using namespace Coin;
 
@@ -42,39 +43,53 @@ uint64_t getRandomNonce64()
 
 void coinMessageHandler(CoinNodeSocket* pNodeSocket, CoinNodeAbstractListener* pListener, const CoinNodeMessage& message)
 {
-    std::string command = message.getCommand();
-
 /*    
     if (command == "tx" || command == "block")
         pNodeSocket->pListener->lockHandler();
 */
     try {
-        if (command == "version") {
+        int type = message.getCommandType();
+        switch (type) {
+        case COMMAND_VERSION: {
             VerackMessage verackMessage;
             CoinNodeMessage msg(pNodeSocket->getMagic(), &verackMessage);
             pNodeSocket->sendMessage(msg);
+            break;
         }
-        else if (command == "inv") {
+        case COMMAND_INV: {
             Inventory* pInventory = static_cast<Inventory*>(message.getPayload());
             GetDataMessage getData(*pInventory);
+            if (pListener->getInventoryCache()) getData.items = pListener->getInventoryCache()->announce(pListener, pInventory->items);
+            if (getData.items.empty()) break;
             CoinNodeMessage msg(pNodeSocket->getMagic(), &getData);
             pNodeSocket->sendMessage(msg);
+            break;
         }
-        else if (command == "tx") {
+        case COMMAND_NOTFOUND:
+            if (pListener->getInventoryCache())
+                pListener->getInventoryCache()->request(pListener->getInventoryCache()->notFound(pListener, static_cast<Inventory*>(message.getPayload())->items));
+            pListener->onMessage(type, message);
+            break;
+        case COMMAND_TX: {
             Transaction* pTx = static_cast<Transaction*>(message.getPayload());
+            if (pListener->getInventoryCache()) pListener->getInventoryCache()->received(pTx->getHashLittleEndian());
             pListener->onTx(*pTx);
+            break;
         }
-        else if (command == "block") {
+        case COMMAND_BLOCK: {
             CoinBlock* pBlock = static_cast<CoinBlock*>(message.getPayload());
+            if (pListener->getInventoryCache()) pListener->getInventoryCache()->received(pBlock->blockHeader.getHashLittleEndian());
             pListener->onBlock(*pBlock);
+            break;
         }
-        else if (command == "addr") {
-            AddrMessage* pAddr = static_cast<AddrMessage*>(message.getPayload());
-            pListener->onAddr(*pAddr);
-        }
-        else if (command == "headers") {
-            HeadersMessage* pHeaders = static_cast<HeadersMessage*>(message.getPayload());
-            pListener->onHeaders(*pHeaders);
+        case COMMAND_ADDR:
+            pListener->onAddr(*static_cast<AddrMessage*>(message.getPayload()));
+            break;
+        case COMMAND_HEADERS:
+            pListener->onHeaders(*static_cast<HeadersMessage*>(message.getPayload()));
+            break;
+        default:
+            pListener->onMessage(type, message);
         }
     }
     catch (const std::exception& e) {
@@ -87,16 +102,42 @@ void coinMessageHandler(CoinNodeSocket* pNodeSocket, CoinNodeAbstractListener* p
 
 void socketClosedHandler(CoinNodeSocket* pNodeSocket, CoinNodeAbstractListener* pListener, int code)
 {
+    if (pListener->getInventoryCache())
+        pListener->getInventoryCache()->request(pListener->getInventoryCache()->removePeer(pListener));
     pListener->onSocketClosed(code);
 }
 
 void CoinNodeAbstractListener::start()
 {
+    if (m_pInventoryCache) m_pInventoryCache->addPeer(this, boost::bind(&CoinNodeAbstractListener::requestItems, this, _1));
     m_nodeSocket.open(coinMessageHandler, m_magic, m_version, m_peerHostname.c_str(), m_port, socketClosedHandler);
     m_nodeSocket.doHandshake(m_version, NODE_NETWORK, time(NULL), m_peerAddress, m_listenerAddress, getRandomNonce64(), "", 0);
     m_nodeSocket.waitOnHandshakeComplete();
 }	
 
+void CoinNodeAbstractListener::stop()
+{
+    m_nodeSocket.close();
+
+    // The cache hands our items to other peers through their handlers, so it must forget us before we go away.
+    if (m_pInventoryCache) m_pInventoryCache->request(m_pInventoryCache->removePeer(this));
+}
+
+void CoinNodeAbstractListener::requestItems(const std::vector<InventoryItem>& items)
+{
+    try {
+        GetDataMessage getData(items);
+        CoinNodeMessage msg(this->getMagic(), &getData);
+        this->sendMessage(msg);
+    }
+    catch (const std::exception& e) {
+        // the socket is closing - taking us out of the cache hands the items on
+#ifdef __SHOW_EXCEPTIONS__
+        std::cout << "CoinNodeAbstractListener::requestItems() - Exception: " << e.what() << std::endl;
+#endif
+    }
+}
+
 void CoinNodeAbstractListener::askForBlock(const std::string& hash)
 {
     InventoryItem block(MSG_BLOCK, uchar_vector(hash));
@@ -107,6 +148,14 @@ void CoinNodeAbstractListener::askForBlock(const std::string& hash)
     this->sendMessage(msg);
 }
 
+void CoinNodeAbstractListener::askForBlocks(const std::vector<uchar_vector>& hashes)
+{
+    GetDataMessage getData;
+    for (unsigned int i = 0; i < hashes.size(); i++) getData.addItem(MSG_BLOCK, hashes[i]);
+    CoinNodeMessage msg(this->getMagic(), &getData);
+    this->sendMessage(msg);
+}
+
 void CoinNodeAbstractListener::getBlocks(const std::vector<std::string>& locatorHashes, const std::string& hashStop)
 {
     GetBlocksMessage getBlocks;
@@ -26,6 +26,7 @@
 #define _COIN_NODE_ABSTRACT_LISTENER_H__
 
 #include "CoinNodeSocket.h"
+#include "InventoryCache.h"
 
 #include <pthread.h>
 
@@ -51,6 +52,8 @@ protected:
     bool m_syncMessages;
     pthread_mutex_t m_handlerLock;
 
+    InventoryCache* m_pInventoryCache;
+
 public:
     // set syncMessages to false to allow subclass to handle thread synchronization itself.
     CoinNodeAbstractListener(uint32_t magic, uint32_t version, const std::string& peerHostname, uint16_t port, bool syncMessages = false,
@@ -59,7 +62,8 @@ public:
         m_version(version),
         m_peerHostname(peerHostname),
         m_port(port),
-        m_syncMessages(syncMessages)
+        m_syncMessages(syncMessages),
+        m_pInventoryCache(NULL)
     {
         m_listenerAddress.set(NODE_NETWORK, listenerIpAddress, port);
         m_peerAddress.set(NODE_NETWORK, peerIpAddress, port);
@@ -77,12 +81,26 @@ public:
     uint32_t getVersion() const { return m_version; }
     const boost::asio::ip::tcp::endpoint& getEndpoint() const { return m_nodeSocket.getEndpoint(); }
 
+    // Run the on* callbacks on the dispatcher's workers instead of the socket's read thread. Call before start().
+    void setDispatcher(MessageDispatcher* pDispatcher) { m_nodeSocket.setDispatcher(pDispatcher); }
+
+    // Share one cache between listeners connected to different peers so that each announced item is requested
+    // from only one of them. Items aren't requested again until they've timed out, and notfound replies and
+    // closed sockets hand their items to another peer. Call before start().
+    void setInventoryCache(InventoryCache* pInventoryCache) { m_pInventoryCache = pInventoryCache; }
+    InventoryCache* getInventoryCache() const { return m_pInventoryCache; }
+
+    // Sends a getdata for items - the inventory cache's request handler for this listener.
+    void requestItems(const std::vector<InventoryItem>& items);
+
     virtual void start();
-    virtual void stop() { m_nodeSocket.close(); }
+    virtual void stop(); // also called by the destructor, which takes the listener out of the inventory cache
 	
     virtual void sendMessage(const CoinNodeMessage& pMessage) { m_nodeSocket.sendMessage(pMessage); }
+    virtual void sendMessage(const SerializedMessage& message) { m_nodeSocket.sendMessage(message); }
 
     virtual void askForBlock(const std::string& hash);
+    virtual void askForBlocks(const std::vector<uchar_vector>& hashes); // one getdata for all of them
     virtual void getBlocks(const std::vector<std::string>& locatorHashes,
                            const std::string& hashStop = "0000000000000000000000000000000000000000000000000000000000000000");
     virtual void getBlocks(const std::vector<uchar_vector>& locatorHashes,
@@ -101,6 +119,9 @@ public:
     virtual void onAddr(AddrMessage& addr) { };
     virtual void onHeaders(HeadersMessage& headers) { };
 
+    // Called for any other command, including ones added with CommandTable::registerCommand().
+    virtual void onMessage(int commandType, const CoinNodeMessage& message) { };
+
     virtual void onSocketClosed(int code) { };
 };
 
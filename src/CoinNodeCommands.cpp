@@ -0,0 +1,209 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// CoinNodeCommands.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "CoinNodeCommands.h"
+#include "CoinNodeData.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+// must be a power of two, comfortably larger than MAX_COMMAND_TYPES
+#define COMMAND_TABLE_SLOTS     256
+
+using namespace Coin;
+
+namespace
+{
+    // Payload factories for the built-in commands
+    template<typename T>
+    CoinNodeStructure* createPayload(const char* /*command*/, const uchar_vector& bytes) { return new T(bytes); }
+
+    template<typename T>
+    CoinNodeStructure* clonePayload(const CoinNodeStructure& payload) { return new T(static_cast<const T&>(payload)); }
+
+    CoinNodeStructure* createBlank(const char* command, const uchar_vector& /*bytes*/) { return new BlankMessage(command); }
+    CoinNodeStructure* cloneBlank(const CoinNodeStructure& payload) { return new BlankMessage(payload.getCommand()); }
+
+    CoinNodeStructure* createGetAddr(const char* /*command*/, const uchar_vector& /*bytes*/) { return new GetAddrMessage(); }
+    CoinNodeStructure* cloneGetAddr(const CoinNodeStructure& /*payload*/) { return new GetAddrMessage(); }
+
+    struct CommandEntry
+    {
+        char name[COMMAND_SIZE + 1];
+        PayloadFactory factory;
+        PayloadCloner cloner;
+    };
+
+    struct CommandSlot
+    {
+        CommandKey key;
+        int type;
+    };
+
+    class CommandRegistry
+    {
+    public:
+        static CommandRegistry& instance()
+        {
+            static CommandRegistry registry;
+            return registry;
+        }
+
+        int getType(const CommandKey& key) const
+        {
+            if (key.isNull()) return COMMAND_UNKNOWN;
+            for (std::size_t i = hash(key);; i = (i + 1) & (COMMAND_TABLE_SLOTS - 1)) {
+                if (m_slots[i].key == key) return m_slots[i].type;
+                if (m_slots[i].key.isNull()) return COMMAND_UNKNOWN;
+            }
+        }
+
+        const CommandEntry* getEntry(int type) const
+        {
+            if (type <= COMMAND_UNKNOWN || type >= m_nextType) return NULL;
+            return &m_entries[type];
+        }
+
+        int add(const char* command, PayloadFactory factory, PayloadCloner cloner, int type = COMMAND_UNKNOWN)
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+
+            CommandKey key(command);
+            if (key.isNull()) throw std::runtime_error("CommandTable::registerCommand() - empty command.");
+            if (getType(key) != COMMAND_UNKNOWN) throw std::runtime_error(std::string("CommandTable::registerCommand() - command already registered: ") + command);
+            if (type == COMMAND_UNKNOWN) type = m_nextType;
+            if (type >= MAX_COMMAND_TYPES) throw std::runtime_error("CommandTable::registerCommand() - command table is full.");
+
+            CommandEntry& entry = m_entries[type];
+            memset(entry.name, 0, sizeof(entry.name));
+            strncpy(entry.name, command, COMMAND_SIZE);
+            entry.factory = factory;
+            entry.cloner = cloner;
+
+            // publish the entry before the slot that points at it
+            std::size_t i = hash(key);
+            while (!m_slots[i].key.isNull()) i = (i + 1) & (COMMAND_TABLE_SLOTS - 1);
+            m_slots[i].type = type;
+            m_slots[i].key = key;
+
+            if (type >= m_nextType) m_nextType = type + 1;
+            return type;
+        }
+
+    private:
+        CommandRegistry() : m_nextType(COMMAND_CUSTOM)
+        {
+            memset(m_entries, 0, sizeof(m_entries));
+            for (std::size_t i = 0; i < COMMAND_TABLE_SLOTS; i++) m_slots[i].type = COMMAND_UNKNOWN;
+
+            add("version",      &createPayload<VersionMessage>,      &clonePayload<VersionMessage>,      COMMAND_VERSION);
+            add("verack",       &createBlank,                        &cloneBlank,                        COMMAND_VERACK);
+            add("mempool",      &createBlank,                        &cloneBlank,                        COMMAND_MEMPOOL);
+            add("addr",         &createPayload<AddrMessage>,         &clonePayload<AddrMessage>,         COMMAND_ADDR);
+            add("inv",          &createPayload<Inventory>,           &clonePayload<Inventory>,           COMMAND_INV);
+            add("getdata",      &createPayload<GetDataMessage>,      &clonePayload<GetDataMessage>,      COMMAND_GETDATA);
+            add("notfound",     &createPayload<NotFoundMessage>,     &clonePayload<NotFoundMessage>,     COMMAND_NOTFOUND);
+            add("getblocks",    &createPayload<GetBlocksMessage>,    &clonePayload<GetBlocksMessage>,    COMMAND_GETBLOCKS);
+            add("getheaders",   &createPayload<GetHeadersMessage>,   &clonePayload<GetHeadersMessage>,   COMMAND_GETHEADERS);
+            add("tx",           &createPayload<Transaction>,         &clonePayload<Transaction>,         COMMAND_TX);
+            add("block",        &createPayload<CoinBlock>,           &clonePayload<CoinBlock>,           COMMAND_BLOCK);
+            add("merkleblock",  &createPayload<MerkleBlock>,         &clonePayload<MerkleBlock>,         COMMAND_MERKLEBLOCK);
+            add("headers",      &createPayload<HeadersMessage>,      &clonePayload<HeadersMessage>,      COMMAND_HEADERS);
+            add("getaddr",      &createGetAddr,                      &cloneGetAddr,                      COMMAND_GETADDR);
+            add("filterload",   &createPayload<FilterLoadMessage>,   &clonePayload<FilterLoadMessage>,   COMMAND_FILTERLOAD);
+            add("filteradd",    &createPayload<FilterAddMessage>,    &clonePayload<FilterAddMessage>,    COMMAND_FILTERADD);
+            add("filterclear",  &createBlank,                        &cloneBlank,                        COMMAND_FILTERCLEAR);
+        }
+
+        static std::size_t hash(const CommandKey& key)
+        {
+            uint64_t h = (key.lo ^ ((uint64_t)key.hi << 29)) * 0x9e3779b97f4a7c15ull;
+            return (std::size_t)(h >> 56) & (COMMAND_TABLE_SLOTS - 1);
+        }
+
+        boost::mutex m_mutex;
+        CommandSlot m_slots[COMMAND_TABLE_SLOTS];
+        CommandEntry m_entries[MAX_COMMAND_TYPES];
+        int m_nextType;
+    };
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// struct CommandKey implementation
+//
+CommandKey::CommandKey(const char* command)
+{
+    unsigned char bytes[COMMAND_SIZE];
+    memset(bytes, 0, COMMAND_SIZE);
+    for (std::size_t i = 0; i < COMMAND_SIZE && command[i]; i++) bytes[i] = command[i];
+
+    lo = 0;
+    for (int i = 7; i >= 0; i--) lo = (lo << 8) | bytes[i];
+    hi = 0;
+    for (int i = 11; i >= 8; i--) hi = (hi << 8) | bytes[i];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class CommandTable implementation
+//
+int CommandTable::getType(const char* command)
+{
+    return CommandRegistry::instance().getType(CommandKey(command));
+}
+
+int CommandTable::getType(const CommandKey& key)
+{
+    return CommandRegistry::instance().getType(key);
+}
+
+const char* CommandTable::getName(int type)
+{
+    const CommandEntry* pEntry = CommandRegistry::instance().getEntry(type);
+    return pEntry ? pEntry->name : "";
+}
+
+int CommandTable::registerCommand(const char* command, PayloadFactory factory, PayloadCloner cloner)
+{
+    if (!factory || !cloner) throw std::runtime_error("CommandTable::registerCommand() - missing payload factory.");
+    return CommandRegistry::instance().add(command, factory, cloner);
+}
+
+CoinNodeStructure* CommandTable::createPayload(int type, const uchar_vector& bytes)
+{
+    const CommandEntry* pEntry = CommandRegistry::instance().getEntry(type);
+    if (!pEntry) throw std::runtime_error("Unrecognized command.");
+    return pEntry->factory(pEntry->name, bytes);
+}
+
+CoinNodeStructure* CommandTable::clonePayload(int type, const CoinNodeStructure& payload)
+{
+    const CommandEntry* pEntry = CommandRegistry::instance().getEntry(type);
+    if (!pEntry) throw std::runtime_error(std::string("Unrecognized command: ") + payload.getCommand());
+    return pEntry->cloner(payload);
+}
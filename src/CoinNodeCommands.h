@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// CoinNodeCommands.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Maps the 12-byte command field of a message header to a command type and to the
+// functions that build its payload. Command names are packed into a pair of integers
+// and looked up in a small open-addressed table, so a lookup costs a hash and two
+// integer compares rather than a chain of string compares.
+//
+// Applications can add their own commands with CommandTable::registerCommand().
+// Register them before opening any connections - lookups are not synchronized
+// against registration.
+
+#ifndef _COIN_NODE_COMMANDS_H__
+#define _COIN_NODE_COMMANDS_H__
+
+#include "uchar_vector.h"
+
+#include <stdint.h>
+
+#define COMMAND_SIZE            12
+#define MAX_COMMAND_TYPES       128
+
+namespace Coin
+{
+
+class CoinNodeStructure;
+
+enum CommandType
+{
+    COMMAND_UNKNOWN = 0,
+    COMMAND_VERSION,
+    COMMAND_VERACK,
+    COMMAND_MEMPOOL,
+    COMMAND_ADDR,
+    COMMAND_INV,
+    COMMAND_GETDATA,
+    COMMAND_NOTFOUND,
+    COMMAND_GETBLOCKS,
+    COMMAND_GETHEADERS,
+    COMMAND_TX,
+    COMMAND_BLOCK,
+    COMMAND_MERKLEBLOCK,
+    COMMAND_HEADERS,
+    COMMAND_GETADDR,
+    COMMAND_FILTERLOAD,
+    COMMAND_FILTERADD,
+    COMMAND_FILTERCLEAR,
+    COMMAND_CUSTOM // first type handed out by registerCommand()
+};
+
+// A command name, NUL-padded to 12 bytes and packed into two integers.
+struct CommandKey
+{
+    uint64_t lo;
+    uint32_t hi;
+
+    CommandKey() : lo(0), hi(0) { }
+    explicit CommandKey(const char* command); // reads at most COMMAND_SIZE bytes
+
+    bool operator==(const CommandKey& rhs) const { return lo == rhs.lo && hi == rhs.hi; }
+    bool operator!=(const CommandKey& rhs) const { return lo != rhs.lo || hi != rhs.hi; }
+    bool isNull() const { return lo == 0 && hi == 0; }
+};
+
+// Builds a payload from its serialized bytes.
+typedef CoinNodeStructure* (*PayloadFactory)(const char* command, const uchar_vector& bytes);
+
+// Makes a heap copy of a payload of the registered command.
+typedef CoinNodeStructure* (*PayloadCloner)(const CoinNodeStructure& payload);
+
+class CommandTable
+{
+public:
+    // Returns COMMAND_UNKNOWN if the command was never registered.
+    static int getType(const char* command);
+    static int getType(const CommandKey& key);
+
+    static const char* getName(int type);
+
+    // Returns the new command's type. Throws if the command is already registered or the table is full.
+    static int registerCommand(const char* command, PayloadFactory factory, PayloadCloner cloner);
+
+    // Both throw std::runtime_error for unknown types.
+    static CoinNodeStructure* createPayload(int type, const uchar_vector& bytes);
+    static CoinNodeStructure* clonePayload(int type, const CoinNodeStructure& payload);
+};
+
+}; // namespace Coin
+
+#endif // _COIN_NODE_COMMANDS_H__
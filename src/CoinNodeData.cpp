@@ -555,6 +555,15 @@ void MessageHeader::setSerialized(const uchar_vector& bytes)
         this->checksum = vch_to_uint<uint32_t>(uchar_vector(bytes.begin() + 20, bytes.begin() + 24), _BIG_ENDIAN);
 }
 
+void MessageHeader::setSerialized(const unsigned char* bytes)
+{
+    this->magic = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+    memcpy(this->command, bytes + 4, 12);
+    this->length = (uint32_t)bytes[16] | ((uint32_t)bytes[17] << 8) | ((uint32_t)bytes[18] << 16) | ((uint32_t)bytes[19] << 24);
+    this->checksum = (uint32_t)bytes[20] | ((uint32_t)bytes[21] << 8) | ((uint32_t)bytes[22] << 16) | ((uint32_t)bytes[23] << 24);
+    this->hasChecksum = true;
+}
+
 string MessageHeader::toString() const
 {
     stringstream ss;
@@ -581,94 +590,16 @@ string MessageHeader::toIndentedString(uint spaces) const
 //
 void CoinNodeMessage::setMessage(uint32_t magic, CoinNodeStructure* pPayload)
 {
-    string command = pPayload->getCommand();
-    if (command == "version") {
-// VERSION_CHECKSUM_CHANGE
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        VersionMessage* pMessage = static_cast<VersionMessage*>(pPayload);
-        this->pPayload = new VersionMessage(*pMessage);
-    }
-    else if (command == "verack") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        this->pPayload = new BlankMessage("verack");
-    }
-    else if (command == "mempool") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        this->pPayload = new BlankMessage("mempool");
-    }
-    else if (command == "addr") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        AddrMessage* pMessage = static_cast<AddrMessage*>(pPayload);
-        this->pPayload = new AddrMessage(*pMessage);
-    }
-    else if (command == "inv") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        Inventory* pMessage = static_cast<Inventory*>(pPayload);
-        this->pPayload = new Inventory(*pMessage);
-    }
-    else if (command == "getdata") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        GetDataMessage* pMessage = static_cast<GetDataMessage*>(pPayload);
-        this->pPayload = new GetDataMessage(*pMessage);
-    }
-    else if (command == "notfound") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        NotFoundMessage* pMessage = static_cast<NotFoundMessage*>(pPayload);
-        this->pPayload = new NotFoundMessage(*pMessage);
-    }
-    else if (command == "getblocks") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        GetBlocksMessage* pMessage = static_cast<GetBlocksMessage*>(pPayload);
-        this->pPayload = new GetBlocksMessage(*pMessage);
-    }
-    else if (command == "getheaders") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        GetHeadersMessage* pMessage = static_cast<GetHeadersMessage*>(pPayload);
-        this->pPayload = new GetHeadersMessage(*pMessage);
-    }
-    else if (command == "tx") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        Transaction* pMessage = static_cast<Transaction*>(pPayload);
-        this->pPayload = new Transaction(*pMessage);
-    }
-    else if (command == "block") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        CoinBlock* pMessage = static_cast<CoinBlock*>(pPayload);
-        this->pPayload = new CoinBlock(*pMessage);
-    }
-    else if (command == "merkleblock") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        MerkleBlock* pMessage = static_cast<MerkleBlock*>(pPayload);
-        this->pPayload = new MerkleBlock(*pMessage);
-    }
-    else if (command == "headers") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        HeadersMessage* pMessage = static_cast<HeadersMessage*>(pPayload);
-        this->pPayload = new HeadersMessage(*pMessage);
-    }
-    else if (command == "getaddr") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        this->pPayload = new GetAddrMessage();
-    }
-    else if (command == "filterload") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        FilterLoadMessage* pMessage = static_cast<FilterLoadMessage*>(pPayload);
-        this->pPayload = new FilterLoadMessage(*pMessage);
-    }
-    else if (command == "filteradd") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        FilterAddMessage* pMessage = static_cast<FilterAddMessage*>(pPayload);
-        this->pPayload = new FilterAddMessage(*pMessage);
-    }
-    else if (command == "filterclear") {
-        this->header = MessageHeader(magic, command.c_str(), pPayload->getSize(), pPayload->getChecksum());
-        this->pPayload = new BlankMessage("filterclear");
-    }
-    else {
+    int type = CommandTable::getType(pPayload->getCommand());
+    if (type == COMMAND_UNKNOWN) {
         string error_msg = "Unrecognized command: ";
-        error_msg += command;
+        error_msg += pPayload->getCommand();
         throw runtime_error(error_msg.c_str());
     }
+
+// VERSION_CHECKSUM_CHANGE
+    this->header = MessageHeader(magic, pPayload->getCommand(), pPayload->getSize(), pPayload->getChecksum());
+    this->pPayload = CommandTable::clonePayload(type, *pPayload);
 }
 
 CoinNodeMessage::~CoinNodeMessage()
@@ -691,90 +622,37 @@ uchar_vector CoinNodeMessage::getSerialized() const
 
 void CoinNodeMessage::setSerialized(const uchar_vector& bytes)
 {
-    this->header.setSerialized(bytes);
-    string command = this->header.command;
+    MessageHeader header(bytes);
+    if (bytes.size() < header.getSize() + header.length)
+        throw runtime_error("Invalid data - CoinNodeMessage too small.");
+
+    this->setSerialized(header, &bytes[0] + header.getSize());
+}
+
+void CoinNodeMessage::setSerialized(const MessageHeader& header, const unsigned char* payload)
+{
+    this->header = header;
 //      if ((command == "version") || (command == "verack"))
 // VERSION_CHECKSUM_CHANGE
 /*      if (command == "verack")
             this->header.removeChecksum();
 */
-    if (bytes.size() < header.getSize() + header.length)
-        throw runtime_error("Invalid data - CoinNodeMessage too small.");
 
     if (pPayload) {
         delete pPayload;
         pPayload = NULL;
     }
 
-    if (command == "version") {
-        this->pPayload =
-        new VersionMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "verack") {
-        this->pPayload = new BlankMessage("verack");
-    }
-    else if (command == "mempool") {
-        this->pPayload = new BlankMessage("mempool");
-    }
-    else if (command == "addr") {
-        this->pPayload =
-            new AddrMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "inv") {
-        this->pPayload =
-            new Inventory(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "getdata") {
-        this->pPayload =
-            new GetDataMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "notfound") {
-        this->pPayload =
-            new NotFoundMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "getblocks") {
-        this->pPayload =
-            new GetBlocksMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "getheaders") {
-        this->pPayload =
-            new GetHeadersMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "tx") {
-        this->pPayload =
-            new Transaction(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "block") {
-        this->pPayload =
-            new CoinBlock(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "merkleblock") {
-        this->pPayload =
-            new MerkleBlock(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "headers") {
-        this->pPayload =
-            new HeadersMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "getaddr") {
-        this->pPayload = new GetAddrMessage();
-    }
-    else if (command == "filterload") {
-        this->pPayload =
-            new FilterLoadMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "filteradd") {
-        this->pPayload =
-            new FilterAddMessage(uchar_vector(bytes.begin() + header.getSize(), bytes.begin() + header.getSize() + header.length));
-    }
-    else if (command == "filterclear") {
-        this->pPayload = new BlankMessage("filterclear");
-    }
-    else {
+    int type = this->header.getCommandType();
+    if (type == COMMAND_UNKNOWN) {
         string error_msg = "Unrecognized command: ";
-        error_msg += command;
+        error_msg += string(this->header.command, strnlen(this->header.command, COMMAND_SIZE));
         throw runtime_error(error_msg.c_str());
     }
+
+    // the only copy of the payload bytes made on the way to the parser
+    uchar_vector bytes(payload, payload + header.length);
+    this->pPayload = CommandTable::createPayload(type, bytes);
 }
 
 bool CoinNodeMessage::isChecksumValid() const
@@ -1427,6 +1305,19 @@ void TxOut::setSerialized(const uchar_vector& bytes)
 
 string TxOut::getAddress() const
 {
+    // The exact pay-to-pubkey-hash and pay-to-script-hash scripts - the regexes below would match them
+    // at offset 0 - are encoded straight from the script bytes.
+    const uchar_vector& script = this->scriptPubKey;
+    char address[BASE58CHECK_ADDRESS_SIZE];
+    if (script.size() == 25 && script[0] == 0x76 && script[1] == 0xa9 && script[2] == 0x14 && script[23] == 0x88 && script[24] == 0xac) {
+        toBase58Check(&script[3], 20, g_addressVersion, address);
+        return address;
+    }
+    if (script.size() == 23 && script[0] == 0xa9 && script[1] == 0x14 && script[22] == 0x87) {
+        toBase58Check(&script[2], 20, g_multiSigAddressVersion, address);
+        return address;
+    }
+
     string scriptPubKeyHex = this->scriptPubKey.getHex();
     boost::match_results<string::const_iterator> publicKey;
 
@@ -1689,51 +1580,29 @@ void CoinBlockHeader::setSerialized(const uchar_vector& bytes)
 
 const BigInt CoinBlockHeader::getTarget() const
 {
-    uint32_t nExp = bits >> 24;
-    uint32_t nMantissa = bits & 0x007fffff;
-    if (nExp <= 3) {
-        nMantissa >>= 8*(3 - nExp);
-        BigInt target(nMantissa);
-        return target;
-    }
-    else {
-        BigInt target(nMantissa);
-        return target << (8*(nExp - 3));
-    }    
+    return BigInt(getTarget256().getBytes());
 }
 
 void CoinBlockHeader::setTarget(const BigInt& target)
 {
-    uint32_t nExp =  target.numBytes();
-    uint32_t nMantissa;
-    if (nExp <= 3) {
-        nMantissa = target.getWord() << 8*(3 - nExp);
-    }
-    else {
-        nMantissa = (target >> (8*(nExp - 3))).getWord();
-    }
-
-    if (nMantissa >> 24) {
-        throw std::runtime_error("Mantissa too large.");
-    }
-
-    if (nMantissa & 0x00800000) {
-        nMantissa >>= 8;
-        nExp++;
-    }
-
-    if (nExp >> 8) {
+    if (target.numBytes() > 32) {
         throw std::runtime_error("Exponent too large.");
     }
 
-    bits = (nExp << 24) | nMantissa;
+    uint256 target256;
+    target256.setBytes(target.getBytes());
+    setTarget256(target256);
 }
 
 const BigInt CoinBlockHeader::getWork() const
 {
-    BigInt target = getTarget();
-    if (target <= 0) return 0;
-    return (BigInt(1) << 256) / (getTarget() + 1);
+    return BigInt(getWork256().getBytes());
+}
+
+bool CoinBlockHeader::checkProofOfWork() const
+{
+    uchar_vector hash = getHash();
+    return Coin::checkProofOfWork(&hash[0], bits);
 }
 
 string CoinBlockHeader::toString() const
@@ -27,9 +27,11 @@
 
 #include "uchar_vector.h"
 #include "hash.h"
+#include "CoinNodeCommands.h"
 #include "IPv6.h"
 
 #include "BigInt.h"
+#include "uint256.h"
 
 #include <list>
 #include <queue>
@@ -268,6 +270,9 @@ public:
     uint64_t getSize() const { return hasChecksum ? 24 : 20; }
     uchar_vector getSerialized() const;
     void setSerialized(const uchar_vector& bytes);
+    void setSerialized(const unsigned char* bytes); // reads MIN_MESSAGE_HEADER_SIZE bytes in place
+
+    int getCommandType() const { return CommandTable::getType(CommandKey(command)); }
 
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
@@ -286,15 +291,20 @@ public:
     CoinNodeMessage(const CoinNodeMessage& message) { this->setMessage(message.header.magic, message.pPayload); }
     CoinNodeMessage(uint32_t magic, CoinNodeStructure* pPayload) { this->setMessage(magic, pPayload); }
     CoinNodeMessage(const uchar_vector& bytes) { this->pPayload = NULL; this->setSerialized(bytes); }
+    CoinNodeMessage(const MessageHeader& header, const unsigned char* payload) { this->pPayload = NULL; this->setSerialized(header, payload); }
     ~CoinNodeMessage();
 
     void setMessage(uint32_t magic, CoinNodeStructure* pPayload);
 
     const char* getCommand() const { return this->pPayload->getCommand(); }
+    int getCommandType() const { return header.getCommandType(); }
     uint64_t getSize() const;
     uchar_vector getSerialized() const;
     void setSerialized(const uchar_vector& bytes);
 
+    // Builds the payload straight from a buffer holding header.length bytes, e.g. a MessageFrameBuffer view.
+    void setSerialized(const MessageHeader& header, const unsigned char* payload);
+
     std::string toString() const;
     std::string toIndentedString(uint spaces = 0) const;
 
@@ -329,7 +339,7 @@ public:
         int32_t startHeight,
         bool relay = true
     );
-    VersionMessage(const uchar_vector bytes) { this->setSerialized(bytes); }
+    VersionMessage(const uchar_vector& bytes) { this->setSerialized(bytes); }
 
     const char* getCommand() const { return "version"; }
     uint64_t getSize() const;
@@ -724,6 +734,14 @@ public:
     void setTarget(const BigInt& target);
 
     const BigInt getWork() const;
+
+    // Same as the above without BigInt's heap allocations.
+    uint256 getTarget256() const { return uint256().setCompact(bits); }
+    void setTarget256(const uint256& target) { bits = target.getCompact(); }
+    uint256 getWork256() const { return Coin::getWork(getTarget256()); }
+
+    // True if the header's hash meets its own target.
+    bool checkProofOfWork() const;
 };
 
 class CoinBlock : public CoinNodeStructure
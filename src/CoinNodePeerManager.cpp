@@ -0,0 +1,567 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// CoinNodePeerManager.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "CoinNodePeerManager.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <ctime>
+
+#include <boost/bind.hpp>
+#include <boost/random/mersenne_twister.hpp>
+
+using namespace Coin;
+
+namespace
+{
+    const unsigned char LOCAL_IPV6[] = {0,0,0,0,0,0,0,0,0,0,255,255,127,0,0,1};
+
+    uint64_t getPeerNonce()
+    {
+        static boost::mutex nonceMutex;
+        static boost::random::mt19937_64 gen(static_cast<uint64_t>(time(NULL)) ^ reinterpret_cast<uintptr_t>(&nonceMutex));
+        boost::lock_guard<boost::mutex> lock(nonceMutex);
+        return gen();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class CoinNodePeer implementation
+//
+CoinNodePeer::CoinNodePeer(CoinNodePeerManager* pManager, const boost::shared_ptr<boost::asio::io_service>& io_service, const std::string& host, uint16_t port)
+    : m_pManager(pManager), m_magic(pManager->getMagic()), m_version(pManager->getVersion()), m_sendHighWaterMark(pManager->getSendHighWaterMark()),
+      m_io_service(io_service), m_resolver(*io_service), m_socket(*io_service), m_handshakeTimer(*io_service),
+      m_host(host), m_port(port), m_bOpen(false), m_bClosing(false), m_bHandshakeComplete(false), m_frameBuffer(pManager->getMagic()),
+      m_dispatchTimer(*io_service), m_writeCount(0), m_writeBytes(0), m_bWriting(false), m_queuedBytes(0)
+{
+}
+
+CoinNodePeer::~CoinNodePeer()
+{
+    boost::system::error_code ec;
+    m_socket.close(ec);
+}
+
+std::string CoinNodePeer::getName() const
+{
+    std::stringstream ss;
+    ss << m_host << ":" << m_port;
+    return ss.str();
+}
+
+void CoinNodePeer::start()
+{
+    std::stringstream ss;
+    ss << m_port;
+    tcp::resolver::query query(m_host, ss.str());
+    m_resolver.async_resolve(query, boost::bind(&CoinNodePeer::handleResolve, shared_from_this(),
+        boost::asio::placeholders::error, boost::asio::placeholders::iterator));
+
+    m_handshakeTimer.expires_from_now(boost::posix_time::milliseconds(m_pManager->getHandshakeTimeout()));
+    m_handshakeTimer.async_wait(boost::bind(&CoinNodePeer::handleHandshakeTimeout, shared_from_this(),
+        boost::asio::placeholders::error));
+}
+
+void CoinNodePeer::close()
+{
+    if (m_bClosing) return;
+    m_io_service->post(boost::bind(&CoinNodePeer::doClose, shared_from_this(), boost::system::error_code()));
+}
+
+void CoinNodePeer::doClose(const boost::system::error_code& ec)
+{
+    if (m_bClosing) return;
+    m_bClosing = true;
+    m_bOpen = false;
+
+    boost::system::error_code ignored;
+    m_handshakeTimer.cancel(ignored);
+    m_resolver.cancel();
+    m_socket.close(ignored);
+    if (!m_bWriting) clearWriteQueue(); // otherwise handleWrite clears it once the aborted write returns
+
+    m_pManager->onPeerClosed(shared_from_this(), ec.value());
+}
+
+void CoinNodePeer::handleResolve(const boost::system::error_code& ec, tcp::resolver::iterator it)
+{
+    if (ec || m_bClosing) {
+        doClose(ec);
+        return;
+    }
+
+    boost::asio::async_connect(m_socket, it, boost::bind(&CoinNodePeer::handleConnect, shared_from_this(),
+        boost::asio::placeholders::error));
+}
+
+void CoinNodePeer::handleConnect(const boost::system::error_code& ec)
+{
+    if (ec || m_bClosing) {
+        doClose(ec);
+        return;
+    }
+
+    m_bOpen = true;
+    startRead();
+
+    NetworkAddress peerAddress(NODE_NETWORK, LOCAL_IPV6, m_port);
+    NetworkAddress listenerAddress(NODE_NETWORK, LOCAL_IPV6, m_port);
+    VersionMessage versionMessage(m_version, NODE_NETWORK, time(NULL), peerAddress, listenerAddress, getPeerNonce(), "", 0);
+    queueMessage(SerializedMessage(m_magic, versionMessage), true); // anything queued before we connected must go after the version message
+}
+
+void CoinNodePeer::handleHandshakeTimeout(const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted || m_bHandshakeComplete) return;
+    doClose(boost::asio::error::timed_out);
+}
+
+void CoinNodePeer::startRead()
+{
+    m_socket.async_read_some(boost::asio::buffer(m_frameBuffer.prepare(), m_frameBuffer.writable()),
+        boost::bind(&CoinNodePeer::handleRead, shared_from_this(), boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred));
+}
+
+void CoinNodePeer::handleRead(const boost::system::error_code& ec, std::size_t bytesRead)
+{
+    if (ec || m_bClosing) {
+        doClose(ec);
+        return;
+    }
+
+    m_frameBuffer.commit(bytesRead);
+    readFrames();
+}
+
+// Handles whatever complete frames are buffered, then reads more - unless the dispatcher is backed up,
+// in which case handleDispatchRetry picks up where this left off.
+void CoinNodePeer::readFrames()
+{
+    while (m_blockedTasks.empty()) {
+        try {
+            if (!m_frameBuffer.nextFrame()) break;
+            if (!m_frameBuffer.isChecksumValid())
+                throw std::runtime_error("Checksum does not match payload.");
+            CoinNodeMessagePtr nodeMessage(new CoinNodeMessage(m_frameBuffer.getHeader(), m_frameBuffer.getPayload()));
+            // only once it parses - a malformed tx or block must still be requested from someone else
+            if (m_pManager->getInventoryCache())
+                markReceived(m_frameBuffer.getHeader().getCommandType(), m_frameBuffer.getPayload(), m_frameBuffer.getPayloadSize());
+            processMessage(nodeMessage);
+        }
+        catch (const std::exception& e) {
+#ifdef __SHOW_EXCEPTIONS__
+            std::cout << "CoinNodePeer::handleRead() - " << getName() << " - Exception: " << e.what() << std::endl;
+#endif
+        }
+        m_frameBuffer.consume();
+        if (m_bClosing) return;
+    }
+
+    if (m_blockedTasks.empty()) startRead();
+}
+
+void CoinNodePeer::notify(const MessageDispatcher::Task& task)
+{
+    // nothing may overtake callbacks that are still waiting
+    if (m_blockedTasks.empty() && m_pManager->notify(this, task)) return;
+    m_blockedTasks.push_back(task);
+    if (m_blockedTasks.size() == 1) startDispatchTimer();
+}
+
+void CoinNodePeer::startDispatchTimer()
+{
+    m_dispatchTimer.expires_from_now(boost::posix_time::milliseconds(DISPATCH_RETRY_INTERVAL));
+    m_dispatchTimer.async_wait(boost::bind(&CoinNodePeer::handleDispatchRetry, shared_from_this(),
+        boost::asio::placeholders::error));
+}
+
+void CoinNodePeer::handleDispatchRetry(const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted) return;
+
+    while (!m_blockedTasks.empty() && m_pManager->notify(this, m_blockedTasks.front())) m_blockedTasks.pop_front();
+    if (!m_blockedTasks.empty())
+        startDispatchTimer();
+    else if (!m_bClosing)
+        readFrames();
+}
+
+// Hashes the raw payload rather than reserializing the parsed message.
+void CoinNodePeer::markReceived(int type, const unsigned char* payload, uint32_t length)
+{
+    if (type == COMMAND_BLOCK) {
+        if (length < MIN_COIN_BLOCK_HEADER_SIZE) return;
+        length = MIN_COIN_BLOCK_HEADER_SIZE;
+    }
+    else if (type != COMMAND_TX) {
+        return;
+    }
+
+    unsigned char hash[32];
+    sha256_2(payload, length, hash);
+    std::reverse(hash, hash + 32); // same byte order as InventoryItem::hash
+    m_pManager->getInventoryCache()->received(hash);
+}
+
+void CoinNodePeer::requestItems(CoinNodePeerWeakPtr peer, const std::vector<InventoryItem>& items)
+{
+    CoinNodePeerPtr p = peer.lock();
+    if (!p) return;
+    GetDataMessage getData(items);
+    p->sendMessage(SerializedMessage(p->m_magic, getData));
+}
+
+void CoinNodePeer::processMessage(const CoinNodeMessagePtr& message)
+{
+    CoinNodePeerListener* pListener = m_pManager->getListener();
+
+    int type = message->getCommandType();
+    switch (type) {
+    case COMMAND_VERSION: {
+        VerackMessage verackMessage;
+        queueMessage(SerializedMessage(m_magic, verackMessage));
+        break;
+    }
+    case COMMAND_VERACK:
+        if (!m_bHandshakeComplete) {
+            m_bHandshakeComplete = true;
+            boost::system::error_code ignored;
+            m_handshakeTimer.cancel(ignored);
+            if (pListener) notify(boost::bind(&CoinNodePeerListener::onPeerConnected, pListener, shared_from_this()));
+        }
+        break;
+    case COMMAND_INV: {
+        Inventory* pInventory = static_cast<Inventory*>(message->getPayload());
+        GetDataMessage getData(*pInventory);
+        if (m_pManager->getInventoryCache()) getData.items = m_pManager->getInventoryCache()->announce(this, pInventory->items);
+        if (!getData.items.empty()) queueMessage(SerializedMessage(m_magic, getData));
+        break;
+    }
+    case COMMAND_NOTFOUND:
+        if (m_pManager->getInventoryCache())
+            m_pManager->getInventoryCache()->request(m_pManager->getInventoryCache()->notFound(this, static_cast<Inventory*>(message->getPayload())->items));
+        if (pListener) notify(boost::bind(&CoinNodePeer::deliverMessage, pListener, shared_from_this(), type, message));
+        break;
+    default:
+        if (pListener) notify(boost::bind(&CoinNodePeer::deliverMessage, pListener, shared_from_this(), type, message));
+    }
+}
+
+void CoinNodePeer::deliverMessage(CoinNodePeerListener* pListener, CoinNodePeerPtr peer, int type, CoinNodeMessagePtr message)
+{
+    switch (type) {
+    case COMMAND_TX:
+        pListener->onTx(peer, *static_cast<Transaction*>(message->getPayload()));
+        break;
+    case COMMAND_BLOCK:
+        pListener->onBlock(peer, *static_cast<CoinBlock*>(message->getPayload()));
+        break;
+    case COMMAND_ADDR:
+        pListener->onAddr(peer, *static_cast<AddrMessage*>(message->getPayload()));
+        break;
+    case COMMAND_HEADERS:
+        pListener->onHeaders(peer, *static_cast<HeadersMessage*>(message->getPayload()));
+        break;
+    default:
+        pListener->onMessage(peer, type, *message);
+    }
+}
+
+bool CoinNodePeer::sendMessage(const CoinNodeMessage& message)
+{
+    return sendMessage(SerializedMessage(message));
+}
+
+bool CoinNodePeer::sendBuffers(const SharedBuffer& header, const SharedBuffer& payload)
+{
+    // Closed peers - including every peer of a manager that has stopped - have nobody left to write for them.
+    if (m_bClosing) return false;
+
+    OutboundMessage message;
+    message.header = header;
+    message.payload = payload;
+
+    // Always let one message through to an idle peer, however large. The bytes are reserved in the same
+    // step as the check so that concurrent senders can't all squeeze in under the mark.
+    std::size_t queuedBytes = m_queuedBytes;
+    do {
+        if (queuedBytes > 0 && queuedBytes + message.size() > m_sendHighWaterMark) return false;
+    } while (!m_queuedBytes.compare_exchange_weak(queuedBytes, queuedBytes + message.size()));
+
+    m_io_service->post(boost::bind(&CoinNodePeer::queueWrite, shared_from_this(), message));
+    return true;
+}
+
+void CoinNodePeer::queueMessage(const SerializedMessage& message, bool bFront)
+{
+    if (m_bClosing) return;
+
+    OutboundMessage outbound;
+    outbound.header = message.getHeader();
+    outbound.payload = message.getPayload();
+    m_queuedBytes += outbound.size();
+
+    // never put anything in front of a write that's in progress
+    if (bFront && !m_bWriting)
+        m_writeQueue.push_front(outbound);
+    else
+        m_writeQueue.push_back(outbound);
+
+    if (m_bOpen && !m_bWriting) startWrite();
+}
+
+void CoinNodePeer::queueWrite(const OutboundMessage& message)
+{
+    if (m_bClosing) {
+        m_queuedBytes -= message.size();
+        return;
+    }
+    m_writeQueue.push_back(message);
+    if (m_bOpen && !m_bWriting) startWrite();
+}
+
+void CoinNodePeer::startWrite()
+{
+    if (m_writeQueue.empty()) return;
+
+    // Gather as many queued messages as fit in one batch into a single scatter-gather write.
+    m_writeBuffers.clear();
+    m_writeCount = 0;
+    m_writeBytes = 0;
+    for (std::deque<OutboundMessage>::iterator it = m_writeQueue.begin(); it != m_writeQueue.end(); ++it) {
+        if (m_writeCount == MAX_WRITE_BATCH_MESSAGES) break;
+        if (m_writeCount > 0 && m_writeBytes + it->size() > MAX_WRITE_BATCH_BYTES) break;
+
+        m_writeBuffers.push_back(boost::asio::buffer(*it->header));
+        if (!it->payload->empty()) m_writeBuffers.push_back(boost::asio::buffer(*it->payload));
+        m_writeBytes += it->size();
+        m_writeCount++;
+    }
+
+    m_bWriting = true;
+    boost::asio::async_write(m_socket, m_writeBuffers,
+        boost::bind(&CoinNodePeer::handleWrite, shared_from_this(), boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred));
+}
+
+void CoinNodePeer::handleWrite(const boost::system::error_code& ec, std::size_t /*bytesWritten*/)
+{
+    m_bWriting = false;
+    m_writeQueue.erase(m_writeQueue.begin(), m_writeQueue.begin() + m_writeCount);
+    m_queuedBytes -= m_writeBytes;
+    m_writeCount = 0;
+    m_writeBytes = 0;
+
+    if (ec || m_bClosing) {
+        clearWriteQueue();
+        doClose(ec);
+        return;
+    }
+
+    startWrite();
+}
+
+void CoinNodePeer::clearWriteQueue()
+{
+    for (std::size_t i = 0; i < m_writeQueue.size(); i++) m_queuedBytes -= m_writeQueue[i].size();
+    m_writeQueue.clear();
+}
+
+void CoinNodePeer::askForBlock(const std::string& hash)
+{
+    InventoryItem block(MSG_BLOCK, uchar_vector(hash));
+    Inventory inv;
+    inv.addItem(block);
+    GetDataMessage getData(inv);
+    this->sendMessage(SerializedMessage(m_magic, getData));
+}
+
+void CoinNodePeer::askForBlocks(const std::vector<uchar_vector>& hashes)
+{
+    GetDataMessage getData;
+    for (std::size_t i = 0; i < hashes.size(); i++) getData.addItem(MSG_BLOCK, hashes[i]);
+    this->sendMessage(SerializedMessage(m_magic, getData));
+}
+
+void CoinNodePeer::askForTx(const std::string& hash)
+{
+    InventoryItem tx(MSG_TX, uchar_vector(hash));
+    Inventory inv;
+    inv.addItem(tx);
+    GetDataMessage getData(inv);
+    this->sendMessage(SerializedMessage(m_magic, getData));
+}
+
+void CoinNodePeer::askForPeers()
+{
+    BlankMessage getAddr("getaddr");
+    this->sendMessage(SerializedMessage(m_magic, getAddr));
+}
+
+void CoinNodePeer::askForMempool()
+{
+    BlankMessage mempool("mempool");
+    this->sendMessage(SerializedMessage(m_magic, mempool));
+}
+
+void CoinNodePeer::getHeaders(const std::vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop)
+{
+    GetHeadersMessage getHeaders(m_version, locatorHashes, hashStop);
+    this->sendMessage(SerializedMessage(m_magic, getHeaders));
+}
+
+void CoinNodePeer::getBlocks(const std::vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop)
+{
+    GetBlocksMessage getBlocks(m_version, locatorHashes, hashStop);
+    this->sendMessage(SerializedMessage(m_magic, getBlocks));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class CoinNodePeerManager implementation
+//
+CoinNodePeerManager::CoinNodePeerManager(CoinNodePeerListener* pListener, uint32_t magic, uint32_t version, unsigned int nThreads)
+    : m_pListener(pListener), m_pDispatcher(NULL), m_pInventoryCache(NULL), m_magic(magic), m_version(version), m_nThreads(nThreads), m_handshakeTimeout(5000),
+      m_sendHighWaterMark(DEFAULT_SEND_HIGH_WATER_MARK),
+      m_nextService(0), m_bRunning(false)
+{
+    if (m_nThreads == 0) m_nThreads = boost::thread::hardware_concurrency();
+    if (m_nThreads == 0) m_nThreads = 1;
+}
+
+void CoinNodePeerManager::start()
+{
+    if (m_bRunning) throw std::runtime_error("CoinNodePeerManager::start() - already running.");
+
+    m_io_services.clear();
+    m_work.clear();
+    for (unsigned int i = 0; i < m_nThreads; i++) {
+        boost::shared_ptr<boost::asio::io_service> io_service(new boost::asio::io_service());
+        m_io_services.push_back(io_service);
+        m_work.push_back(boost::shared_ptr<boost::asio::io_service::work>(new boost::asio::io_service::work(*io_service)));
+        m_threads.create_thread(boost::bind(&boost::asio::io_service::run, io_service.get()));
+    }
+    m_bRunning = true;
+
+    if (m_pInventoryCache) {
+        m_inventoryTimer.reset(new boost::asio::deadline_timer(*m_io_services[0]));
+        startInventoryTimer();
+    }
+}
+
+void CoinNodePeerManager::stop()
+{
+    if (!m_bRunning) return;
+    m_bRunning = false;
+
+    if (m_inventoryTimer) m_io_services[0]->post(boost::bind(&boost::asio::deadline_timer::cancel, m_inventoryTimer));
+
+    std::vector<CoinNodePeerPtr> peers = getPeers();
+    for (std::size_t i = 0; i < peers.size(); i++) peers[i]->close();
+
+    // once the closes have run and pending handlers are aborted, the io_services run out of work
+    m_work.clear();
+    m_threads.join_all();
+
+    m_inventoryTimer.reset();
+
+    boost::lock_guard<boost::mutex> lock(m_peerMutex);
+    m_peers.clear();
+}
+
+CoinNodePeerPtr CoinNodePeerManager::connect(const std::string& host, uint16_t port)
+{
+    if (!m_bRunning) throw std::runtime_error("CoinNodePeerManager::connect() - not running.");
+
+    CoinNodePeerPtr peer;
+    {
+        boost::lock_guard<boost::mutex> lock(m_peerMutex);
+        const boost::shared_ptr<boost::asio::io_service>& io_service = m_io_services[m_nextService++ % m_io_services.size()];
+        peer = CoinNodePeerPtr(new CoinNodePeer(this, io_service, host, port));
+        m_peers.insert(peer);
+    }
+    if (m_pInventoryCache) m_pInventoryCache->addPeer(peer.get(), boost::bind(&CoinNodePeer::requestItems, CoinNodePeerWeakPtr(peer), _1));
+    peer->m_io_service->post(boost::bind(&CoinNodePeer::start, peer));
+    return peer;
+}
+
+std::vector<CoinNodePeerPtr> CoinNodePeerManager::getPeers() const
+{
+    boost::lock_guard<boost::mutex> lock(m_peerMutex);
+    return std::vector<CoinNodePeerPtr>(m_peers.begin(), m_peers.end());
+}
+
+std::size_t CoinNodePeerManager::getPeerCount() const
+{
+    boost::lock_guard<boost::mutex> lock(m_peerMutex);
+    return m_peers.size();
+}
+
+std::size_t CoinNodePeerManager::broadcast(const SerializedMessage& message, const CoinNodePeer* pExclude)
+{
+    std::vector<CoinNodePeerPtr> peers = getPeers();
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < peers.size(); i++) {
+        if (peers[i].get() == pExclude || !peers[i]->isHandshakeComplete()) continue;
+        if (peers[i]->sendMessage(message)) count++;
+    }
+    return count;
+}
+
+void CoinNodePeerManager::onPeerClosed(CoinNodePeerPtr peer, int code)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_peerMutex);
+        m_peers.erase(peer);
+    }
+    if (m_pInventoryCache) m_pInventoryCache->request(m_pInventoryCache->removePeer(peer.get()));
+    if (m_pListener) peer->notify(boost::bind(&CoinNodePeerListener::onPeerClosed, m_pListener, peer, code));
+}
+
+bool CoinNodePeerManager::notify(const CoinNodePeer* pPeer, const MessageDispatcher::Task& task)
+{
+    if (m_pDispatcher && m_pDispatcher->isRunning()) {
+        if (m_pDispatcher->tryDispatch(pPeer, task)) return true;
+        if (m_pDispatcher->isRunning()) return false;
+    }
+    task();
+    return true;
+}
+
+void CoinNodePeerManager::startInventoryTimer()
+{
+    m_inventoryTimer->expires_from_now(boost::posix_time::milliseconds(INVENTORY_TIMER_INTERVAL));
+    m_inventoryTimer->async_wait(boost::bind(&CoinNodePeerManager::handleInventoryTimer, this, boost::asio::placeholders::error));
+}
+
+void CoinNodePeerManager::handleInventoryTimer(const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted || !m_bRunning) return;
+    m_pInventoryCache->request(m_pInventoryCache->expire());
+    startInventoryTimer();
+}
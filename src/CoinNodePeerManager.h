@@ -0,0 +1,276 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// CoinNodePeerManager.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Asynchronous connection manager. All peers share a small pool of io_services
+// (one thread each) instead of owning a socket, an io_service and a blocking
+// read thread apiece like CoinNodeSocket does.
+
+#ifndef _COIN_NODE_PEER_MANAGER_H__
+#define _COIN_NODE_PEER_MANAGER_H__
+
+#include "CoinNodeData.h"
+#include "MessageFrameBuffer.h"
+#include "SerializedMessage.h"
+#include "MessageDispatcher.h"
+#include "InventoryCache.h"
+
+#include <string>
+#include <deque>
+#include <set>
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/atomic.hpp>
+
+#define DEFAULT_SEND_HIGH_WATER_MARK    0x00800000 // 8 MB queued per peer
+#define MAX_WRITE_BATCH_BYTES           0x00040000 // coalesce queued messages into writes of up to 256 KB...
+#define MAX_WRITE_BATCH_MESSAGES        32         // ...and at most this many messages (two buffers each)
+#define INVENTORY_TIMER_INTERVAL        1000       // milliseconds between checks for overdue getdata requests
+#define DISPATCH_RETRY_INTERVAL         10         // milliseconds a peer's reads stay paused while the dispatcher is full
+
+namespace Coin
+{
+
+class CoinNodePeer;
+class CoinNodePeerManager;
+
+typedef boost::shared_ptr<CoinNodePeer> CoinNodePeerPtr;
+typedef boost::weak_ptr<CoinNodePeer> CoinNodePeerWeakPtr;
+typedef boost::shared_ptr<CoinNodeMessage> CoinNodeMessagePtr;
+
+// Implement the following methods in a derived subclass. All callbacks for a given
+// peer are invoked from the io_service thread that peer is bound to - or, if the
+// manager has a dispatcher, from a dispatcher worker in ordered mode - so callbacks
+// for the same peer never run concurrently.
+class CoinNodePeerListener
+{
+public:
+    virtual ~CoinNodePeerListener() { }
+
+    virtual void onPeerConnected(CoinNodePeerPtr /*peer*/) { } // handshake complete
+    virtual void onPeerClosed(CoinNodePeerPtr /*peer*/, int /*code*/) { }
+
+    virtual void onBlock(CoinNodePeerPtr /*peer*/, CoinBlock& /*block*/) { }
+    virtual void onTx(CoinNodePeerPtr /*peer*/, Transaction& /*tx*/) { }
+    virtual void onAddr(CoinNodePeerPtr /*peer*/, AddrMessage& /*addr*/) { }
+    virtual void onHeaders(CoinNodePeerPtr /*peer*/, HeadersMessage& /*headers*/) { }
+
+    // Called for any other command, including ones added with CommandTable::registerCommand().
+    virtual void onMessage(CoinNodePeerPtr /*peer*/, int /*commandType*/, const CoinNodeMessage& /*message*/) { }
+};
+
+class CoinNodePeer : public boost::enable_shared_from_this<CoinNodePeer>
+{
+public:
+    ~CoinNodePeer();
+
+    const std::string& getHost() const { return m_host; }
+    uint16_t getPort() const { return m_port; }
+    std::string getName() const;
+
+    bool isOpen() const { return m_bOpen; }
+    bool isHandshakeComplete() const { return m_bHandshakeComplete; }
+
+    // Thread-safe. Messages are serialized by the caller and queued on the peer's io_service.
+    // Returns false, dropping the message, if the peer already has more than the manager's
+    // send high-water mark queued.
+    bool sendMessage(const CoinNodeMessage& message);
+    bool sendMessage(const SerializedMessage& message) { return sendBuffers(message.getHeader(), message.getPayload()); }
+
+    // Thread-safe. Queues a serialized header and payload as-is - the buffers may be shared with other peers.
+    bool sendBuffers(const SharedBuffer& header, const SharedBuffer& payload);
+
+    // Bytes queued but not yet written to the socket.
+    std::size_t getQueuedBytes() const { return m_queuedBytes; }
+
+    // Thread-safe. Closing is asynchronous - onPeerClosed is called once the socket is gone.
+    void close();
+
+    void askForBlock(const std::string& hash);
+    void askForBlocks(const std::vector<uchar_vector>& hashes); // one getdata for all of them
+    void askForTx(const std::string& hash);
+    void askForPeers();
+    void askForMempool();
+    void getHeaders(const std::vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop = g_zero32bytes);
+    void getBlocks(const std::vector<uchar_vector>& locatorHashes, const uchar_vector& hashStop = g_zero32bytes);
+
+private:
+    friend class CoinNodePeerManager;
+
+    typedef boost::asio::ip::tcp tcp;
+
+    CoinNodePeer(CoinNodePeerManager* pManager, const boost::shared_ptr<boost::asio::io_service>& io_service, const std::string& host, uint16_t port);
+
+    void start();
+    void doClose(const boost::system::error_code& ec);
+
+    void handleResolve(const boost::system::error_code& ec, tcp::resolver::iterator it);
+    void handleConnect(const boost::system::error_code& ec);
+    void handleHandshakeTimeout(const boost::system::error_code& ec);
+
+    void startRead();
+    void handleRead(const boost::system::error_code& ec, std::size_t bytesRead);
+    void readFrames();
+    void notify(const MessageDispatcher::Task& task);
+    void startDispatchTimer();
+    void handleDispatchRetry(const boost::system::error_code& ec);
+    void markReceived(int type, const unsigned char* payload, uint32_t length);
+    static void requestItems(CoinNodePeerWeakPtr peer, const std::vector<InventoryItem>& items);
+    void processMessage(const CoinNodeMessagePtr& message);
+    static void deliverMessage(CoinNodePeerListener* pListener, CoinNodePeerPtr peer, int type, CoinNodeMessagePtr message);
+
+    struct OutboundMessage
+    {
+        SharedBuffer header;
+        SharedBuffer payload;
+
+        std::size_t size() const { return header->size() + payload->size(); }
+    };
+
+    void queueMessage(const SerializedMessage& message, bool bFront = false);
+    void queueWrite(const OutboundMessage& message);
+    void startWrite();
+    void clearWriteQueue();
+    void handleWrite(const boost::system::error_code& ec, std::size_t bytesWritten);
+
+    // The manager is only used from the io_service thread, which it joins before going away. Anything
+    // the public methods need is copied, so a peer can safely be held on to after its manager is destroyed.
+    CoinNodePeerManager* m_pManager;
+    uint32_t m_magic;
+    uint32_t m_version;
+    std::size_t m_sendHighWaterMark;
+
+    // Shared so that the socket and timers below never outlive it
+    boost::shared_ptr<boost::asio::io_service> m_io_service;
+    tcp::resolver m_resolver;
+    tcp::socket m_socket;
+    boost::asio::deadline_timer m_handshakeTimer;
+
+    std::string m_host;
+    uint16_t m_port;
+
+    // Written on the io_service thread, read from any thread
+    boost::atomic<bool> m_bOpen;
+    boost::atomic<bool> m_bClosing;
+    boost::atomic<bool> m_bHandshakeComplete;
+
+    MessageFrameBuffer m_frameBuffer;
+
+    // Listener callbacks the dispatcher had no room for, oldest first. Reading stops until they're queued.
+    std::deque<MessageDispatcher::Task> m_blockedTasks;
+    boost::asio::deadline_timer m_dispatchTimer;
+
+    // Write queue - only touched from the io_service thread
+    std::deque<OutboundMessage> m_writeQueue;
+    std::vector<boost::asio::const_buffer> m_writeBuffers;
+    std::size_t m_writeCount;
+    std::size_t m_writeBytes;
+    bool m_bWriting;
+    boost::atomic<std::size_t> m_queuedBytes;
+};
+
+class CoinNodePeerManager
+{
+public:
+    // nThreads = 0 uses one io_service per hardware thread.
+    CoinNodePeerManager(CoinNodePeerListener* pListener, uint32_t magic, uint32_t version, unsigned int nThreads = 0);
+    ~CoinNodePeerManager() { this->stop(); }
+
+    uint32_t getMagic() const { return m_magic; }
+    uint32_t getVersion() const { return m_version; }
+    CoinNodePeerListener* getListener() const { return m_pListener; }
+
+    // Listener callbacks run on the dispatcher's workers instead of the io_service threads, keyed by peer.
+    // Set before start(). The dispatcher must outlive the manager's peers.
+    void setDispatcher(MessageDispatcher* pDispatcher) { m_pDispatcher = pDispatcher; }
+    MessageDispatcher* getDispatcher() const { return m_pDispatcher; }
+
+    // Announced items are only requested if the cache hasn't seen them and no other peer is already
+    // fetching them. Items a peer doesn't deliver in time are requested from another peer that announced
+    // them. Set before start(). The cache may be shared with other managers and listeners.
+    void setInventoryCache(InventoryCache* pInventoryCache) { m_pInventoryCache = pInventoryCache; }
+    InventoryCache* getInventoryCache() const { return m_pInventoryCache; }
+
+    // milliseconds to wait for a verack before giving up on a peer
+    void setHandshakeTimeout(unsigned int timeout) { m_handshakeTimeout = timeout; }
+    unsigned int getHandshakeTimeout() const { return m_handshakeTimeout; }
+
+    // bytes a peer may have queued before further sends to it are refused - applies to peers connected afterwards
+    void setSendHighWaterMark(std::size_t bytes) { m_sendHighWaterMark = bytes; }
+    std::size_t getSendHighWaterMark() const { return m_sendHighWaterMark; }
+
+    void start();
+    void stop();
+    bool isRunning() const { return m_bRunning; }
+
+    // Starts connecting asynchronously. onPeerConnected is called after the handshake.
+    CoinNodePeerPtr connect(const std::string& host, uint16_t port);
+
+    std::vector<CoinNodePeerPtr> getPeers() const;
+    std::size_t getPeerCount() const;
+
+    // Queues the same serialized buffers on every peer that has completed its handshake, except pExclude
+    // (typically the peer the message came from). Returns the number of peers that accepted the message.
+    std::size_t broadcast(const SerializedMessage& message, const CoinNodePeer* pExclude = NULL);
+    std::size_t broadcast(const CoinNodeStructure& payload, const CoinNodePeer* pExclude = NULL)
+        { return broadcast(SerializedMessage(m_magic, payload), pExclude); }
+
+private:
+    friend class CoinNodePeer;
+
+    void onPeerClosed(CoinNodePeerPtr peer, int code);
+
+    void startInventoryTimer();
+    void handleInventoryTimer(const boost::system::error_code& ec);
+
+    // Runs task on the dispatcher if there is one, otherwise right away. Returns false, without running
+    // the task, if the peer's dispatcher queue is full - it must never block an io_service thread.
+    bool notify(const CoinNodePeer* pPeer, const MessageDispatcher::Task& task);
+
+    CoinNodePeerListener* m_pListener;
+    MessageDispatcher* m_pDispatcher;
+    InventoryCache* m_pInventoryCache;
+    uint32_t m_magic;
+    uint32_t m_version;
+    unsigned int m_nThreads;
+    unsigned int m_handshakeTimeout;
+    std::size_t m_sendHighWaterMark;
+
+    std::vector<boost::shared_ptr<boost::asio::io_service> > m_io_services;
+    std::vector<boost::shared_ptr<boost::asio::io_service::work> > m_work;
+    boost::thread_group m_threads;
+    boost::shared_ptr<boost::asio::deadline_timer> m_inventoryTimer;
+    unsigned int m_nextService;
+    boost::atomic<bool> m_bRunning;
+
+    mutable boost::mutex m_peerMutex;
+    std::set<CoinNodePeerPtr> m_peers;
+};
+
+}; // namespace Coin
+
+#endif // _COIN_NODE_PEER_MANAGER_H__
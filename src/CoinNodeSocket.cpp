@@ -26,6 +26,7 @@
 #define __SHOW_EXCEPTIONS__
 
 #include <CoinNodeSocket.h>
+#include <MessageFrameBuffer.h>
 #include <numericdata.h>
 
 #include <stdio.h>
@@ -37,10 +38,9 @@
 #include <stdexcept>
 
 #include <boost/thread/locks.hpp>
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
 
-#define SOCKET_BUFFER_SIZE 1024
-#define MESSAGE_HEADER_SIZE 20
-#define COMMAND_SIZE 12
 
 using namespace Coin;
 using namespace std;
@@ -59,13 +59,19 @@ public:
 int _recv(boost::asio::ip::tcp::socket* pSocket, unsigned char* buf, size_t len, int flags)
 {
     boost::system::error_code ec;
-    int bytesRecv = boost::asio::read(*pSocket, boost::asio::buffer(buf, len), boost::asio::transfer_at_least(24), ec);
+    int bytesRecv = pSocket->read_some(boost::asio::buffer(buf, len), ec);
     if (ec) {
         throw recv_exception(ec.message(), ec.value());
     }
     return bytesRecv;
 }
 
+void dispatchedMessageHandler(CoinMessageHandler handler, CoinNodeSocket* pNodeSocket, CoinNodeAbstractListener* pListener,
+                              boost::shared_ptr<CoinNodeMessage> pMessage)
+{
+    handler(pNodeSocket, pListener, *pMessage);
+}
+
 void CoinNodeSocket::messageLoop()
 {
     try {
@@ -73,80 +79,49 @@ void CoinNodeSocket::messageLoop()
         fprintf(stdout, "Starting message loop.\n\n");
 #endif
         CoinNodeSocket* pNodeSocket = this;
-        uchar_vector message;
-        uchar_vector magicBytes = uint_to_vch(magic, _BIG_ENDIAN);
-#ifdef __DEBUG_OUT__
-        fprintf(stdout, "Magic Bytes: %s\n", magicBytes.getHex().c_str());
-#endif
-        unsigned char command[12];
-        uchar_vector payload;
-        uint payloadLength = 0;
-        uchar_vector checksum;
-        uint checksumLength = 0;
-        unsigned char receivedData[SOCKET_BUFFER_SIZE];
-        uint bytesBuffered = 0;
+        MessageFrameBuffer frameBuffer(magic);
         while (!bDisconnect) {
-            try {  
-                // Find magic bytes. all magic bytes must exist in a single frame to be recognized.
-                uchar_vector::iterator it;
-                while ((it = search(message.begin(), message.end(), magicBytes.begin(), magicBytes.end())) == message.end()) {
-                    bytesBuffered = _recv(pSocket, receivedData, SOCKET_BUFFER_SIZE, 0);
-                    message = uchar_vector(receivedData, bytesBuffered);
-                }
-                message.assign(it, message.end()); // remove everything before magic bytes
-
-                // get rest of header
-                while (message.size() < MIN_MESSAGE_HEADER_SIZE) {
-                    bytesBuffered = _recv(pSocket, receivedData, SOCKET_BUFFER_SIZE, 0);
-                    message += uchar_vector(receivedData, bytesBuffered);
-                }
-                // get command
-                uchar_vector(message.begin() + 4, message.begin() + 16).copyToArray(command);
-
-                // get payload length
-                payloadLength = vch_to_uint<uint32_t>(uchar_vector(message.begin() + 16, message.begin() + 20), _BIG_ENDIAN);
-
-                // version and verack messages have no checksum - as of Feb 20, 2012, version messages do have a checksum
-                /*checksumLength = ((strcmp((char*)command, "version") == 0) ||
-                                    (strcmp((char*)command, "verack") == 0)) ? 0 : 4;*/
-                // VERSION_CHECKSUM_CHANGE
-                checksumLength = (strcmp((char*)command, "verack") == 0) ? 0 : 4;
-
-                // get checksum and payload
-                while (message.size() < MIN_MESSAGE_HEADER_SIZE + checksumLength + payloadLength) {
-                    bytesBuffered = _recv(pSocket, receivedData, SOCKET_BUFFER_SIZE, 0);
-                    message += uchar_vector(receivedData, bytesBuffered);
-                }
-
-                CoinNodeMessage nodeMessage(message);
-
-#ifdef __DEBUG_OUT__
-                if (bytesBuffered > message.size())
-                    fprintf(stdout, "Received extra bytes. Buffer dump:\n%s\n", uchar_vector(receivedData, bytesBuffered).getHex().c_str());
-#endif
-
-                if (nodeMessage.isChecksumValid()) {
-                    // if it's a verack, signal the completion of the handshake
-                    if (string((char*)command) == "verack") {
-                        if (!bHandshakeComplete) {
-                            boost::unique_lock<boost::mutex> lock(handshakeMutex);
-                            bHandshakeComplete = true;
-                            lock.unlock();
-                            handshakeCond.notify_all();
-                        } 
-                        //pthread_cond_signal(&pNodeSocket->m_handshakeComplete);
+            try {
+                // Reads go directly into the frame buffer - large messages arrive in a few big chunks.
+                uint bytesBuffered = _recv(pSocket, frameBuffer.prepare(), frameBuffer.writable(), 0);
+                frameBuffer.commit(bytesBuffered);
+
+                // A bad frame header is skipped by nextFrame() when it throws, so keep draining what's buffered.
+                while (true) {
+                    try {
+                        if (!frameBuffer.nextFrame()) break;
+                        if (!frameBuffer.isChecksumValid())
+                            throw runtime_error("Checksum does not match payload for message of type.");
+
+                        // if it's a verack, signal the completion of the handshake
+                        if (frameBuffer.getHeader().getCommandType() == COMMAND_VERACK) {
+                            if (!bHandshakeComplete) {
+                                boost::unique_lock<boost::mutex> lock(handshakeMutex);
+                                bHandshakeComplete = true;
+                                lock.unlock();
+                                handshakeCond.notify_all();
+                            }
+                        }
+
+                        // send the message to callback function. This thread only reads from this socket, so waiting
+                        // for room on the dispatcher simply stops reading until the handlers catch up.
+                        if (coinMessageHandler && pDispatcher) {
+                            boost::shared_ptr<CoinNodeMessage> pMessage(new CoinNodeMessage(frameBuffer.getHeader(), frameBuffer.getPayload()));
+                            if (!pDispatcher->dispatch(this, boost::bind(&dispatchedMessageHandler, coinMessageHandler, this, pListener, pMessage)))
+                                coinMessageHandler(this, pListener, *pMessage); // dispatcher stopped
+                        }
+                        else if (coinMessageHandler) {
+                            CoinNodeMessage nodeMessage(frameBuffer.getHeader(), frameBuffer.getPayload());
+                            coinMessageHandler(this, pListener, nodeMessage);
+                        }
                     }
-
-                    // send the message to callback function.
-                    if (coinMessageHandler) {
-                        coinMessageHandler(this, pListener, nodeMessage);
+                    catch (const exception& e) {
+#ifdef __SHOW_EXCEPTIONS__
+                        fprintf(stdout, "Exception: %s\n", e.what());
+#endif
                     }
+                    frameBuffer.consume();
                 }
-                else
-                    throw runtime_error("Checksum does not match payload for message of type.");
-
-                // shift message frame over
-                message.assign(message.begin() + MESSAGE_HEADER_SIZE + checksumLength + payloadLength, message.end());
             }
             catch (const recv_exception& e)
             {
@@ -158,7 +133,6 @@ void CoinNodeSocket::messageLoop()
                 return;
             }
             catch (const exception& e) {
-                message.assign(message.begin() + MESSAGE_HEADER_SIZE + checksumLength + payloadLength, message.end());
 #ifdef __SHOW_EXCEPTIONS__
                 fprintf(stdout, "Exception: %s\n", e.what());
 #endif
@@ -254,17 +228,23 @@ void CoinNodeSocket::waitOnHandshakeComplete()
 
 void CoinNodeSocket::sendMessage(const CoinNodeMessage& message)
 {
-    boost::lock_guard<boost::mutex> lock(connectionMutex);
-    if (!pSocket) throw runtime_error("Socket is not open.");
- 
-    std::vector<unsigned char> rawData = message.getSerialized();
-
 #ifdef __DEBUG_OUT__
     fprintf(stdout, "Sending message: %s\n", message.toString().c_str());
-    fprintf(stdout, "Raw data:\n%s\n", uchar_vector(rawData).getHex().c_str());
 #endif
 
-    std::vector<uint8_t> buffer = rawData;
-    boost::asio::write(*pSocket, boost::asio::buffer(rawData));
+    // Serialize before taking the lock so other senders aren't held up by it.
+    this->sendMessage(SerializedMessage(message));
 }
 
+void CoinNodeSocket::sendMessage(const SerializedMessage& message)
+{
+#ifdef __DEBUG_OUT__
+    fprintf(stdout, "Raw data:\n%s\n", message.getSerialized().getHex().c_str());
+#endif
+
+    boost::array<boost::asio::const_buffer, 2> buffers = {{ boost::asio::buffer(*message.getHeader()), boost::asio::buffer(*message.getPayload()) }};
+
+    boost::lock_guard<boost::mutex> lock(connectionMutex);
+    if (!pSocket) throw runtime_error("Socket is not open.");
+    boost::asio::write(*pSocket, buffers);
+}
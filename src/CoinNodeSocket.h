@@ -9,6 +9,8 @@
 #define COINNODESOCKET_H__
 
 #include "CoinNodeData.h"
+#include "SerializedMessage.h"
+#include "MessageDispatcher.h"
 
 #include <string>
 #include <iostream>
@@ -58,11 +60,18 @@ private:
     // Listener for callbacks
     CoinNodeAbstractListener* pListener;
 
+    // Runs coinMessageHandler off the read thread when set
+    MessageDispatcher* pDispatcher;
+
 public:
-    CoinNodeSocket() : pSocket(NULL) { }
+    CoinNodeSocket() : pSocket(NULL), pListener(NULL), pDispatcher(NULL) { }
     ~CoinNodeSocket() { this->close(); }
 
     void setListener(CoinNodeAbstractListener* _pListener) { pListener = _pListener; }
+
+    // Messages are handed to the dispatcher's workers, in order per socket, instead of being handled on
+    // the read thread. Set before open(). The dispatcher must be stopped before the socket is destroyed.
+    void setDispatcher(MessageDispatcher* _pDispatcher) { pDispatcher = _pDispatcher; }
     uint32_t getMagic() const { return magic; }
     SocketClosedHandler getSocketClosedHandler() const { return socketClosedHandler; }
 
@@ -85,6 +94,7 @@ public:
 
     void sendMessage(unsigned char* command, const std::vector<unsigned char>& payload);
     void sendMessage(const Coin::CoinNodeMessage& pMessage);
+    void sendMessage(const Coin::SerializedMessage& message); // buffers can be shared by many sockets
 
     const tcp::endpoint& getEndpoint() const { return endpoint; }
 };
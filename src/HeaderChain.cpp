@@ -0,0 +1,233 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// HeaderChain.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "HeaderChain.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace Coin;
+
+namespace
+{
+    inline uint32_t slotPosition(uint32_t fingerprint) { return fingerprint * 0x9e3779b1; }
+}
+
+const uint32_t HeaderChain::NO_INDEX;
+
+HeaderChain::HeaderChain(const CoinBlockHeader& genesis)
+    : m_tableMask(0), m_best(0)
+{
+    m_table.resize(1024);
+    m_tableMask = m_table.size() - 1;
+    for (std::size_t i = 0; i < m_table.size(); i++) m_table[i].index = NO_INDEX;
+
+    uchar_vector bytes = genesis.getSerialized();
+    m_headers.assign(bytes.begin(), bytes.end());
+    m_parents.push_back(NO_INDEX);
+    m_heights.push_back(0);
+    m_skips.push_back(NO_INDEX);
+    m_chainWork.push_back(genesis.getWork256());
+
+    unsigned char hash[32];
+    sha256_2(&m_headers[0], 80, hash);
+    insertSlot(0, getFingerprint(hash));
+    memcpy(m_lastHash, hash, 32);
+    m_lastIndex = 0;
+}
+
+void HeaderChain::reserve(std::size_t nHeaders)
+{
+    m_headers.reserve(80 * nHeaders);
+    m_parents.reserve(nHeaders);
+    m_heights.reserve(nHeaders);
+    m_skips.reserve(nHeaders);
+    m_chainWork.reserve(nHeaders);
+    while (m_table.size() < 2 * nHeaders) growTable();
+}
+
+uint32_t HeaderChain::add(const CoinBlockHeader& header)
+{
+    uchar_vector bytes = header.getSerialized();
+    return add(&bytes[0]);
+}
+
+uint32_t HeaderChain::add(const unsigned char* header)
+{
+    unsigned char hash[32];
+    sha256_2(header, 80, hash);
+    return add(header, hash);
+}
+
+uint32_t HeaderChain::add(const unsigned char* header, const unsigned char* hash)
+{
+    uint32_t index = findRaw(hash);
+    if (index != NO_INDEX) return index;
+
+    // headers usually arrive in order - don't look up the one we just added
+    uint32_t parent = (memcmp(header + 4, m_lastHash, 32) == 0) ? m_lastIndex : findRaw(header + 4);
+    if (parent == NO_INDEX)
+        throw std::runtime_error("HeaderChain::add() - parent header not found.");
+
+    uint32_t bits = (uint32_t)header[72] | ((uint32_t)header[73] << 8) | ((uint32_t)header[74] << 16) | ((uint32_t)header[75] << 24);
+    if (!checkProofOfWork(hash, bits))
+        throw std::runtime_error("HeaderChain::add() - insufficient proof of work.");
+
+    index = m_parents.size();
+    if (index == NO_INDEX)
+        throw std::runtime_error("HeaderChain::add() - chain is full.");
+
+    uint256 chainWork = m_chainWork[parent] + getWork(bits);
+
+    uint32_t height = m_heights[parent] + 1;
+    m_headers.insert(m_headers.end(), header, header + 80);
+    m_parents.push_back(parent);
+    m_heights.push_back(height);
+    m_skips.push_back(getAncestor(parent, getSkipHeight(height)));
+    m_chainWork.push_back(chainWork);
+
+    if (2 * (index + 1) > m_table.size()) growTable();
+    insertSlot(index, getFingerprint(hash));
+
+    if (m_chainWork[m_best] < chainWork) m_best = index;
+    memcpy(m_lastHash, hash, 32);
+    m_lastIndex = index;
+    return index;
+}
+
+uint32_t HeaderChain::find(const uchar_vector& hash) const
+{
+    if (hash.size() != 32) return NO_INDEX;
+    uchar_vector rawHash(hash.rbegin(), hash.rend());
+    return findRaw(&rawHash[0]);
+}
+
+uint32_t HeaderChain::findRaw(const unsigned char* hash) const
+{
+    uint32_t fingerprint = getFingerprint(hash);
+    for (std::size_t pos = slotPosition(fingerprint) & m_tableMask; m_table[pos].index != NO_INDEX; pos = (pos + 1) & m_tableMask) {
+        if (m_table[pos].fingerprint != fingerprint) continue;
+
+        unsigned char candidate[32];
+        sha256_2(getRawHeader(m_table[pos].index), 80, candidate);
+        if (memcmp(candidate, hash, 32) == 0) return m_table[pos].index;
+    }
+    return NO_INDEX;
+}
+
+void HeaderChain::insertSlot(uint32_t index, uint32_t fingerprint)
+{
+    std::size_t pos = slotPosition(fingerprint) & m_tableMask;
+    while (m_table[pos].index != NO_INDEX) pos = (pos + 1) & m_tableMask;
+    m_table[pos].index = index;
+    m_table[pos].fingerprint = fingerprint;
+}
+
+void HeaderChain::growTable()
+{
+    std::vector<Slot> oldTable;
+    oldTable.swap(m_table);
+
+    Slot empty;
+    empty.index = NO_INDEX;
+    empty.fingerprint = 0;
+    m_table.assign(2 * oldTable.size(), empty);
+    m_tableMask = m_table.size() - 1;
+
+    // positions only depend on the fingerprint, so nothing has to be rehashed
+    for (std::size_t i = 0; i < oldTable.size(); i++) {
+        if (oldTable[i].index != NO_INDEX) insertSlot(oldTable[i].index, oldTable[i].fingerprint);
+    }
+}
+
+uchar_vector HeaderChain::getHash(uint32_t index) const
+{
+    unsigned char hash[32];
+    sha256_2(getRawHeader(index), 80, hash);
+    return uchar_vector(hash, hash + 32).getReverse();
+}
+
+// Same skip heights as bitcoind: any ancestor is reachable in O(log n) steps.
+uint32_t HeaderChain::getSkipHeight(uint32_t height)
+{
+    if (height < 2) return 0;
+    uint32_t n = height - 1;
+    return (height & 1) ? ((n & (n - 1)) & ((n & (n - 1)) - 1)) + 1 : (height & (height - 1));
+}
+
+uint32_t HeaderChain::getAncestor(uint32_t index, uint32_t height) const
+{
+    if (height > m_heights[index]) return NO_INDEX;
+
+    while (m_heights[index] > height) {
+        uint32_t skip = m_skips[index];
+        if (skip != NO_INDEX) {
+            int64_t skipHeight = m_heights[skip];
+            int64_t skipPrevHeight = getSkipHeight(m_heights[index] - 1);
+            // take the skip unless the parent's skip gets us closer without overshooting
+            if (skipHeight == height ||
+                (skipHeight > height && !(skipPrevHeight < skipHeight - 2 && skipPrevHeight >= height))) {
+                index = skip;
+                continue;
+            }
+        }
+        index = m_parents[index];
+    }
+    return index;
+}
+
+uint32_t HeaderChain::getForkPoint(uint32_t a, uint32_t b) const
+{
+    if (m_heights[a] > m_heights[b])
+        a = getAncestor(a, m_heights[b]);
+    else
+        b = getAncestor(b, m_heights[a]);
+
+    while (a != b) {
+        // step both by skip pointers while they still differ there
+        if (m_skips[a] != m_skips[b] && m_skips[a] != NO_INDEX && m_skips[b] != NO_INDEX) {
+            a = m_skips[a];
+            b = m_skips[b];
+        }
+        else {
+            a = m_parents[a];
+            b = m_parents[b];
+        }
+    }
+    return a;
+}
+
+std::vector<uchar_vector> HeaderChain::getLocator(uint32_t index) const
+{
+    std::vector<uchar_vector> locator;
+    uint32_t step = 1;
+    while (true) {
+        locator.push_back(getHash(index));
+        uint32_t height = m_heights[index];
+        if (height == 0) break;
+        if (locator.size() >= 10) step *= 2;
+        index = getAncestor(index, height > step ? height - step : 0);
+    }
+    return locator;
+}
@@ -0,0 +1,122 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// HeaderChain.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Compact block header index. Headers are kept as one contiguous array of 80-byte
+// serialized headers, with parallel arrays of parent index, height, skip-list pointer
+// and cumulative work - about 124 bytes per header. Hashes aren't stored: the lookup
+// table keeps a 32-bit fingerprint per entry and a match is confirmed by hashing the
+// stored header, so a million headers take roughly 140 MB.
+//
+// Headers may arrive on any branch. The best tip is the one with the most cumulative
+// work. Ancestor lookups follow skip pointers and take O(log n) steps.
+//
+// Not thread-safe - callers sharing a chain must lock around it.
+
+#ifndef _HEADER_CHAIN_H__
+#define _HEADER_CHAIN_H__
+
+#include "CoinNodeData.h"
+
+#include <vector>
+
+namespace Coin
+{
+
+class HeaderChain
+{
+public:
+    static const uint32_t NO_INDEX = 0xffffffff;
+
+    explicit HeaderChain(const CoinBlockHeader& genesis);
+
+    // Preallocates room for nHeaders so the arrays don't have to be copied as they grow.
+    void reserve(std::size_t nHeaders);
+
+    // Returns the new header's index, or the existing index if it's already known.
+    // Throws if the parent is unknown or the hash doesn't meet the header's target.
+    uint32_t add(const CoinBlockHeader& header);
+    uint32_t add(const unsigned char* header); // 80 serialized bytes
+    uint32_t add(const unsigned char* header, const unsigned char* hash); // hash already computed, as a raw digest
+
+    // Hashes in the same byte order as CoinBlockHeader::getHashLittleEndian(). Returns NO_INDEX if unknown.
+    uint32_t find(const uchar_vector& hash) const;
+    bool contains(const uchar_vector& hash) const { return find(hash) != NO_INDEX; }
+
+    std::size_t size() const { return m_parents.size(); }
+
+    uint32_t getBestIndex() const { return m_best; }
+    uint32_t getBestHeight() const { return m_heights[m_best]; }
+
+    uint32_t getParent(uint32_t index) const { return m_parents[index]; }
+    uint32_t getHeight(uint32_t index) const { return m_heights[index]; }
+    uchar_vector getHash(uint32_t index) const;
+    CoinBlockHeader getHeader(uint32_t index) const { return CoinBlockHeader(uchar_vector(getRawHeader(index), getRawHeader(index) + 80)); }
+    const unsigned char* getRawHeader(uint32_t index) const { return &m_headers[80 * (std::size_t)index]; }
+    const uint256& getChainWork(uint32_t index) const { return m_chainWork[index]; }
+
+    // The ancestor of index at the given height, or NO_INDEX if height is above it.
+    uint32_t getAncestor(uint32_t index, uint32_t height) const;
+
+    // The last header two branches have in common. If the best tip moves from oldBest to newBest and
+    // getForkPoint(oldBest, newBest) != oldBest, the headers above the fork point were reorganized out.
+    uint32_t getForkPoint(uint32_t a, uint32_t b) const;
+
+    bool isInBestChain(uint32_t index) const { return getAncestor(m_best, m_heights[index]) == index; }
+
+    // Hashes suitable for getheaders or getblocks: the last ten headers, then exponentially sparser, ending at genesis.
+    std::vector<uchar_vector> getLocator(uint32_t index) const;
+    std::vector<uchar_vector> getLocator() const { return getLocator(m_best); }
+
+private:
+    struct Slot
+    {
+        uint32_t index;
+        uint32_t fingerprint;
+    };
+
+    static uint32_t getFingerprint(const unsigned char* hash) { uint32_t fp; memcpy(&fp, hash, 4); return fp; }
+    static uint32_t getSkipHeight(uint32_t height);
+
+    uint32_t findRaw(const unsigned char* hash) const; // hash in wire byte order
+    void insertSlot(uint32_t index, uint32_t fingerprint);
+    void growTable();
+
+    std::vector<unsigned char> m_headers;
+    std::vector<uint32_t> m_parents;
+    std::vector<uint32_t> m_heights;
+    std::vector<uint32_t> m_skips;
+    std::vector<uint256> m_chainWork;
+
+    std::vector<Slot> m_table;      // open addressing, linear probing
+    std::size_t m_tableMask;
+
+    uint32_t m_best;
+
+    unsigned char m_lastHash[32];   // last header added, in wire byte order
+    uint32_t m_lastIndex;
+};
+
+}; // namespace Coin
+
+#endif // _HEADER_CHAIN_H__
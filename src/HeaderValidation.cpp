@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// HeaderValidation.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "HeaderValidation.h"
+#include "sha256multi.h"
+#include "uint256.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+using namespace Coin;
+
+namespace
+{
+    inline void writeLE32(unsigned char* p, uint32_t x) { p[0] = x; p[1] = x >> 8; p[2] = x >> 16; p[3] = x >> 24; }
+    inline uint32_t readLE32(const unsigned char* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+    // Hashes headers [begin, end) and records the first one failing proof of work, if any, as the chunk's result.
+    void hashAndCheck(const unsigned char* data, std::size_t stride, unsigned char* hashes, std::vector<std::size_t>* pFirstInvalid,
+                      std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        sha256_2_80(data + stride * begin, stride, end - begin, hashes + 32 * begin);
+
+        for (std::size_t i = begin; i < end; i++) {
+            if (!checkProofOfWork(hashes + 32 * i, readLE32(data + stride * i + 72))) {
+                (*pFirstInvalid)[chunk] = i;
+                return;
+            }
+        }
+    }
+}
+
+void Coin::serializeHeader(const CoinBlockHeader& header, unsigned char* out)
+{
+    memset(out, 0, 80);
+    writeLE32(out, header.version);
+    std::size_t prevSize = std::min<std::size_t>(header.prevBlockHash.size(), 32);
+    std::reverse_copy(header.prevBlockHash.begin(), header.prevBlockHash.begin() + prevSize, out + 4 + 32 - prevSize);
+    std::size_t merkleSize = std::min<std::size_t>(header.merkleRoot.size(), 32);
+    std::reverse_copy(header.merkleRoot.begin(), header.merkleRoot.begin() + merkleSize, out + 36 + 32 - merkleSize);
+    writeLE32(out + 68, header.timestamp);
+    writeLE32(out + 72, header.bits);
+    writeLE32(out + 76, header.nonce);
+}
+
+int Coin::validateHeaders(const unsigned char* data, std::size_t stride, std::size_t count, const unsigned char* prevHash,
+                          unsigned char* hashes, unsigned int nThreads)
+{
+    if (count == 0) return -1;
+
+    std::size_t nChunks = getChunkCount(count, MIN_HEADERS_PER_THREAD, nThreads);
+    std::vector<std::size_t> firstInvalid(nChunks, count);
+    parallelFor(count, nChunks, boost::bind(&hashAndCheck, data, stride, hashes, &firstInvalid, _1, _2, _3));
+    std::size_t result = *std::min_element(firstInvalid.begin(), firstInvalid.end());
+
+    // linkage only needs checking up to the first proof-of-work failure
+    if (prevHash && memcmp(data + 4, prevHash, 32) != 0) return 0;
+    for (std::size_t i = 1; i < result; i++) {
+        if (memcmp(data + stride * i + 4, hashes + 32 * (i - 1), 32) != 0) return (int)i;
+    }
+
+    return (result == count) ? -1 : (int)result;
+}
+
+int Coin::validateHeaders(const HeadersMessage& headers, const uchar_vector& prevBlockHash, std::vector<uchar_vector>* pHashes,
+                          unsigned int nThreads)
+{
+    std::size_t count = headers.headers.size();
+    if (count == 0) {
+        if (pHashes) pHashes->clear();
+        return -1;
+    }
+
+    std::vector<unsigned char> data(80 * count);
+    for (std::size_t i = 0; i < count; i++) serializeHeader(headers.headers[i], &data[80 * i]);
+
+    uchar_vector prevHash;
+    if (!prevBlockHash.empty()) prevHash = uchar_vector(prevBlockHash.rbegin(), prevBlockHash.rend());
+
+    std::vector<unsigned char> hashes(32 * count);
+    int result = validateHeaders(&data[0], 80, count, prevHash.empty() ? NULL : &prevHash[0], &hashes[0], nThreads);
+
+    if (pHashes) {
+        pHashes->resize(count);
+        for (std::size_t i = 0; i < count; i++)
+            (*pHashes)[i] = uchar_vector(hashes.rend() - 32 * (i + 1), hashes.rend() - 32 * i);
+    }
+    return result;
+}
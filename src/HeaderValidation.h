@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// HeaderValidation.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Batch validation of block headers, such as the up to 2000 in a headers message.
+// The headers are hashed with the multi-buffer SHA-256 kernel, each hash is checked
+// against its compact target with uint256, and each header must link to the one
+// before it. Large batches are split across threads.
+
+#ifndef _HEADER_VALIDATION_H__
+#define _HEADER_VALIDATION_H__
+
+#include "CoinNodeData.h"
+
+#include <vector>
+
+#define MIN_HEADERS_PER_THREAD  1000
+
+namespace Coin
+{
+
+// Returns the index of the first header that fails proof of work or doesn't link to the header before it
+// (the first one to prevBlockHash, unless that's empty), or -1 if they're all valid. Hashes are in the same
+// byte order as CoinBlockHeader::prevBlockHash. nThreads = 0 uses one thread per hardware thread.
+int validateHeaders(const HeadersMessage& headers, const uchar_vector& prevBlockHash = uchar_vector(),
+                    std::vector<uchar_vector>* pHashes = NULL, unsigned int nThreads = 0);
+
+// Same for count serialized 80-byte headers spaced stride bytes apart - a headers payload after its count
+// is 81 bytes per header. prevHash (may be NULL) and the count * 32 bytes written to hashes are raw digests.
+int validateHeaders(const unsigned char* data, std::size_t stride, std::size_t count, const unsigned char* prevHash,
+                    unsigned char* hashes, unsigned int nThreads = 0);
+
+// Writes the 80-byte serialization of header to out without any allocations.
+void serializeHeader(const CoinBlockHeader& header, unsigned char* out);
+
+}; // namespace Coin
+
+#endif // _HEADER_VALIDATION_H__
@@ -0,0 +1,246 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// InventoryCache.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "InventoryCache.h"
+
+#include <algorithm>
+
+#include <boost/thread/locks.hpp>
+
+using namespace Coin;
+
+InventoryCache::InventoryCache(std::size_t maxSeen, unsigned int timeout, unsigned int nShards)
+    : m_timeout(timeout)
+{
+    if (nShards == 0) nShards = 1;
+    m_maxSeenPerShard = maxSeen / nShards;
+    if (m_maxSeenPerShard == 0) m_maxSeenPerShard = 1;
+    for (unsigned int i = 0; i < nShards; i++)
+        m_shards.push_back(boost::shared_ptr<Shard>(new Shard()));
+}
+
+void InventoryCache::markSeen(Shard& shard, const Key& key)
+{
+    if (!shard.seen.insert(key).second) return;
+    shard.seenOrder.push_back(key);
+    while (shard.seenOrder.size() > m_maxSeenPerShard) {
+        shard.seen.erase(shard.seenOrder.front());
+        shard.seenOrder.pop_front();
+    }
+}
+
+// Moves entry to the next announcer other than exclude, or marks it for removal if there is none.
+void InventoryCache::reassign(const Key& key, InFlight& entry, PeerId exclude, const boost::posix_time::ptime& now,
+                              Requests& requests, std::vector<Key>& forgotten)
+{
+    std::vector<PeerId>::iterator it = std::remove(entry.announcers.begin(), entry.announcers.end(), exclude);
+    entry.announcers.erase(it, entry.announcers.end());
+
+    if (entry.announcers.empty()) {
+        forgotten.push_back(key);
+        return;
+    }
+
+    entry.peer = entry.announcers.front();
+    entry.announcers.erase(entry.announcers.begin());
+    entry.deadline = now + m_timeout;
+
+    InventoryItem item;
+    item.itemType = entry.itemType;
+    memcpy(item.hash, key.hash, 32);
+    requests[entry.peer].push_back(item);
+}
+
+void InventoryCache::addPeer(PeerId peer, const RequestHandler& handler)
+{
+    boost::unique_lock<boost::shared_mutex> lock(m_handlerMutex);
+    m_handlers[peer] = handler;
+}
+
+void InventoryCache::request(const Requests& requests) const
+{
+    if (requests.empty()) return;
+
+    // Held while the handlers run so that removePeer() can't return - and the peer go away - in the middle of one.
+    boost::shared_lock<boost::shared_mutex> lock(m_handlerMutex);
+    for (Requests::const_iterator it = requests.begin(); it != requests.end(); ++it) {
+        std::map<PeerId, RequestHandler>::const_iterator handler = m_handlers.find(it->first);
+        if (handler != m_handlers.end() && !it->second.empty()) handler->second(it->second);
+    }
+}
+
+std::vector<InventoryItem> InventoryCache::announce(PeerId peer, const std::vector<InventoryItem>& items)
+{
+    std::vector<InventoryItem> toRequest;
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+    for (std::size_t i = 0; i < items.size(); i++) {
+        Key key(items[i].hash);
+        Shard& shard = getShard(key.hash);
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+
+        if (shard.seen.count(key)) continue;
+
+        InFlightMap::iterator it = shard.inFlight.find(key);
+        if (it == shard.inFlight.end()) {
+            InFlight& entry = shard.inFlight[key];
+            entry.itemType = items[i].itemType;
+            entry.peer = peer;
+            entry.deadline = now + m_timeout;
+            toRequest.push_back(items[i]);
+            continue;
+        }
+
+        InFlight& entry = it->second;
+        if (entry.peer == peer) continue;
+
+        if (entry.deadline < now) {
+            // the first peer missed its deadline - take the item over
+            entry.peer = peer;
+            entry.deadline = now + m_timeout;
+            toRequest.push_back(items[i]);
+        }
+        else if (entry.announcers.size() < MAX_INVENTORY_ANNOUNCERS &&
+                 std::find(entry.announcers.begin(), entry.announcers.end(), peer) == entry.announcers.end()) {
+            entry.announcers.push_back(peer);
+        }
+    }
+
+    return toRequest;
+}
+
+void InventoryCache::received(const unsigned char* hash)
+{
+    Key key(hash);
+    Shard& shard = getShard(hash);
+    boost::lock_guard<boost::mutex> lock(shard.mutex);
+    shard.inFlight.erase(key);
+    markSeen(shard, key);
+}
+
+InventoryCache::Requests InventoryCache::notFound(PeerId peer, const std::vector<InventoryItem>& items)
+{
+    Requests requests;
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+    for (std::size_t i = 0; i < items.size(); i++) {
+        Key key(items[i].hash);
+        Shard& shard = getShard(key.hash);
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+
+        InFlightMap::iterator it = shard.inFlight.find(key);
+        if (it == shard.inFlight.end() || it->second.peer != peer) continue;
+
+        std::vector<Key> forgotten;
+        reassign(key, it->second, peer, now, requests, forgotten);
+        if (!forgotten.empty()) shard.inFlight.erase(it);
+    }
+
+    return requests;
+}
+
+InventoryCache::Requests InventoryCache::expire()
+{
+    Requests requests;
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+    for (std::size_t s = 0; s < m_shards.size(); s++) {
+        Shard& shard = *m_shards[s];
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+
+        std::vector<Key> forgotten;
+        for (InFlightMap::iterator it = shard.inFlight.begin(); it != shard.inFlight.end(); ++it) {
+            if (it->second.deadline < now)
+                reassign(it->first, it->second, it->second.peer, now, requests, forgotten);
+        }
+        for (std::size_t i = 0; i < forgotten.size(); i++) shard.inFlight.erase(forgotten[i]);
+    }
+
+    return requests;
+}
+
+InventoryCache::Requests InventoryCache::removePeer(PeerId peer)
+{
+    {
+        boost::unique_lock<boost::shared_mutex> lock(m_handlerMutex);
+        m_handlers.erase(peer);
+    }
+
+    Requests requests;
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+    for (std::size_t s = 0; s < m_shards.size(); s++) {
+        Shard& shard = *m_shards[s];
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+
+        std::vector<Key> forgotten;
+        for (InFlightMap::iterator it = shard.inFlight.begin(); it != shard.inFlight.end(); ++it) {
+            InFlight& entry = it->second;
+            if (entry.peer == peer) {
+                reassign(it->first, entry, peer, now, requests, forgotten);
+            }
+            else {
+                std::vector<PeerId>::iterator end = std::remove(entry.announcers.begin(), entry.announcers.end(), peer);
+                entry.announcers.erase(end, entry.announcers.end());
+            }
+        }
+        for (std::size_t i = 0; i < forgotten.size(); i++) shard.inFlight.erase(forgotten[i]);
+    }
+
+    return requests;
+}
+
+bool InventoryCache::isSeen(const unsigned char* hash) const
+{
+    Shard& shard = getShard(hash);
+    boost::lock_guard<boost::mutex> lock(shard.mutex);
+    return shard.seen.count(Key(hash)) > 0;
+}
+
+bool InventoryCache::isInFlight(const unsigned char* hash) const
+{
+    Shard& shard = getShard(hash);
+    boost::lock_guard<boost::mutex> lock(shard.mutex);
+    return shard.inFlight.count(Key(hash)) > 0;
+}
+
+std::size_t InventoryCache::getSeenCount() const
+{
+    std::size_t count = 0;
+    for (std::size_t s = 0; s < m_shards.size(); s++) {
+        boost::lock_guard<boost::mutex> lock(m_shards[s]->mutex);
+        count += m_shards[s]->seen.size();
+    }
+    return count;
+}
+
+std::size_t InventoryCache::getInFlightCount() const
+{
+    std::size_t count = 0;
+    for (std::size_t s = 0; s < m_shards.size(); s++) {
+        boost::lock_guard<boost::mutex> lock(m_shards[s]->mutex);
+        count += m_shards[s]->inFlight.size();
+    }
+    return count;
+}
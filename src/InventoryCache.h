@@ -0,0 +1,152 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// InventoryCache.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Tracks which inventory items have already been received and which are being
+// fetched, so that an item announced by many peers is requested from only one of
+// them. Items that aren't delivered before the timeout - or that the peer says it
+// doesn't have - are reassigned to another peer that announced them.
+//
+// Hashes are in the same byte order as InventoryItem::hash. Peers are identified by
+// an opaque pointer and registered with addPeer() along with a function that sends
+// them a getdata, so the cache can hand an item to any peer that announced it - even
+// one belonging to another listener or manager. The cache is sharded by hash so that
+// many connections can use it at once without contending on one lock.
+
+#ifndef _INVENTORY_CACHE_H__
+#define _INVENTORY_CACHE_H__
+
+#include "CoinNodeData.h"
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#define DEFAULT_INVENTORY_CACHE_SIZE    100000  // received hashes remembered
+#define DEFAULT_INVENTORY_TIMEOUT       30000   // milliseconds before an item is asked for elsewhere
+#define MAX_INVENTORY_ANNOUNCERS        8       // alternate peers remembered per item in flight
+
+namespace Coin
+{
+
+class InventoryCache
+{
+public:
+    typedef const void* PeerId;
+    typedef std::map<PeerId, std::vector<InventoryItem> > Requests;
+    typedef boost::function<void (const std::vector<InventoryItem>& items)> RequestHandler;
+
+    InventoryCache(std::size_t maxSeen = DEFAULT_INVENTORY_CACHE_SIZE, unsigned int timeout = DEFAULT_INVENTORY_TIMEOUT,
+                   unsigned int nShards = 16);
+
+    // Call before peer announces anything. handler sends peer a getdata for the given items and must not
+    // call back into the cache. It's called from whichever thread request() runs on.
+    void addPeer(PeerId peer, const RequestHandler& handler);
+
+    // Sends each peer its items through the handler it was added with. Items for a peer that has since been
+    // removed are dropped - removePeer() already handed them to someone else.
+    void request(const Requests& requests) const;
+
+    // Call when peer announces items. Returns the items to request from that peer - the ones that have
+    // been neither received nor requested from someone else, plus any whose earlier request timed out.
+    std::vector<InventoryItem> announce(PeerId peer, const std::vector<InventoryItem>& items);
+
+    // Call when an item arrives, from any peer.
+    void received(const unsigned char* hash);
+    void received(const uchar_vector& hash) { received(&hash[0]); }
+
+    // Call when peer answers a request with notfound. Returns the items to request from other peers.
+    Requests notFound(PeerId peer, const std::vector<InventoryItem>& items);
+
+    // Returns the timed out items to request from other peers. Timed out items nobody else has
+    // announced are forgotten, so the next announcement of them gets requested again.
+    Requests expire();
+
+    // Call when a peer disconnects. Returns its outstanding items to request from other peers. Once this
+    // returns the peer's handler is no longer running and won't be called again.
+    Requests removePeer(PeerId peer);
+
+    bool isSeen(const unsigned char* hash) const;
+    bool isInFlight(const unsigned char* hash) const;
+
+    std::size_t getSeenCount() const;
+    std::size_t getInFlightCount() const;
+
+private:
+    struct Key
+    {
+        unsigned char hash[32];
+
+        Key(const unsigned char* _hash) { memcpy(hash, _hash, 32); }
+        bool operator==(const Key& rhs) const { return memcmp(hash, rhs.hash, 32) == 0; }
+    };
+
+    struct KeyHasher
+    {
+        // Hashes are in display order, so a block hash starts with its proof-of-work zeros - the
+        // last bytes are the uniformly distributed ones.
+        std::size_t operator()(const Key& key) const { std::size_t h; memcpy(&h, key.hash + 32 - sizeof(h), sizeof(h)); return h; }
+    };
+
+    struct InFlight
+    {
+        uint32_t itemType;
+        PeerId peer;
+        boost::posix_time::ptime deadline;
+        std::vector<PeerId> announcers;
+    };
+
+    typedef std::unordered_map<Key, InFlight, KeyHasher> InFlightMap;
+
+    struct Shard
+    {
+        mutable boost::mutex mutex;
+        InFlightMap inFlight;
+        std::unordered_set<Key, KeyHasher> seen;
+        std::deque<Key> seenOrder; // oldest first, for eviction
+    };
+
+    Shard& getShard(const unsigned char* hash) const { return *m_shards[hash[31] % m_shards.size()]; } // see KeyHasher
+    void markSeen(Shard& shard, const Key& key);
+    void reassign(const Key& key, InFlight& entry, PeerId exclude, const boost::posix_time::ptime& now, Requests& requests,
+                  std::vector<Key>& forgotten);
+
+    mutable boost::shared_mutex m_handlerMutex;
+    std::map<PeerId, RequestHandler> m_handlers;
+
+    std::size_t m_maxSeenPerShard;
+    boost::posix_time::milliseconds m_timeout;
+    std::vector<boost::shared_ptr<Shard> > m_shards;
+};
+
+}; // namespace Coin
+
+#endif // _INVENTORY_CACHE_H__
@@ -0,0 +1,160 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MappedFile.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace Coin;
+
+namespace
+{
+    const std::size_t MIN_MAPPING = 0x00100000; // 1 MB
+
+    void throwError(const std::string& what, const std::string& path)
+    {
+        throw std::runtime_error(what + " " + path + ": " + strerror(errno));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class MappedRegion implementation
+//
+MappedRegion::MappedRegion(int fd, std::size_t length, bool bWritable)
+    : m_data(NULL), m_length(length)
+{
+    void* p = mmap(NULL, length, bWritable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) throw std::runtime_error(std::string("MappedRegion - mmap failed: ") + strerror(errno));
+    m_data = static_cast<unsigned char*>(p);
+}
+
+MappedRegion::~MappedRegion()
+{
+    munmap(m_data, m_length);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class MappedFile implementation
+//
+void MappedFile::open(const std::string& path, bool bWritableMap)
+{
+    close();
+
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_fd == -1) throwError("MappedFile::open() - cannot open", path);
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        ::close(m_fd);
+        m_fd = -1;
+        throwError("MappedFile::open() - cannot stat", path);
+    }
+
+    m_path = path;
+    m_size = st.st_size;
+    m_bWritable = bWritableMap;
+}
+
+void MappedFile::close()
+{
+    m_region.reset();
+    m_regions.clear();
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_size = 0;
+}
+
+uint64_t MappedFile::append(const void* data, std::size_t length)
+{
+    uint64_t offset = m_size;
+    write(offset, data, length);
+    return offset;
+}
+
+void MappedFile::write(uint64_t offset, const void* data, std::size_t length)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    while (length > 0) {
+        ssize_t n = pwrite(m_fd, p, length, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throwError("MappedFile::write() - cannot write", m_path);
+        }
+        p += n;
+        offset += n;
+        length -= n;
+    }
+    if (offset > m_size) m_size = offset;
+}
+
+void MappedFile::resize(uint64_t size)
+{
+    if (size < m_size) {
+        m_region.reset();
+        for (std::size_t i = 0; i < m_regions.size(); i++) {
+            if (!m_regions[i].expired()) throw std::runtime_error("MappedFile::resize() - cannot truncate " + m_path + " while it is mapped");
+        }
+        m_regions.clear();
+    }
+    if (ftruncate(m_fd, size) != 0) throwError("MappedFile::resize() - cannot resize", m_path);
+    m_size = size;
+}
+
+void MappedFile::sync()
+{
+    if (m_region && m_bWritable) msync(m_region->data(), m_region->length(), MS_SYNC);
+    if (fsync(m_fd) != 0) throwError("MappedFile::sync() - cannot sync", m_path);
+}
+
+MappedRegionPtr MappedFile::getView(uint64_t minLength)
+{
+    if (minLength > m_size) throw std::runtime_error("MappedFile::getView() - past end of " + m_path);
+
+    if (!m_region || m_region->length() < minLength) {
+        // Pages past the end of the file can't be touched, but they can be mapped - once the
+        // file grows into them they become readable without a new mapping.
+        std::size_t length = MIN_MAPPING;
+        while (length < 2 * minLength) length *= 2;
+        m_region = MappedRegionPtr(new MappedRegion(m_fd, length, m_bWritable));
+
+        std::size_t live = 0;
+        for (std::size_t i = 0; i < m_regions.size(); i++) {
+            if (!m_regions[i].expired()) m_regions[live++] = m_regions[i];
+        }
+        m_regions.resize(live);
+        m_regions.push_back(m_region);
+    }
+    return m_region;
+}
@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MappedFile.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// A file that is appended to with write() and read through mmap(). Views handed
+// out by getView() stay valid after the file grows and is remapped - each mapping
+// is unmapped only when the last view holding it is gone.
+
+#ifndef _MAPPED_FILE_H__
+#define _MAPPED_FILE_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+namespace Coin
+{
+
+class MappedRegion
+{
+public:
+    MappedRegion(int fd, std::size_t length, bool bWritable);
+    ~MappedRegion();
+
+    unsigned char* data() const { return m_data; }
+    std::size_t length() const { return m_length; }
+
+private:
+    MappedRegion(const MappedRegion&);
+    MappedRegion& operator=(const MappedRegion&);
+
+    unsigned char* m_data;
+    std::size_t m_length;
+};
+
+typedef boost::shared_ptr<MappedRegion> MappedRegionPtr;
+
+class MappedFile
+{
+public:
+    MappedFile() : m_fd(-1), m_size(0), m_bWritable(false) { }
+    ~MappedFile() { close(); }
+
+    // Opens or creates the file. With bWritableMap, the mapping can be written through as well.
+    void open(const std::string& path, bool bWritableMap = false);
+    void close();
+    bool isOpen() const { return m_fd != -1; }
+
+    const std::string& getPath() const { return m_path; }
+    uint64_t size() const { return m_size; }
+
+    // Writes at the end of the file. Returns the offset written at.
+    uint64_t append(const void* data, std::size_t length);
+    void write(uint64_t offset, const void* data, std::size_t length);
+
+    // Extends with zeros or truncates. Truncating while any view is still held would leave its
+    // readers faulting on the pages past the new end, so that throws instead.
+    void resize(uint64_t size);
+
+    // Flushes written data (and any writes through the mapping) to disk.
+    void sync();
+
+    // A mapping of at least the first minLength bytes, which must not exceed size(). The mapping
+    // is made larger than needed so that the file can grow for a while before it has to be remapped.
+    MappedRegionPtr getView(uint64_t minLength);
+    MappedRegionPtr getView() { return getView(m_size); }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    std::string m_path;
+    int m_fd;
+    uint64_t m_size;
+    bool m_bWritable;
+    MappedRegionPtr m_region;
+    std::vector<boost::weak_ptr<MappedRegion> > m_regions; // every mapping handed out, to tell whether any is still in use
+};
+
+}; // namespace Coin
+
+#endif // _MAPPED_FILE_H__
@@ -0,0 +1,428 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Mempool.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "Mempool.h"
+#include "hash.h"
+
+#include <algorithm>
+
+using namespace Coin;
+
+namespace
+{
+    // Rough heap usage of a transaction held by the pool, including its index entries.
+    std::size_t estimateUsage(const Transaction& tx, uint32_t size)
+    {
+        return sizeof(Transaction) + 2 * size + tx.inputs.size() * (sizeof(TxIn) + 64) + tx.outputs.size() * sizeof(TxOut) + 256;
+    }
+
+    inline double feeRate(uint64_t fee, uint64_t size)
+    {
+        return size ? (double)fee / size : 0.0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Orderings
+//
+bool Mempool::ByAncestorFeeRate::operator()(const Entry* a, const Entry* b) const
+{
+    double rateA = feeRate(a->ancestorFee, a->ancestorSize);
+    double rateB = feeRate(b->ancestorFee, b->ancestorSize);
+    if (rateA != rateB) return rateA > rateB;
+    return a->sequence < b->sequence;
+}
+
+bool Mempool::ByDescendantFeeRate::operator()(const Entry* a, const Entry* b) const
+{
+    // A transaction is worth at least its own fee rate, whatever its descendants pay.
+    double rateA = std::max(feeRate(a->fee, a->size), feeRate(a->descendantFee, a->descendantSize));
+    double rateB = std::max(feeRate(b->fee, b->size), feeRate(b->descendantFee, b->descendantSize));
+    if (rateA != rateB) return rateA < rateB;
+    return a->sequence > b->sequence; // newest goes first
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class Mempool implementation
+//
+Mempool::Mempool(std::size_t maxUsage, std::size_t ancestorLimit)
+    : m_maxUsage(maxUsage), m_ancestorLimit(ancestorLimit), m_usage(0), m_nextSequence(0)
+{
+}
+
+Mempool::~Mempool()
+{
+    for (boost::unordered_map<TxId, Entry*, TxIdHasher>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        delete it->second;
+    }
+}
+
+Mempool::TxId Mempool::getTxId(const Transaction& tx)
+{
+    TxId txid;
+    uchar_vector serialized = tx.getSerialized();
+    sha256_2(&serialized[0], serialized.size(), txid.bytes);
+    std::reverse(txid.bytes, txid.bytes + 32);
+    return txid;
+}
+
+Mempool::TxId Mempool::toTxId(const uchar_vector& hash)
+{
+    if (hash.size() != 32) throw std::runtime_error("Mempool - txid must be 32 bytes.");
+    TxId txid;
+    memcpy(txid.bytes, &hash[0], 32);
+    return txid;
+}
+
+Mempool::Entry* Mempool::find(const TxId& txid) const
+{
+    boost::unordered_map<TxId, Entry*, TxIdHasher>::const_iterator it = m_entries.find(txid);
+    return it == m_entries.end() ? NULL : it->second;
+}
+
+void Mempool::getAncestors(const Entries& parents, Entries& ancestors) const
+{
+    std::vector<Entry*> stack(parents.begin(), parents.end());
+    while (!stack.empty()) {
+        Entry* entry = stack.back();
+        stack.pop_back();
+        if (!ancestors.insert(entry).second) continue;
+        stack.insert(stack.end(), entry->parents.begin(), entry->parents.end());
+    }
+}
+
+void Mempool::getDescendants(Entry* entry, Entries& descendants) const
+{
+    std::vector<Entry*> stack(entry->children.begin(), entry->children.end());
+    while (!stack.empty()) {
+        Entry* descendant = stack.back();
+        stack.pop_back();
+        if (!descendants.insert(descendant).second) continue;
+        stack.insert(stack.end(), descendant->children.begin(), descendant->children.end());
+    }
+}
+
+void Mempool::unindex(Entry* entry)
+{
+    m_byAncestorFeeRate.erase(entry);
+    m_byDescendantFeeRate.erase(entry);
+}
+
+void Mempool::reindex(Entry* entry)
+{
+    m_byAncestorFeeRate.insert(entry);
+    m_byDescendantFeeRate.insert(entry);
+}
+
+Mempool::AddResult Mempool::add(const TransactionPtr& tx, const TxId& txid, uint64_t fee)
+{
+    if (find(txid)) return ALREADY_IN_POOL;
+
+    Entries parents;
+    for (std::size_t i = 0; i < tx->inputs.size(); i++) {
+        const OutPoint& outPoint = tx->inputs[i].previousOut;
+        if (m_spent.count(UtxoKey(outPoint))) return CONFLICT;
+        TxId parentId;
+        memcpy(parentId.bytes, outPoint.hash, 32);
+        Entry* parent = find(parentId);
+        if (parent) parents.insert(parent);
+    }
+
+    Entries ancestors;
+    getAncestors(parents, ancestors);
+    if (ancestors.size() + 1 > m_ancestorLimit) return TOO_MANY_ANCESTORS;
+
+    Entry* entry = new Entry();
+    entry->tx = tx;
+    entry->txid = txid;
+    entry->fee = fee;
+    entry->size = tx->getSize();
+    entry->usage = sizeof(Entry) + estimateUsage(*tx, entry->size);
+    entry->sequence = m_nextSequence++;
+    entry->parents = parents;
+    entry->ancestorCount = entry->descendantCount = 1;
+    entry->ancestorSize = entry->descendantSize = entry->size;
+    entry->ancestorFee = entry->descendantFee = fee;
+
+    for (Entries::iterator it = ancestors.begin(); it != ancestors.end(); ++it) {
+        Entry* ancestor = *it;
+        entry->ancestorCount++;
+        entry->ancestorSize += ancestor->size;
+        entry->ancestorFee += ancestor->fee;
+
+        unindex(ancestor);
+        ancestor->descendantCount++;
+        ancestor->descendantSize += entry->size;
+        ancestor->descendantFee += fee;
+        reindex(ancestor);
+    }
+    for (Entries::iterator it = parents.begin(); it != parents.end(); ++it) {
+        (*it)->children.insert(entry);
+    }
+
+    m_entries[txid] = entry;
+    for (std::size_t i = 0; i < tx->inputs.size(); i++) {
+        m_spent[UtxoKey(tx->inputs[i].previousOut)] = entry;
+    }
+    reindex(entry);
+    m_usage += entry->usage;
+
+    trim();
+    return find(txid) ? ADDED : POOL_FULL;
+}
+
+Mempool::AddResult Mempool::addTx(const TransactionPtr& tx, uint64_t fee)
+{
+    TxId txid = getTxId(*tx);
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+    return add(tx, txid, fee);
+}
+
+Mempool::AddResult Mempool::addTx(const TransactionPtr& tx, UtxoSet& utxos)
+{
+    TxId txid = getTxId(*tx);
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+    if (find(txid)) return ALREADY_IN_POOL;
+
+    uint64_t valueIn = 0;
+    for (std::size_t i = 0; i < tx->inputs.size(); i++) {
+        const OutPoint& outPoint = tx->inputs[i].previousOut;
+        TxId parentId;
+        memcpy(parentId.bytes, outPoint.hash, 32);
+        Entry* parent = find(parentId);
+        if (parent) {
+            if (outPoint.index >= parent->tx->outputs.size()) return MISSING_INPUTS;
+            valueIn += parent->tx->outputs[outPoint.index].value;
+            continue;
+        }
+        UtxoCoin coin;
+        if (!utxos.getCoin(outPoint, coin)) return MISSING_INPUTS;
+        valueIn += coin.value;
+    }
+
+    uint64_t valueOut = tx->getTotalSent();
+    if (valueOut > valueIn) return NEGATIVE_FEE;
+    return add(tx, txid, valueIn - valueOut);
+}
+
+void Mempool::removeEntries(const Entries& entries)
+{
+    // Take each entry out of the totals of the ancestors and descendants that stay.
+    for (Entries::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        Entry* entry = *it;
+
+        Entries ancestors;
+        getAncestors(entry->parents, ancestors);
+        for (Entries::iterator a = ancestors.begin(); a != ancestors.end(); ++a) {
+            if (entries.count(*a)) continue;
+            unindex(*a);
+            (*a)->descendantCount--;
+            (*a)->descendantSize -= entry->size;
+            (*a)->descendantFee -= entry->fee;
+            reindex(*a);
+        }
+
+        Entries descendants;
+        getDescendants(entry, descendants);
+        for (Entries::iterator d = descendants.begin(); d != descendants.end(); ++d) {
+            if (entries.count(*d)) continue;
+            unindex(*d);
+            (*d)->ancestorCount--;
+            (*d)->ancestorSize -= entry->size;
+            (*d)->ancestorFee -= entry->fee;
+            reindex(*d);
+        }
+    }
+
+    for (Entries::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        Entry* entry = *it;
+        unindex(entry);
+        for (Entries::iterator p = entry->parents.begin(); p != entry->parents.end(); ++p) {
+            if (!entries.count(*p)) (*p)->children.erase(entry);
+        }
+        for (Entries::iterator c = entry->children.begin(); c != entry->children.end(); ++c) {
+            if (!entries.count(*c)) (*c)->parents.erase(entry);
+        }
+        for (std::size_t i = 0; i < entry->tx->inputs.size(); i++) {
+            m_spent.erase(UtxoKey(entry->tx->inputs[i].previousOut));
+        }
+        m_entries.erase(entry->txid);
+        m_usage -= entry->usage;
+        delete entry;
+    }
+}
+
+void Mempool::trim()
+{
+    while (m_usage > m_maxUsage && !m_byDescendantFeeRate.empty()) {
+        Entry* entry = *m_byDescendantFeeRate.begin();
+        Entries entries;
+        getDescendants(entry, entries);
+        entries.insert(entry);
+        removeEntries(entries);
+    }
+}
+
+std::size_t Mempool::removeForBlock(const CoinBlock& block)
+{
+    std::vector<TxId> txids(block.txs.size());
+    for (std::size_t i = 0; i < block.txs.size(); i++) {
+        txids[i] = getTxId(block.txs[i]);
+    }
+
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+    Entries entries;
+    for (std::size_t i = 0; i < block.txs.size(); i++) {
+        Entry* entry = find(txids[i]);
+        if (entry) {
+            entries.insert(entry);
+            continue;
+        }
+
+        // Not in the pool, so anything in the pool spending its inputs is a double spend.
+        const Transaction& tx = block.txs[i];
+        for (std::size_t j = 0; j < tx.inputs.size(); j++) {
+            boost::unordered_map<UtxoKey, Entry*, UtxoKeyHasher>::iterator it = m_spent.find(UtxoKey(tx.inputs[j].previousOut));
+            if (it == m_spent.end()) continue;
+            entries.insert(it->second);
+            getDescendants(it->second, entries);
+        }
+    }
+    removeEntries(entries);
+    return entries.size();
+}
+
+std::size_t Mempool::removeTx(const uchar_vector& txid)
+{
+    TxId id = toTxId(txid);
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+    Entry* entry = find(id);
+    if (!entry) return 0;
+
+    Entries entries;
+    getDescendants(entry, entries);
+    entries.insert(entry);
+    removeEntries(entries);
+    return entries.size();
+}
+
+bool Mempool::contains(const uchar_vector& txid) const
+{
+    TxId id = toTxId(txid);
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+    return find(id) != NULL;
+}
+
+TransactionPtr Mempool::getTx(const uchar_vector& txid) const
+{
+    TxId id = toTxId(txid);
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+    Entry* entry = find(id);
+    return entry ? entry->tx : TransactionPtr();
+}
+
+uint64_t Mempool::getFee(const uchar_vector& txid) const
+{
+    TxId id = toTxId(txid);
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+    Entry* entry = find(id);
+    if (!entry) throw std::runtime_error("Mempool::getFee() - transaction not in pool.");
+    return entry->fee;
+}
+
+TransactionPtr Mempool::getSpender(const OutPoint& outPoint) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+    boost::unordered_map<UtxoKey, Entry*, UtxoKeyHasher>::const_iterator it = m_spent.find(UtxoKey(outPoint));
+    return it == m_spent.end() ? TransactionPtr() : it->second->tx;
+}
+
+std::vector<TransactionPtr> Mempool::getConflicts(const Transaction& tx) const
+{
+    std::vector<TransactionPtr> conflicts;
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+    for (std::size_t i = 0; i < tx.inputs.size(); i++) {
+        boost::unordered_map<UtxoKey, Entry*, UtxoKeyHasher>::const_iterator it = m_spent.find(UtxoKey(tx.inputs[i].previousOut));
+        if (it == m_spent.end()) continue;
+        if (std::find(conflicts.begin(), conflicts.end(), it->second->tx) == conflicts.end()) conflicts.push_back(it->second->tx);
+    }
+    return conflicts;
+}
+
+namespace
+{
+    template<typename EntryPtr>
+    struct ByAncestorCount
+    {
+        bool operator()(EntryPtr a, EntryPtr b) const { return a->ancestorCount < b->ancestorCount; }
+    };
+}
+
+std::vector<TransactionPtr> Mempool::getBlockTemplateTxs(std::size_t maxSize) const
+{
+    std::vector<TransactionPtr> txs;
+    std::size_t totalSize = 0;
+    Entries included;
+
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+    for (std::set<Entry*, ByAncestorFeeRate>::const_iterator it = m_byAncestorFeeRate.begin(); it != m_byAncestorFeeRate.end(); ++it) {
+        Entry* entry = *it;
+        if (included.count(entry)) continue;
+
+        Entries ancestors;
+        getAncestors(entry->parents, ancestors);
+        std::vector<Entry*> package;
+        std::size_t packageSize = entry->size;
+        for (Entries::iterator a = ancestors.begin(); a != ancestors.end(); ++a) {
+            if (included.count(*a)) continue;
+            package.push_back(*a);
+            packageSize += (*a)->size;
+        }
+        if (totalSize + packageSize > maxSize) continue;
+
+        // Fewer ancestors first puts parents before their children.
+        std::sort(package.begin(), package.end(), ByAncestorCount<Entry*>());
+        package.push_back(entry);
+        for (std::size_t i = 0; i < package.size(); i++) {
+            included.insert(package[i]);
+            txs.push_back(package[i]->tx);
+        }
+        totalSize += packageSize;
+    }
+    return txs;
+}
+
+std::size_t Mempool::size() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+std::size_t Mempool::getUsage() const
+{
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+    return m_usage;
+}
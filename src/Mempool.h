@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Mempool.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Unconfirmed transactions. Transactions are held through shared pointers and
+// never copied. The pool indexes them by txid and by the outpoints they spend,
+// so a double spend is found with one lookup. Each entry keeps totals over its
+// in-pool ancestors and descendants: block templates take transactions by
+// ancestor fee rate, and the pool evicts by descendant fee rate once it goes
+// over its memory budget.
+//
+// Thread-safe - lookups share a lock, changes take it exclusively.
+
+#ifndef _MEMPOOL_H__
+#define _MEMPOOL_H__
+
+#include "CoinNodeData.h"
+#include "UtxoSet.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+#define DEFAULT_MEMPOOL_MAX_USAGE       300000000 // bytes
+#define DEFAULT_MEMPOOL_ANCESTOR_LIMIT  25
+
+namespace Coin
+{
+
+typedef boost::shared_ptr<const Transaction> TransactionPtr;
+
+class Mempool
+{
+public:
+    enum AddResult
+    {
+        ADDED,
+        ALREADY_IN_POOL,
+        CONFLICT,           // spends an outpoint another pool transaction already spends
+        MISSING_INPUTS,     // only when fees are looked up in a UtxoSet
+        NEGATIVE_FEE,       // likewise - outputs add up to more than inputs
+        TOO_MANY_ANCESTORS,
+        POOL_FULL           // evicted again right away - its fee rate is too low
+    };
+
+    explicit Mempool(std::size_t maxUsage = DEFAULT_MEMPOOL_MAX_USAGE, std::size_t ancestorLimit = DEFAULT_MEMPOOL_ANCESTOR_LIMIT);
+    ~Mempool();
+
+    AddResult addTx(const TransactionPtr& tx, uint64_t fee);
+
+    // Looks up input values in the pool and then in utxos.
+    AddResult addTx(const TransactionPtr& tx, UtxoSet& utxos);
+
+    // Removes the block's transactions, and anything else spending the same outpoints along with its descendants.
+    // Children of confirmed transactions stay. Returns the number of transactions removed.
+    std::size_t removeForBlock(const CoinBlock& block);
+
+    // Removes the transaction and its descendants. Returns the number removed.
+    std::size_t removeTx(const uchar_vector& txid);
+
+    // txids are in display order (as returned by getHashLittleEndian).
+    bool contains(const uchar_vector& txid) const;
+    TransactionPtr getTx(const uchar_vector& txid) const;
+    uint64_t getFee(const uchar_vector& txid) const;
+
+    // The pool transaction spending outpoint, or null.
+    TransactionPtr getSpender(const OutPoint& outPoint) const;
+
+    // Pool transactions spending any of tx's inputs.
+    std::vector<TransactionPtr> getConflicts(const Transaction& tx) const;
+
+    // Picks transactions by ancestor fee rate, each preceded by any of its ancestors not already picked, skipping
+    // any that don't fit in maxSize bytes. The result is in an order they can be included in a block.
+    std::vector<TransactionPtr> getBlockTemplateTxs(std::size_t maxSize) const;
+
+    std::size_t size() const;
+    std::size_t getUsage() const;
+    std::size_t getMaxUsage() const { return m_maxUsage; }
+
+private:
+    Mempool(const Mempool&);
+    Mempool& operator=(const Mempool&);
+
+    struct TxId
+    {
+        unsigned char bytes[32];
+        bool operator==(const TxId& rhs) const { return memcmp(bytes, rhs.bytes, 32) == 0; }
+    };
+
+    struct TxIdHasher
+    {
+        std::size_t operator()(const TxId& txid) const { std::size_t h; memcpy(&h, txid.bytes, sizeof(h)); return h; }
+    };
+
+    struct UtxoKeyHasher
+    {
+        std::size_t operator()(const UtxoKey& key) const { return key.getHash(); }
+    };
+
+    struct Entry;
+    typedef std::set<Entry*> Entries;
+
+    struct Entry
+    {
+        TransactionPtr tx;
+        TxId txid;
+        uint64_t fee;
+        uint32_t size;
+        std::size_t usage;
+        uint64_t sequence;  // insertion order, breaks fee rate ties
+
+        Entries parents;
+        Entries children;
+
+        // Totals including the entry itself
+        uint64_t ancestorCount;
+        uint64_t ancestorSize;
+        uint64_t ancestorFee;
+        uint64_t descendantCount;
+        uint64_t descendantSize;
+        uint64_t descendantFee;
+    };
+
+    // Highest ancestor fee rate first
+    struct ByAncestorFeeRate
+    {
+        bool operator()(const Entry* a, const Entry* b) const;
+    };
+
+    // Lowest descendant fee rate first
+    struct ByDescendantFeeRate
+    {
+        bool operator()(const Entry* a, const Entry* b) const;
+    };
+
+    static TxId getTxId(const Transaction& tx);
+    static TxId toTxId(const uchar_vector& txid);
+
+    AddResult add(const TransactionPtr& tx, const TxId& txid, uint64_t fee);
+    Entry* find(const TxId& txid) const;
+    void getAncestors(const Entries& parents, Entries& ancestors) const;
+    void getDescendants(Entry* entry, Entries& descendants) const;
+    void unindex(Entry* entry);
+    void reindex(Entry* entry);
+    void removeEntries(const Entries& entries);
+    void trim();
+
+    std::size_t m_maxUsage;
+    std::size_t m_ancestorLimit;
+
+    mutable boost::shared_mutex m_mutex;
+    boost::unordered_map<TxId, Entry*, TxIdHasher> m_entries;
+    boost::unordered_map<UtxoKey, Entry*, UtxoKeyHasher> m_spent;
+    std::set<Entry*, ByAncestorFeeRate> m_byAncestorFeeRate;
+    std::set<Entry*, ByDescendantFeeRate> m_byDescendantFeeRate;
+    std::size_t m_usage;
+    uint64_t m_nextSequence;
+};
+
+}; // namespace Coin
+
+#endif // _MEMPOOL_H__
@@ -0,0 +1,230 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MessageDispatcher.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "MessageDispatcher.h"
+
+#include <iostream>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+
+#define WORKER_SPIN_COUNT   64
+#define WORKER_IDLE_WAIT    10 // milliseconds - upper bound on a missed wakeup
+
+using namespace Coin;
+
+MessageDispatcher::MessageDispatcher(unsigned int nWorkers, std::size_t queueSize, bool bOrdered)
+    : m_nWorkers(nWorkers), m_queueSize(queueSize), m_bOrdered(bOrdered), m_bRunning(false), m_bStopping(false), m_enqueuing(0),
+      m_dispatched(0), m_completed(0), m_failed(0), m_queueWaitMicros(0), m_maxQueueWaitMicros(0), m_handlerMicros(0), m_maxHandlerMicros(0)
+{
+    if (m_nWorkers == 0) m_nWorkers = boost::thread::hardware_concurrency();
+    if (m_nWorkers == 0) m_nWorkers = 1;
+}
+
+void MessageDispatcher::start()
+{
+    if (m_bRunning) throw std::runtime_error("MessageDispatcher::start() - already running.");
+
+    m_lanes.clear();
+    std::size_t nLanes = m_bOrdered ? m_nWorkers : 1;
+    for (std::size_t i = 0; i < nLanes; i++)
+        m_lanes.push_back(boost::shared_ptr<Lane>(new Lane(m_queueSize)));
+
+    m_bStopping = false;
+    m_bRunning = true;
+    for (unsigned int i = 0; i < m_nWorkers; i++)
+        m_threads.create_thread(boost::bind(&MessageDispatcher::workerLoop, this, m_lanes[i % nLanes].get()));
+}
+
+void MessageDispatcher::stop()
+{
+    if (!m_bRunning) return;
+
+    m_bRunning = false;
+    m_bStopping = true;
+    for (std::size_t i = 0; i < m_lanes.size(); i++) {
+        boost::lock_guard<boost::mutex> lock(m_lanes[i]->mutex);
+        m_lanes[i]->cond.notify_all();
+        m_lanes[i]->spaceCond.notify_all();
+    }
+    m_threads.join_all();
+}
+
+MessageDispatcher::Lane& MessageDispatcher::getLane(const void* key)
+{
+    if (m_lanes.size() == 1) return *m_lanes[0];
+
+    // mix the pointer bits - allocations are aligned so the low bits alone spread poorly
+    uint64_t h = (uint64_t)(uintptr_t)key * 0x9e3779b97f4a7c15ull;
+    return *m_lanes[(std::size_t)(h >> 32) % m_lanes.size()];
+}
+
+bool MessageDispatcher::dispatch(const void* key, const Task& task)
+{
+    return enqueue(key, task, true);
+}
+
+bool MessageDispatcher::tryDispatch(const void* key, const Task& task)
+{
+    return enqueue(key, task, false);
+}
+
+bool MessageDispatcher::enqueue(const void* key, const Task& task, bool bWait)
+{
+    // Workers don't exit while an enqueue is in progress, so a task pushed after stop() started still runs.
+    m_enqueuing++;
+    bool bQueued = push(key, task, bWait);
+    m_enqueuing--;
+    return bQueued;
+}
+
+bool MessageDispatcher::push(const void* key, const Task& task, bool bWait)
+{
+    if (!m_bRunning) return false;
+
+    Lane& lane = getLane(key);
+    Item item;
+    item.task = task;
+    item.queued = boost::posix_time::microsec_clock::universal_time();
+
+    if (!lane.queue.push(item)) {
+        if (!bWait) return false;
+
+        // queue full - sleep until a worker makes room
+        boost::unique_lock<boost::mutex> lock(lane.mutex);
+        lane.waiters++;
+        while (!lane.queue.push(item)) {
+            if (!m_bRunning) {
+                lane.waiters--;
+                return false;
+            }
+            lane.spaceCond.timed_wait(lock, boost::posix_time::milliseconds(WORKER_IDLE_WAIT));
+        }
+        lane.waiters--;
+    }
+    m_dispatched++;
+
+    if (lane.sleepers > 0) {
+        boost::lock_guard<boost::mutex> lock(lane.mutex);
+        lane.cond.notify_one();
+    }
+    return true;
+}
+
+void MessageDispatcher::workerLoop(Lane* pLane)
+{
+    Item item;
+    while (true) {
+        if (pLane->queue.pop(item)) {
+            run(pLane, item);
+            continue;
+        }
+
+        // spin briefly before going to sleep - messages tend to arrive in bursts
+        bool bGotItem = false;
+        for (int i = 0; i < WORKER_SPIN_COUNT && !bGotItem; i++) {
+            boost::this_thread::yield();
+            bGotItem = pLane->queue.pop(item);
+        }
+        if (bGotItem) {
+            run(pLane, item);
+            continue;
+        }
+
+        if (m_bStopping && m_enqueuing == 0) {
+            // every enqueue that saw us running has pushed by now - run whatever they left, then exit
+            if (!pLane->queue.pop(item)) break;
+            run(pLane, item);
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(pLane->mutex);
+        pLane->sleepers++;
+        if (pLane->queue.size() == 0 && !m_bStopping)
+            pLane->cond.timed_wait(lock, boost::posix_time::milliseconds(WORKER_IDLE_WAIT));
+        pLane->sleepers--;
+    }
+}
+
+void MessageDispatcher::run(Lane* pLane, Item& item)
+{
+    if (pLane->waiters > 0) {
+        boost::lock_guard<boost::mutex> lock(pLane->mutex);
+        pLane->spaceCond.notify_one();
+    }
+
+    boost::posix_time::ptime started = boost::posix_time::microsec_clock::universal_time();
+    try {
+        item.task();
+    }
+    catch (const std::exception& e) {
+        m_failed++;
+#ifdef __SHOW_EXCEPTIONS__
+        std::cout << "MessageDispatcher - Exception in handler: " << e.what() << std::endl;
+#endif
+    }
+    catch (...) {
+        m_failed++;
+#ifdef __SHOW_EXCEPTIONS__
+        std::cout << "MessageDispatcher - Unknown exception in handler." << std::endl;
+#endif
+    }
+    boost::posix_time::ptime finished = boost::posix_time::microsec_clock::universal_time();
+    item.task.clear();
+
+    uint64_t queueWait = (started - item.queued).total_microseconds();
+    uint64_t handlerTime = (finished - started).total_microseconds();
+    m_queueWaitMicros += queueWait;
+    m_handlerMicros += handlerTime;
+    updateMax(m_maxQueueWaitMicros, queueWait);
+    updateMax(m_maxHandlerMicros, handlerTime);
+    m_completed++;
+}
+
+void MessageDispatcher::updateMax(boost::atomic<uint64_t>& max, uint64_t value)
+{
+    uint64_t current = max.load(boost::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, boost::memory_order_relaxed));
+}
+
+std::size_t MessageDispatcher::getQueueDepth() const
+{
+    std::size_t depth = 0;
+    for (std::size_t i = 0; i < m_lanes.size(); i++) depth += m_lanes[i]->queue.size();
+    return depth;
+}
+
+DispatcherStats MessageDispatcher::getStats() const
+{
+    DispatcherStats stats;
+    stats.queueDepth = getQueueDepth();
+    stats.dispatched = m_dispatched;
+    stats.completed = m_completed;
+    stats.failed = m_failed;
+    stats.queueWaitMicros = m_queueWaitMicros;
+    stats.maxQueueWaitMicros = m_maxQueueWaitMicros;
+    stats.handlerMicros = m_handlerMicros;
+    stats.maxHandlerMicros = m_maxHandlerMicros;
+    return stats;
+}
@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MessageDispatcher.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Runs message handlers on a pool of worker threads so that a slow handler never
+// holds up reading from the network. Read loops push tasks onto bounded lock-free
+// queues and workers pop them.
+//
+// In ordered mode every worker owns its own queue (lane) and tasks are routed by
+// key, so all tasks with the same key - e.g. all messages from one peer - run one
+// at a time in the order they were dispatched. In unordered mode all workers share
+// a single queue.
+//
+// When a queue is full, dispatch() waits for room, which pushes back on the
+// reading socket rather than buffering without bound. Threads that serve many
+// sockets, like an io_service thread, should use tryDispatch() instead and stop
+// reading from the one socket until there is room.
+
+#ifndef _MESSAGE_DISPATCHER_H__
+#define _MESSAGE_DISPATCHER_H__
+
+#include "MpmcQueue.h"
+
+#include <stdint.h>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+
+#define DEFAULT_DISPATCH_QUEUE_SIZE     4096
+
+namespace Coin
+{
+
+struct DispatcherStats
+{
+    std::size_t queueDepth;         // tasks waiting right now
+    uint64_t dispatched;
+    uint64_t completed;
+    uint64_t failed;                // handlers that threw
+    uint64_t queueWaitMicros;       // total time tasks spent queued
+    uint64_t maxQueueWaitMicros;
+    uint64_t handlerMicros;         // total time spent in handlers
+    uint64_t maxHandlerMicros;
+
+    double getAverageQueueWaitMicros() const { return completed ? (double)queueWaitMicros / completed : 0.0; }
+    double getAverageHandlerMicros() const { return completed ? (double)handlerMicros / completed : 0.0; }
+};
+
+class MessageDispatcher
+{
+public:
+    typedef boost::function<void()> Task;
+
+    // nWorkers = 0 uses one worker per hardware thread.
+    MessageDispatcher(unsigned int nWorkers = 0, std::size_t queueSize = DEFAULT_DISPATCH_QUEUE_SIZE, bool bOrdered = true);
+    ~MessageDispatcher() { this->stop(); }
+
+    void start();
+
+    // Runs everything already dispatched, then joins the workers.
+    void stop();
+
+    bool isRunning() const { return m_bRunning; }
+    bool isOrdered() const { return m_bOrdered; }
+    unsigned int getWorkerCount() const { return m_nWorkers; }
+
+    // Thread-safe. Blocks while the key's queue is full. Returns false if the dispatcher isn't running.
+    bool dispatch(const void* key, const Task& task);
+
+    // Thread-safe. Returns false right away if the dispatcher isn't running or the key's queue is full.
+    bool tryDispatch(const void* key, const Task& task);
+
+    std::size_t getQueueDepth() const;
+    DispatcherStats getStats() const;
+
+private:
+    struct Item
+    {
+        Task task;
+        boost::posix_time::ptime queued;
+    };
+
+    struct Lane
+    {
+        Lane(std::size_t queueSize) : queue(queueSize), sleepers(0), waiters(0) { }
+
+        MpmcQueue<Item> queue;
+        boost::mutex mutex;
+        boost::condition_variable cond;         // workers wait here for tasks
+        boost::condition_variable spaceCond;    // dispatch() waits here for room
+        boost::atomic<int> sleepers;
+        boost::atomic<int> waiters;
+    };
+
+    bool enqueue(const void* key, const Task& task, bool bWait);
+    bool push(const void* key, const Task& task, bool bWait);
+    void workerLoop(Lane* pLane);
+    void run(Lane* pLane, Item& item);
+    Lane& getLane(const void* key);
+
+    static void updateMax(boost::atomic<uint64_t>& max, uint64_t value);
+
+    unsigned int m_nWorkers;
+    std::size_t m_queueSize;
+    bool m_bOrdered;
+
+    std::vector<boost::shared_ptr<Lane> > m_lanes;
+    boost::thread_group m_threads;
+    boost::atomic<bool> m_bRunning;
+    boost::atomic<bool> m_bStopping;
+    boost::atomic<int> m_enqueuing;          // enqueue() calls in progress
+
+    boost::atomic<uint64_t> m_dispatched;
+    boost::atomic<uint64_t> m_completed;
+    boost::atomic<uint64_t> m_failed;
+    boost::atomic<uint64_t> m_queueWaitMicros;
+    boost::atomic<uint64_t> m_maxQueueWaitMicros;
+    boost::atomic<uint64_t> m_handlerMicros;
+    boost::atomic<uint64_t> m_maxHandlerMicros;
+};
+
+}; // namespace Coin
+
+#endif // _MESSAGE_DISPATCHER_H__
@@ -0,0 +1,137 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MessageFrameBuffer.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "MessageFrameBuffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+
+using namespace Coin;
+
+MessageFrameBuffer::MessageFrameBuffer(uint32_t magic, std::size_t readSize)
+    : m_readSize(readSize), m_buffer(2 * readSize), m_begin(0), m_end(0), m_bHaveFrame(false), m_pendingFrameSize(0)
+{
+    setMagic(magic);
+}
+
+void MessageFrameBuffer::setMagic(uint32_t magic)
+{
+    m_magic = magic;
+    for (int i = 0; i < 4; i++) {
+        m_magicBytes[i] = magic & 0xff;
+        magic >>= 8;
+    }
+}
+
+unsigned char* MessageFrameBuffer::prepare()
+{
+    m_bHaveFrame = false;
+
+    // Make room for the rest of a partially received frame all at once so large blocks
+    // don't bounce between reading and compacting.
+    std::size_t needed = m_readSize;
+    if (m_pendingFrameSize > size() && m_pendingFrameSize - size() > needed)
+        needed = m_pendingFrameSize - size();
+
+    if (writable() < needed) {
+        if (m_begin > 0) {
+            std::copy(m_buffer.begin() + m_begin, m_buffer.begin() + m_end, m_buffer.begin());
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+        if (writable() < needed)
+            m_buffer.resize(m_end + needed);
+    }
+
+    return &m_buffer[m_end];
+}
+
+void MessageFrameBuffer::commit(std::size_t n)
+{
+    if (n > writable())
+        throw std::runtime_error("MessageFrameBuffer::commit() - committed more bytes than prepared.");
+
+    m_end += n;
+}
+
+bool MessageFrameBuffer::nextFrame()
+{
+    if (m_bHaveFrame) return true;
+
+    if (size() < MIN_MESSAGE_HEADER_SIZE) return false;
+
+    // Find the magic bytes, discarding anything before them. If they aren't found, keep
+    // the last three bytes in case the magic bytes straddle two reads.
+    std::vector<unsigned char>::iterator it = std::search(m_buffer.begin() + m_begin, m_buffer.begin() + m_end, m_magicBytes, m_magicBytes + 4);
+    if (it == m_buffer.begin() + m_end) {
+        m_begin = m_end - 3;
+        m_pendingFrameSize = 0;
+        return false;
+    }
+    m_begin = it - m_buffer.begin();
+    if (size() < MIN_MESSAGE_HEADER_SIZE) return false;
+
+    m_header.setSerialized(&m_buffer[m_begin]);
+    if (m_header.length > MAX_MESSAGE_PAYLOAD_SIZE) {
+        // skip the magic bytes so the next call resynchronizes
+        m_begin += 4;
+        m_pendingFrameSize = 0;
+        std::stringstream ss;
+        ss << "MessageFrameBuffer::nextFrame() - payload size " << m_header.length << " exceeds maximum.";
+        throw std::runtime_error(ss.str());
+    }
+
+    std::size_t frameSize = MIN_MESSAGE_HEADER_SIZE + m_header.length;
+    if (size() < frameSize) {
+        m_pendingFrameSize = frameSize;
+        return false;
+    }
+
+    m_pendingFrameSize = 0;
+    m_bHaveFrame = true;
+    return true;
+}
+
+bool MessageFrameBuffer::isChecksumValid() const
+{
+    if (!m_bHaveFrame)
+        throw std::runtime_error("MessageFrameBuffer::isChecksumValid() - no frame.");
+
+    unsigned char hash[32];
+    sha256_2(getPayload(), m_header.length, hash);
+    uint32_t checksum = (uint32_t)hash[0] | ((uint32_t)hash[1] << 8) | ((uint32_t)hash[2] << 16) | ((uint32_t)hash[3] << 24);
+    return (checksum == m_header.checksum);
+}
+
+void MessageFrameBuffer::consume()
+{
+    if (!m_bHaveFrame) return;
+
+    m_begin += MIN_MESSAGE_HEADER_SIZE + m_header.length;
+    m_bHaveFrame = false;
+
+    // nothing left over - rewind for free
+    if (m_begin == m_end) m_begin = m_end = 0;
+}
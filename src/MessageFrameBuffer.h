@@ -0,0 +1,103 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MessageFrameBuffer.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Receive buffer for the wire protocol. Socket reads go straight into the free
+// tail of the buffer, frames are located and their headers parsed in place, and
+// payloads are handed out as pointers into the buffer. Consumed bytes are only
+// reclaimed when the tail runs out of room, so the memmove cost is paid once per
+// buffer's worth of data instead of once per message.
+//
+// Typical use:
+//
+//     size_t n = socket.read_some(boost::asio::buffer(frameBuffer.prepare(), frameBuffer.writable()));
+//     frameBuffer.commit(n);
+//     while (frameBuffer.nextFrame()) {
+//         if (frameBuffer.isChecksumValid()) {
+//             CoinNodeMessage message(frameBuffer.getHeader(), frameBuffer.getPayload());
+//             ...
+//         }
+//         frameBuffer.consume();
+//     }
+
+#ifndef _MESSAGE_FRAME_BUFFER_H__
+#define _MESSAGE_FRAME_BUFFER_H__
+
+#include "CoinNodeData.h"
+
+#include <vector>
+
+#define FRAME_BUFFER_READ_SIZE      65536
+#define MAX_MESSAGE_PAYLOAD_SIZE    0x02000000 // 32 MB
+
+namespace Coin
+{
+
+class MessageFrameBuffer
+{
+public:
+    MessageFrameBuffer(uint32_t magic = 0, std::size_t readSize = FRAME_BUFFER_READ_SIZE);
+
+    void setMagic(uint32_t magic);
+    uint32_t getMagic() const { return m_magic; }
+
+    // Returns a pointer to at least writable() free bytes. Call commit() with the number of bytes actually written.
+    unsigned char* prepare();
+    std::size_t writable() const { return m_buffer.size() - m_end; }
+    void commit(std::size_t n);
+
+    // Number of buffered bytes not yet consumed.
+    std::size_t size() const { return m_end - m_begin; }
+    void clear() { m_begin = m_end = 0; m_bHaveFrame = false; m_pendingFrameSize = 0; }
+
+    // Skips garbage up to the next magic bytes and returns true if a complete frame is buffered.
+    // Throws if the frame header announces a payload larger than MAX_MESSAGE_PAYLOAD_SIZE.
+    bool nextFrame();
+
+    // Only valid after nextFrame() returns true and until consume() or prepare() is called.
+    const MessageHeader& getHeader() const { return m_header; }
+    const char* getCommand() const { return m_header.command; }
+    const unsigned char* getPayload() const { return &m_buffer[m_begin + MIN_MESSAGE_HEADER_SIZE]; }
+    uint32_t getPayloadSize() const { return m_header.length; }
+    bool isChecksumValid() const;
+
+    // Drops the current frame.
+    void consume();
+
+private:
+    uint32_t m_magic;
+    unsigned char m_magicBytes[4];
+    std::size_t m_readSize;
+
+    std::vector<unsigned char> m_buffer;
+    std::size_t m_begin;
+    std::size_t m_end;
+
+    MessageHeader m_header;
+    bool m_bHaveFrame;
+    std::size_t m_pendingFrameSize; // size of a frame whose header has arrived but whose payload hasn't
+};
+
+}; // namespace Coin
+
+#endif // _MESSAGE_FRAME_BUFFER_H__
@@ -0,0 +1,142 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MpmcQueue.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design).
+// Each cell carries a sequence number that tells producers and consumers whether
+// it is free for them; head and tail are claimed with a single compare-and-swap.
+
+#ifndef _MPMC_QUEUE_H__
+#define _MPMC_QUEUE_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+
+namespace Coin
+{
+
+template<typename T>
+class MpmcQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit MpmcQueue(std::size_t capacity = 1024)
+    {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+        m_mask = size - 1;
+        m_cells = std::vector<Cell>(size);
+        for (std::size_t i = 0; i < size; i++) m_cells[i].sequence.store(i, boost::memory_order_relaxed);
+        m_enqueuePos.store(0, boost::memory_order_relaxed);
+        m_dequeuePos.store(0, boost::memory_order_relaxed);
+    }
+
+    std::size_t capacity() const { return m_mask + 1; }
+
+    // Approximate when other threads are pushing or popping.
+    std::size_t size() const
+    {
+        std::size_t enqueuePos = m_enqueuePos.load(boost::memory_order_relaxed);
+        std::size_t dequeuePos = m_dequeuePos.load(boost::memory_order_relaxed);
+        return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+    }
+
+    // Returns false if the queue is full.
+    bool push(const T& item)
+    {
+        Cell* pCell;
+        std::size_t pos = m_enqueuePos.load(boost::memory_order_relaxed);
+        while (true) {
+            pCell = &m_cells[pos & m_mask];
+            std::size_t sequence = pCell->sequence.load(boost::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = m_enqueuePos.load(boost::memory_order_relaxed);
+            }
+        }
+        pCell->data = item;
+        pCell->sequence.store(pos + 1, boost::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty.
+    bool pop(T& item)
+    {
+        Cell* pCell;
+        std::size_t pos = m_dequeuePos.load(boost::memory_order_relaxed);
+        while (true) {
+            pCell = &m_cells[pos & m_mask];
+            std::size_t sequence = pCell->sequence.load(boost::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = m_dequeuePos.load(boost::memory_order_relaxed);
+            }
+        }
+        item = pCell->data;
+        pCell->data = T(); // don't keep references alive in the cell
+        pCell->sequence.store(pos + m_mask + 1, boost::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        boost::atomic<std::size_t> sequence;
+        T data;
+
+        Cell() : sequence(0) { }
+        Cell(const Cell& cell) : sequence(cell.sequence.load()), data(cell.data) { }
+        Cell& operator=(const Cell& cell) { sequence.store(cell.sequence.load()); data = cell.data; return *this; }
+    };
+
+    MpmcQueue(const MpmcQueue&);
+    MpmcQueue& operator=(const MpmcQueue&);
+
+    // keep producers and consumers off each other's cache lines
+    char m_pad0[64];
+    std::vector<Cell> m_cells;
+    std::size_t m_mask;
+    char m_pad1[64];
+    boost::atomic<std::size_t> m_enqueuePos;
+    char m_pad2[64];
+    boost::atomic<std::size_t> m_dequeuePos;
+    char m_pad3[64];
+};
+
+}; // namespace Coin
+
+#endif // _MPMC_QUEUE_H__
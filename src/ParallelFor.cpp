@@ -0,0 +1,190 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// ParallelFor.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <deque>
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+using namespace Coin;
+
+namespace
+{
+    struct ChunkError
+    {
+        ChunkError() : bFailed(false) { }
+
+        boost::mutex mutex;
+        bool bFailed;
+        std::string what;
+
+        void set(const char* message)
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            if (bFailed) return;
+            bFailed = true;
+            what = message;
+        }
+    };
+
+    // One parallelFor() call. Lives on the caller's stack, which doesn't return until every chunk is done.
+    struct Job
+    {
+        const ChunkTask* pTask;
+        std::size_t count;
+        std::size_t chunkSize;
+        std::size_t nChunks;
+        std::size_t nextChunk;  // guarded by the pool mutex, like finished
+        std::size_t finished;
+        ChunkError error;
+    };
+
+    void runChunk(Job& job, std::size_t chunk)
+    {
+        std::size_t begin = chunk * job.chunkSize;
+        std::size_t end = std::min(begin + job.chunkSize, job.count);
+        try {
+            (*job.pTask)(chunk, begin, end);
+        }
+        catch (const std::exception& e) {
+            job.error.set(e.what());
+        }
+        catch (...) {
+            job.error.set("Unknown exception.");
+        }
+    }
+
+    // Workers are started as they're first needed and then kept for the life of the process, so a batch
+    // costs a wakeup rather than a thread creation per chunk. The caller works on its own job too, so
+    // parallelFor() can be called from inside a task without waiting on workers that are all busy.
+    class ChunkPool
+    {
+    public:
+        ChunkPool() : m_nWorkers(0), m_bStopping(false) { }
+
+        ~ChunkPool()
+        {
+            {
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_bStopping = true;
+                m_workCond.notify_all();
+            }
+            m_threads.join_all();
+        }
+
+        void run(Job& job)
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            m_jobs.push_back(&job);
+            while (m_nWorkers < job.nChunks - 1) {
+                m_threads.create_thread(boost::bind(&ChunkPool::workerLoop, this));
+                m_nWorkers++;
+            }
+            m_workCond.notify_all();
+
+            std::size_t chunk;
+            while (claim(job, chunk)) {
+                lock.unlock();
+                runChunk(job, chunk);
+                lock.lock();
+                job.finished++;
+            }
+            while (job.finished < job.nChunks) m_doneCond.wait(lock);
+        }
+
+    private:
+        // Call with m_mutex held. Jobs leave the queue once their last chunk is claimed.
+        bool claim(Job& job, std::size_t& chunk)
+        {
+            if (job.nextChunk >= job.nChunks) return false;
+            chunk = job.nextChunk++;
+            if (job.nextChunk == job.nChunks) m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), &job));
+            return true;
+        }
+
+        void workerLoop()
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            while (true) {
+                while (m_jobs.empty() && !m_bStopping) m_workCond.wait(lock);
+                if (m_bStopping) return;
+
+                Job& job = *m_jobs.front();
+                std::size_t chunk;
+                claim(job, chunk);
+                lock.unlock();
+                runChunk(job, chunk);
+                lock.lock();
+                if (++job.finished == job.nChunks) m_doneCond.notify_all();
+            }
+        }
+
+        boost::mutex m_mutex;
+        boost::condition_variable m_workCond;
+        boost::condition_variable m_doneCond;
+        std::deque<Job*> m_jobs;
+        boost::thread_group m_threads;
+        std::size_t m_nWorkers;
+        bool m_bStopping;
+    };
+
+    ChunkPool& getPool()
+    {
+        static ChunkPool pool;
+        return pool;
+    }
+}
+
+std::size_t Coin::getChunkCount(std::size_t count, std::size_t minPerChunk, unsigned int nThreads)
+{
+    if (nThreads == 0) nThreads = boost::thread::hardware_concurrency();
+    if (minPerChunk == 0) minPerChunk = 1;
+    return std::min<std::size_t>(std::max(nThreads, 1u), std::max<std::size_t>(count / minPerChunk, 1));
+}
+
+void Coin::parallelFor(std::size_t count, std::size_t nChunks, const ChunkTask& task)
+{
+    if (count == 0) return;
+    if (nChunks <= 1) {
+        task(0, 0, count);
+        return;
+    }
+
+    Job job;
+    job.pTask = &task;
+    job.count = count;
+    job.chunkSize = (count + nChunks - 1) / nChunks;
+    job.nChunks = (count + job.chunkSize - 1) / job.chunkSize; // no empty chunks
+    job.nextChunk = 0;
+    job.finished = 0;
+    getPool().run(job);
+
+    if (job.error.bFailed) throw std::runtime_error(job.error.what);
+}
@@ -0,0 +1,54 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// ParallelFor.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Splits a range of independent work items into chunks and runs them on a pool of
+// worker threads that is started on first use and kept, with the calling thread
+// taking chunks too. Used for the batch hashing, signing and verification that
+// dominates block and transaction processing, so a block or transaction costs a
+// wakeup of already running threads rather than starting new ones.
+
+#ifndef _PARALLEL_FOR_H__
+#define _PARALLEL_FOR_H__
+
+#include <cstddef>
+
+#include <boost/function.hpp>
+
+namespace Coin
+{
+
+// Called with the chunk's index and its half-open range [begin, end).
+typedef boost::function<void (std::size_t chunk, std::size_t begin, std::size_t end)> ChunkTask;
+
+// Number of chunks for count items: at most nThreads, and none smaller than minPerChunk items unless
+// there is only one. nThreads = 0 uses one thread per hardware thread.
+std::size_t getChunkCount(std::size_t count, std::size_t minPerChunk, unsigned int nThreads);
+
+// Runs task on nChunks chunks of [0, count), all the same size but the last, and returns once they're all
+// done. Empty chunks are skipped. Rethrows the first exception a task threw, as a std::runtime_error.
+void parallelFor(std::size_t count, std::size_t nChunks, const ChunkTask& task);
+
+}; // namespace Coin
+
+#endif // _PARALLEL_FOR_H__
@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// SerializedMessage.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "SerializedMessage.h"
+
+#include <stdexcept>
+
+using namespace Coin;
+
+SerializedMessage::SerializedMessage(uint32_t magic, const CoinNodeStructure& payload)
+{
+    uchar_vector* pPayload = new uchar_vector(payload.getSerialized());
+    m_payload = SharedBuffer(pPayload);
+
+    unsigned char hash[32];
+    sha256_2(pPayload->empty() ? NULL : &(*pPayload)[0], pPayload->size(), hash);
+    uint32_t checksum = (uint32_t)hash[0] | ((uint32_t)hash[1] << 8) | ((uint32_t)hash[2] << 16) | ((uint32_t)hash[3] << 24);
+
+    m_messageHeader = MessageHeader(magic, payload.getCommand(), pPayload->size(), checksum);
+    m_header = SharedBuffer(new uchar_vector(m_messageHeader.getSerialized()));
+}
+
+SerializedMessage::SerializedMessage(const CoinNodeMessage& message)
+{
+    if (!message.pPayload) throw std::runtime_error("SerializedMessage - message not initialized.");
+
+    m_messageHeader = message.header;
+    m_header = SharedBuffer(new uchar_vector(m_messageHeader.getSerialized()));
+    m_payload = SharedBuffer(new uchar_vector(message.pPayload->getSerialized()));
+}
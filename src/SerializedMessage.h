@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// SerializedMessage.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// A wire-ready message whose payload is serialized and checksummed exactly once.
+// Copies share the same immutable buffers, so relaying a block or tx to any
+// number of peers costs one serialization and one double-SHA256.
+
+#ifndef _SERIALIZED_MESSAGE_H__
+#define _SERIALIZED_MESSAGE_H__
+
+#include "CoinNodeData.h"
+
+#include <boost/shared_ptr.hpp>
+
+namespace Coin
+{
+
+// Serialized bytes that are never modified once created.
+typedef boost::shared_ptr<const uchar_vector> SharedBuffer;
+
+class SerializedMessage
+{
+public:
+    SerializedMessage() { }
+    SerializedMessage(uint32_t magic, const CoinNodeStructure& payload);
+
+    // Reuses the header (and checksum) the message already computed.
+    explicit SerializedMessage(const CoinNodeMessage& message);
+
+    bool isNull() const { return !m_header; }
+
+    const MessageHeader& getMessageHeader() const { return m_messageHeader; }
+    const char* getCommand() const { return m_messageHeader.command; }
+    uint32_t getChecksum() const { return m_messageHeader.checksum; }
+
+    const SharedBuffer& getHeader() const { return m_header; }
+    const SharedBuffer& getPayload() const { return m_payload; }
+    std::size_t getSize() const { return m_header->size() + m_payload->size(); }
+
+    uchar_vector getSerialized() const { return *m_header + *m_payload; }
+
+private:
+    MessageHeader m_messageHeader;
+    SharedBuffer m_header;
+    SharedBuffer m_payload;
+};
+
+}; // namespace Coin
+
+#endif // _SERIALIZED_MESSAGE_H__
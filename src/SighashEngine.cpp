@@ -0,0 +1,130 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// SighashEngine.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "SighashEngine.h"
+#include "StandardTransactions.h"
+
+using namespace Coin;
+
+uchar_vector Coin::getSignatureHash(const Transaction& tx, uint index, const uchar_vector& subscript, unsigned char hashType)
+{
+    if (index >= tx.inputs.size()) throw std::runtime_error("Index out of range.");
+
+    Transaction copy(tx);
+    copy.clearScriptSigs();
+    copy.inputs[index].scriptSig = subscript;
+
+    switch (hashType & 0x1f) {
+    case SIGHASH_NONE:
+        copy.outputs.clear();
+        for (uint i = 0; i < copy.inputs.size(); i++)
+            if (i != index) copy.inputs[i].sequence = 0;
+        break;
+
+    case SIGHASH_SINGLE:
+        if (index >= copy.outputs.size()) {
+            uchar_vector one(32, 0);
+            one[0] = 1;
+            return one;
+        }
+        copy.outputs.resize(index + 1);
+        for (uint i = 0; i < index; i++) copy.outputs[i] = TxOut(0xffffffffffffffffull, uchar_vector());
+        for (uint i = 0; i < copy.inputs.size(); i++)
+            if (i != index) copy.inputs[i].sequence = 0;
+        break;
+    }
+
+    if (hashType & SIGHASH_ANYONECANPAY) {
+        TxIn input = copy.inputs[index];
+        copy.inputs.assign(1, input);
+    }
+
+    return copy.getHashWithAppendedCode(hashType);
+}
+
+SighashEngine::SighashEngine(const Transaction& tx)
+    : m_tx(tx)
+{
+    m_tx.clearScriptSigs();
+    m_serialized = m_tx.getSerialized();
+
+    // version, input count, then 36-byte outpoint, empty script and 4-byte sequence per input
+    std::size_t pos = 4 + VarInt(m_tx.inputs.size()).getSize();
+    std::size_t hashed = 0;
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    m_scriptOffsets.reserve(m_tx.inputs.size());
+    m_midstates.reserve(m_tx.inputs.size());
+    for (uint i = 0; i < m_tx.inputs.size(); i++) {
+        std::size_t offset = pos + 36;
+        SHA256_Update(&ctx, &m_serialized[hashed], offset - hashed);
+        hashed = offset;
+        m_scriptOffsets.push_back(offset);
+        m_midstates.push_back(ctx);
+        pos += 41;
+    }
+}
+
+uchar_vector SighashEngine::getHash(uint index, const uchar_vector& subscript, unsigned char hashType) const
+{
+    if (index >= m_scriptOffsets.size()) throw std::runtime_error("Index out of range.");
+    if (!isHashAll(hashType)) return getSignatureHash(m_tx, index, subscript, hashType);
+
+    uchar_vector hash(32);
+    getHashAll(index, subscript.empty() ? NULL : &subscript[0], subscript.size(), hashType, &hash[0]);
+    return hash;
+}
+
+void SighashEngine::getHashAll(uint index, const unsigned char* subscript, std::size_t length, uint32_t hashType, unsigned char* hash) const
+{
+    if (index >= m_scriptOffsets.size()) throw std::runtime_error("Index out of range.");
+
+    // script length as a VarInt
+    unsigned char lengthBytes[9];
+    std::size_t lengthSize;
+    if (length < 0xfd) {
+        lengthBytes[0] = length;
+        lengthSize = 1;
+    }
+    else if (length <= 0xffff) {
+        lengthBytes[0] = 0xfd;
+        lengthBytes[1] = length; lengthBytes[2] = length >> 8;
+        lengthSize = 3;
+    }
+    else {
+        lengthBytes[0] = 0xfe;
+        lengthBytes[1] = length; lengthBytes[2] = length >> 8; lengthBytes[3] = length >> 16; lengthBytes[4] = length >> 24;
+        lengthSize = 5;
+    }
+    unsigned char hashTypeBytes[4] = { (unsigned char)hashType, (unsigned char)(hashType >> 8), (unsigned char)(hashType >> 16), (unsigned char)(hashType >> 24) };
+
+    std::size_t offset = m_scriptOffsets[index];
+    SHA256_CTX ctx = m_midstates[index];
+    SHA256_Update(&ctx, lengthBytes, lengthSize);
+    if (length > 0) SHA256_Update(&ctx, subscript, length);
+    SHA256_Update(&ctx, &m_serialized[offset + 1], m_serialized.size() - offset - 1);
+    SHA256_Update(&ctx, hashTypeBytes, sizeof(hashTypeBytes));
+    SHA256_Final(hash, &ctx);
+    SHA256(hash, 32, hash);
+}
@@ -0,0 +1,77 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// SighashEngine.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Legacy (pre-segwit) signature hashes for every input of a transaction.
+//
+// The hash for input i covers the transaction with input i's scriptSig replaced by the
+// script being satisfied and every other scriptSig empty, so the serializations for all
+// inputs agree up to input i's script. SighashEngine serializes the transaction once and
+// keeps the SHA-256 state at the start of each input's script; a SIGHASH_ALL hash then
+// only feeds the subscript and the bytes after it. Those trailing bytes - the remaining
+// inputs, the outputs and the lock time - still have to be hashed for each input, since
+// SHA-256 can only resume from a prefix.
+
+#ifndef _SIGHASH_ENGINE_H__
+#define _SIGHASH_ENGINE_H__
+
+#include "CoinNodeData.h"
+
+#include <vector>
+
+#include <openssl/sha.h>
+
+namespace Coin
+{
+
+// Signature hash of input index, with subscript in place of its scriptSig, built from a copy of the
+// transaction. Handles every hash type; SIGHASH_SINGLE without a matching output gives the hash 1, as in bitcoind.
+uchar_vector getSignatureHash(const Transaction& tx, uint index, const uchar_vector& subscript, unsigned char hashType);
+
+class SighashEngine
+{
+public:
+    // Everything but NONE, SINGLE and ANYONECANPAY signs the transaction as is.
+    static bool isHashAll(uint32_t hashType) { return !(hashType & 0x80) && (hashType & 0x1f) != 2 && (hashType & 0x1f) != 3; }
+
+    explicit SighashEngine(const Transaction& tx);
+
+    std::size_t getInputCount() const { return m_scriptOffsets.size(); }
+
+    // Same as getSignatureHash(tx, index, subscript, hashType). Thread-safe.
+    uchar_vector getHash(uint index, const uchar_vector& subscript, unsigned char hashType) const;
+
+    // Writes the 32-byte hash without any allocations. Only for hash types that commit to every input and
+    // output as they are, like SIGHASH_ALL - see isHashAll().
+    void getHashAll(uint index, const unsigned char* subscript, std::size_t length, uint32_t hashType, unsigned char* hash) const;
+
+private:
+    Transaction m_tx;                           // for the hash types that change the transaction
+    uchar_vector m_serialized;                  // every scriptSig empty
+    std::vector<std::size_t> m_scriptOffsets;   // where each input's (zero) script length is
+    std::vector<SHA256_CTX> m_midstates;        // state after hashing m_serialized up to each offset
+};
+
+}; // namespace Coin
+
+#endif // _SIGHASH_ENGINE_H__
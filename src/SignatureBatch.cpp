@@ -0,0 +1,178 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// SignatureBatch.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "SignatureBatch.h"
+#include "StandardTransactions.h"
+#include "hash.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+using namespace Coin;
+
+namespace
+{
+    void verifyRange(const secp256k1::PublicKey* pubkeys, const unsigned char* digests, const unsigned char* signatures,
+                     unsigned char* results, std::size_t begin, std::size_t end)
+    {
+        secp256k1::verifyBatch(pubkeys + begin, digests + 32 * begin, signatures + 64 * begin, end - begin, results + begin);
+    }
+
+    // Reads the next push in script and advances pos past it. Returns false for anything else.
+    bool readPush(const uchar_vector& script, uint& pos, uchar_vector& data)
+    {
+        if (pos >= script.size() || script[pos] > 0x4e || script[pos] == 0) return false;
+        try {
+            uint32_t size = bytesPushData(script, pos);
+            if (size > script.size() - pos) return false;
+            data.assign(script.begin() + pos, script.begin() + pos + size);
+            pos += size;
+            return true;
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+    }
+}
+
+void SignatureBatch::add(const uchar_vector& pubkey, const uchar_vector& digest, const uchar_vector& signature)
+{
+    secp256k1::PublicKey key;
+    unsigned char sig[64];
+    if (digest.size() != 32 ||
+        pubkey.empty() || !secp256k1::parsePublicKey(&pubkey[0], pubkey.size(), key) ||
+        signature.empty() || !secp256k1::decodeDerSignature(&signature[0], signature.size(), sig)) {
+        addFailure();
+        return;
+    }
+
+    m_pubkeys.push_back(key);
+    m_digests.insert(m_digests.end(), digest.begin(), digest.end());
+    m_signatures.insert(m_signatures.end(), sig, sig + 64);
+    m_bParsed.push_back(true);
+}
+
+bool SignatureBatch::addInput(const SighashEngine& sighashEngine, const Transaction& tx, uint index, const uchar_vector& scriptPubKey)
+{
+    if (index >= tx.inputs.size()) throw std::runtime_error("Index out of range.");
+
+    // pay-to-pubkey-hash: OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG
+    bool bPayToPubKeyHash = scriptPubKey.size() == 25 && scriptPubKey[0] == 0x76 && scriptPubKey[1] == 0xa9 &&
+                            scriptPubKey[2] == 0x14 && scriptPubKey[23] == 0x88 && scriptPubKey[24] == 0xac;
+
+    // pay-to-pubkey: <33 or 65 bytes> OP_CHECKSIG
+    bool bPayToPubKey = (scriptPubKey.size() == 35 && scriptPubKey[0] == 33 && scriptPubKey[34] == 0xac) ||
+                        (scriptPubKey.size() == 67 && scriptPubKey[0] == 65 && scriptPubKey[66] == 0xac);
+
+    if (!bPayToPubKeyHash && !bPayToPubKey) return false;
+
+    const uchar_vector& scriptSig = tx.inputs[index].scriptSig;
+    uint pos = 0;
+    uchar_vector sig, pubkey;
+    if (!readPush(scriptSig, pos, sig) || sig.empty()) {
+        addFailure();
+        return true;
+    }
+
+    if (bPayToPubKeyHash) {
+        if (!readPush(scriptSig, pos, pubkey) ||
+            !std::equal(scriptPubKey.begin() + 3, scriptPubKey.begin() + 23, mdsha(pubkey).begin())) {
+            addFailure();
+            return true;
+        }
+    }
+    else {
+        pubkey.assign(scriptPubKey.begin() + 1, scriptPubKey.end() - 1);
+    }
+
+    if (pos != scriptSig.size()) {
+        addFailure();
+        return true;
+    }
+
+    unsigned char hashType = sig.back();
+    sig.pop_back();
+    add(pubkey, sighashEngine.getHash(index, scriptPubKey, hashType), sig);
+    return true;
+}
+
+std::size_t SignatureBatch::addTransaction(const Transaction& tx, const std::vector<uchar_vector>& scriptPubKeys)
+{
+    if (scriptPubKeys.size() != tx.inputs.size())
+        throw std::runtime_error("SignatureBatch::addTransaction - need one scriptPubKey per input.");
+
+    SighashEngine sighashEngine(tx);
+    std::size_t added = 0;
+    for (uint i = 0; i < tx.inputs.size(); i++) {
+        if (addInput(sighashEngine, tx, i, scriptPubKeys[i])) added++;
+    }
+    return added;
+}
+
+std::size_t SignatureBatch::addBlock(const CoinBlock& block, const std::vector<std::vector<uchar_vector> >& scriptPubKeys)
+{
+    if (scriptPubKeys.size() != block.txs.size())
+        throw std::runtime_error("SignatureBatch::addBlock - need scriptPubKeys for each transaction.");
+
+    std::size_t added = 0;
+    for (std::size_t i = 1; i < block.txs.size(); i++) added += addTransaction(block.txs[i], scriptPubKeys[i]);
+    return added;
+}
+
+void SignatureBatch::clear()
+{
+    m_pubkeys.clear();
+    m_digests.clear();
+    m_signatures.clear();
+    m_bParsed.clear();
+}
+
+int SignatureBatch::verify(std::vector<bool>* pResults, unsigned int nThreads) const
+{
+    std::size_t count = m_pubkeys.size();
+    if (pResults) pResults->assign(count, false);
+    if (count == 0) return -1;
+
+    std::vector<unsigned char> results(count);
+    parallelFor(count, getChunkCount(count, MIN_SIGNATURES_PER_THREAD, nThreads),
+                boost::bind(&verifyRange, &m_pubkeys[0], &m_digests[0], &m_signatures[0], &results[0], _2, _3));
+
+    int firstInvalid = -1;
+    for (std::size_t i = 0; i < count; i++) {
+        bool bValid = results[i] && m_bParsed[i];
+        if (pResults) (*pResults)[i] = bValid;
+        if (!bValid && firstInvalid < 0) firstInvalid = (int)i;
+    }
+    return firstInvalid;
+}
+
+void SignatureBatch::addFailure()
+{
+    m_pubkeys.push_back(secp256k1::PublicKey());
+    m_digests.insert(m_digests.end(), 32, 0);
+    m_signatures.insert(m_signatures.end(), 64, 0);
+    m_bParsed.push_back(false);
+}
@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// SignatureBatch.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Collects (public key, digest, signature) checks - typically every signature in a
+// transaction or block - and verifies them together. Large batches are split across
+// threads, and each thread shares a single scalar inversion across its signatures
+// (see secp256k1::verifyBatch).
+//
+// Inputs spending pay-to-pubkey and pay-to-pubkey-hash outputs are turned into checks
+// directly. Anything else (multisig, P2SH, nonstandard scripts) needs a script
+// interpreter and is left to the caller.
+
+#ifndef _SIGNATURE_BATCH_H__
+#define _SIGNATURE_BATCH_H__
+
+#include "CoinNodeData.h"
+#include "SighashEngine.h"
+#include "secp256k1math.h"
+
+#include <vector>
+
+#define MIN_SIGNATURES_PER_THREAD   16
+
+namespace Coin
+{
+
+class SignatureBatch
+{
+public:
+    SignatureBatch() { }
+
+    // signature is DER without the hash type byte. Keys and signatures that don't parse are
+    // kept as checks that fail.
+    void add(const uchar_vector& pubkey, const uchar_vector& digest, const uchar_vector& signature);
+
+    // Adds the check for input index of tx, which spends an output with scriptPubKey. Returns false,
+    // adding nothing, if scriptPubKey is neither pay-to-pubkey nor pay-to-pubkey-hash. A scriptSig
+    // that doesn't fit the script (wrong pushes, a key not matching the hash) is added as a failing check.
+    bool addInput(const Transaction& tx, uint index, const uchar_vector& scriptPubKey) { return addInput(SighashEngine(tx), tx, index, scriptPubKey); }
+
+    // scriptPubKeys[i] is the output spent by input i. Returns the number of inputs added.
+    std::size_t addTransaction(const Transaction& tx, const std::vector<uchar_vector>& scriptPubKeys);
+
+    // scriptPubKeys[i] are the spent outputs for block.txs[i]; the coinbase's entry is ignored.
+    std::size_t addBlock(const CoinBlock& block, const std::vector<std::vector<uchar_vector> >& scriptPubKeys);
+
+    std::size_t size() const { return m_pubkeys.size(); }
+    void clear();
+
+    // Returns the index of the first check that fails, or -1 if they all pass. If pResults isn't NULL
+    // it receives the result of every check. nThreads = 0 uses one thread per hardware thread.
+    int verify(std::vector<bool>* pResults = NULL, unsigned int nThreads = 0) const;
+
+private:
+    bool addInput(const SighashEngine& sighashEngine, const Transaction& tx, uint index, const uchar_vector& scriptPubKey);
+    void addFailure();
+
+    std::vector<secp256k1::PublicKey> m_pubkeys;
+    std::vector<unsigned char> m_digests;       // 32 bytes per check
+    std::vector<unsigned char> m_signatures;    // 64-byte r || s per check
+    std::vector<unsigned char> m_bParsed;       // false for checks that are known to fail
+};
+
+}; // namespace Coin
+
+#endif // _SIGNATURE_BATCH_H__
@@ -31,12 +31,34 @@
 #include "CoinKey.h"
 #include "hash.h"
 
+#include "SighashEngine.h"
+#include "ParallelFor.h"
+
 #include <map>
 #include <set>
 #include <sstream>
+#include <algorithm>
+
+#include <boost/bind.hpp>
 
 using namespace Coin;
 
+namespace
+{
+    void signRange(const SighashEngine* pSighashEngine, const std::vector<SignatureRequest>* pRequests, std::vector<uchar_vector>* pSigs,
+                   std::vector<unsigned char>* pFailed, std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; i++) {
+            const SignatureRequest& request = (*pRequests)[i];
+            uchar_vector hashToSign = pSighashEngine->getHash(request.inputIndex, request.subscript, request.sigHashType);
+            if (!request.pKey->sign(hashToSign, (*pSigs)[i])) {
+                (*pFailed)[chunk] = 1;
+                return;
+            }
+        }
+    }
+}
+
 // TODO: Move opPushData and bytesPushData to a script manipulation module and use them
 // wherever scripts are accessed.
 uchar_vector Coin::opPushData(uint32_t nBytes)
@@ -213,6 +235,35 @@ void P2AddressTxIn::setScriptSig(ScriptSigType scriptSigType)
 
 
 
+std::vector<uchar_vector> Coin::signInputs(const Transaction& tx, const std::vector<SignatureRequest>& requests, unsigned int nThreads)
+{
+    std::size_t count = requests.size();
+    std::vector<uchar_vector> sigs(count);
+    if (count == 0) return sigs;
+
+    for (std::size_t i = 0; i < count; i++) {
+        if (requests[i].inputIndex >= tx.inputs.size()) {
+            throw std::runtime_error("Invalid input index.");
+        }
+        if (!requests[i].pKey) {
+            throw std::runtime_error("Missing key.");
+        }
+    }
+
+    SighashEngine sighashEngine(tx);
+
+    std::size_t nChunks = getChunkCount(count, MIN_INPUTS_PER_SIGNING_THREAD, nThreads);
+    std::vector<unsigned char> failed(nChunks, 0);
+    parallelFor(count, nChunks, boost::bind(&signRange, &sighashEngine, &requests, &sigs, &failed, _1, _2, _3));
+
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end()) {
+        throw std::runtime_error("Signing failed.");
+    }
+    return sigs;
+}
+
+
+
 void MultiSigRedeemScript::setMinSigs(uint minSigs)
 {
     if (minSigs < 1) {
@@ -822,6 +873,45 @@ void TransactionBuilder::sign(uint index, const uchar_vector& pubKey, const std:
     inputs[index]->addSig(pubKey, sig, sigHashType);
 }
 
+uint TransactionBuilder::signAll(const std::vector<CoinKey>& keys, SigHashType sigHashType, unsigned int nThreads)
+{
+    std::map<uchar_vector, const CoinKey*> mapPubKeyToKey;
+    for (uint i = 0; i < keys.size(); i++) {
+        if (!keys[i].isPrivate()) continue; // public-only keys can't sign
+        CoinKey key(keys[i]);
+        key.setCompressed(true);
+        mapPubKeyToKey[key.getPublicKey()] = &keys[i];
+        key.setCompressed(false);
+        mapPubKeyToKey[key.getPublicKey()] = &keys[i];
+    }
+
+    std::vector<SignatureRequest> requests;
+    std::vector<uchar_vector> requestPubKeys;
+    std::vector<InputSigRequest>& missing = getMissingSigs();
+    for (uint i = 0; i < missing.size(); i++) {
+        uint needed = missing[i].minSigsStillNeeded;
+        uint index = missing[i].inputIndex;
+        for (uint j = 0; j < missing[i].pubKeys.size() && needed > 0; j++) {
+            std::map<uchar_vector, const CoinKey*>::iterator it = mapPubKeyToKey.find(missing[i].pubKeys[j]);
+            if (it == mapPubKeyToKey.end()) continue;
+
+            inputs[index]->setScriptSig(SCRIPT_SIG_SIGN);
+            requests.push_back(SignatureRequest(index, inputs[index]->scriptSig, it->second, sigHashType));
+            requestPubKeys.push_back(missing[i].pubKeys[j]);
+            needed--;
+        }
+    }
+    if (requests.empty()) return 0;
+
+    std::vector<uchar_vector> sigs = signInputs(getTx(SCRIPT_SIG_SIGN), requests, nThreads);
+    for (uint i = 0; i < requests.size(); i++) {
+        inputs[requests[i].inputIndex]->addSig(requestPubKeys[i], sigs[i], sigHashType);
+    }
+
+    bMissingSigsUpdated = false;
+    return requests.size();
+}
+
 void TransactionBuilder::clearInputs()
 {
     if (inputs.size() > 0) {
@@ -37,6 +37,8 @@
 #include <set>
 #include <sstream>
 
+#define MIN_INPUTS_PER_SIGNING_THREAD 8
+
 namespace Coin {
 
 const unsigned char BITCOIN_ADDRESS_VERSIONS[] = {0x00, 0x05};
@@ -254,6 +256,24 @@ public:
     }
 };
 
+// One signature for signInputs(): subscript stands in for input inputIndex's scriptSig while hashing.
+class SignatureRequest
+{
+public:
+    uint32_t inputIndex;
+    uchar_vector subscript;
+    const CoinKey* pKey;
+    SigHashType sigHashType;
+
+    SignatureRequest(uint32_t _inputIndex, const uchar_vector& _subscript, const CoinKey* _pKey, SigHashType _sigHashType = SIGHASH_ALL)
+        : inputIndex(_inputIndex), subscript(_subscript), pKey(_pKey), sigHashType(_sigHashType) { }
+};
+
+// Returns the DER signatures (without hash type bytes) for requests against tx, whose own scriptSigs are ignored.
+// tx is serialized once and the requests are hashed and signed on nThreads threads (0 = one per hardware thread).
+// Throws if a key can't sign.
+std::vector<uchar_vector> signInputs(const Transaction& tx, const std::vector<SignatureRequest>& requests, unsigned int nThreads = 0);
+
 class TransactionBuilder
 {
 private:
@@ -302,6 +322,11 @@ public:
 
     void sign(uint index, const uchar_vector& pubKey, const uchar_vector& privKey, SigHashType sigHashType = SIGHASH_ALL);
     void sign(uint index, const uchar_vector& pubKey, const std::string& privKey, SigHashType sigHashType = SIGHASH_ALL);
+
+    // Signs every input still missing signatures with whichever of keys it needs, matching keys to the
+    // inputs' pubkeys in either compressed or uncompressed form. Keys without a private part are ignored.
+    // Returns the number of signatures added.
+    uint signAll(const std::vector<CoinKey>& keys, SigHashType sigHashType = SIGHASH_ALL, unsigned int nThreads = 0);
 };
 
 
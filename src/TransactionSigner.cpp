@@ -27,6 +27,7 @@
 #include "CoinNodeData.h"
 #include "Base58Check.h"
 #include "CoinKey.h"
+#include "StandardTransactions.h"
 
 using namespace Coin;
 
@@ -61,49 +62,7 @@ Transaction CreateTransaction(
         tx.addOutput(txout);
     }
 
-    // add input outpoints and sequences
-    for (uint i = 0; i < claims.size(); i++) {
-        TxIn txin(claims[i].outPoint, "", claims[i].sequence);
-        tx.addInput(txin);
-    }
-
-    // compute signature for each input
-    std::vector<uchar_vector> signatures;
-    std::vector<uchar_vector> pubKeys;
-    for (uint i = 0; i < claims.size(); i++) {
-        CoinKey key;
-        if (claims[i].walletImport != "") {
-            if (!key.setWalletImport(claims[i].walletImport))
-                throw std::runtime_error("Invalid wallet import key.");
-        }
-        else if (!key.setPrivateKey(claims[i].privKey))
-            throw std::runtime_error("Error setting private key.");
-
-        uchar_vector fromPubKey = key.getPublicKey();
-        uchar_vector fromPubKeyHash = ripemd160(sha256(fromPubKey));
-
-        tx.clearScriptSigs();
-        tx.setScriptSig(i, prefix + fromPubKeyHash + suffix);
-
-        uchar_vector signature;
-        if (!key.sign(tx.getHashWithAppendedCode(1), signature))
-            throw std::runtime_error("Error trying to sign.");
-
-        signatures.push_back(signature);
-        pubKeys.push_back(fromPubKey);
-    }
-
-    // add signatures to transaction
-    for (uint i = 0; i < claims.size(); i++) {
-        uchar_vector scriptSig;
-        scriptSig.push_back(signatures[i].size() + 1);
-        scriptSig += signatures[i];
-        scriptSig.push_back(1); // hash type byte
-        scriptSig.push_back(pubKeys[i].size());
-        scriptSig += pubKeys[i];
-
-        tx.setScriptSig(i, scriptSig);
-    }
+    SignTransaction(claims, tx);
 
     return tx;
 }
@@ -125,11 +84,13 @@ void SignTransaction(const std::vector<BasicInput>& claims, Transaction& tx)
         TxIn txin(claims[i].outPoint, "", claims[i].sequence);
         tx.addInput(txin);
     }
-    // compute signature for each input
-    std::vector<uchar_vector> signatures;
+
+    // parse the keys up front - the signatures are computed together
+    std::vector<CoinKey> keys(claims.size());
     std::vector<uchar_vector> pubKeys;
+    std::vector<SignatureRequest> requests;
     for (uint i = 0; i < claims.size(); i++) {
-        CoinKey key;
+        CoinKey& key = keys[i];
         if (claims[i].walletImport != "") {
             if (!key.setWalletImport(claims[i].walletImport))
                 throw std::runtime_error("Invalid wallet import key.");
@@ -140,17 +101,12 @@ void SignTransaction(const std::vector<BasicInput>& claims, Transaction& tx)
         uchar_vector fromPubKey = key.getPublicKey();
         uchar_vector fromPubKeyHash = ripemd160(sha256(fromPubKey));
 
-        tx.clearScriptSigs();
-        tx.setScriptSig(i, prefix + fromPubKeyHash + suffix);
-
-        uchar_vector signature;
-        if (!key.sign(tx.getHashWithAppendedCode(1), signature))
-            throw std::runtime_error("Error trying to sign.");
-
-        signatures.push_back(signature);
+        requests.push_back(SignatureRequest(i, prefix + fromPubKeyHash + suffix, &key));
         pubKeys.push_back(fromPubKey);
     }
 
+    std::vector<uchar_vector> signatures = signInputs(tx, requests);
+
     // add signatures to transaction
     for (uint i = 0; i < claims.size(); i++) {
         uchar_vector scriptSig;
@@ -0,0 +1,589 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// UtxoSet.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "UtxoSet.h"
+#include "hash.h"
+#include "ParallelFor.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#define MAX_SCRIPT_SIZE 10000
+
+using namespace Coin;
+
+const uint32_t UtxoSet::NO_NODE = 0xffffffff;
+
+namespace
+{
+    // Base 128 with the continuation bit on all but the last byte, most significant group first. Each
+    // continuation subtracts one so that every value has exactly one encoding (as in bitcoind).
+    void writeVarInt(uchar_vector& out, uint64_t n)
+    {
+        unsigned char tmp[10];
+        int len = 0;
+        while (true) {
+            tmp[len] = (n & 0x7f) | (len ? 0x80 : 0x00);
+            if (n <= 0x7f) break;
+            n = (n >> 7) - 1;
+            len++;
+        }
+        do {
+            out.push_back(tmp[len]);
+        } while (len--);
+    }
+
+    const unsigned char* readVarInt(const unsigned char* p, const unsigned char* end, uint64_t& n)
+    {
+        n = 0;
+        while (true) {
+            if (p >= end) throw std::runtime_error("UtxoSet - compressed data is truncated.");
+            if (n > (0xffffffffffffffffull >> 7)) throw std::runtime_error("UtxoSet - varint is too large.");
+            unsigned char ch = *p++;
+            n = (n << 7) | (ch & 0x7f);
+            if (!(ch & 0x80)) return p;
+            if (n == 0xffffffffffffffffull) throw std::runtime_error("UtxoSet - varint is too large.");
+            n++;
+        }
+    }
+
+    inline bool isUnspendable(const uchar_vector& script)
+    {
+        return (!script.empty() && script[0] == 0x6a) || script.size() > MAX_SCRIPT_SIZE; // OP_RETURN
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Compression
+//
+uint64_t Coin::compressAmount(uint64_t amount)
+{
+    if (amount == 0) return 0;
+    int e = 0;
+    while ((amount % 10) == 0 && e < 9) {
+        amount /= 10;
+        e++;
+    }
+    if (e < 9) {
+        int d = amount % 10;
+        amount /= 10;
+        return 1 + (amount * 9 + d - 1) * 10 + e;
+    }
+    return 1 + (amount - 1) * 10 + 9;
+}
+
+uint64_t Coin::decompressAmount(uint64_t compressed)
+{
+    if (compressed == 0) return 0;
+    compressed--;
+    int e = compressed % 10;
+    compressed /= 10;
+    uint64_t amount;
+    if (e < 9) {
+        int d = (compressed % 9) + 1;
+        compressed /= 9;
+        amount = compressed * 10 + d;
+    }
+    else {
+        amount = compressed + 1;
+    }
+    while (e-- > 0) amount *= 10;
+    return amount;
+}
+
+// 0: pay-to-pubkey-hash, 1: pay-to-script-hash, 2 and 3: pay-to-pubkey with a compressed key.
+// 4 and 5 are bitcoind's codes for uncompressed keys - not produced here. Anything else is stored
+// as its size + 6 followed by the script.
+void Coin::compressScript(const uchar_vector& script, uchar_vector& compressed)
+{
+    if (script.size() == 25 && script[0] == 0x76 && script[1] == 0xa9 && script[2] == 0x14 && script[23] == 0x88 && script[24] == 0xac) {
+        compressed.push_back(0x00);
+        compressed.insert(compressed.end(), script.begin() + 3, script.begin() + 23);
+    }
+    else if (script.size() == 23 && script[0] == 0xa9 && script[1] == 0x14 && script[22] == 0x87) {
+        compressed.push_back(0x01);
+        compressed.insert(compressed.end(), script.begin() + 2, script.begin() + 22);
+    }
+    else if (script.size() == 35 && script[0] == 0x21 && (script[1] == 0x02 || script[1] == 0x03) && script[34] == 0xac) {
+        compressed.insert(compressed.end(), script.begin() + 1, script.begin() + 34);
+    }
+    else {
+        writeVarInt(compressed, script.size() + 6);
+        compressed.insert(compressed.end(), script.begin(), script.end());
+    }
+}
+
+const unsigned char* Coin::decompressScript(const unsigned char* begin, const unsigned char* end, uchar_vector& script)
+{
+    uint64_t code;
+    const unsigned char* p = readVarInt(begin, end, code);
+    script.clear();
+    switch (code) {
+    case 0x00:
+        if (end - p < 20) break;
+        script.push_back(0x76); script.push_back(0xa9); script.push_back(0x14);
+        script.insert(script.end(), p, p + 20);
+        script.push_back(0x88); script.push_back(0xac);
+        return p + 20;
+
+    case 0x01:
+        if (end - p < 20) break;
+        script.push_back(0xa9); script.push_back(0x14);
+        script.insert(script.end(), p, p + 20);
+        script.push_back(0x87);
+        return p + 20;
+
+    case 0x02:
+    case 0x03:
+        if (end - p < 32) break;
+        script.push_back(0x21); script.push_back(code);
+        script.insert(script.end(), p, p + 32);
+        script.push_back(0xac);
+        return p + 32;
+
+    case 0x04:
+    case 0x05:
+        throw std::runtime_error("decompressScript() - uncompressed pubkey encoding is not supported.");
+
+    default:
+        if ((uint64_t)(end - p) < code - 6) break;
+        script.assign(p, p + (code - 6));
+        return p + (code - 6);
+    }
+    throw std::runtime_error("decompressScript() - compressed script is truncated.");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class UtxoCoin implementation
+//
+uchar_vector UtxoCoin::getCompressed() const
+{
+    uchar_vector compressed;
+    compressed.reserve(scriptPubKey.size() + 16);
+    writeVarInt(compressed, (uint64_t)height * 2 + (bCoinbase ? 1 : 0));
+    writeVarInt(compressed, compressAmount(value));
+    compressScript(scriptPubKey, compressed);
+    return compressed;
+}
+
+void UtxoCoin::setCompressed(const uchar_vector& compressed)
+{
+    const unsigned char* p = compressed.empty() ? NULL : &compressed[0];
+    const unsigned char* end = p + compressed.size();
+    uint64_t code;
+    p = readVarInt(p, end, code);
+    height = code >> 1;
+    bCoinbase = code & 1;
+    p = readVarInt(p, end, code);
+    value = decompressAmount(code);
+    p = decompressScript(p, end, scriptPubKey);
+    if (p != end) throw std::runtime_error("UtxoCoin::setCompressed() - extra bytes.");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class UtxoUndo implementation
+//
+uchar_vector UtxoUndo::getSerialized() const
+{
+    uchar_vector rval;
+    writeVarInt(rval, spentCoins.size());
+    for (std::size_t i = 0; i < spentCoins.size(); i++) {
+        rval.insert(rval.end(), spentCoins[i].key.bytes, spentCoins[i].key.bytes + 36);
+        writeVarInt(rval, spentCoins[i].coin.size());
+        rval += spentCoins[i].coin;
+    }
+    return rval;
+}
+
+void UtxoUndo::setSerialized(const uchar_vector& bytes)
+{
+    const unsigned char* p = bytes.empty() ? NULL : &bytes[0];
+    const unsigned char* end = p + bytes.size();
+    uint64_t count;
+    p = readVarInt(p, end, count);
+    if (count > bytes.size() / 37) throw std::runtime_error("UtxoUndo::setSerialized() - invalid count.");
+
+    spentCoins.resize(count);
+    for (uint64_t i = 0; i < count; i++) {
+        if (end - p < 36) throw std::runtime_error("UtxoUndo::setSerialized() - data is truncated.");
+        memcpy(spentCoins[i].key.bytes, p, 36);
+        uint64_t size;
+        p = readVarInt(p + 36, end, size);
+        if ((uint64_t)(end - p) < size) throw std::runtime_error("UtxoUndo::setSerialized() - data is truncated.");
+        spentCoins[i].coin.assign(p, p + size);
+        p += size;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class UtxoSet implementation
+//
+UtxoSet::UtxoSet(UtxoStore* pStore, std::size_t maxCacheSize)
+    : m_pStore(pStore), m_maxCacheSize(std::max<std::size_t>(maxCacheSize, 1)), m_lruHead(NO_NODE), m_lruTail(NO_NODE), m_dirtyCount(0)
+{
+    std::size_t capacity = 1024;
+    while (capacity < 2 * m_maxCacheSize && capacity < 0x80000000) capacity <<= 1;
+    Slot empty = { 0, NO_NODE };
+    m_slots.assign(capacity, empty);
+    m_mask = capacity - 1;
+
+    m_bestBlock = m_pStore->getBestBlock();
+}
+
+uint32_t UtxoSet::findNode(const UtxoKey& key) const
+{
+    uint32_t fingerprint = key.getHash();
+    for (std::size_t i = slotPosition(fingerprint);; i = (i + 1) & m_mask) {
+        const Slot& slot = m_slots[i];
+        if (slot.node == NO_NODE) return NO_NODE;
+        if (slot.fingerprint == fingerprint && m_nodes[slot.node].key == key) return slot.node;
+    }
+}
+
+uint32_t UtxoSet::fetchNode(const UtxoKey& key)
+{
+    uint32_t node = findNode(key);
+    if (node != NO_NODE) {
+        touch(node);
+        return node;
+    }
+
+    uchar_vector coin;
+    if (!m_pStore->get(key, coin)) return NO_NODE;
+    return addNode(key, coin, 0);
+}
+
+uint32_t UtxoSet::addNode(const UtxoKey& key, const uchar_vector& coin, unsigned char flags)
+{
+    if (2 * (m_nodes.size() - m_freeNodes.size() + 1) > m_slots.size()) growTable();
+
+    uint32_t node;
+    if (!m_freeNodes.empty()) {
+        node = m_freeNodes.back();
+        m_freeNodes.pop_back();
+    }
+    else {
+        if (m_nodes.size() >= NO_NODE) throw std::runtime_error("UtxoSet - cache is full.");
+        node = m_nodes.size();
+        m_nodes.push_back(Node());
+    }
+
+    Node& n = m_nodes[node];
+    n.key = key;
+    n.coin = coin;
+    n.flags = flags;
+    if (flags & DIRTY) m_dirtyCount++;
+
+    // Link in at the front of the LRU list
+    n.prev = NO_NODE;
+    n.next = m_lruHead;
+    if (m_lruHead != NO_NODE) m_nodes[m_lruHead].prev = node;
+    m_lruHead = node;
+    if (m_lruTail == NO_NODE) m_lruTail = node;
+
+    uint32_t fingerprint = key.getHash();
+    std::size_t i = slotPosition(fingerprint);
+    while (m_slots[i].node != NO_NODE) i = (i + 1) & m_mask;
+    m_slots[i].fingerprint = fingerprint;
+    m_slots[i].node = node;
+    return node;
+}
+
+void UtxoSet::removeNode(uint32_t node)
+{
+    Node& n = m_nodes[node];
+    uint32_t fingerprint = n.key.getHash();
+    std::size_t i = slotPosition(fingerprint);
+    while (m_slots[i].node != node) i = (i + 1) & m_mask;
+
+    // Backward shift deletion - no tombstones.
+    for (std::size_t j = (i + 1) & m_mask; m_slots[j].node != NO_NODE; j = (j + 1) & m_mask) {
+        std::size_t home = slotPosition(m_slots[j].fingerprint);
+        bool bStay = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!bStay) {
+            m_slots[i] = m_slots[j];
+            i = j;
+        }
+    }
+    m_slots[i].node = NO_NODE;
+
+    unlink(node);
+    if (n.flags & DIRTY) m_dirtyCount--;
+    uchar_vector().swap(n.coin);
+    m_freeNodes.push_back(node);
+}
+
+void UtxoSet::unlink(uint32_t node)
+{
+    Node& n = m_nodes[node];
+    if (n.prev != NO_NODE) m_nodes[n.prev].next = n.next;
+    else m_lruHead = n.next;
+    if (n.next != NO_NODE) m_nodes[n.next].prev = n.prev;
+    else m_lruTail = n.prev;
+}
+
+void UtxoSet::touch(uint32_t node)
+{
+    if (node == m_lruHead) return;
+    unlink(node);
+    Node& n = m_nodes[node];
+    n.prev = NO_NODE;
+    n.next = m_lruHead;
+    m_nodes[m_lruHead].prev = node;
+    m_lruHead = node;
+}
+
+void UtxoSet::growTable()
+{
+    std::vector<Slot> oldSlots;
+    oldSlots.swap(m_slots);
+    Slot empty = { 0, NO_NODE };
+    m_slots.assign(2 * oldSlots.size(), empty);
+    m_mask = m_slots.size() - 1;
+    for (std::size_t j = 0; j < oldSlots.size(); j++) {
+        if (oldSlots[j].node == NO_NODE) continue;
+        std::size_t i = slotPosition(oldSlots[j].fingerprint);
+        while (m_slots[i].node != NO_NODE) i = (i + 1) & m_mask;
+        m_slots[i] = oldSlots[j];
+    }
+}
+
+void UtxoSet::writeBack(Node& node)
+{
+    if (!(node.flags & DIRTY)) return;
+
+    if (node.flags & SPENT) {
+        if (!(node.flags & FRESH)) m_pStore->erase(node.key);
+    }
+    else {
+        m_pStore->put(node.key, node.coin);
+    }
+    node.flags &= ~(DIRTY | FRESH);
+    m_dirtyCount--;
+}
+
+void UtxoSet::evict()
+{
+    while (m_nodes.size() - m_freeNodes.size() > m_maxCacheSize) {
+        uint32_t node = m_lruTail;
+        writeBack(m_nodes[node]);
+        removeNode(node);
+    }
+}
+
+void UtxoSet::addCoin(const UtxoKey& key, const uchar_vector& coin, bool bPossibleOverwrite)
+{
+    uint32_t node = findNode(key);
+    if (node == NO_NODE) {
+        // Transaction hashes are unique apart from a couple of old coinbases, so a new coin isn't in the store.
+        addNode(key, coin, DIRTY | (bPossibleOverwrite ? 0 : FRESH));
+        return;
+    }
+
+    Node& n = m_nodes[node];
+    n.coin = coin;
+    // A spent coin that's still in the store has to stay non-fresh so that the store gets updated.
+    if (n.flags & SPENT) n.flags &= ~(SPENT | FRESH);
+    if (!(n.flags & DIRTY)) {
+        n.flags |= DIRTY;
+        m_dirtyCount++;
+    }
+    touch(node);
+}
+
+bool UtxoSet::spendCoin(const UtxoKey& key, uchar_vector* pCoin)
+{
+    uint32_t node = fetchNode(key);
+    if (node == NO_NODE) return false;
+
+    Node& n = m_nodes[node];
+    if (n.flags & SPENT) return false;
+
+    if (pCoin) pCoin->swap(n.coin);
+    if (n.flags & FRESH) {
+        removeNode(node);
+        return true;
+    }
+
+    uchar_vector().swap(n.coin);
+    n.flags |= SPENT;
+    if (!(n.flags & DIRTY)) {
+        n.flags |= DIRTY;
+        m_dirtyCount++;
+    }
+    return true;
+}
+
+void UtxoSet::prepareTxs(const CoinBlock& block, uint32_t height, std::vector<PreparedTx>& txs, std::size_t begin, std::size_t end)
+{
+    for (std::size_t i = begin; i < end; i++) {
+        const Transaction& tx = block.txs[i];
+        PreparedTx& prepared = txs[i];
+
+        uchar_vector serialized = tx.getSerialized();
+        sha256_2(&serialized[0], serialized.size(), prepared.hash);
+        std::reverse(prepared.hash, prepared.hash + 32);
+
+        prepared.coins.resize(tx.outputs.size());
+        for (std::size_t j = 0; j < tx.outputs.size(); j++) {
+            if (isUnspendable(tx.outputs[j].scriptPubKey)) continue;
+            prepared.coins[j] = UtxoCoin(tx.outputs[j], height, i == 0).getCompressed();
+        }
+    }
+}
+
+void UtxoSet::disconnect(const CoinBlock& block, const std::vector<PreparedTx>& txs, std::size_t txCount, const UtxoUndo& undo, std::size_t undoCount)
+{
+    // Last transaction first - its inputs may be outputs of earlier ones in the block.
+    for (std::size_t i = txCount; i-- > 0;) {
+        const PreparedTx& tx = txs[i];
+        for (std::size_t j = 0; j < tx.coins.size(); j++) {
+            if (!tx.coins[j].empty()) spendCoin(UtxoKey(tx.hash, j), NULL);
+        }
+        if (i == 0) break;
+        for (std::size_t j = block.txs[i].inputs.size(); j-- > 0;) {
+            const UtxoUndo::SpentCoin& spent = undo.spentCoins[--undoCount];
+            addCoin(spent.key, spent.coin, true);
+        }
+    }
+}
+
+void UtxoSet::applyBlock(const CoinBlock& block, uint32_t height, UtxoUndo* pUndo, unsigned int nThreads)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    if (!m_bestBlock.empty() && block.blockHeader.prevBlockHash != m_bestBlock) {
+        throw std::runtime_error("UtxoSet::applyBlock() - block does not build on the best block.");
+    }
+
+    // Hashing the transactions and compressing their outputs is most of the work - do that in parallel.
+    std::size_t count = block.txs.size();
+    std::vector<PreparedTx> txs(count);
+    parallelFor(count, getChunkCount(count, MIN_UTXO_TXS_PER_THREAD, nThreads),
+                boost::bind(&UtxoSet::prepareTxs, boost::cref(block), height, boost::ref(txs), _2, _3));
+
+    // The cache updates themselves are in block order, since transactions can spend outputs of earlier ones.
+    UtxoUndo undo;
+    for (std::size_t i = 0; i < count; i++) {
+        const Transaction& tx = block.txs[i];
+        if (i > 0) {
+            std::size_t undoStart = undo.spentCoins.size();
+            for (std::size_t j = 0; j < tx.inputs.size(); j++) {
+                UtxoKey key(tx.inputs[j].previousOut);
+                uchar_vector coin;
+                if (!spendCoin(key, &coin)) {
+                    for (std::size_t k = undo.spentCoins.size(); k-- > undoStart;) {
+                        addCoin(undo.spentCoins[k].key, undo.spentCoins[k].coin, true);
+                    }
+                    disconnect(block, txs, i, undo, undoStart);
+                    throw std::runtime_error("UtxoSet::applyBlock() - missing input " + tx.inputs[j].previousOut.toDelimited(":"));
+                }
+                undo.spentCoins.push_back(UtxoUndo::SpentCoin(key, coin));
+            }
+        }
+        const PreparedTx& prepared = txs[i];
+        for (std::size_t j = 0; j < prepared.coins.size(); j++) {
+            if (!prepared.coins[j].empty()) addCoin(UtxoKey(prepared.hash, j), prepared.coins[j], i == 0);
+        }
+    }
+
+    if (pUndo) pUndo->spentCoins.swap(undo.spentCoins);
+    m_bestBlock = block.blockHeader.getHashLittleEndian();
+    evict();
+}
+
+void UtxoSet::undoBlock(const CoinBlock& block, const UtxoUndo& undo)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    if (block.blockHeader.getHashLittleEndian() != m_bestBlock) {
+        throw std::runtime_error("UtxoSet::undoBlock() - block is not the best block.");
+    }
+
+    std::size_t inputCount = 0;
+    for (std::size_t i = 1; i < block.txs.size(); i++) {
+        inputCount += block.txs[i].inputs.size();
+    }
+    if (inputCount != undo.spentCoins.size()) throw std::runtime_error("UtxoSet::undoBlock() - undo data does not match block.");
+
+    std::vector<PreparedTx> txs(block.txs.size());
+    prepareTxs(block, 0, txs, 0, txs.size());
+    disconnect(block, txs, txs.size(), undo, undo.spentCoins.size());
+
+    m_bestBlock = block.blockHeader.prevBlockHash;
+    evict();
+}
+
+bool UtxoSet::getCoin(const OutPoint& outPoint, UtxoCoin& coin)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    uint32_t node = fetchNode(UtxoKey(outPoint));
+    if (node == NO_NODE || (m_nodes[node].flags & SPENT)) return false;
+    coin.setCompressed(m_nodes[node].coin);
+    evict();
+    return true;
+}
+
+bool UtxoSet::haveCoin(const OutPoint& outPoint)
+{
+    UtxoCoin coin;
+    return getCoin(outPoint, coin);
+}
+
+uchar_vector UtxoSet::getBestBlock() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_bestBlock;
+}
+
+void UtxoSet::flush()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    for (uint32_t node = m_lruHead; node != NO_NODE;) {
+        Node& n = m_nodes[node];
+        uint32_t next = n.next;
+        writeBack(n);
+        if (n.flags & SPENT) removeNode(node);
+        node = next;
+    }
+    m_pStore->commit(m_bestBlock);
+}
+
+std::size_t UtxoSet::getCacheSize() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_nodes.size() - m_freeNodes.size();
+}
+
+std::size_t UtxoSet::getDirtyCount() const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    return m_dirtyCount;
+}
@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// UtxoSet.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Unspent transaction outputs, updated a block at a time. Coins are kept
+// compressed the same way bitcoind does it: amounts are stored as a mantissa and
+// a power of ten, and pay-to-pubkey-hash, pay-to-script-hash and compressed
+// pay-to-pubkey scripts shrink to their hash or key.
+//
+// A write-back LRU cache sits in front of a UtxoStore. Changes are written to the
+// store when dirty coins are evicted and on flush(), which also commits the store.
+
+#ifndef _UTXO_SET_H__
+#define _UTXO_SET_H__
+
+#include "CoinNodeData.h"
+#include "UtxoStore.h"
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#define DEFAULT_UTXO_CACHE_SIZE     1000000 // coins
+#define MIN_UTXO_TXS_PER_THREAD     250     // don't split smaller blocks across threads
+
+namespace Coin
+{
+
+uint64_t compressAmount(uint64_t amount);
+uint64_t decompressAmount(uint64_t compressed);
+
+// Uncompressed pubkeys are kept as they are - compressing them would mean decompressing them again on every read.
+void compressScript(const uchar_vector& script, uchar_vector& compressed);
+const unsigned char* decompressScript(const unsigned char* begin, const unsigned char* end, uchar_vector& script);
+
+class UtxoCoin
+{
+public:
+    uint64_t value;
+    uchar_vector scriptPubKey;
+    uint32_t height;
+    bool bCoinbase;
+
+    UtxoCoin() : value(0), height(0), bCoinbase(false) { }
+    UtxoCoin(const TxOut& txOut, uint32_t _height, bool _bCoinbase)
+        : value(txOut.value), scriptPubKey(txOut.scriptPubKey), height(_height), bCoinbase(_bCoinbase) { }
+    UtxoCoin(const uchar_vector& compressed) { this->setCompressed(compressed); }
+
+    uchar_vector getCompressed() const;
+    void setCompressed(const uchar_vector& compressed);
+
+    TxOut getTxOut() const { return TxOut(value, scriptPubKey); }
+};
+
+// The coins a block spent, in the order it spent them - what undoBlock needs to put them back.
+class UtxoUndo
+{
+public:
+    struct SpentCoin
+    {
+        UtxoKey key;
+        uchar_vector coin; // compressed
+
+        SpentCoin() { }
+        SpentCoin(const UtxoKey& _key, const uchar_vector& _coin) : key(_key), coin(_coin) { }
+    };
+
+    std::vector<SpentCoin> spentCoins;
+
+    UtxoUndo() { }
+    UtxoUndo(const uchar_vector& bytes) { this->setSerialized(bytes); }
+
+    uchar_vector getSerialized() const;
+    void setSerialized(const uchar_vector& bytes);
+};
+
+class UtxoSet
+{
+public:
+    // The store must outlive the set. The best block starts out as the store's.
+    UtxoSet(UtxoStore* pStore, std::size_t maxCacheSize = DEFAULT_UTXO_CACHE_SIZE);
+    ~UtxoSet() { }
+
+    bool getCoin(const OutPoint& outPoint, UtxoCoin& coin);
+    bool haveCoin(const OutPoint& outPoint);
+
+    // Spends the block's inputs and adds its outputs, except provably unspendable ones. The block must build on
+    // the best block unless the set is empty. Throws if an input is missing, leaving the set unchanged.
+    // Transactions are hashed and their outputs compressed on nThreads threads - 0 to use one per core.
+    void applyBlock(const CoinBlock& block, uint32_t height, UtxoUndo* pUndo = NULL, unsigned int nThreads = 0);
+
+    // Reverses applyBlock for the best block, using the undo data it produced.
+    void undoBlock(const CoinBlock& block, const UtxoUndo& undo);
+
+    // Display order, empty if no block has been applied.
+    uchar_vector getBestBlock() const;
+
+    // Writes all changes to the store and commits them.
+    void flush();
+
+    std::size_t getCacheSize() const;
+    std::size_t getDirtyCount() const;
+
+private:
+    UtxoSet(const UtxoSet&);
+    UtxoSet& operator=(const UtxoSet&);
+
+    static const uint32_t NO_NODE;
+
+    enum
+    {
+        DIRTY = 0x01,   // differs from the store
+        FRESH = 0x02,   // not in the store, so it can be dropped once spent
+        SPENT = 0x04
+    };
+
+    struct Node
+    {
+        UtxoKey key;
+        uchar_vector coin;
+        uint32_t prev;  // LRU list, most recently used first
+        uint32_t next;
+        unsigned char flags;
+    };
+
+    struct Slot
+    {
+        uint32_t fingerprint;
+        uint32_t node;  // NO_NODE if empty
+    };
+
+    // Per transaction results of the parallel pass over a block.
+    struct PreparedTx
+    {
+        unsigned char hash[32]; // display order, like OutPoint::hash
+        std::vector<uchar_vector> coins; // compressed outputs, empty for unspendable ones
+    };
+
+    static void prepareTxs(const CoinBlock& block, uint32_t height, std::vector<PreparedTx>& txs, std::size_t begin, std::size_t end);
+
+    // Cache
+    uint32_t findNode(const UtxoKey& key) const;
+    uint32_t fetchNode(const UtxoKey& key); // loads from the store on a miss, NO_NODE if neither has it
+    uint32_t addNode(const UtxoKey& key, const uchar_vector& coin, unsigned char flags);
+    void removeNode(uint32_t node);
+    void touch(uint32_t node);
+    void unlink(uint32_t node);
+    void writeBack(Node& node);
+    void evict();
+    void growTable();
+    std::size_t slotPosition(uint32_t fingerprint) const { return (fingerprint * 0x9e3779b1) & m_mask; }
+
+    void addCoin(const UtxoKey& key, const uchar_vector& coin, bool bPossibleOverwrite);
+    bool spendCoin(const UtxoKey& key, uchar_vector* pCoin);
+    void disconnect(const CoinBlock& block, const std::vector<PreparedTx>& txs, std::size_t txCount, const UtxoUndo& undo, std::size_t undoCount);
+
+    UtxoStore* m_pStore;
+    std::size_t m_maxCacheSize;
+
+    mutable boost::mutex m_mutex;
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_freeNodes;
+    std::vector<Slot> m_slots;
+    std::size_t m_mask;
+    uint32_t m_lruHead;
+    uint32_t m_lruTail;
+    std::size_t m_dirtyCount;
+
+    uchar_vector m_bestBlock;
+};
+
+}; // namespace Coin
+
+#endif // _UTXO_SET_H__
@@ -0,0 +1,416 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// UtxoStore.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "UtxoStore.h"
+#include "CoinNodeData.h"
+
+#include <stdexcept>
+#include <vector>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace Coin;
+
+const uint64_t UtxoStore::NO_SLOT = 0xffffffffffffffffull;
+
+namespace
+{
+    const uint32_t INDEX_MAGIC = 0x58444955; // "UIDX"
+    const uint32_t STATE_MAGIC = 0x54534955; // "UIST"
+
+    enum { ERASE_RECORD = 0, PUT_RECORD = 1 };
+    const uint64_t ERASE_RECORD_SIZE = 37;   // type, key
+    const uint64_t PUT_RECORD_HEADER = 41;   // type, key, length
+
+    struct State
+    {
+        uint32_t magic;
+        uint32_t generation;
+        uint64_t logLength;
+        uint64_t count;
+        uint64_t liveBytes;
+        uint32_t bestBlockSize;
+        unsigned char bestBlock[32];
+    };
+
+    inline uint64_t slotPosition(uint64_t keyHash, uint64_t mask)
+    {
+        return (keyHash ^ (keyHash >> 29)) & mask;
+    }
+}
+
+UtxoKey::UtxoKey(const OutPoint& outPoint)
+{
+    memcpy(bytes, outPoint.hash, 32);
+    memcpy(bytes + 32, &outPoint.index, 4);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// class UtxoStore implementation
+//
+UtxoStore::UtxoStore(const std::string& dir)
+    : m_dir(dir), m_generation(0), m_mask(0), m_bIndexDirty(false), m_count(0), m_liveBytes(0)
+{
+    if (!m_dir.empty() && m_dir[m_dir.size() - 1] != '/') m_dir += "/";
+
+    readState();
+    uint64_t committedLength = m_log.size();
+
+    // A compaction that didn't get as far as writing the state leaves a newer log behind,
+    // and one that didn't get as far as deleting the old log leaves that.
+    unlink(getLogPath(m_generation + 1).c_str());
+    if (m_generation > 0) unlink(getLogPath(m_generation - 1).c_str());
+
+    m_index.open(m_dir + "utxo.idx", true);
+    bool bValid = false;
+    if (m_index.size() >= sizeof(IndexHeader)) {
+        m_indexView = m_index.getView();
+        const IndexHeader& header = *indexHeader();
+        bValid = header.magic == INDEX_MAGIC && header.generation == m_generation && header.logLength == committedLength &&
+                 header.capacity >= MIN_UTXO_INDEX_SLOTS && (header.capacity & (header.capacity - 1)) == 0 &&
+                 m_index.size() == sizeof(IndexHeader) + header.capacity * sizeof(Slot);
+    }
+    if (bValid) {
+        m_mask = indexHeader()->capacity - 1;
+    }
+    else {
+        rebuildIndex();
+    }
+}
+
+std::string UtxoStore::getLogPath(uint32_t generation) const
+{
+    char name[32];
+    sprintf(name, "utxo%05u.log", generation);
+    return m_dir + name;
+}
+
+void UtxoStore::openLog(uint32_t generation, uint64_t length)
+{
+    m_logView.reset();
+    m_log.open(getLogPath(generation));
+    if (m_log.size() < length) throw std::runtime_error("UtxoStore - " + m_log.getPath() + " is shorter than its last commit.");
+    if (m_log.size() > length) m_log.resize(length); // written after the last commit
+    m_generation = generation;
+}
+
+void UtxoStore::readState()
+{
+    State state;
+    memset(&state, 0, sizeof(state));
+
+    FILE* f = fopen((m_dir + "utxo.state").c_str(), "rb");
+    if (f) {
+        bool bValid = fread(&state, sizeof(state), 1, f) == 1 && state.magic == STATE_MAGIC && state.bestBlockSize <= 32;
+        fclose(f);
+        if (!bValid) throw std::runtime_error("UtxoStore - " + m_dir + "utxo.state is invalid.");
+    }
+
+    openLog(state.generation, state.logLength);
+    m_count = state.count;
+    m_liveBytes = state.liveBytes;
+    m_bestBlock.assign(state.bestBlock, state.bestBlock + state.bestBlockSize);
+}
+
+void UtxoStore::writeState()
+{
+    State state;
+    memset(&state, 0, sizeof(state));
+    state.magic = STATE_MAGIC;
+    state.generation = m_generation;
+    state.logLength = m_log.size();
+    state.count = m_count;
+    state.liveBytes = m_liveBytes;
+    state.bestBlockSize = m_bestBlock.size() > 32 ? 32 : m_bestBlock.size();
+    if (state.bestBlockSize > 0) memcpy(state.bestBlock, &m_bestBlock[0], state.bestBlockSize);
+
+    // Write a new file and rename it over the old one so the state is never half written.
+    std::string path = m_dir + "utxo.state";
+    std::string tempPath = path + ".tmp";
+    FILE* f = fopen(tempPath.c_str(), "wb");
+    if (!f) throw std::runtime_error("UtxoStore - cannot create " + tempPath);
+    bool bWritten = fwrite(&state, sizeof(state), 1, f) == 1 && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    fclose(f);
+    if (!bWritten || rename(tempPath.c_str(), path.c_str()) != 0) throw std::runtime_error("UtxoStore - cannot write " + path);
+
+    int dirFd = ::open(m_dir.empty() ? "." : m_dir.c_str(), O_RDONLY);
+    if (dirFd != -1) {
+        fsync(dirFd);
+        ::close(dirFd);
+    }
+}
+
+const unsigned char* UtxoStore::getLogData(uint64_t minLength) const
+{
+    if (!m_logView || m_logView->length() < minLength) m_logView = m_log.getView(minLength);
+    return m_logView->data();
+}
+
+uint64_t UtxoStore::getRecordSize(uint64_t offset) const
+{
+    const unsigned char* record = getLogData(offset + PUT_RECORD_HEADER) + offset;
+    if (record[0] == ERASE_RECORD) return ERASE_RECORD_SIZE;
+    uint32_t length;
+    memcpy(&length, record + 37, 4);
+    return PUT_RECORD_HEADER + length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Index
+//
+void UtxoStore::createIndex(uint64_t capacity)
+{
+    m_indexView.reset();
+    m_index.resize(0);
+    m_index.resize(sizeof(IndexHeader) + capacity * sizeof(Slot));
+    m_indexView = m_index.getView();
+    m_mask = capacity - 1;
+
+    IndexHeader& header = *indexHeader();
+    header.magic = INDEX_MAGIC;
+    header.generation = m_generation;
+    header.capacity = capacity;
+    header.used = 0;
+    header.logLength = NO_SLOT;
+    m_bIndexDirty = true;
+}
+
+void UtxoStore::growIndex()
+{
+    std::vector<Slot> oldSlots(slots(), slots() + m_mask + 1);
+    createIndex(2 * (m_mask + 1));
+    for (std::size_t i = 0; i < oldSlots.size(); i++) {
+        if (oldSlots[i].record != 0) insertSlot(oldSlots[i].keyHash, oldSlots[i].record - 1);
+    }
+}
+
+void UtxoStore::rebuildIndex()
+{
+    uint64_t capacity = MIN_UTXO_INDEX_SLOTS;
+    while (capacity < 2 * m_count) capacity <<= 1;
+    createIndex(capacity);
+
+    m_count = 0;
+    m_liveBytes = 0;
+    uint64_t logLength = m_log.size();
+    for (uint64_t offset = 0; offset < logLength;) {
+        if (offset + ERASE_RECORD_SIZE > logLength) throw std::runtime_error("UtxoStore - " + m_log.getPath() + " is corrupt.");
+        const unsigned char* record = getLogData(logLength) + offset;
+        UtxoKey key;
+        memcpy(key.bytes, record + 1, 36);
+
+        uint64_t slot = findSlot(key);
+        if (slot != NO_SLOT) {
+            m_liveBytes -= getRecordSize(slots()[slot].record - 1);
+            removeSlot(slot);
+            m_count--;
+        }
+
+        uint64_t size = getRecordSize(offset);
+        if (record[0] == PUT_RECORD) {
+            if (offset + size > logLength) throw std::runtime_error("UtxoStore - " + m_log.getPath() + " is corrupt.");
+            insertSlot(key.getHash(), offset);
+            m_liveBytes += size;
+            m_count++;
+        }
+        offset += size;
+    }
+    syncIndex();
+}
+
+void UtxoStore::markIndexDirty()
+{
+    if (m_bIndexDirty) return;
+
+    // If we crash before the next commit the index can't be trusted - make sure that's on disk first.
+    indexHeader()->logLength = NO_SLOT;
+    m_index.sync();
+    m_bIndexDirty = true;
+}
+
+void UtxoStore::syncIndex()
+{
+    m_index.sync();
+    indexHeader()->generation = m_generation;
+    indexHeader()->logLength = m_log.size();
+    m_index.sync();
+    m_bIndexDirty = false;
+}
+
+uint64_t UtxoStore::findSlot(const UtxoKey& key) const
+{
+    uint64_t keyHash = key.getHash();
+    const Slot* pSlots = slots();
+    for (uint64_t i = slotPosition(keyHash, m_mask);; i = (i + 1) & m_mask) {
+        const Slot& slot = pSlots[i];
+        if (slot.record == 0) return NO_SLOT;
+        if (slot.keyHash == keyHash) {
+            const unsigned char* record = getLogData(slot.record - 1 + ERASE_RECORD_SIZE) + slot.record - 1;
+            if (memcmp(record + 1, key.bytes, 36) == 0) return i;
+        }
+    }
+}
+
+void UtxoStore::insertSlot(uint64_t keyHash, uint64_t offset)
+{
+    if (2 * (indexHeader()->used + 1) > m_mask + 1) growIndex();
+
+    Slot* pSlots = slots();
+    uint64_t i = slotPosition(keyHash, m_mask);
+    while (pSlots[i].record != 0) i = (i + 1) & m_mask;
+    pSlots[i].keyHash = keyHash;
+    pSlots[i].record = offset + 1;
+    indexHeader()->used++;
+}
+
+void UtxoStore::removeSlot(uint64_t slot)
+{
+    // Backward shift deletion - move later entries of the probe sequence up so there are no tombstones.
+    Slot* pSlots = slots();
+    uint64_t i = slot;
+    for (uint64_t j = (i + 1) & m_mask; pSlots[j].record != 0; j = (j + 1) & m_mask) {
+        uint64_t home = slotPosition(pSlots[j].keyHash, m_mask);
+        // Leave j where it is if its home lies cyclically in (i, j].
+        bool bStay = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!bStay) {
+            pSlots[i] = pSlots[j];
+            i = j;
+        }
+    }
+    pSlots[i].keyHash = 0;
+    pSlots[i].record = 0;
+    indexHeader()->used--;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Reads and writes
+//
+bool UtxoStore::get(const UtxoKey& key, uchar_vector& coin) const
+{
+    uint64_t slot = findSlot(key);
+    if (slot == NO_SLOT) return false;
+
+    uint64_t offset = slots()[slot].record - 1;
+    uint64_t size = getRecordSize(offset);
+    const unsigned char* record = getLogData(offset + size) + offset;
+    coin.assign(record + PUT_RECORD_HEADER, record + size);
+    return true;
+}
+
+void UtxoStore::put(const UtxoKey& key, const unsigned char* coin, std::size_t length)
+{
+    markIndexDirty();
+
+    unsigned char header[PUT_RECORD_HEADER];
+    header[0] = PUT_RECORD;
+    memcpy(header + 1, key.bytes, 36);
+    uint32_t length32 = length;
+    memcpy(header + 37, &length32, 4);
+    uint64_t offset = m_log.append(header, PUT_RECORD_HEADER);
+    if (length > 0) m_log.append(coin, length);
+
+    uint64_t slot = findSlot(key);
+    if (slot != NO_SLOT) {
+        m_liveBytes -= getRecordSize(slots()[slot].record - 1);
+        slots()[slot].record = offset + 1;
+    }
+    else {
+        insertSlot(key.getHash(), offset);
+        m_count++;
+    }
+    m_liveBytes += PUT_RECORD_HEADER + length;
+}
+
+void UtxoStore::erase(const UtxoKey& key)
+{
+    uint64_t slot = findSlot(key);
+    if (slot == NO_SLOT) return;
+
+    markIndexDirty();
+
+    unsigned char record[ERASE_RECORD_SIZE];
+    record[0] = ERASE_RECORD;
+    memcpy(record + 1, key.bytes, 36);
+    m_log.append(record, ERASE_RECORD_SIZE);
+
+    m_liveBytes -= getRecordSize(slots()[slot].record - 1);
+    removeSlot(slot);
+    m_count--;
+}
+
+void UtxoStore::commit(const uchar_vector& bestBlock)
+{
+    m_bestBlock = bestBlock;
+    m_log.sync();
+    syncIndex();
+    writeState();
+
+    if (m_log.size() >= MIN_UTXO_COMPACT_SIZE && m_log.size() > 2 * m_liveBytes) compact();
+}
+
+void UtxoStore::compact()
+{
+    markIndexDirty();
+
+    // Copy live records to the next log in slot order, pointing the slots at their new offsets as we go.
+    MappedFile newLog;
+    newLog.open(getLogPath(m_generation + 1));
+    newLog.resize(0);
+
+    const uint64_t BATCH_SIZE = 0x00100000;
+    std::vector<unsigned char> batch;
+    batch.reserve(BATCH_SIZE);
+    uint64_t newLength = 0;
+
+    Slot* pSlots = slots();
+    for (uint64_t i = 0; i <= m_mask; i++) {
+        if (pSlots[i].record == 0) continue;
+        uint64_t offset = pSlots[i].record - 1;
+        uint64_t size = getRecordSize(offset);
+        const unsigned char* record = getLogData(offset + size) + offset;
+
+        if (batch.size() + size > BATCH_SIZE && !batch.empty()) {
+            newLog.append(&batch[0], batch.size());
+            batch.clear();
+        }
+        batch.insert(batch.end(), record, record + size);
+        pSlots[i].record = newLength + 1;
+        newLength += size;
+    }
+    if (!batch.empty()) newLog.append(&batch[0], batch.size());
+    newLog.sync();
+    newLog.close();
+
+    uint32_t oldGeneration = m_generation;
+    openLog(m_generation + 1, newLength);
+    m_liveBytes = newLength;
+    syncIndex();
+    writeState();
+    unlink(getLogPath(oldGeneration).c_str());
+}
@@ -0,0 +1,160 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// UtxoStore.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// On-disk map from outpoints to compressed coins, the backing store for UtxoSet.
+//
+// Puts and erases are appended to a log (utxo00000.log, ...) and located through
+// an open addressing index kept in a mapped file (utxo.idx). commit() makes
+// everything written so far durable and records it, together with the best block,
+// in utxo.state, which is replaced atomically. On open, the log is cut back to
+// the last commit and the index is rebuilt from the log if it doesn't match it.
+// Once most of the log is dead records, commit() copies the live ones to a new log.
+
+#ifndef _UTXO_STORE_H__
+#define _UTXO_STORE_H__
+
+#include "MappedFile.h"
+
+#include <string>
+#include <cstring>
+
+#include "uchar_vector.h"
+
+#define MIN_UTXO_INDEX_SLOTS    0x00010000
+#define MIN_UTXO_COMPACT_SIZE   0x04000000 // don't bother compacting logs smaller than 64 MB
+
+namespace Coin
+{
+
+class OutPoint;
+
+// Outpoint hash (in the same order as OutPoint::hash) followed by the index in host order.
+class UtxoKey
+{
+public:
+    unsigned char bytes[36];
+
+    UtxoKey() { memset(bytes, 0, 36); }
+    UtxoKey(const unsigned char* hash, uint32_t index) { memcpy(bytes, hash, 32); memcpy(bytes + 32, &index, 4); }
+    explicit UtxoKey(const OutPoint& outPoint);
+
+    uint32_t getIndex() const { uint32_t index; memcpy(&index, bytes + 32, 4); return index; }
+
+    uint64_t getHash() const
+    {
+        // The tx hash is already uniformly distributed - just mix in the output index.
+        uint64_t h;
+        memcpy(&h, bytes, 8);
+        return h ^ ((uint64_t)(getIndex() + 1) * 0x9e3779b97f4a7c15ull);
+    }
+
+    bool operator==(const UtxoKey& rhs) const { return memcmp(bytes, rhs.bytes, 36) == 0; }
+    bool operator!=(const UtxoKey& rhs) const { return !(*this == rhs); }
+};
+
+class UtxoStore
+{
+public:
+    // Opens or creates a store in dir, which must already exist.
+    explicit UtxoStore(const std::string& dir);
+    ~UtxoStore() { }
+
+    // Returns false if there is no coin for key.
+    bool get(const UtxoKey& key, uchar_vector& coin) const;
+    bool contains(const UtxoKey& key) const { return findSlot(key) != NO_SLOT; }
+
+    void put(const UtxoKey& key, const unsigned char* coin, std::size_t length);
+    void put(const UtxoKey& key, const uchar_vector& coin) { put(key, coin.empty() ? NULL : &coin[0], coin.size()); }
+    void erase(const UtxoKey& key);
+
+    // Makes everything written so far durable. bestBlock is whatever the caller wants to recover
+    // along with this state - UtxoSet uses the hash of the last block applied.
+    void commit(const uchar_vector& bestBlock);
+    const uchar_vector& getBestBlock() const { return m_bestBlock; }
+
+    uint64_t getCount() const { return m_count; }
+    uint64_t getLogSize() const { return m_log.size(); }
+
+private:
+    UtxoStore(const UtxoStore&);
+    UtxoStore& operator=(const UtxoStore&);
+
+    static const uint64_t NO_SLOT;
+
+    struct IndexHeader
+    {
+        uint32_t magic;
+        uint32_t generation;
+        uint64_t capacity;
+        uint64_t used;
+        uint64_t logLength; // of the log the index was synced with, NO_SLOT while it is being changed
+    };
+
+    struct Slot
+    {
+        uint64_t keyHash;
+        uint64_t record; // offset in the log + 1, 0 if empty
+    };
+
+    std::string getLogPath(uint32_t generation) const;
+    void openLog(uint32_t generation, uint64_t length);
+    void readState();
+    void writeState();
+
+    // Index
+    void createIndex(uint64_t capacity);
+    void growIndex();
+    void rebuildIndex();
+    void markIndexDirty();
+    void syncIndex();
+    IndexHeader* indexHeader() const { return reinterpret_cast<IndexHeader*>(m_indexView->data()); }
+    Slot* slots() const { return reinterpret_cast<Slot*>(m_indexView->data() + sizeof(IndexHeader)); }
+    uint64_t findSlot(const UtxoKey& key) const;
+    void insertSlot(uint64_t keyHash, uint64_t offset);
+    void removeSlot(uint64_t slot);
+
+    // Log
+    uint64_t getRecordSize(uint64_t offset) const;
+    void compact();
+
+    std::string m_dir;
+
+    uint32_t m_generation;
+    mutable MappedFile m_log;
+    mutable MappedRegionPtr m_logView;
+    const unsigned char* getLogData(uint64_t minLength) const;
+
+    MappedFile m_index;
+    MappedRegionPtr m_indexView;
+    uint64_t m_mask;
+    bool m_bIndexDirty;
+
+    uint64_t m_count;
+    uint64_t m_liveBytes;
+    uchar_vector m_bestBlock;
+};
+
+}; // namespace Coin
+
+#endif // _UTXO_STORE_H__
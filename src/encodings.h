@@ -30,4 +30,591 @@
 
 #define DEFAULT_BASE58_CHARS BITCOIN_BASE58_CHARS
 
+// Base58 without big number arithmetic. Encoding treats the data as a big-endian number and
+// builds it up in limbs of radix 58^5, five base58 digits per limb; decoding goes the other way,
+// five digits at a time into 32-bit limbs. Either way every step is a 64-bit multiply-add per
+// limb, and nothing is allocated for inputs up to BASE58_MAX_STACK_SIZE bytes. Leading zero
+// bytes map to leading zero digits one for one.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+
+#define BASE58_MAX_STACK_SIZE       128
+#define BASE58_RADIX_5              656356768u  // 58^5
+
+// Upper bounds on the output sizes: log(256)/log(58) = 1.3657..., and no digit decodes to more than a byte.
+#define BASE58_MAX_ENCODED_SIZE(n)  ((n) * 138 / 100 + 1)
+#define BASE58_MAX_DECODED_SIZE(n)  (n)
+
+// Writes the base58 digits of data to out, which needs room for BASE58_MAX_ENCODED_SIZE(len)
+// characters. No terminator is written. Returns the number of characters.
+inline size_t encodeBase58(const unsigned char* data, size_t len, char* out, const char* base58chars = DEFAULT_BASE58_CHARS)
+{
+    size_t zeros = 0;
+    while (zeros < len && data[zeros] == 0) zeros++;
+
+    // little-endian limbs of radix 58^5
+    size_t maxLimbs = (len - zeros) * 138 / 500 + 2;
+    uint32_t stackLimbs[BASE58_MAX_STACK_SIZE * 138 / 500 + 2];
+    std::vector<uint32_t> heapLimbs;
+    uint32_t* limbs = stackLimbs;
+    if (maxLimbs > sizeof(stackLimbs) / sizeof(uint32_t)) {
+        heapLimbs.resize(maxLimbs);
+        limbs = &heapLimbs[0];
+    }
+    size_t nLimbs = 0;
+
+    // two bytes at a time: limb * 2^16 + carry stays well within 64 bits
+    size_t i = zeros;
+    if ((len - zeros) & 1) {
+        limbs[nLimbs++] = data[i++];
+    }
+    for (; i < len; i += 2) {
+        uint64_t carry = ((uint32_t)data[i] << 8) | data[i + 1];
+        for (size_t j = 0; j < nLimbs; j++) {
+            carry += (uint64_t)limbs[j] << 16;
+            limbs[j] = (uint32_t)(carry % BASE58_RADIX_5);
+            carry /= BASE58_RADIX_5;
+        }
+        while (carry) {
+            limbs[nLimbs++] = (uint32_t)(carry % BASE58_RADIX_5);
+            carry /= BASE58_RADIX_5;
+        }
+    }
+    while (nLimbs > 0 && limbs[nLimbs - 1] == 0) nLimbs--;
+
+    char* p = out;
+    for (size_t z = 0; z < zeros; z++) *p++ = base58chars[0];
+    if (nLimbs > 0) {
+        // the top limb without its leading zero digits, then five digits per limb
+        char digits[5];
+        int n = 0;
+        for (uint32_t v = limbs[nLimbs - 1]; v; v /= 58) digits[n++] = base58chars[v % 58];
+        while (n > 0) *p++ = digits[--n];
+        for (size_t j = nLimbs - 1; j-- > 0;) {
+            uint32_t v = limbs[j];
+            for (int k = 4; k >= 0; k--) { p[k] = base58chars[v % 58]; v /= 58; }
+            p += 5;
+        }
+    }
+    return p - out;
+}
+
+// Maps each character to its digit, or -1.
+class Base58Table
+{
+public:
+    Base58Table(const char* base58chars)
+    {
+        memset(digits_, -1, sizeof(digits_));
+        for (int i = 0; i < 58; i++) digits_[(unsigned char)base58chars[i]] = i;
+    }
+
+    int operator[](char c) const { return digits_[(unsigned char)c]; }
+
+    // Shared tables for the built-in alphabets, NULL for any other.
+    static const Base58Table* get(const char* base58chars)
+    {
+        static const Base58Table bitcoinTable(BITCOIN_BASE58_CHARS);
+        static const Base58Table rippleTable(RIPPLE_BASE58_CHARS);
+        if (strcmp(base58chars, BITCOIN_BASE58_CHARS) == 0) return &bitcoinTable;
+        if (strcmp(base58chars, RIPPLE_BASE58_CHARS) == 0) return &rippleTable;
+        return NULL;
+    }
+
+private:
+    signed char digits_[256];
+};
+
+// Decodes with a prebuilt table. zeroChar is the alphabet's first character.
+inline bool decodeBase58(const char* str, size_t len, unsigned char* out, size_t& outLen, const Base58Table& table, char zeroChar)
+{
+    size_t zeros = 0;
+    while (zeros < len && str[zeros] == zeroChar) zeros++;
+
+    // little-endian 32-bit limbs
+    size_t maxLimbs = (len - zeros) * 733 / 4000 + 2;
+    uint32_t stackLimbs[BASE58_MAX_STACK_SIZE * 733 / 4000 + 2];
+    std::vector<uint32_t> heapLimbs;
+    uint32_t* limbs = stackLimbs;
+    if (maxLimbs > sizeof(stackLimbs) / sizeof(uint32_t)) {
+        heapLimbs.resize(maxLimbs);
+        limbs = &heapLimbs[0];
+    }
+    size_t nLimbs = 0;
+
+    // up to five digits at a time
+    for (size_t i = zeros; i < len;) {
+        uint64_t chunk = 0, multiplier = 1;
+        for (size_t end = std::min(i + 5, len); i < end; i++) {
+            int digit = table[str[i]];
+            if (digit < 0) return false;
+            chunk = chunk * 58 + digit;
+            multiplier *= 58;
+        }
+        uint64_t carry = chunk;
+        for (size_t j = 0; j < nLimbs; j++) {
+            carry += (uint64_t)limbs[j] * multiplier;
+            limbs[j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if (carry) limbs[nLimbs++] = (uint32_t)carry;
+    }
+
+    unsigned char* p = out;
+    for (size_t z = 0; z < zeros; z++) *p++ = 0;
+    size_t j = nLimbs;
+    if (j > 0) {
+        // the top limb without its leading zero bytes, then four bytes per limb
+        uint32_t top = limbs[--j];
+        int shift = 24;
+        while (shift > 0 && !(top >> shift)) shift -= 8;
+        for (; shift >= 0; shift -= 8) *p++ = (unsigned char)(top >> shift);
+        while (j-- > 0) {
+            uint32_t v = limbs[j];
+            p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+            p += 4;
+        }
+    }
+    outLen = p - out;
+    return true;
+}
+
+// Writes the bytes encoded by the len characters at str to out, which needs room for
+// BASE58_MAX_DECODED_SIZE(len) bytes, and sets outLen. Returns false for characters
+// outside the alphabet.
+inline bool decodeBase58(const char* str, size_t len, unsigned char* out, size_t& outLen, const char* base58chars = DEFAULT_BASE58_CHARS)
+{
+    const Base58Table* pTable = Base58Table::get(base58chars);
+    if (!pTable) {
+        Base58Table customTable(base58chars);
+        return decodeBase58(str, len, out, outLen, customTable, base58chars[0]);
+    }
+    return decodeBase58(str, len, out, outLen, *pTable, base58chars[0]);
+}
+
+inline std::string encodeBase58(const std::vector<unsigned char>& data, const char* base58chars = DEFAULT_BASE58_CHARS)
+{
+    std::string str(BASE58_MAX_ENCODED_SIZE(data.size()), '\0');
+    str.resize(encodeBase58(data.empty() ? NULL : &data[0], data.size(), &str[0], base58chars));
+    return str;
+}
+
+inline bool decodeBase58(const std::string& str, std::vector<unsigned char>& data, const char* base58chars = DEFAULT_BASE58_CHARS)
+{
+    std::vector<unsigned char> bytes(BASE58_MAX_DECODED_SIZE(str.size()));
+    size_t len;
+    if (!decodeBase58(str.data(), str.size(), bytes.empty() ? NULL : &bytes[0], len, base58chars)) return false;
+    bytes.resize(len);
+    data.swap(bytes);
+    return true;
+}
+
+// Hex. The table-driven scalar code handles any length; where the compiler targets SSE2 (always on x86-64)
+// or AVX2 (-mavx2), 16 or 32 bytes are converted per step. Both directions work on caller-provided buffers.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define HEX_DIGITS "0123456789abcdef"
+
+// Writes the 2 * len lowercase hex digits of data to out. No terminator is written.
+inline void encodeHex(const unsigned char* data, size_t len, char* out)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i mask = _mm256_set1_epi8(0x0f), nine = _mm256_set1_epi8(9);
+    const __m256i zero = _mm256_set1_epi8('0'), alpha = _mm256_set1_epi8('a' - '0' - 10);
+    for (; i + 32 <= len; i += 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(in, 4), mask);
+        __m256i lo = _mm256_and_si256(in, mask);
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);   // bytes 0-7 and 16-23
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);   // bytes 8-15 and 24-31
+        a = _mm256_add_epi8(_mm256_add_epi8(a, zero), _mm256_and_si256(_mm256_cmpgt_epi8(a, nine), alpha));
+        b = _mm256_add_epi8(_mm256_add_epi8(b, zero), _mm256_and_si256(_mm256_cmpgt_epi8(b, nine), alpha));
+        _mm256_storeu_si256((__m256i*)(out + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*)(out + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x0f), nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0'), alpha = _mm_set1_epi8('a' - '0' - 10);
+    for (; i + 16 <= len; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(in, 4), mask);
+        __m128i lo = _mm_and_si128(in, mask);
+        __m128i a = _mm_unpacklo_epi8(hi, lo);
+        __m128i b = _mm_unpackhi_epi8(hi, lo);
+        a = _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), alpha));
+        b = _mm_add_epi8(_mm_add_epi8(b, zero), _mm_and_si128(_mm_cmpgt_epi8(b, nine), alpha));
+        _mm_storeu_si128((__m128i*)(out + 2 * i), a);
+        _mm_storeu_si128((__m128i*)(out + 2 * i + 16), b);
+    }
+#endif
+    for (; i < len; i++) {
+        out[2 * i] = HEX_DIGITS[data[i] >> 4];
+        out[2 * i + 1] = HEX_DIGITS[data[i] & 0x0f];
+    }
+}
+
+// Maps each character to its hex digit, or -1.
+class HexTable
+{
+public:
+    HexTable()
+    {
+        memset(digits_, -1, sizeof(digits_));
+        for (int i = 0; i < 10; i++) digits_['0' + i] = i;
+        for (int i = 0; i < 6; i++) { digits_['a' + i] = 10 + i; digits_['A' + i] = 10 + i; }
+    }
+
+    int operator[](char c) const { return digits_[(unsigned char)c]; }
+
+    static const HexTable& get()
+    {
+        static const HexTable table;
+        return table;
+    }
+
+private:
+    signed char digits_[256];
+};
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+typedef __m256i HexVector;
+#define HEX_VECTOR_SIZE 32
+#define HEX_VECTOR(f) _mm256_##f
+#define HEX_VECTOR_BITS(f) _mm256_##f##_si256
+#else
+typedef __m128i HexVector;
+#define HEX_VECTOR_SIZE 16
+#define HEX_VECTOR(f) _mm_##f
+#define HEX_VECTOR_BITS(f) _mm_##f##_si128
+#endif
+
+// Digit values of HEX_VECTOR_SIZE characters. valid gets 0xff for every hex digit and 0 for anything else.
+inline HexVector hexDigitValues(HexVector c, HexVector& valid)
+{
+    HexVector d = HEX_VECTOR(sub_epi8)(c, HEX_VECTOR(set1_epi8)('0'));
+    HexVector isDigit = HEX_VECTOR_BITS(and)(HEX_VECTOR(cmpgt_epi8)(d, HEX_VECTOR(set1_epi8)(-1)),
+                                             HEX_VECTOR(cmpgt_epi8)(HEX_VECTOR(set1_epi8)(10), d));
+    // folding case maps exactly A-F and a-f onto a-f
+    HexVector l = HEX_VECTOR(sub_epi8)(HEX_VECTOR_BITS(or)(c, HEX_VECTOR(set1_epi8)(0x20)), HEX_VECTOR(set1_epi8)('a'));
+    HexVector isAlpha = HEX_VECTOR_BITS(and)(HEX_VECTOR(cmpgt_epi8)(l, HEX_VECTOR(set1_epi8)(-1)),
+                                             HEX_VECTOR(cmpgt_epi8)(HEX_VECTOR(set1_epi8)(6), l));
+    valid = HEX_VECTOR_BITS(or)(isDigit, isAlpha);
+    return HEX_VECTOR_BITS(or)(HEX_VECTOR_BITS(and)(isDigit, d),
+                               HEX_VECTOR_BITS(and)(isAlpha, HEX_VECTOR(add_epi8)(l, HEX_VECTOR(set1_epi8)(10))));
+}
+
+// Combines adjacent digit pairs into 16-bit lanes holding one byte value each.
+inline HexVector hexPairValues(HexVector v)
+{
+    return HEX_VECTOR_BITS(or)(HEX_VECTOR(slli_epi16)(HEX_VECTOR_BITS(and)(v, HEX_VECTOR(set1_epi16)(0x00ff)), 4),
+                               HEX_VECTOR(srli_epi16)(v, 8));
+}
+#endif
+
+// Writes the len / 2 bytes encoded by the even number of hex digits at hex to out. Returns false,
+// leaving out partly written, if there is a character that isn't a hex digit. Either case is accepted.
+inline bool decodeHex(const char* hex, size_t len, unsigned char* out)
+{
+    size_t n = len / 2;
+    size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; i + HEX_VECTOR_SIZE <= n; i += HEX_VECTOR_SIZE) {
+        HexVector valid0, valid1;
+        HexVector v0 = hexDigitValues(HEX_VECTOR_BITS(loadu)((const HexVector*)(hex + 2 * i)), valid0);
+        HexVector v1 = hexDigitValues(HEX_VECTOR_BITS(loadu)((const HexVector*)(hex + 2 * i + HEX_VECTOR_SIZE)), valid1);
+        if (HEX_VECTOR(movemask_epi8)(HEX_VECTOR_BITS(and)(valid0, valid1)) != (int)(((uint64_t)1 << HEX_VECTOR_SIZE) - 1)) return false;
+        HexVector bytes = HEX_VECTOR(packus_epi16)(hexPairValues(v0), hexPairValues(v1));
+#if defined(__AVX2__)
+        bytes = _mm256_permute4x64_epi64(bytes, 0xd8); // packus works per 128-bit lane
+#endif
+        HEX_VECTOR_BITS(storeu)((HexVector*)(out + i), bytes);
+    }
+#endif
+    const HexTable& table = HexTable::get();
+    for (; i < n; i++) {
+        int hi = table[hex[2 * i]];
+        int lo = table[hex[2 * i + 1]];
+        if (hi < 0 || lo < 0) return false;
+        out[i] = (hi << 4) | lo;
+    }
+    return true;
+}
+
+#undef HEX_VECTOR_SIZE
+#undef HEX_VECTOR
+#undef HEX_VECTOR_BITS
+
+// Base64 (RFC 4648, standard alphabet). Encoding pads with '='. Decoding stops at the first character
+// outside the alphabet - padding, whitespace or anything else - so a trailing '=' or newline is harmless.
+// Whole groups are converted straight from the input without copying; when compiled with -mavx2,
+// 24 bytes (32 characters) are converted per step. Base64Encoder and Base64Decoder take input in pieces.
+
+#define BASE64_CHARS "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+
+#define BASE64_ENCODED_SIZE(n)      (((n) + 2) / 3 * 4)
+#define BASE64_MAX_DECODED_SIZE(n)  ((n) / 4 * 3 + 2)
+
+// Maps each character to its digit, or -1.
+class Base64Table
+{
+public:
+    Base64Table()
+    {
+        memset(digits_, -1, sizeof(digits_));
+        for (int i = 0; i < 64; i++) digits_[(unsigned char)BASE64_CHARS[i]] = i;
+    }
+
+    int operator[](char c) const { return digits_[(unsigned char)c]; }
+
+    static const Base64Table& get()
+    {
+        static const Base64Table table;
+        return table;
+    }
+
+private:
+    signed char digits_[256];
+};
+
+#if defined(__AVX2__)
+// Spreads the 12 bytes in each lane into 16 six-bit values and maps them onto the alphabet.
+inline __m256i base64EncodeVector(__m256i in)
+{
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+    __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+    __m256i values = _mm256_or_si256(t0, t1);
+
+    // offsets to add for A-Z (index 0), a-z (1), 0-9 (2-11), + (12) and / (13)
+    const __m256i offsets = _mm256_setr_epi8(
+        65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+        65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m256i indices = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+    indices = _mm256_sub_epi8(indices, _mm256_cmpgt_epi8(values, _mm256_set1_epi8(25)));
+    return _mm256_add_epi8(values, _mm256_shuffle_epi8(offsets, indices));
+}
+
+// Maps 32 characters onto their six-bit values and packs them into 24 bytes at out.
+// Returns false, writing nothing, if any of them is outside the alphabet.
+inline bool base64DecodeVector(__m256i str, unsigned char* out)
+{
+    // each character's low and high nibble select bit flags that only overlap for invalid characters
+    const __m256i loFlags = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i hiFlags = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i offsets = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i slash = _mm256_set1_epi8(0x2f);
+
+    __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), slash);
+    __m256i loNibbles = _mm256_and_si256(str, slash);
+    if (!_mm256_testz_si256(_mm256_shuffle_epi8(loFlags, loNibbles), _mm256_shuffle_epi8(hiFlags, hiNibbles))) return false;
+
+    // '/' shares its high nibble with '+' and needs its own offset
+    __m256i values = _mm256_add_epi8(str, _mm256_shuffle_epi8(offsets, _mm256_add_epi8(_mm256_cmpeq_epi8(str, slash), hiNibbles)));
+
+    // merge four six-bit values into three bytes per 32-bit word, then drop the empty byte of each
+    values = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    values = _mm256_madd_epi16(values, _mm256_set1_epi32(0x00011000));
+    values = _mm256_shuffle_epi8(values, _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    values = _mm256_permutevar8x32_epi32(values, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(values));
+    _mm_storel_epi64((__m128i*)(out + 16), _mm256_extracti128_si256(values, 1));
+    return true;
+}
+#endif
+
+// Encodes the len / 3 whole groups of data into out without padding. Returns the number of bytes consumed.
+inline size_t encodeBase64Groups(const unsigned char* data, size_t len, char* out)
+{
+    size_t i = 0;
+    char* p = out;
+#if defined(__AVX2__)
+    // each step reads 28 bytes to fill both lanes and uses 24
+    for (; i + 28 <= len; i += 24, p += 32) {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(data + i))),
+                                             _mm_loadu_si128((const __m128i*)(data + i + 12)), 1);
+        _mm256_storeu_si256((__m256i*)p, base64EncodeVector(in));
+    }
+#endif
+    for (; i + 3 <= len; i += 3, p += 4) {
+        uint32_t triple = ((uint32_t)data[i] << 16) | ((uint32_t)data[i + 1] << 8) | (uint32_t)data[i + 2];
+        p[0] = BASE64_CHARS[triple >> 18];
+        p[1] = BASE64_CHARS[(triple >> 12) & 0x3f];
+        p[2] = BASE64_CHARS[(triple >> 6) & 0x3f];
+        p[3] = BASE64_CHARS[triple & 0x3f];
+    }
+    return i;
+}
+
+// Encodes a final group of one or two bytes with padding. Returns the number of characters written.
+inline size_t encodeBase64Tail(const unsigned char* data, size_t len, char* out)
+{
+    if (len == 0) return 0;
+    uint32_t triple = ((uint32_t)data[0] << 16) | (len > 1 ? (uint32_t)data[1] << 8 : 0);
+    out[0] = BASE64_CHARS[triple >> 18];
+    out[1] = BASE64_CHARS[(triple >> 12) & 0x3f];
+    out[2] = len > 1 ? BASE64_CHARS[(triple >> 6) & 0x3f] : '=';
+    out[3] = '=';
+    return 4;
+}
+
+// Writes the BASE64_ENCODED_SIZE(len) characters encoding data to out. No terminator is written.
+inline size_t encodeBase64(const unsigned char* data, size_t len, char* out)
+{
+    size_t i = encodeBase64Groups(data, len, out);
+    size_t n = i / 3 * 4;
+    return n + encodeBase64Tail(data + i, len - i, out + n);
+}
+
+// Decodes whole groups of four characters up to the first character outside the alphabet.
+// Sets consumed to the number of characters used and returns the number of bytes written.
+inline size_t decodeBase64Groups(const char* str, size_t len, unsigned char* out, size_t& consumed)
+{
+    const Base64Table& table = Base64Table::get();
+    size_t i = 0;
+    unsigned char* p = out;
+#if defined(__AVX2__)
+    for (; i + 32 <= len; i += 32, p += 24) {
+        if (!base64DecodeVector(_mm256_loadu_si256((const __m256i*)(str + i)), p)) break;
+    }
+#endif
+    for (; i + 4 <= len; i += 4, p += 3) {
+        int a = table[str[i]], b = table[str[i + 1]], c = table[str[i + 2]], d = table[str[i + 3]];
+        if ((a | b | c | d) < 0) break;
+        uint32_t quadruple = (a << 18) | (b << 12) | (c << 6) | d;
+        p[0] = quadruple >> 16;
+        p[1] = quadruple >> 8;
+        p[2] = quadruple;
+    }
+    consumed = i;
+    return p - out;
+}
+
+// Decodes a final group of fewer than four digits, stopping at the first character outside the alphabet.
+// Returns the number of bytes written - a lone digit doesn't make a byte.
+inline size_t decodeBase64Tail(const char* str, size_t len, unsigned char* out)
+{
+    const Base64Table& table = Base64Table::get();
+    uint32_t quadruple = 0;
+    size_t n = 0;
+    for (; n < len && n < 4; n++) {
+        int digit = table[str[n]];
+        if (digit < 0) break;
+        quadruple |= (uint32_t)digit << (18 - 6 * n);
+    }
+    if (n > 1) out[0] = quadruple >> 16;
+    if (n > 2) out[1] = quadruple >> 8;
+    if (n > 3) out[2] = quadruple;
+    return n > 1 ? n - 1 : 0;
+}
+
+// Writes the bytes encoded by str, up to its first character outside the alphabet, to out, which needs
+// room for BASE64_MAX_DECODED_SIZE(len) bytes. Returns the number of bytes written.
+inline size_t decodeBase64(const char* str, size_t len, unsigned char* out)
+{
+    size_t consumed;
+    size_t n = decodeBase64Groups(str, len, out, consumed);
+    return n + decodeBase64Tail(str + consumed, len - consumed, out + n);
+}
+
+// Encodes data arriving in pieces of any size. Output is identical to encoding it all at once.
+class Base64Encoder
+{
+public:
+    Base64Encoder() : nPending_(0) { }
+
+    // Encodes all whole groups so far, keeping up to two bytes for the next call.
+    // out needs room for BASE64_ENCODED_SIZE(len + 2) characters. Returns the number written.
+    size_t update(const unsigned char* data, size_t len, char* out)
+    {
+        size_t n = 0;
+        if (nPending_ > 0) {
+            while (nPending_ < 3 && len > 0) { pending_[nPending_++] = *data++; len--; }
+            if (nPending_ < 3) return 0;
+            encodeBase64Groups(pending_, 3, out);
+            nPending_ = 0;
+            n = 4;
+        }
+        size_t i = encodeBase64Groups(data, len, out + n);
+        n += i / 3 * 4;
+        for (; i < len; i++) pending_[nPending_++] = data[i];
+        return n;
+    }
+
+    // Writes the padded final group, if any, to out, which needs room for 4 characters.
+    size_t finish(char* out)
+    {
+        size_t n = encodeBase64Tail(pending_, nPending_, out);
+        nPending_ = 0;
+        return n;
+    }
+
+private:
+    unsigned char pending_[3];
+    size_t nPending_;
+};
+
+// Decodes base64 arriving in pieces of any size, up to the first character outside the alphabet.
+class Base64Decoder
+{
+public:
+    Base64Decoder() : nPending_(0), bDone_(false) { }
+
+    // Decodes all whole groups so far, keeping up to three characters for the next call. out needs
+    // room for BASE64_MAX_DECODED_SIZE(len + 3) bytes. Returns the number written.
+    size_t update(const char* str, size_t len, unsigned char* out)
+    {
+        if (bDone_) return 0;
+        size_t n = 0, consumed;
+        if (nPending_ > 0) {
+            while (nPending_ < 4 && len > 0) { pending_[nPending_++] = *str++; len--; }
+            if (nPending_ < 4) return 0;
+            n = decodeBase64Groups(pending_, 4, out, consumed);
+            if (consumed < 4) { bDone_ = true; return 0; }
+            nPending_ = 0;
+        }
+        n += decodeBase64Groups(str, len, out + n, consumed);
+        if (len - consumed >= 4) { bDone_ = true; memcpy(pending_, str + consumed, 4); nPending_ = 4; return n; }
+        for (; consumed < len; consumed++) pending_[nPending_++] = str[consumed];
+        return n;
+    }
+
+    // Decodes the final partial group, if any, to out, which needs room for 3 bytes.
+    size_t finish(unsigned char* out)
+    {
+        size_t n = decodeBase64Tail(pending_, nPending_, out);
+        nPending_ = 0;
+        bDone_ = true;
+        return n;
+    }
+
+    // True once a character outside the alphabet has been seen - further input is ignored.
+    bool isDone() const { return bDone_; }
+
+private:
+    char pending_[4];
+    size_t nPending_;
+    bool bDone_;
+};
+
 #endif // COIN_ENCODINGS_H
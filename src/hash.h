@@ -57,6 +57,18 @@ inline uchar_vector sha256_2(const uchar_vector& data)
     return rval;
 }
 
+// Writes the 32-byte double hash of len bytes at data into hash without any intermediate copies.
+inline void sha256_2(const unsigned char* data, size_t len, unsigned char* hash)
+{
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, data, len);
+    SHA256_Final(hash, &sha256);
+    SHA256_Init(&sha256);
+    SHA256_Update(&sha256, hash, SHA256_DIGEST_LENGTH);
+    SHA256_Final(hash, &sha256);
+}
+
 inline uchar_vector ripemd160(const uchar_vector& data)
 {
     unsigned char hash[RIPEMD160_DIGEST_LENGTH];
@@ -26,19 +26,97 @@
 #include "hdkeys.h"
 
 #include "hash.h"
-#include "secp256k1.h"
-#include "BigInt.h"
+#include "secp256k1math.h"
 #include "uchar_vector.h"
+#include "ParallelFor.h"
 
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 #include "typedefs.h"
 
 using namespace Coin;
 
-const uchar_vector CURVE_ORDER_BYTES("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141");
-const BigInt CURVE_ORDER(CURVE_ORDER_BYTES);
+namespace
+{
+    // HMAC-SHA512 with the padded key hashed once up front, so children of the same parent only
+    // hash their own 37 bytes. Unlike HMAC() with a NULL output buffer it's safe to use from several threads.
+    class HmacSha512
+    {
+    public:
+        HmacSha512(const bytes_t& key)
+        {
+            unsigned char pad[SHA512_CBLOCK];
+            memset(pad, 0, sizeof(pad));
+            memcpy(pad, &key[0], key.size()); // chain codes are shorter than a block
+
+            for (unsigned int i = 0; i < sizeof(pad); i++) pad[i] ^= 0x36;
+            SHA512_Init(&inner_);
+            SHA512_Update(&inner_, pad, sizeof(pad));
+
+            for (unsigned int i = 0; i < sizeof(pad); i++) pad[i] ^= 0x36 ^ 0x5c;
+            SHA512_Init(&outer_);
+            SHA512_Update(&outer_, pad, sizeof(pad));
+        }
+
+        void compute(const unsigned char* data, size_t len, unsigned char* digest) const
+        {
+            SHA512_CTX ctx = inner_;
+            SHA512_Update(&ctx, data, len);
+            SHA512_Final(digest, &ctx);
+            ctx = outer_;
+            SHA512_Update(&ctx, digest, SHA512_DIGEST_LENGTH);
+            SHA512_Final(digest, &ctx);
+        }
+
+    private:
+        SHA512_CTX inner_;
+        SHA512_CTX outer_;
+    };
+
+    // Derives children offset + [first, last), which go in pubkeys[first, last).
+    void deriveChildren(const HmacSha512* hmac, const bytes_t* parent_pubkey, const secp256k1::PublicKey* parent_point,
+                        uint32_t offset, std::vector<bytes_t>* pubkeys, std::vector<bytes_t>* hashes, size_t first, size_t last)
+    {
+        uint32_t begin = offset + first;
+        uint32_t end = offset + last;
+        size_t count = end - begin;
+        std::vector<unsigned char> tweaks(32 * count);
+        unsigned char data[37];
+        unsigned char digest[SHA512_DIGEST_LENGTH];
+        std::copy(parent_pubkey->begin(), parent_pubkey->end(), data);
+        for (uint32_t i = begin; i < end; i++) {
+            data[33] = i >> 24;
+            data[34] = (i >> 16) & 0xff;
+            data[35] = (i >> 8) & 0xff;
+            data[36] = i & 0xff;
+            hmac->compute(data, sizeof(data), digest);
+            memcpy(&tweaks[32 * (i - begin)], digest, 32); // I_L
+        }
+
+        std::vector<secp256k1::PublicKey> points(count);
+        std::vector<unsigned char> results(count);
+        secp256k1::tweakAddPublicKeys(*parent_point, &tweaks[0], count, &points[0], &results[0]);
+
+        unsigned char sha[SHA256_DIGEST_LENGTH];
+        for (size_t i = 0; i < count; i++) {
+            if (!results[i]) continue;
+            bytes_t& pubkey = (*pubkeys)[begin - offset + i];
+            pubkey.resize(SECP256K1_COMPRESSED_PUBKEY_SIZE);
+            secp256k1::serializePublicKey(points[i], true, &pubkey[0]);
+            if (hashes) {
+                bytes_t& hash = (*hashes)[begin - offset + i];
+                hash.resize(RIPEMD160_DIGEST_LENGTH);
+                SHA256(&pubkey[0], pubkey.size(), sha);
+                RIPEMD160(sha, sizeof(sha), &hash[0]);
+            }
+        }
+    }
+}
 
 
 HDKeychain::HDKeychain(const bytes_t& key, const bytes_t& chain_code, uint32_t child_num, uint32_t parent_fp, uint32_t depth)
@@ -49,8 +127,7 @@ HDKeychain::HDKeychain(const bytes_t& key, const bytes_t& chain_code, uint32_t c
     }
 
    if (key_.size() == 32) {
-        BigInt n(key_);
-        if (n >= CURVE_ORDER || n.isZero()) {
+        if (!secp256k1::isValidSecret(&key_[0])) {
             throw std::runtime_error("Invalid key.");
         }
 
@@ -87,7 +164,8 @@ HDKeychain::HDKeychain(const bytes_t& extkey)
     valid_ = true;
 }
 
-HDKeychain::HDKeychain(HDKeychain&& source)
+// Copies take the source's pubkey as is - it's already derived from its key.
+HDKeychain::HDKeychain(const HDKeychain& source)
 {
     valid_ = source.valid_;
     if (!valid_) return;
@@ -98,7 +176,22 @@ HDKeychain::HDKeychain(HDKeychain&& source)
     child_num_ = source.child_num_;
     chain_code_ = source.chain_code_;
     key_ = source.key_;
-    updatePubkey();
+    pubkey_ = source.pubkey_;
+}
+
+HDKeychain::HDKeychain(HDKeychain&& source)
+{
+    valid_ = source.valid_;
+    if (!valid_) return;
+
+    version_ = source.version_;
+    depth_ = source.depth_;
+    parent_fp_ = source.parent_fp_;
+    child_num_ = source.child_num_;
+    chain_code_.swap(source.chain_code_);
+    key_.swap(source.key_);
+    pubkey_.swap(source.pubkey_);
+    source.valid_ = false;
 }
 
 HDKeychain& HDKeychain::operator=(const HDKeychain& rhs)
@@ -111,7 +204,7 @@ HDKeychain& HDKeychain::operator=(const HDKeychain& rhs)
         child_num_ = rhs.child_num_;
         chain_code_ = rhs.chain_code_;
         key_ = rhs.key_;
-        updatePubkey();
+        pubkey_ = rhs.pubkey_;
     }
     return *this;
 }
@@ -209,30 +302,24 @@ HDKeychain HDKeychain::getChild(uint32_t i) const
     data.push_back(i & 0xff);
 
     bytes_t digest = hmac_sha512(chain_code_, data);
-    bytes_t left32(digest.begin(), digest.begin() + 32);
-    BigInt Il(left32);
-    if (Il >= CURVE_ORDER) return child;
 
     if (isPrivate()) {
-        BigInt k(key_);
-        k += Il;
-        k %= CURVE_ORDER;
-        if (k.isZero()) return child;
-
-        bytes_t child_key = k.getBytes();
-        // pad with 0's to make it 33 bytes
-        uchar_vector padded_key(33 - child_key.size(), 0);
-        padded_key += child_key;
-        child.key_ = padded_key;
+        // k_i = (I_L + k) mod n - fails if I_L >= n or k_i == 0
+        bytes_t child_key(key_);
+        if (!secp256k1::tweakAddSecret(&child_key[1], &digest[0])) return child;
+
+        child.key_ = child_key;
         child.updatePubkey();
     }
     else {
-        secp256k1_point K;
-        K.bytes(pubkey_);
-        K.generator_mul(left32);
-        if (K.is_at_infinity()) return child;
-
-        child.key_ = child.pubkey_ = K.bytes();
+        // K_i = I_L*G + K - fails if I_L >= n or K_i is the point at infinity
+        secp256k1::PublicKey K;
+        if (!secp256k1::parsePublicKey(&pubkey_[0], pubkey_.size(), K)) return child;
+        if (!secp256k1::tweakAddPublic(K, &digest[0])) return child;
+
+        child.key_.resize(SECP256K1_COMPRESSED_PUBKEY_SIZE);
+        secp256k1::serializePublicKey(K, true, &child.key_[0]);
+        child.pubkey_ = child.key_;
     }
 
     child.version_ = version_; 
@@ -245,6 +332,36 @@ HDKeychain HDKeychain::getChild(uint32_t i) const
     return child;
 }
 
+std::vector<bytes_t> HDKeychain::deriveRange(uint32_t begin, uint32_t end, std::vector<bytes_t>* hashes, unsigned int nThreads) const
+{
+    if (!valid_) {
+        throw std::runtime_error("Keychain is invalid.");
+    }
+
+    if (end < begin || end > 0x80000000) {
+        throw std::runtime_error("Invalid range for non-hardened derivation.");
+    }
+
+    uint32_t count = end - begin;
+    std::vector<bytes_t> pubkeys(count);
+    if (hashes) {
+        hashes->clear();
+        hashes->resize(count);
+    }
+    if (count == 0) return pubkeys;
+
+    secp256k1::PublicKey parent;
+    if (!secp256k1::parsePublicKey(&pubkey_[0], pubkey_.size(), parent)) {
+        throw std::runtime_error("Invalid key.");
+    }
+    HmacSha512 hmac(chain_code_);
+
+    parallelFor(count, getChunkCount(count, MIN_HD_CHILDREN_PER_THREAD, nThreads),
+                boost::bind(&deriveChildren, &hmac, &pubkey_, &parent, begin, &pubkeys, hashes, _2, _3));
+
+    return pubkeys;
+}
+
 std::string HDKeychain::toString() const
 {
     std::stringstream ss;
@@ -260,14 +377,97 @@ std::string HDKeychain::toString() const
 
 void HDKeychain::updatePubkey() {
     if (isPrivate()) {
-        secp256k1_key curvekey;
-        curvekey.setPrivKey(bytes_t(key_.begin() + 1, key_.end()));
-        pubkey_ = curvekey.getPubKey();
+        secp256k1::PublicKey K;
+        if (!secp256k1::derivePublicKey(&key_[1], K)) {
+            throw std::runtime_error("Invalid key.");
+        }
+        pubkey_.resize(SECP256K1_COMPRESSED_PUBKEY_SIZE);
+        secp256k1::serializePublicKey(K, true, &pubkey_[0]);
     }
     else {
         pubkey_ = key_;
     }
 }
 
+HDKeychainCache::HDKeychainCache(size_t max_size, unsigned int num_shards)
+{
+    if (num_shards == 0) num_shards = 1;
+    max_shard_size_ = std::max<size_t>(max_size / num_shards, 1);
+    for (unsigned int i = 0; i < num_shards; i++) {
+        shards_.push_back(boost::shared_ptr<Shard>(new Shard()));
+    }
+}
+
+size_t HDKeychainCache::KeyHasher::operator()(const Key& key) const
+{
+    // FNV-1a over the extended key and child number
+    size_t h = 2166136261u;
+    for (size_t i = 0; i < key.extkey.size(); i++) h = (h ^ key.extkey[i]) * 16777619u;
+    return (h ^ key.child_num) * 16777619u;
+}
+
+HDKeychain HDKeychainCache::getChild(const HDKeychain& parent, uint32_t i)
+{
+    if (!parent) {
+        throw std::runtime_error("Keychain is invalid.");
+    }
+
+    Key key;
+    key.extkey = parent.extkey();
+    key.child_num = i;
+    Shard& shard = *shards_[KeyHasher()(key) % shards_.size()];
+
+    {
+        boost::lock_guard<boost::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return it->second->second;
+        }
+    }
+
+    // derive without holding the lock - another thread might derive the same child meanwhile, which is harmless
+    HDKeychain child = parent.getChild(i);
+    if (!child) return child;
+
+    boost::lock_guard<boost::mutex> lock(shard.mutex);
+    if (shard.index.count(key)) return child;
+    shard.entries.push_front(std::make_pair(key, child));
+    shard.index[key] = shard.entries.begin();
+    if (shard.entries.size() > max_shard_size_) {
+        shard.index.erase(shard.entries.back().first);
+        shard.entries.pop_back();
+    }
+    return child;
+}
+
+HDKeychain HDKeychainCache::getChild(const HDKeychain& parent, const std::vector<uint32_t>& path)
+{
+    HDKeychain keychain(parent);
+    for (size_t i = 0; i < path.size() && keychain; i++) {
+        keychain = getChild(keychain, path[i]);
+    }
+    return keychain;
+}
+
+size_t HDKeychainCache::size() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < shards_.size(); i++) {
+        boost::lock_guard<boost::mutex> lock(shards_[i]->mutex);
+        total += shards_[i]->entries.size();
+    }
+    return total;
+}
+
+void HDKeychainCache::clear()
+{
+    for (size_t i = 0; i < shards_.size(); i++) {
+        boost::lock_guard<boost::mutex> lock(shards_[i]->mutex);
+        shards_[i]->index.clear();
+        shards_[i]->entries.clear();
+    }
+}
+
 uint32_t HDKeychain::priv_version_ = 0;
 uint32_t HDKeychain::pub_version_ = 0;
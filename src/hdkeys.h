@@ -30,6 +30,16 @@
 
 #include "typedefs.h"
 
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+
+#define MIN_HD_CHILDREN_PER_THREAD 256
+#define DEFAULT_HD_CACHE_SIZE 10000
+
 namespace Coin {
 
 const uchar_vector BITCOIN_SEED("426974636f696e2073656564"); // key = "Bitcoin seed"
@@ -58,9 +68,10 @@ private:
 class HDKeychain
 {
 public:
-    HDKeychain() { }
+    HDKeychain() : valid_(false) { }
     HDKeychain(const bytes_t& key, const bytes_t& chain_code, uint32_t child_num = 0, uint32_t parent_fp = 0, uint32_t depth = 0);
     HDKeychain(const bytes_t& extkey);
+    HDKeychain(const HDKeychain& source);
     HDKeychain(HDKeychain&& source);
 
     HDKeychain& operator=(const HDKeychain& rhs);    
@@ -91,6 +102,12 @@ public:
     HDKeychain getPublic() const;
     HDKeychain getChild(uint32_t i) const;
 
+    // Compressed pubkeys of the non-hardened children begin..end-1, the same as getChild(i).pubkey() but
+    // without building keychains. If hashes isn't NULL it also gets their ripemd160(sha256(pubkey)). A child
+    // that can't be derived (probability < 2^-127) gets empty entries, BIP32 says to skip to the next index.
+    // Large ranges are split across threads, nThreads = 0 uses one per hardware thread.
+    std::vector<bytes_t> deriveRange(uint32_t begin, uint32_t end, std::vector<bytes_t>* hashes = NULL, unsigned int nThreads = 0) const;
+
     static void setVersions(uint32_t priv_version, uint32_t pub_version) { priv_version_ = priv_version; pub_version_ = pub_version; }
 
     std::string toString() const;
@@ -113,6 +130,55 @@ private:
     void updatePubkey();
 };
 
+
+// Remembers derived children so that walking paths like m/44'/0'/0'/0/i only derives each
+// intermediate node once. Entries are keyed by the parent's extended key and the child index
+// and evicted least recently used first. Safe to use from several threads - the cache is
+// sharded so that they rarely wait on the same lock.
+//
+// Children of private keychains are private too, so the cache holds secrets for as long as
+// they're in it. Call clear() when they're no longer needed.
+class HDKeychainCache
+{
+public:
+    HDKeychainCache(size_t max_size = DEFAULT_HD_CACHE_SIZE, unsigned int num_shards = 16);
+
+    // Same as parent.getChild(i).
+    HDKeychain getChild(const HDKeychain& parent, uint32_t i);
+
+    // Follows path down from parent, e.g. { 0x8000002c, 0x80000000, 0x80000000, 0, i } for m/44'/0'/0'/0/i.
+    HDKeychain getChild(const HDKeychain& parent, const std::vector<uint32_t>& path);
+
+    size_t size() const;
+    void clear();
+
+private:
+    struct Key
+    {
+        bytes_t extkey;
+        uint32_t child_num;
+
+        bool operator==(const Key& rhs) const { return child_num == rhs.child_num && extkey == rhs.extkey; }
+    };
+
+    struct KeyHasher
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    typedef std::list<std::pair<Key, HDKeychain> > Entries; // most recently used first
+
+    struct Shard
+    {
+        mutable boost::mutex mutex;
+        Entries entries;
+        std::unordered_map<Key, Entries::iterator, KeyHasher> index;
+    };
+
+    size_t max_shard_size_;
+    std::vector<boost::shared_ptr<Shard> > shards_;
+};
+
 }
 
 #endif // COIN_HDKEYS_H
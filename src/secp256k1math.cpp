@@ -0,0 +1,1451 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// secp256k1math.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "secp256k1math.h"
+
+#include <openssl/sha.h>
+#include <openssl/crypto.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+
+#if !defined(__SIZEOF_INT128__)
+#error "secp256k1math.cpp needs a compiler with unsigned __int128 (64-bit gcc or clang)"
+#endif
+
+typedef unsigned __int128 uint128_t;
+
+namespace Coin
+{
+
+namespace secp256k1
+{
+
+namespace
+{
+
+inline uint64_t readBE64(const unsigned char* p)
+{
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+           ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+inline void writeBE64(unsigned char* p, uint64_t a)
+{
+    for (int i = 7; i >= 0; i--) { p[i] = (unsigned char)a; a >>= 8; }
+}
+
+// all ones if a == b, zero otherwise, without branching
+inline uint64_t equalMask(unsigned int a, unsigned int b)
+{
+    return (uint64_t)0 - (uint64_t)(((uint32_t)(a ^ b) - 1) >> 31);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Field elements mod p = 2^256 - 2^32 - 977
+//
+// value = sum n[i] * 2^(52i). Limbs are allowed to grow past 52 bits between
+// reductions: an element of magnitude m has limbs of at most 2m(2^52 - 1).
+// Products and squares accept magnitudes up to 64 and return magnitude 1.
+//
+
+const uint64_t M52 = 0xFFFFFFFFFFFFFULL;
+const uint64_t M48 = 0x0FFFFFFFFFFFFULL;
+const uint64_t P0 = 0xFFFFEFFFFFC2FULL;     // lowest limb of p - the rest are all ones
+const uint64_t R256 = 0x1000003D1ULL;       // 2^256 mod p
+const uint64_t R260 = 0x1000003D10ULL;      // 2^260 mod p
+
+struct Fe
+{
+    uint64_t n[5];
+};
+
+inline void feSetInt(Fe& r, uint64_t a)
+{
+    r.n[0] = a; r.n[1] = r.n[2] = r.n[3] = r.n[4] = 0;
+}
+
+// Returns false if a >= p.
+bool feSetBytes(Fe& r, const unsigned char* a)
+{
+    uint64_t w0 = readBE64(a + 24), w1 = readBE64(a + 16), w2 = readBE64(a + 8), w3 = readBE64(a);
+    r.n[0] = w0 & M52;
+    r.n[1] = (w0 >> 52) | ((w1 & 0xFFFFFFFFFFULL) << 12);
+    r.n[2] = (w1 >> 40) | ((w2 & 0xFFFFFFFULL) << 24);
+    r.n[3] = (w2 >> 28) | ((w3 & 0xFFFFULL) << 36);
+    r.n[4] = w3 >> 16;
+    return !(r.n[4] == M48 && (r.n[3] & r.n[2] & r.n[1]) == M52 && r.n[0] >= P0);
+}
+
+// a must be normalized
+void feGetBytes(unsigned char* r, const Fe& a)
+{
+    writeBE64(r + 24, a.n[0] | (a.n[1] << 52));
+    writeBE64(r + 16, (a.n[1] >> 12) | (a.n[2] << 40));
+    writeBE64(r + 8, (a.n[2] >> 24) | (a.n[3] << 28));
+    writeBE64(r, (a.n[3] >> 36) | (a.n[4] << 16));
+}
+
+// Reduces to magnitude 1 without fully reducing mod p.
+inline void feNormalizeWeak(Fe& r)
+{
+    uint64_t t0 = r.n[0], t1 = r.n[1], t2 = r.n[2], t3 = r.n[3], t4 = r.n[4];
+    uint64_t x = t4 >> 48; t4 &= M48;
+    t0 += x * R256;
+    t1 += t0 >> 52; t0 &= M52;
+    t2 += t1 >> 52; t1 &= M52;
+    t3 += t2 >> 52; t2 &= M52;
+    t4 += t3 >> 52; t3 &= M52;
+    r.n[0] = t0; r.n[1] = t1; r.n[2] = t2; r.n[3] = t3; r.n[4] = t4;
+}
+
+// Fully reduces mod p, in constant time.
+void feNormalize(Fe& r)
+{
+    uint64_t t0 = r.n[0], t1 = r.n[1], t2 = r.n[2], t3 = r.n[3], t4 = r.n[4];
+    uint64_t m;
+    uint64_t x = t4 >> 48; t4 &= M48;
+    t0 += x * R256;
+    t1 += t0 >> 52; t0 &= M52;
+    t2 += t1 >> 52; t1 &= M52; m = t1;
+    t3 += t2 >> 52; t2 &= M52; m &= t2;
+    t4 += t3 >> 52; t3 &= M52; m &= t3;
+
+    // at most one more reduction: either bit 256 is set or the value is in [p, 2^256)
+    x = (t4 >> 48) | ((uint64_t)(t4 == M48) & (uint64_t)(m == M52) & (uint64_t)(t0 >= P0));
+    t0 += x * R256;
+    t1 += t0 >> 52; t0 &= M52;
+    t2 += t1 >> 52; t1 &= M52;
+    t3 += t2 >> 52; t2 &= M52;
+    t4 += t3 >> 52; t3 &= M52;
+    t4 &= M48;
+    r.n[0] = t0; r.n[1] = t1; r.n[2] = t2; r.n[3] = t3; r.n[4] = t4;
+}
+
+// a must be normalized
+inline bool feIsZero(const Fe& a)
+{
+    return (a.n[0] | a.n[1] | a.n[2] | a.n[3] | a.n[4]) == 0;
+}
+
+// a must be normalized
+inline bool feIsOdd(const Fe& a)
+{
+    return a.n[0] & 1;
+}
+
+// a and b must be normalized
+inline bool feEqual(const Fe& a, const Fe& b)
+{
+    return ((a.n[0] ^ b.n[0]) | (a.n[1] ^ b.n[1]) | (a.n[2] ^ b.n[2]) | (a.n[3] ^ b.n[3]) | (a.n[4] ^ b.n[4])) == 0;
+}
+
+inline bool feNormalizesToZero(const Fe& a)
+{
+    Fe t = a;
+    feNormalize(t);
+    return feIsZero(t);
+}
+
+// r += a
+inline void feAdd(Fe& r, const Fe& a)
+{
+    r.n[0] += a.n[0]; r.n[1] += a.n[1]; r.n[2] += a.n[2]; r.n[3] += a.n[3]; r.n[4] += a.n[4];
+}
+
+inline void feMulInt(Fe& r, uint64_t k)
+{
+    r.n[0] *= k; r.n[1] *= k; r.n[2] *= k; r.n[3] *= k; r.n[4] *= k;
+}
+
+// r = -a, where a has magnitude at most m. The result has magnitude m + 1.
+inline void feNegate(Fe& r, const Fe& a, uint64_t m)
+{
+    r.n[0] = P0 * 2 * (m + 1) - a.n[0];
+    r.n[1] = M52 * 2 * (m + 1) - a.n[1];
+    r.n[2] = M52 * 2 * (m + 1) - a.n[2];
+    r.n[3] = M52 * 2 * (m + 1) - a.n[3];
+    r.n[4] = M48 * 2 * (m + 1) - a.n[4];
+}
+
+// r = a if mask is all ones, unchanged if it's zero
+inline void feCmov(Fe& r, const Fe& a, uint64_t mask)
+{
+    for (int i = 0; i < 5; i++) r.n[i] = (r.n[i] & ~mask) | (a.n[i] & mask);
+}
+
+// Folds the nine 104-bit-ish columns of a product back into five limbs.
+inline void feReduce(Fe& r, uint128_t* c)
+{
+    // bring the upper columns down to 52 bits so they can be multiplied by 2^260 mod p
+    c[6] += c[5] >> 52; c[5] &= M52;
+    c[7] += c[6] >> 52; c[6] &= M52;
+    c[8] += c[7] >> 52; c[7] &= M52;
+    c[9] = c[8] >> 52;  c[8] &= M52;
+
+    c[0] += c[5] * R260;
+    c[1] += c[6] * R260;
+    c[2] += c[7] * R260;
+    c[3] += c[8] * R260;
+    c[4] += c[9] * R260;
+
+    c[1] += c[0] >> 52; c[0] &= M52;
+    c[2] += c[1] >> 52; c[1] &= M52;
+    c[3] += c[2] >> 52; c[2] &= M52;
+    c[4] += c[3] >> 52; c[3] &= M52;
+
+    // and whatever is left above 2^256
+    c[0] += (c[4] >> 48) * R256; c[4] &= M48;
+    c[1] += c[0] >> 52; c[0] &= M52;
+    c[2] += c[1] >> 52; c[1] &= M52;
+    c[3] += c[2] >> 52; c[2] &= M52;
+    c[4] += c[3] >> 52; c[3] &= M52;
+
+    r.n[0] = (uint64_t)c[0]; r.n[1] = (uint64_t)c[1]; r.n[2] = (uint64_t)c[2]; r.n[3] = (uint64_t)c[3]; r.n[4] = (uint64_t)c[4];
+}
+
+void feMul(Fe& r, const Fe& a, const Fe& b)
+{
+    const uint64_t* x = a.n;
+    const uint64_t* y = b.n;
+    uint128_t c[10];
+    c[0] = (uint128_t)x[0] * y[0];
+    c[1] = (uint128_t)x[0] * y[1] + (uint128_t)x[1] * y[0];
+    c[2] = (uint128_t)x[0] * y[2] + (uint128_t)x[1] * y[1] + (uint128_t)x[2] * y[0];
+    c[3] = (uint128_t)x[0] * y[3] + (uint128_t)x[1] * y[2] + (uint128_t)x[2] * y[1] + (uint128_t)x[3] * y[0];
+    c[4] = (uint128_t)x[0] * y[4] + (uint128_t)x[1] * y[3] + (uint128_t)x[2] * y[2] + (uint128_t)x[3] * y[1] + (uint128_t)x[4] * y[0];
+    c[5] = (uint128_t)x[1] * y[4] + (uint128_t)x[2] * y[3] + (uint128_t)x[3] * y[2] + (uint128_t)x[4] * y[1];
+    c[6] = (uint128_t)x[2] * y[4] + (uint128_t)x[3] * y[3] + (uint128_t)x[4] * y[2];
+    c[7] = (uint128_t)x[3] * y[4] + (uint128_t)x[4] * y[3];
+    c[8] = (uint128_t)x[4] * y[4];
+    feReduce(r, c);
+}
+
+void feSqr(Fe& r, const Fe& a)
+{
+    const uint64_t* x = a.n;
+    uint64_t x0d = x[0] * 2, x1d = x[1] * 2, x2d = x[2] * 2, x3d = x[3] * 2;
+    uint128_t c[10];
+    c[0] = (uint128_t)x[0] * x[0];
+    c[1] = (uint128_t)x0d * x[1];
+    c[2] = (uint128_t)x0d * x[2] + (uint128_t)x[1] * x[1];
+    c[3] = (uint128_t)x0d * x[3] + (uint128_t)x1d * x[2];
+    c[4] = (uint128_t)x0d * x[4] + (uint128_t)x1d * x[3] + (uint128_t)x[2] * x[2];
+    c[5] = (uint128_t)x1d * x[4] + (uint128_t)x2d * x[3];
+    c[6] = (uint128_t)x2d * x[4] + (uint128_t)x[3] * x[3];
+    c[7] = (uint128_t)x3d * x[4];
+    c[8] = (uint128_t)x[4] * x[4];
+    feReduce(r, c);
+}
+
+inline void feSqrN(Fe& r, const Fe& a, int n)
+{
+    r = a;
+    for (int i = 0; i < n; i++) feSqr(r, r);
+}
+
+// a^(2^2 - 1), a^(2^3 - 1), a^(2^22 - 1) and a^(2^223 - 1) - the runs of ones in p - 2 and (p + 1)/4
+struct FePowers
+{
+    Fe x2, x3, x22, x223;
+
+    explicit FePowers(const Fe& a)
+    {
+        Fe x6, x9, x11, x44, x88, x176, x220;
+        feSqr(x2, a);           feMul(x2, x2, a);
+        feSqr(x3, x2);          feMul(x3, x3, a);
+        feSqrN(x6, x3, 3);      feMul(x6, x6, x3);
+        feSqrN(x9, x6, 3);      feMul(x9, x9, x3);
+        feSqrN(x11, x9, 2);     feMul(x11, x11, x2);
+        feSqrN(x22, x11, 11);   feMul(x22, x22, x11);
+        feSqrN(x44, x22, 22);   feMul(x44, x44, x22);
+        feSqrN(x88, x44, 44);   feMul(x88, x88, x44);
+        feSqrN(x176, x88, 88);  feMul(x176, x176, x88);
+        feSqrN(x220, x176, 44); feMul(x220, x220, x44);
+        feSqrN(x223, x220, 3);  feMul(x223, x223, x3);
+    }
+};
+
+// r = a^(p - 2). Constant time.
+void feInv(Fe& r, const Fe& a)
+{
+    FePowers pw(a);
+    Fe t;
+    feSqrN(t, pw.x223, 23); feMul(t, t, pw.x22);
+    feSqrN(t, t, 5);        feMul(t, t, a);
+    feSqrN(t, t, 3);        feMul(t, t, pw.x2);
+    feSqrN(t, t, 2);        feMul(r, t, a);
+}
+
+// r = a^((p + 1)/4). Returns false if a isn't a square.
+bool feSqrt(Fe& r, const Fe& a)
+{
+    FePowers pw(a);
+    Fe t, check, an = a;
+    feSqrN(t, pw.x223, 23); feMul(t, t, pw.x22);
+    feSqrN(t, t, 6);        feMul(t, t, pw.x2);
+    feSqrN(t, t, 2);
+
+    feSqr(check, t);
+    feNormalize(check);
+    feNormalize(an);
+    r = t;
+    return feEqual(check, an);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Scalars mod n = FFFFFFFF FFFFFFFF FFFFFFFF FFFFFFFE BAAEDCE6 AF48A03B BFD25E8C D0364141
+//
+
+const uint64_t N[4] = { 0xBFD25E8CD0364141ULL, 0xBAAEDCE6AF48A03BULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL };
+const uint64_t NC[3] = { 0x402DA1732FC9BEBFULL, 0x4551231950B75FC4ULL, 1 }; // 2^256 - n
+const uint64_t NH[4] = { 0xDFE92F46681B20A0ULL, 0x5D576E7357A4501DULL, 0xFFFFFFFFFFFFFFFFULL, 0x7FFFFFFFFFFFFFFFULL }; // n/2
+
+struct Sc
+{
+    uint64_t d[4];
+};
+
+inline void scSetInt(Sc& r, uint64_t a)
+{
+    r.d[0] = a; r.d[1] = r.d[2] = r.d[3] = 0;
+}
+
+inline bool scIsZero(const Sc& a)
+{
+    return (a.d[0] | a.d[1] | a.d[2] | a.d[3]) == 0;
+}
+
+// 1 if a >= n. Constant time.
+inline uint64_t scCheckOverflow(const Sc& a)
+{
+    uint64_t yes = 0, no = 0;
+    no |= (uint64_t)(a.d[3] < N[3]);
+    no |= (uint64_t)(a.d[2] < N[2]);
+    yes |= (uint64_t)(a.d[2] > N[2]) & ~no;
+    no |= (uint64_t)(a.d[1] < N[1]);
+    yes |= (uint64_t)(a.d[1] > N[1]) & ~no;
+    yes |= (uint64_t)(a.d[0] >= N[0]) & ~no;
+    return yes & 1;
+}
+
+// r -= n if overflow is 1
+inline void scReduce(Sc& r, uint64_t overflow)
+{
+    uint128_t t = (uint128_t)r.d[0] + overflow * NC[0];
+    r.d[0] = (uint64_t)t; t >>= 64;
+    t += (uint128_t)r.d[1] + overflow * NC[1];
+    r.d[1] = (uint64_t)t; t >>= 64;
+    t += (uint128_t)r.d[2] + overflow * NC[2];
+    r.d[2] = (uint64_t)t; t >>= 64;
+    t += r.d[3];
+    r.d[3] = (uint64_t)t;
+}
+
+// Reduces mod n. Returns true if a >= n.
+bool scSetBytes(Sc& r, const unsigned char* a)
+{
+    r.d[0] = readBE64(a + 24); r.d[1] = readBE64(a + 16); r.d[2] = readBE64(a + 8); r.d[3] = readBE64(a);
+    uint64_t overflow = scCheckOverflow(r);
+    scReduce(r, overflow);
+    return overflow;
+}
+
+void scGetBytes(unsigned char* r, const Sc& a)
+{
+    writeBE64(r, a.d[3]); writeBE64(r + 8, a.d[2]); writeBE64(r + 16, a.d[1]); writeBE64(r + 24, a.d[0]);
+}
+
+void scAdd(Sc& r, const Sc& a, const Sc& b)
+{
+    uint128_t t = (uint128_t)a.d[0] + b.d[0];
+    r.d[0] = (uint64_t)t; t >>= 64;
+    t += (uint128_t)a.d[1] + b.d[1];
+    r.d[1] = (uint64_t)t; t >>= 64;
+    t += (uint128_t)a.d[2] + b.d[2];
+    r.d[2] = (uint64_t)t; t >>= 64;
+    t += (uint128_t)a.d[3] + b.d[3];
+    r.d[3] = (uint64_t)t; t >>= 64;
+    scReduce(r, (uint64_t)t | scCheckOverflow(r));
+}
+
+// r = n - a, or zero if a is zero
+void scNegate(Sc& r, const Sc& a)
+{
+    uint64_t nonzero = (uint64_t)0 - (uint64_t)!scIsZero(a);
+    uint128_t t = (uint128_t)(~a.d[0]) + N[0] + 1;
+    r.d[0] = (uint64_t)t & nonzero; t >>= 64;
+    t += (uint128_t)(~a.d[1]) + N[1];
+    r.d[1] = (uint64_t)t & nonzero; t >>= 64;
+    t += (uint128_t)(~a.d[2]) + N[2];
+    r.d[2] = (uint64_t)t & nonzero; t >>= 64;
+    t += (uint128_t)(~a.d[3]) + N[3];
+    r.d[3] = (uint64_t)t & nonzero;
+}
+
+// a > n/2. Variable time.
+bool scIsHigh(const Sc& a)
+{
+    for (int i = 3; i >= 0; i--) {
+        if (a.d[i] != NH[i]) return a.d[i] > NH[i];
+    }
+    return false;
+}
+
+// m = m[0..3] + m[4..4+nHigh-1] * (2^256 - n)
+inline void scFold(uint64_t* m, int nHigh)
+{
+    uint64_t p[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < nHigh; i++) {
+        uint128_t c = (uint128_t)m[4 + i] * NC[0] + p[i];
+        p[i] = (uint64_t)c; c >>= 64;
+        c += (uint128_t)m[4 + i] * NC[1] + p[i + 1];
+        p[i + 1] = (uint64_t)c; c >>= 64;
+        c += (uint128_t)m[4 + i] + p[i + 2];        // NC[2] == 1
+        p[i + 2] = (uint64_t)c;
+        p[i + 3] = (uint64_t)(c >> 64);
+    }
+    uint128_t c = 0;
+    for (int k = 0; k < 4; k++) {
+        c += (uint128_t)m[k] + p[k];
+        m[k] = (uint64_t)c; c >>= 64;
+    }
+    for (int k = 4; k < 8; k++) {
+        c += p[k];
+        m[k] = (uint64_t)c; c >>= 64;
+    }
+}
+
+// r = m mod n
+inline void scReduce512(Sc& r, uint64_t* m)
+{
+    // < 2^512, then < 2^386, < 2^259, < 2^256 + 2^132 and finally < 2^256
+    scFold(m, 4);
+    scFold(m, 3);
+    scFold(m, 1);
+    scFold(m, 1);
+
+    r.d[0] = m[0]; r.d[1] = m[1]; r.d[2] = m[2]; r.d[3] = m[3];
+    scReduce(r, scCheckOverflow(r));
+}
+
+void scMul(Sc& r, const Sc& a, const Sc& b)
+{
+    uint64_t m[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        uint128_t c = 0;
+        for (int j = 0; j < 4; j++) {
+            c += (uint128_t)a.d[i] * b.d[j] + m[i + j];
+            m[i + j] = (uint64_t)c; c >>= 64;
+        }
+        m[i + 4] = (uint64_t)c;
+    }
+    scReduce512(r, m);
+}
+
+inline bool isOne(const uint64_t* a)
+{
+    return a[0] == 1 && (a[1] | a[2] | a[3]) == 0;
+}
+
+// a >= b
+inline bool isGreaterOrEqual(const uint64_t* a, const uint64_t* b)
+{
+    for (int i = 3; i >= 0; i--) {
+        if (a[i] != b[i]) return a[i] > b[i];
+    }
+    return true;
+}
+
+// a -= b, where a >= b
+inline void subtract(uint64_t* a, const uint64_t* b)
+{
+    uint64_t borrow = 0;
+    for (int i = 0; i < 4; i++) {
+        uint64_t t = a[i] - b[i] - borrow;
+        borrow = (a[i] < b[i]) | ((a[i] == b[i]) & borrow);
+        a[i] = t;
+    }
+}
+
+inline void shiftRight(uint64_t* a, uint64_t top)
+{
+    a[0] = (a[0] >> 1) | (a[1] << 63);
+    a[1] = (a[1] >> 1) | (a[2] << 63);
+    a[2] = (a[2] >> 1) | (a[3] << 63);
+    a[3] = (a[3] >> 1) | (top << 63);
+}
+
+// a/2 mod n
+inline void scHalve(Sc& a)
+{
+    uint64_t carry = 0;
+    if (a.d[0] & 1) {
+        uint128_t c = 0;
+        for (int i = 0; i < 4; i++) {
+            c += (uint128_t)a.d[i] + N[i];
+            a.d[i] = (uint64_t)c; c >>= 64;
+        }
+        carry = (uint64_t)c;
+    }
+    shiftRight(a.d, carry);
+}
+
+// r = 1/a for nonzero a, by the binary extended Euclidean algorithm. Its running time
+// depends on a, so secrets have to be blinded first.
+void scInverse(Sc& r, const Sc& a)
+{
+    // x1 a == u and x2 a == v (mod n) throughout
+    uint64_t u[4] = { a.d[0], a.d[1], a.d[2], a.d[3] };
+    uint64_t v[4] = { N[0], N[1], N[2], N[3] };
+    Sc x1, x2, t;
+    scSetInt(x1, 1);
+    scSetInt(x2, 0);
+    while (!isOne(u) && !isOne(v)) {
+        while (!(u[0] & 1)) { shiftRight(u, 0); scHalve(x1); }
+        while (!(v[0] & 1)) { shiftRight(v, 0); scHalve(x2); }
+        if (isGreaterOrEqual(u, v)) {
+            subtract(u, v);
+            scNegate(t, x2); scAdd(x1, x1, t);
+        }
+        else {
+            subtract(v, u);
+            scNegate(t, x1); scAdd(x2, x2, t);
+        }
+    }
+    r = isOne(u) ? x1 : x2;
+}
+
+inline unsigned int scGetBits(const Sc& a, unsigned int offset, unsigned int count)
+{
+    if (offset >= 256) return 0;
+    unsigned int limb = offset >> 6, shift = offset & 63;
+    uint64_t v = a.d[limb] >> shift;
+    if (shift + count > 64 && limb < 3) v |= a.d[limb + 1] << (64 - shift);
+    return (unsigned int)v & ((1u << count) - 1);
+}
+
+// Window-w non-adjacent form: odd digits in (-2^(w-1), 2^(w-1)) with at least w - 1
+// zeros between them. wnaf has room for 257 digits so a final carry always fits.
+// Returns the number of digits up to the last nonzero one. Variable time.
+int scWnaf(int* wnaf, const Sc& a, int w)
+{
+    const int len = 257;
+    memset(wnaf, 0, len * sizeof(int));
+    int lastSet = -1;
+    int carry = 0;
+    int bit = 0;
+    while (bit < len) {
+        if (scGetBits(a, bit, 1) == (unsigned int)carry) {
+            bit++;
+            continue;
+        }
+        int now = w;
+        if (now > len - bit) now = len - bit;
+        int word = (int)scGetBits(a, bit, now) + carry;
+        carry = (word >> (w - 1)) & 1;
+        word -= carry << w;
+        wnaf[bit] = word;
+        lastSet = bit;
+        bit += now;
+    }
+    return lastSet + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Group elements of y^2 = x^3 + 7
+//
+
+struct Ge
+{
+    Fe x, y;
+    bool infinity;
+};
+
+// (X/Z^2, Y/Z^3)
+struct Gej
+{
+    Fe x, y, z;
+    bool infinity;
+};
+
+const unsigned char G_BYTES[64] = {
+    0x79, 0xBE, 0x66, 0x7E, 0xF9, 0xDC, 0xBB, 0xAC, 0x55, 0xA0, 0x62, 0x95, 0xCE, 0x87, 0x0B, 0x07,
+    0x02, 0x9B, 0xFC, 0xDB, 0x2D, 0xCE, 0x28, 0xD9, 0x59, 0xF2, 0x81, 0x5B, 0x16, 0xF8, 0x17, 0x98,
+    0x48, 0x3A, 0xDA, 0x77, 0x26, 0xA3, 0xC4, 0x65, 0x5D, 0xA4, 0xFB, 0xFC, 0x0E, 0x11, 0x08, 0xA8,
+    0xFD, 0x17, 0xB4, 0x48, 0xA6, 0x85, 0x54, 0x19, 0x9C, 0x47, 0xD0, 0x8F, 0xFB, 0x10, 0xD4, 0xB8 };
+
+// y^2 == x^3 + 7
+bool geIsValid(const Ge& a)
+{
+    Fe y2, x3, seven;
+    feSqr(y2, a.y);
+    feSqr(x3, a.x); feMul(x3, x3, a.x);
+    feSetInt(seven, 7); feAdd(x3, seven);
+    feNormalize(y2); feNormalize(x3);
+    return feEqual(y2, x3);
+}
+
+// Sets r to the point with x coordinate x and the given y parity.
+bool geSetXo(Ge& r, const Fe& x, bool bOdd)
+{
+    Fe x3, seven, y;
+    feSqr(x3, x); feMul(x3, x3, x);
+    feSetInt(seven, 7); feAdd(x3, seven);
+    if (!feSqrt(y, x3)) return false;
+    feNormalize(y);
+    if (feIsOdd(y) != bOdd) {
+        feNegate(y, y, 1);
+        feNormalize(y);
+    }
+    r.x = x; feNormalize(r.x);
+    r.y = y;
+    r.infinity = false;
+    return true;
+}
+
+inline void geNeg(Ge& r, const Ge& a)
+{
+    r.x = a.x;
+    feNegate(r.y, a.y, 1);
+    feNormalizeWeak(r.y);
+    r.infinity = a.infinity;
+}
+
+inline void gejSetGe(Gej& r, const Ge& a)
+{
+    r.x = a.x; r.y = a.y; feSetInt(r.z, 1);
+    r.infinity = a.infinity;
+}
+
+inline void gejNeg(Gej& r, const Gej& a)
+{
+    r.x = a.x; r.z = a.z;
+    r.y = a.y;
+    feNormalizeWeak(r.y);
+    feNegate(r.y, r.y, 1);
+    r.infinity = a.infinity;
+}
+
+// Affine coordinates of a given 1/Z, normalized.
+inline void geSetGejZinv(Ge& r, const Gej& a, const Fe& zi)
+{
+    Fe zi2, zi3;
+    feSqr(zi2, zi);
+    feMul(zi3, zi2, zi);
+    feMul(r.x, a.x, zi2);
+    feMul(r.y, a.y, zi3);
+    feNormalize(r.x);
+    feNormalize(r.y);
+    r.infinity = a.infinity;
+}
+
+// Constant time.
+void geSetGej(Ge& r, const Gej& a)
+{
+    Fe zi;
+    feInv(zi, a.z);
+    geSetGejZinv(r, a, zi);
+}
+
+// Converts n points, none of them at infinity, with a single inversion.
+void geSetAllGej(Ge* r, const Gej* a, size_t n)
+{
+    if (n == 0) return;
+    std::vector<Fe> acc(n);
+    acc[0] = a[0].z;
+    for (size_t i = 1; i < n; i++) feMul(acc[i], acc[i - 1], a[i].z);
+
+    Fe inv, zi;
+    feInv(inv, acc[n - 1]);
+    for (size_t i = n - 1; i > 0; i--) {
+        feMul(zi, inv, acc[i - 1]);
+        feMul(inv, inv, a[i].z);
+        geSetGejZinv(r[i], a[i], zi);
+    }
+    geSetGejZinv(r[0], a[0], inv);
+}
+
+// r = 2a. Also fine with r == a.
+void gejDouble(Gej& r, const Gej& a)
+{
+    Fe t1, t2, t3, t4;
+    r.infinity = a.infinity;
+    feMul(r.z, a.z, a.y); feMulInt(r.z, 2);         // Z3 = 2YZ                         (2)
+    feSqr(t1, a.x); feMulInt(t1, 3);                // M = 3X^2                         (3)
+    feSqr(t2, t1);                                  // M^2                              (1)
+    feSqr(t3, a.y); feMulInt(t3, 2);                // 2Y^2                             (2)
+    feSqr(t4, t3); feMulInt(t4, 2);                 // 8Y^4                             (2)
+    feMul(t3, t3, a.x);                             // 2XY^2                            (1)
+    r.x = t3; feMulInt(r.x, 4);                     // 2S = 8XY^2                       (4)
+    feNegate(r.x, r.x, 4); feAdd(r.x, t2);          // X3 = M^2 - 2S                    (6)
+    feNegate(t2, t2, 1);                            // -M^2                             (2)
+    feMulInt(t3, 6); feAdd(t3, t2);                 // 3S - M^2                         (8)
+    feMul(r.y, t1, t3);                             //                                  (1)
+    feNegate(t2, t4, 2); feAdd(r.y, t2);            // Y3 = M(3S - M^2) - 8Y^4 = M(S - X3) - 8Y^4 (4)
+}
+
+// The tail shared by the additions: given U1, S1, H = U2 - U1, R = S2 - S1 and the new Z.
+inline void gejAddFinish(Gej& r, const Fe& u1, const Fe& s1, const Fe& h, const Fe& i, const Fe& z)
+{
+    Fe h2, h3, i2, t;
+    feSqr(i2, i);
+    feSqr(h2, h);
+    feMul(h3, h, h2);
+    feMul(t, u1, h2);                               // U1 H^2                           (1)
+    r.z = z;
+    r.x = t; feMulInt(r.x, 2); feAdd(r.x, h3);      // 2 U1 H^2 + H^3                   (3)
+    feNegate(r.x, r.x, 3); feAdd(r.x, i2);          // X3 = R^2 - H^3 - 2 U1 H^2        (5)
+    feNegate(r.y, r.x, 5); feAdd(r.y, t);           // U1 H^2 - X3                      (7)
+    feMul(r.y, r.y, i);
+    feMul(h3, h3, s1); feNegate(h3, h3, 1);
+    feAdd(r.y, h3);                                 // Y3 = R(U1 H^2 - X3) - S1 H^3     (3)
+    r.infinity = false;
+}
+
+// r = a + b without the special cases: a and b must not be at infinity and a != +-b.
+// Constant time.
+void gejAddGeIncomplete(Gej& r, const Gej& a, const Ge& b)
+{
+    Fe z12, u1, u2, s1, s2, h, i, z;
+    feSqr(z12, a.z);
+    u1 = a.x; feNormalizeWeak(u1);
+    feMul(u2, b.x, z12);
+    s1 = a.y; feNormalizeWeak(s1);
+    feMul(s2, b.y, z12); feMul(s2, s2, a.z);
+    feNegate(h, u1, 1); feAdd(h, u2);
+    feNegate(i, s1, 1); feAdd(i, s2);
+    feMul(z, a.z, h);
+    gejAddFinish(r, u1, s1, h, i, z);
+}
+
+// r = a + b. Variable time.
+void gejAddGeVar(Gej& r, const Gej& a, const Ge& b)
+{
+    if (a.infinity) { gejSetGe(r, b); return; }
+    if (b.infinity) { r = a; return; }
+
+    Fe z12, u1, u2, s1, s2, h, i, z;
+    feSqr(z12, a.z);
+    u1 = a.x; feNormalizeWeak(u1);
+    feMul(u2, b.x, z12);
+    s1 = a.y; feNormalizeWeak(s1);
+    feMul(s2, b.y, z12); feMul(s2, s2, a.z);
+    feNegate(h, u1, 1); feAdd(h, u2);
+    feNegate(i, s1, 1); feAdd(i, s2);
+    if (feNormalizesToZero(h)) {
+        if (feNormalizesToZero(i)) { gejDouble(r, a); }
+        else { r.infinity = true; }
+        return;
+    }
+    feMul(z, a.z, h);
+    gejAddFinish(r, u1, s1, h, i, z);
+}
+
+// r = a + b. Variable time.
+void gejAddVar(Gej& r, const Gej& a, const Gej& b)
+{
+    if (a.infinity) { r = b; return; }
+    if (b.infinity) { r = a; return; }
+
+    Fe z12, z22, u1, u2, s1, s2, h, i, z;
+    feSqr(z12, a.z);
+    feSqr(z22, b.z);
+    feMul(u1, a.x, z22);
+    feMul(u2, b.x, z12);
+    feMul(s1, a.y, z22); feMul(s1, s1, b.z);
+    feMul(s2, b.y, z12); feMul(s2, s2, a.z);
+    feNegate(h, u1, 1); feAdd(h, u2);
+    feNegate(i, s1, 1); feAdd(i, s2);
+    if (feNormalizesToZero(h)) {
+        if (feNormalizesToZero(i)) { gejDouble(r, a); }
+        else { r.infinity = true; }
+        return;
+    }
+    feMul(z, a.z, b.z); feMul(z, z, h);
+    gejAddFinish(r, u1, s1, h, i, z);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Multiplication
+//
+
+#define GEN_WINDOW_BITS         4
+#define GEN_WINDOWS             (256 / GEN_WINDOW_BITS)
+#define GEN_WINDOW_SIZE         (1 << GEN_WINDOW_BITS)
+
+#define WNAF_WINDOW_A           5   // verification: odd multiples of the public key, built per call
+#define WNAF_WINDOW_G           8   // and of G, built once
+#define WNAF_TABLE_SIZE(w)      (1 << ((w) - 2))
+
+#define NUMS_SEED               "CoinClasses secp256k1 generator table blinding point"
+
+// gen[i][j] = (j * 16^i)G + U_i, where U_i = 2^i H for i < 63 and U_63 = -(2^63 - 1)H, so
+// the U_i sum to zero. H is a point nobody knows the discrete log of, which keeps every
+// entry and every partial sum away from infinity and from each other - so k*G can be
+// added up with incomplete formulas and no secret-dependent branches.
+struct Tables
+{
+    Ge gen[GEN_WINDOWS][GEN_WINDOW_SIZE];
+    Ge oddG[WNAF_TABLE_SIZE(WNAF_WINDOW_G)];    // G, 3G, 5G, ...
+    Ge g;
+
+    Tables()
+    {
+        feSetBytes(g.x, G_BYTES);
+        feSetBytes(g.y, G_BYTES + 32);
+        g.infinity = false;
+
+        unsigned char seed[32];
+        SHA256((const unsigned char*)NUMS_SEED, sizeof(NUMS_SEED) - 1, seed);
+        Fe x, one;
+        feSetBytes(x, seed);
+        feSetInt(one, 1);
+        Ge h;
+        while (!geSetXo(h, x, false)) {
+            feAdd(x, one);
+            feNormalize(x);
+        }
+
+        std::vector<Gej> prec(GEN_WINDOWS * GEN_WINDOW_SIZE);
+        Gej base, nums, numsSum;
+        gejSetGe(base, g);
+        gejSetGe(nums, h);
+        numsSum.infinity = true;
+        for (int i = 0; i < GEN_WINDOWS; i++) {
+            Gej* row = &prec[i * GEN_WINDOW_SIZE];
+            if (i < GEN_WINDOWS - 1) {
+                row[0] = nums;
+                gejAddVar(numsSum, numsSum, nums);
+                gejDouble(nums, nums);
+            }
+            else {
+                gejNeg(row[0], numsSum);
+            }
+            for (int j = 1; j < GEN_WINDOW_SIZE; j++) gejAddVar(row[j], row[j - 1], base);
+            for (int j = 0; j < GEN_WINDOW_BITS; j++) gejDouble(base, base);
+        }
+        geSetAllGej(&gen[0][0], &prec[0], prec.size());
+
+        Gej odd[WNAF_TABLE_SIZE(WNAF_WINDOW_G)], g2;
+        gejSetGe(odd[0], g);
+        gejDouble(g2, odd[0]);
+        for (int i = 1; i < WNAF_TABLE_SIZE(WNAF_WINDOW_G); i++) gejAddVar(odd[i], odd[i - 1], g2);
+        geSetAllGej(oddG, odd, WNAF_TABLE_SIZE(WNAF_WINDOW_G));
+    }
+};
+
+const Tables& getTables()
+{
+    static Tables tables;
+    return tables;
+}
+
+// r = k*G. Constant time.
+void ecmultGen(Gej& r, const Sc& k)
+{
+    const Tables& tables = getTables();
+    Ge add;
+    add.infinity = false;
+    for (int i = 0; i < GEN_WINDOWS; i++) {
+        unsigned int bits = (unsigned int)(k.d[i >> 4] >> ((i & 15) * GEN_WINDOW_BITS)) & (GEN_WINDOW_SIZE - 1);
+        add.x = tables.gen[i][0].x;
+        add.y = tables.gen[i][0].y;
+        for (unsigned int j = 1; j < GEN_WINDOW_SIZE; j++) {
+            uint64_t mask = equalMask(j, bits);
+            feCmov(add.x, tables.gen[i][j].x, mask);
+            feCmov(add.y, tables.gen[i][j].y, mask);
+        }
+        if (i == 0) { gejSetGe(r, add); }
+        else        { gejAddGeIncomplete(r, r, add); }
+    }
+}
+
+// r = na*a + ng*G. Variable time.
+void ecmult(Gej& r, const Gej& a, const Sc& na, const Sc& ng)
+{
+    const Tables& tables = getTables();
+
+    int wnafA[257], wnafG[257];
+    int bitsA = 0;
+    Gej preA[WNAF_TABLE_SIZE(WNAF_WINDOW_A)];
+    if (!a.infinity && !scIsZero(na)) {
+        Gej a2;
+        preA[0] = a;
+        gejDouble(a2, a);
+        for (int i = 1; i < WNAF_TABLE_SIZE(WNAF_WINDOW_A); i++) gejAddVar(preA[i], preA[i - 1], a2);
+        bitsA = scWnaf(wnafA, na, WNAF_WINDOW_A);
+    }
+    int bitsG = scWnaf(wnafG, ng, WNAF_WINDOW_G);
+    int bits = bitsA > bitsG ? bitsA : bitsG;
+
+    r.infinity = true;
+    for (int i = bits - 1; i >= 0; i--) {
+        if (!r.infinity) gejDouble(r, r);
+
+        int n;
+        if (i < bitsA && (n = wnafA[i]) != 0) {
+            if (n > 0) {
+                gejAddVar(r, r, preA[(n - 1) / 2]);
+            }
+            else {
+                Gej t;
+                gejNeg(t, preA[(-n - 1) / 2]);
+                gejAddVar(r, r, t);
+            }
+        }
+        if (i < bitsG && (n = wnafG[i]) != 0) {
+            if (n > 0) {
+                gejAddGeVar(r, r, tables.oddG[(n - 1) / 2]);
+            }
+            else {
+                Ge t;
+                geNeg(t, tables.oddG[(-n - 1) / 2]);
+                gejAddGeVar(r, r, t);
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// ECDSA
+//
+
+class HmacSha256
+{
+public:
+    // key must be at most 64 bytes
+    HmacSha256(const unsigned char* key, size_t keyLen)
+    {
+        unsigned char pad[64];
+        memset(pad, 0x36, sizeof(pad));
+        for (size_t i = 0; i < keyLen; i++) pad[i] ^= key[i];
+        SHA256_Init(&m_inner);
+        SHA256_Update(&m_inner, pad, sizeof(pad));
+
+        memset(pad, 0x5c, sizeof(pad));
+        for (size_t i = 0; i < keyLen; i++) pad[i] ^= key[i];
+        SHA256_Init(&m_outer);
+        SHA256_Update(&m_outer, pad, sizeof(pad));
+        OPENSSL_cleanse(pad, sizeof(pad));
+    }
+
+    ~HmacSha256()
+    {
+        OPENSSL_cleanse(&m_inner, sizeof(m_inner));
+        OPENSSL_cleanse(&m_outer, sizeof(m_outer));
+    }
+
+    void write(const unsigned char* data, size_t len) { SHA256_Update(&m_inner, data, len); }
+
+    void finalize(unsigned char* hash)
+    {
+        unsigned char inner[32];
+        SHA256_Final(inner, &m_inner);
+        SHA256_Update(&m_outer, inner, sizeof(inner));
+        SHA256_Final(hash, &m_outer);
+    }
+
+private:
+    SHA256_CTX m_inner;
+    SHA256_CTX m_outer;
+};
+
+// RFC 6979 section 3.2 nonces with HMAC-SHA256.
+class Rfc6979
+{
+public:
+    Rfc6979(const unsigned char* seckey, const unsigned char* hash) : m_bRetry(false)
+    {
+        memset(m_v, 0x01, sizeof(m_v));
+        memset(m_k, 0x00, sizeof(m_k));
+        update(0x00, seckey, hash);
+        update(0x01, seckey, hash);
+    }
+
+    ~Rfc6979()
+    {
+        OPENSSL_cleanse(m_v, sizeof(m_v));
+        OPENSSL_cleanse(m_k, sizeof(m_k));
+    }
+
+    void generate(unsigned char* nonce)
+    {
+        if (m_bRetry) update(0x00, NULL, NULL);
+        step();
+        memcpy(nonce, m_v, sizeof(m_v));
+        m_bRetry = true;
+    }
+
+private:
+    // K = HMAC_K(V || b [|| seckey || hash]), V = HMAC_K(V)
+    void update(unsigned char b, const unsigned char* seckey, const unsigned char* hash)
+    {
+        HmacSha256 hmac(m_k, sizeof(m_k));
+        hmac.write(m_v, sizeof(m_v));
+        hmac.write(&b, 1);
+        if (seckey) {
+            hmac.write(seckey, 32);
+            hmac.write(hash, 32);
+        }
+        hmac.finalize(m_k);
+        step();
+    }
+
+    // V = HMAC_K(V)
+    void step()
+    {
+        HmacSha256 hmac(m_k, sizeof(m_k));
+        hmac.write(m_v, sizeof(m_v));
+        hmac.finalize(m_v);
+    }
+
+    unsigned char m_v[32];
+    unsigned char m_k[32];
+    bool m_bRetry;
+};
+
+bool loadSignature(Sc& r, Sc& s, const unsigned char* sig)
+{
+    return !scSetBytes(r, sig) && !scIsZero(r) && !scSetBytes(s, sig + 32) && !scIsZero(s);
+}
+
+// x = r + n as a field element. Returns false if r + n >= p.
+bool addOrder(Fe& x, const Sc& r)
+{
+    uint64_t w[4];
+    uint128_t c = 0;
+    for (int i = 0; i < 4; i++) {
+        c += (uint128_t)r.d[i] + N[i];
+        w[i] = (uint64_t)c; c >>= 64;
+    }
+    if (c) return false;
+    unsigned char b[32];
+    writeBE64(b, w[3]); writeBE64(b + 8, w[2]); writeBE64(b + 16, w[1]); writeBE64(b + 24, w[0]);
+    return feSetBytes(x, b);
+}
+
+// R = u1*G + u2*Q and R.x == r (mod n), checked without leaving Jacobian coordinates:
+// r Z^2 == X for r or r + n.
+bool checkSignature(const Ge& q, const Sc& r, const Sc& u1, const Sc& u2)
+{
+    Gej qj, rj;
+    gejSetGe(qj, q);
+    ecmult(rj, qj, u2, u1);
+    if (rj.infinity) return false;
+
+    unsigned char rb[32];
+    Fe xr, z2, t, x = rj.x;
+    feNormalize(x);
+    feSqr(z2, rj.z);
+    scGetBytes(rb, r);
+    feSetBytes(xr, rb);
+    feMul(t, xr, z2);
+    feNormalize(t);
+    if (feEqual(t, x)) return true;
+
+    if (!addOrder(xr, r)) return false;
+    feMul(t, xr, z2);
+    feNormalize(t);
+    return feEqual(t, x);
+}
+
+bool loadPublicKey(Ge& r, const PublicKey& pubkey)
+{
+    r.infinity = false;
+    return feSetBytes(r.x, pubkey.data) && feSetBytes(r.y, pubkey.data + 32) && geIsValid(r);
+}
+
+// a must be normalized
+void storePublicKey(PublicKey& pubkey, const Ge& a)
+{
+    feGetBytes(pubkey.data, a.x);
+    feGetBytes(pubkey.data + 32, a.y);
+}
+
+}; // anonymous namespace
+
+PublicKey::PublicKey()
+{
+    memset(data, 0, sizeof(data));
+}
+
+bool PublicKey::operator==(const PublicKey& rhs) const
+{
+    return memcmp(data, rhs.data, sizeof(data)) == 0;
+}
+
+bool isValidSecret(const unsigned char* seckey)
+{
+    Sc k;
+    bool bValid = !scSetBytes(k, seckey) && !scIsZero(k);
+    OPENSSL_cleanse(&k, sizeof(k));
+    return bValid;
+}
+
+bool derivePublicKey(const unsigned char* seckey, PublicKey& pubkey)
+{
+    Sc k;
+    if (scSetBytes(k, seckey) || scIsZero(k)) {
+        OPENSSL_cleanse(&k, sizeof(k));
+        return false;
+    }
+
+    Gej r;
+    Ge a;
+    ecmultGen(r, k);
+    geSetGej(a, r);
+    storePublicKey(pubkey, a);
+    OPENSSL_cleanse(&k, sizeof(k));
+    OPENSSL_cleanse(&r, sizeof(r));
+    return true;
+}
+
+bool derivePublicKeys(const unsigned char* seckeys, size_t count, PublicKey* pubkeys, unsigned char* results)
+{
+    if (count == 0) return true;
+
+    std::vector<Gej> r(count);
+    std::vector<Ge> a(count);
+    Sc k, one;
+    scSetInt(one, 1);
+    bool bAllValid = true;
+    for (size_t i = 0; i < count; i++) {
+        bool bValid = !scSetBytes(k, seckeys + 32 * i) && !scIsZero(k);
+        if (!bValid) k = one; // keeps every point off infinity for the shared inversion
+        ecmultGen(r[i], k);
+        if (results) results[i] = bValid;
+        bAllValid = bAllValid && bValid;
+    }
+    OPENSSL_cleanse(&k, sizeof(k));
+
+    geSetAllGej(&a[0], &r[0], count);
+    for (size_t i = 0; i < count; i++) storePublicKey(pubkeys[i], a[i]);
+    OPENSSL_cleanse(&r[0], count * sizeof(Gej));
+    return bAllValid;
+}
+
+void precompute()
+{
+    getTables();
+}
+
+bool parsePublicKey(const unsigned char* data, size_t len, PublicKey& pubkey)
+{
+    Ge a;
+    if (len == SECP256K1_COMPRESSED_PUBKEY_SIZE && (data[0] == 0x02 || data[0] == 0x03)) {
+        Fe x;
+        if (!feSetBytes(x, data + 1) || !geSetXo(a, x, data[0] == 0x03)) return false;
+    }
+    else if (len == SECP256K1_UNCOMPRESSED_PUBKEY_SIZE && (data[0] == 0x04 || data[0] == 0x06 || data[0] == 0x07)) {
+        // 0x06 and 0x07 are the hybrid encodings OpenSSL also accepts - uncompressed plus the parity in the prefix
+        if (data[0] != 0x04 && (data[0] & 1) != (data[64] & 1)) return false;
+        a.infinity = false;
+        if (!feSetBytes(a.x, data + 1) || !feSetBytes(a.y, data + 33) || !geIsValid(a)) return false;
+    }
+    else {
+        return false;
+    }
+    storePublicKey(pubkey, a);
+    return true;
+}
+
+void serializePublicKey(const PublicKey& pubkey, bool bCompressed, unsigned char* out)
+{
+    if (bCompressed) {
+        out[0] = 0x02 | (pubkey.data[63] & 1);
+        memcpy(out + 1, pubkey.data, 32);
+    }
+    else {
+        out[0] = 0x04;
+        memcpy(out + 1, pubkey.data, 64);
+    }
+}
+
+bool sign(const unsigned char* seckey, const unsigned char* hash, unsigned char* sig, int* recid)
+{
+    Sc d, e, k, b, kinv, r, s;
+    if (scSetBytes(d, seckey) || scIsZero(d)) {
+        OPENSSL_cleanse(&d, sizeof(d));
+        return false;
+    }
+
+    unsigned char msg[32], nonce[32];
+    scSetBytes(e, hash);
+    scGetBytes(msg, e);
+    Rfc6979 rng(seckey, msg);
+
+    int id;
+    while (true) {
+        rng.generate(nonce);
+        if (scSetBytes(k, nonce) || scIsZero(k)) continue;
+
+        Gej rj;
+        Ge ra;
+        ecmultGen(rj, k);
+        geSetGej(ra, rj);
+
+        unsigned char rx[32];
+        feGetBytes(rx, ra.x);
+        bool bOverflow = scSetBytes(r, rx);
+        if (scIsZero(r)) continue;
+        id = (bOverflow ? 2 : 0) | (feIsOdd(ra.y) ? 1 : 0);
+
+        // 1/k = b/(kb) for a secret blinding factor b drawn after k: kb is independent of k,
+        // so it can go through the fast variable-time inverse
+        rng.generate(nonce);
+        if (scSetBytes(b, nonce) || scIsZero(b)) scSetInt(b, 1);
+        scMul(kinv, k, b);
+        scInverse(kinv, kinv);
+        scMul(kinv, kinv, b);
+
+        // s = (e + rd)/k
+        scMul(s, r, d);
+        scAdd(s, s, e);
+        scMul(s, s, kinv);
+        if (scIsZero(s)) continue;
+
+        if (scIsHigh(s)) {
+            scNegate(s, s);
+            id ^= 1;
+        }
+        break;
+    }
+
+    scGetBytes(sig, r);
+    scGetBytes(sig + 32, s);
+    if (recid) *recid = id;
+
+    OPENSSL_cleanse(&d, sizeof(d));
+    OPENSSL_cleanse(&k, sizeof(k));
+    OPENSSL_cleanse(&b, sizeof(b));
+    OPENSSL_cleanse(&kinv, sizeof(kinv));
+    OPENSSL_cleanse(nonce, sizeof(nonce));
+    return true;
+}
+
+bool verify(const PublicKey& pubkey, const unsigned char* hash, const unsigned char* sig)
+{
+    Sc r, s, e, w, u1, u2;
+    Ge q;
+    if (!loadSignature(r, s, sig) || !loadPublicKey(q, pubkey)) return false;
+
+    scSetBytes(e, hash);
+    scInverse(w, s);
+    scMul(u1, e, w);
+    scMul(u2, r, w);
+
+    return checkSignature(q, r, u1, u2);
+}
+
+bool verifyBatch(const PublicKey* pubkeys, const unsigned char* hashes, const unsigned char* sigs, size_t count,
+                 unsigned char* results)
+{
+    if (count == 0) return true;
+
+    std::vector<Sc> r(count), s(count), prefix(count);
+    std::vector<Ge> q(count);
+    Sc acc, one;
+    scSetInt(one, 1);
+    acc = one;
+    for (size_t i = 0; i < count; i++) {
+        results[i] = loadSignature(r[i], s[i], sigs + 64 * i) && loadPublicKey(q[i], pubkeys[i]);
+        if (!results[i]) s[i] = one;
+        prefix[i] = acc;
+        scMul(acc, acc, s[i]);
+    }
+
+    // one inversion for the whole batch: 1/s_i = (s_0 ... s_(i-1)) / (s_0 ... s_i)
+    Sc inv, w, e, u1, u2;
+    scInverse(inv, acc);
+    bool bAllValid = true;
+    for (size_t i = count; i-- > 0;) {
+        scMul(w, inv, prefix[i]);
+        scMul(inv, inv, s[i]);
+        if (results[i]) {
+            scSetBytes(e, hashes + 32 * i);
+            scMul(u1, e, w);
+            scMul(u2, r[i], w);
+            results[i] = checkSignature(q[i], r[i], u1, u2);
+        }
+        bAllValid = bAllValid && results[i];
+    }
+    return bAllValid;
+}
+
+bool recover(const unsigned char* hash, const unsigned char* sig, int recid, PublicKey& pubkey)
+{
+    if (recid < 0 || recid > 3) return false;
+
+    Sc r, s;
+    if (!loadSignature(r, s, sig)) return false;
+
+    unsigned char rb[32];
+    Fe x;
+    scGetBytes(rb, r);
+    feSetBytes(x, rb);
+    if ((recid & 2) && !addOrder(x, r)) return false;
+
+    Ge ra;
+    if (!geSetXo(ra, x, recid & 1)) return false;
+
+    // Q = (sR - eG)/r
+    Sc e, rinv, u1, u2;
+    scSetBytes(e, hash);
+    scInverse(rinv, r);
+    scMul(u1, e, rinv);
+    scNegate(u1, u1);
+    scMul(u2, s, rinv);
+
+    Gej rj, qj;
+    gejSetGe(rj, ra);
+    ecmult(qj, rj, u2, u1);
+    if (qj.infinity) return false;
+
+    Ge q;
+    geSetGej(q, qj);
+    storePublicKey(pubkey, q);
+    return true;
+}
+
+size_t encodeDerSignature(const unsigned char* sig, unsigned char* der)
+{
+    unsigned char* p = der + 2;
+    for (int i = 0; i < 2; i++) {
+        const unsigned char* n = sig + 32 * i;
+        size_t len = 32;
+        while (len > 1 && *n == 0) { n++; len--; }
+        bool bPad = (*n & 0x80) != 0;
+        *p++ = 0x02;
+        *p++ = (unsigned char)(len + bPad);
+        if (bPad) *p++ = 0x00;
+        memcpy(p, n, len);
+        p += len;
+    }
+    der[0] = 0x30;
+    der[1] = (unsigned char)(p - der - 2);
+    return p - der;
+}
+
+bool decodeDerSignature(const unsigned char* der, size_t len, unsigned char* sig)
+{
+    if (len < 8 || len > SECP256K1_MAX_DER_SIGNATURE_SIZE || der[0] != 0x30 || der[1] != len - 2) return false;
+
+    size_t pos = 2;
+    for (int i = 0; i < 2; i++) {
+        if (pos + 2 > len || der[pos] != 0x02) return false;
+        size_t n = der[pos + 1];
+        pos += 2;
+        if (n == 0 || pos + n > len || (der[pos] & 0x80)) return false;
+        while (n > 1 && der[pos] == 0) { pos++; n--; }
+        if (n > 32) return false;
+        memset(sig + 32 * i, 0, 32);
+        memcpy(sig + 32 * i + 32 - n, der + pos, n);
+        pos += n;
+    }
+    if (pos != len) return false;
+
+    Sc r, s;
+    return loadSignature(r, s, sig);
+}
+
+bool tweakAddSecret(unsigned char* seckey, const unsigned char* tweak)
+{
+    Sc k, t;
+    bool bValid = !scSetBytes(t, tweak) && !scSetBytes(k, seckey);
+    if (bValid) {
+        scAdd(k, k, t);
+        bValid = !scIsZero(k);
+        if (bValid) scGetBytes(seckey, k);
+    }
+    OPENSSL_cleanse(&k, sizeof(k));
+    OPENSSL_cleanse(&t, sizeof(t));
+    return bValid;
+}
+
+bool tweakAddPublic(PublicKey& pubkey, const unsigned char* tweak)
+{
+    Sc t, zero;
+    Ge p;
+    if (scSetBytes(t, tweak) || !loadPublicKey(p, pubkey)) return false;
+
+    Gej none, r;
+    none.infinity = true;
+    scSetInt(zero, 0);
+    ecmult(r, none, zero, t);
+    gejAddGeVar(r, r, p);
+    if (r.infinity) return false;
+
+    Ge a;
+    geSetGej(a, r);
+    storePublicKey(pubkey, a);
+    return true;
+}
+
+bool tweakAddPublicKeys(const PublicKey& pubkey, const unsigned char* tweaks, size_t count, PublicKey* out,
+                        unsigned char* results)
+{
+    Ge p;
+    if (!loadPublicKey(p, pubkey)) {
+        if (results) memset(results, 0, count);
+        return false;
+    }
+    if (count == 0) return true;
+
+    // The tweaks are public, but the generator table is still the cheapest way to get t*G.
+    std::vector<Gej> r(count);
+    std::vector<Ge> a(count);
+    Sc t;
+    bool bAllValid = true;
+    for (size_t i = 0; i < count; i++) {
+        bool bValid = !scSetBytes(t, tweaks + 32 * i);
+        if (bValid && !scIsZero(t)) {
+            ecmultGen(r[i], t);
+            gejAddGeVar(r[i], r[i], p);
+        }
+        else {
+            gejSetGe(r[i], p);
+        }
+        if (r[i].infinity) {
+            bValid = false;
+            gejSetGe(r[i], p); // stand-in so the batch inversion never sees infinity
+        }
+        if (results) results[i] = bValid;
+        bAllValid = bAllValid && bValid;
+    }
+
+    geSetAllGej(&a[0], &r[0], count);
+    for (size_t i = 0; i < count; i++) storePublicKey(out[i], a[i]);
+    return bAllValid;
+}
+
+}; // namespace secp256k1
+
+}; // namespace Coin
@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// secp256k1math.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+// Native secp256k1 arithmetic for key derivation, signing and verification without
+// going through OpenSSL's EC_KEY, EC_POINT and BN_CTX machinery.
+//
+// Field elements are five 52-bit limbs in 64-bit words (products go through
+// unsigned __int128), scalars are four 64-bit words mod n, and points stay in
+// Jacobian coordinates until they are serialized.
+//
+// Everything that touches a secret - public key derivation, signing and private
+// key tweaks - runs in constant time: k*G is summed from a precomputed table of
+// multiples of G with branch-free lookups, and signing nonces are only inverted
+// behind a secret blinding factor. Verification, recovery and public key tweaks
+// only handle public data and use variable-time wNAF multiplication.
+//
+// Secret keys, hashes and signatures are big-endian byte strings: 32-byte keys
+// and hashes, 64-byte r || s signatures.
+
+#ifndef _SECP256K1_MATH_H__
+#define _SECP256K1_MATH_H__
+
+#include <stddef.h>
+
+#define SECP256K1_COMPRESSED_PUBKEY_SIZE    33
+#define SECP256K1_UNCOMPRESSED_PUBKEY_SIZE  65
+#define SECP256K1_MAX_DER_SIGNATURE_SIZE    72
+
+namespace Coin
+{
+
+namespace secp256k1
+{
+
+// A point on the curve other than infinity, as big-endian affine x || y.
+class PublicKey
+{
+public:
+    PublicKey();
+
+    bool operator==(const PublicKey& rhs) const;
+    bool operator!=(const PublicKey& rhs) const { return !(*this == rhs); }
+
+    unsigned char data[64];
+};
+
+// 0 < key < n
+bool isValidSecret(const unsigned char* seckey);
+
+// Constant time. Returns false if seckey is not a valid secret.
+bool derivePublicKey(const unsigned char* seckey, PublicKey& pubkey);
+
+// Derives count public keys from consecutive 32-byte secrets. The points are converted to
+// affine coordinates together, with one field inversion for the whole batch instead of one
+// per key. If results isn't NULL it receives 1 or 0 for each secret; the public key for an
+// invalid secret is unspecified. Returns true if every secret is valid. Constant time in
+// the secrets.
+bool derivePublicKeys(const unsigned char* seckeys, size_t count, PublicKey* pubkeys, unsigned char* results = NULL);
+
+// The generator tables are built on first use. Call this at startup to pay for them up front.
+void precompute();
+
+// Accepts 33-byte compressed and 65-byte uncompressed encodings of points on the curve.
+bool parsePublicKey(const unsigned char* data, size_t len, PublicKey& pubkey);
+
+// Writes SECP256K1_COMPRESSED_PUBKEY_SIZE or SECP256K1_UNCOMPRESSED_PUBKEY_SIZE bytes.
+void serializePublicKey(const PublicKey& pubkey, bool bCompressed, unsigned char* out);
+
+// Deterministic ECDSA (RFC 6979 nonces, HMAC-SHA256) with low s. Constant time.
+// If recid isn't NULL it receives the recovery id (0-3) for recover().
+bool sign(const unsigned char* seckey, const unsigned char* hash, unsigned char* sig, int* recid = NULL);
+
+// Accepts both low and high s.
+bool verify(const PublicKey& pubkey, const unsigned char* hash, const unsigned char* sig);
+
+// Verifies count signatures, writing 1 or 0 to results[i] for each one, and returns true if
+// they're all valid. hashes and sigs are consecutive 32 and 64-byte entries. ECDSA has no
+// algebraic batch check (a signature carries R.x but not R), so each R is still computed
+// separately; what's shared is the scalar inversion of every s, done with one inversion
+// and three multiplications per signature.
+bool verifyBatch(const PublicKey* pubkeys, const unsigned char* hashes, const unsigned char* sigs, size_t count,
+                 unsigned char* results);
+
+// Reconstructs the public key that produced sig over hash.
+bool recover(const unsigned char* hash, const unsigned char* sig, int recid, PublicKey& pubkey);
+
+// DER encoding of r || s. Returns the number of bytes written, at most SECP256K1_MAX_DER_SIGNATURE_SIZE.
+size_t encodeDerSignature(const unsigned char* sig, unsigned char* der);
+
+// Returns false if der isn't a DER sequence of two positive integers below n.
+bool decodeDerSignature(const unsigned char* der, size_t len, unsigned char* sig);
+
+// seckey = (seckey + tweak) mod n. Constant time. Returns false, leaving seckey alone,
+// if tweak >= n or the result is zero.
+bool tweakAddSecret(unsigned char* seckey, const unsigned char* tweak);
+
+// pubkey = pubkey + tweak*G. Returns false, leaving pubkey alone, if tweak >= n or
+// the result is the point at infinity.
+bool tweakAddPublic(PublicKey& pubkey, const unsigned char* tweak);
+
+// out[i] = pubkey + tweaks[i]*G for count consecutive 32-byte tweaks, converted to affine
+// coordinates with a single shared inversion. If results isn't NULL it receives 1 or 0 for
+// each tweak, with 0 where tweakAddPublic() would fail; out[i] is unspecified there. Returns
+// true if every tweak succeeded.
+bool tweakAddPublicKeys(const PublicKey& pubkey, const unsigned char* tweaks, size_t count, PublicKey* out,
+                        unsigned char* results = NULL);
+
+}; // namespace secp256k1
+
+}; // namespace Coin
+
+#endif // _SECP256K1_MATH_H__
@@ -0,0 +1,220 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sha256multi.cpp
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "sha256multi.h"
+#include "hash.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define HAVE_CPUID
+#endif
+
+#if defined(SHA256_MULTI_PORTABLE)
+#elif defined(__AVX2__)
+#define SHA256_MULTI_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#define SHA256_MULTI_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace Coin;
+
+namespace
+{
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t H0[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+inline uint32_t readBE32(const unsigned char* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+inline void writeBE32(unsigned char* p, uint32_t x) { p[0] = x >> 24; p[1] = x >> 16; p[2] = x >> 8; p[3] = x; }
+
+// One 32-bit word per lane.
+#if defined(SHA256_MULTI_AVX2)
+const size_t LANES = 8;
+typedef __m256i Vec;
+inline Vec add(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+inline Vec band(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+inline Vec bor(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+inline Vec bxor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+inline Vec bandnot(Vec a, Vec b) { return _mm256_andnot_si256(a, b); } // ~a & b
+inline Vec shr(Vec a, int n) { return _mm256_srli_epi32(a, n); }
+inline Vec shl(Vec a, int n) { return _mm256_slli_epi32(a, n); }
+inline Vec splat(uint32_t x) { return _mm256_set1_epi32((int)x); }
+inline Vec load(const uint32_t* w) { return _mm256_loadu_si256((const __m256i*)w); }
+inline void store(uint32_t* w, Vec a) { _mm256_storeu_si256((__m256i*)w, a); }
+#elif defined(SHA256_MULTI_SSE2)
+const size_t LANES = 4;
+typedef __m128i Vec;
+inline Vec add(Vec a, Vec b) { return _mm_add_epi32(a, b); }
+inline Vec band(Vec a, Vec b) { return _mm_and_si128(a, b); }
+inline Vec bor(Vec a, Vec b) { return _mm_or_si128(a, b); }
+inline Vec bxor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+inline Vec bandnot(Vec a, Vec b) { return _mm_andnot_si128(a, b); }
+inline Vec shr(Vec a, int n) { return _mm_srli_epi32(a, n); }
+inline Vec shl(Vec a, int n) { return _mm_slli_epi32(a, n); }
+inline Vec splat(uint32_t x) { return _mm_set1_epi32((int)x); }
+inline Vec load(const uint32_t* w) { return _mm_loadu_si128((const __m128i*)w); }
+inline void store(uint32_t* w, Vec a) { _mm_storeu_si128((__m128i*)w, a); }
+#else
+const size_t LANES = 4;
+struct Vec { uint32_t v[LANES]; };
+#define LANEWISE(expr) Vec r; for (size_t i = 0; i < LANES; i++) r.v[i] = (expr); return r;
+inline Vec add(Vec a, Vec b) { LANEWISE(a.v[i] + b.v[i]) }
+inline Vec band(Vec a, Vec b) { LANEWISE(a.v[i] & b.v[i]) }
+inline Vec bor(Vec a, Vec b) { LANEWISE(a.v[i] | b.v[i]) }
+inline Vec bxor(Vec a, Vec b) { LANEWISE(a.v[i] ^ b.v[i]) }
+inline Vec bandnot(Vec a, Vec b) { LANEWISE(~a.v[i] & b.v[i]) }
+inline Vec shr(Vec a, int n) { LANEWISE(a.v[i] >> n) }
+inline Vec shl(Vec a, int n) { LANEWISE(a.v[i] << n) }
+inline Vec splat(uint32_t x) { LANEWISE(x) }
+inline Vec load(const uint32_t* w) { LANEWISE(w[i]) }
+#undef LANEWISE
+inline void store(uint32_t* w, Vec a) { for (size_t i = 0; i < LANES; i++) w[i] = a.v[i]; }
+#endif
+
+inline Vec rotr(Vec a, int n) { return bor(shr(a, n), shl(a, 32 - n)); }
+inline Vec add(Vec a, Vec b, Vec c) { return add(add(a, b), c); }
+inline Vec add(Vec a, Vec b, Vec c, Vec d) { return add(add(a, b), add(c, d)); }
+inline Vec add(Vec a, Vec b, Vec c, Vec d, Vec e) { return add(add(a, b, c), add(d, e)); }
+
+inline Vec Sigma0(Vec x) { return bxor(bxor(rotr(x, 2), rotr(x, 13)), rotr(x, 22)); }
+inline Vec Sigma1(Vec x) { return bxor(bxor(rotr(x, 6), rotr(x, 11)), rotr(x, 25)); }
+inline Vec sigma0(Vec x) { return bxor(bxor(rotr(x, 7), rotr(x, 18)), shr(x, 3)); }
+inline Vec sigma1(Vec x) { return bxor(bxor(rotr(x, 17), rotr(x, 19)), shr(x, 10)); }
+inline Vec Ch(Vec x, Vec y, Vec z) { return bxor(band(x, y), bandnot(x, z)); }
+inline Vec Maj(Vec x, Vec y, Vec z) { return bor(band(x, y), band(z, bor(x, y))); }
+
+// Compresses one 64-byte block per lane into state.
+void transform(Vec state[8], const Vec block[16])
+{
+    Vec w[16];
+    for (int i = 0; i < 16; i++) w[i] = block[i];
+
+    Vec a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        if (i >= 16) w[i & 15] = add(sigma1(w[(i - 2) & 15]), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]), w[i & 15]);
+        Vec t1 = add(h, Sigma1(e), Ch(e, f, g), splat(K[i]), w[i & 15]);
+        Vec t2 = add(Sigma0(a), Maj(a, b, c));
+        h = g; g = f; f = e; e = add(d, t1);
+        d = c; c = b; b = a; a = add(t1, t2);
+    }
+
+    state[0] = add(state[0], a); state[1] = add(state[1], b); state[2] = add(state[2], c); state[3] = add(state[3], d);
+    state[4] = add(state[4], e); state[5] = add(state[5], f); state[6] = add(state[6], g); state[7] = add(state[7], h);
+}
+
+// Hashes exactly LANES headers. Lanes past count hash the last real header again and are discarded.
+void hashLanes(const unsigned char* data, size_t stride, size_t count, unsigned char* hashes)
+{
+    const unsigned char* p[LANES];
+    for (size_t lane = 0; lane < LANES; lane++) p[lane] = data + stride * (lane < count ? lane : count - 1);
+
+    uint32_t words[LANES];
+    Vec block[16];
+    Vec state[8];
+
+    // first 64 bytes
+    for (int i = 0; i < 16; i++) {
+        for (size_t lane = 0; lane < LANES; lane++) words[lane] = readBE32(p[lane] + 4*i);
+        block[i] = load(words);
+    }
+    for (int i = 0; i < 8; i++) state[i] = splat(H0[i]);
+    transform(state, block);
+
+    // last 16 bytes and padding for an 80-byte message
+    for (int i = 0; i < 4; i++) {
+        for (size_t lane = 0; lane < LANES; lane++) words[lane] = readBE32(p[lane] + 64 + 4*i);
+        block[i] = load(words);
+    }
+    block[4] = splat(0x80000000);
+    for (int i = 5; i < 15; i++) block[i] = splat(0);
+    block[15] = splat(80 * 8);
+    transform(state, block);
+
+    // second hash over the 32-byte digest
+    for (int i = 0; i < 8; i++) {
+        block[i] = state[i];
+        state[i] = splat(H0[i]);
+    }
+    block[8] = splat(0x80000000);
+    for (int i = 9; i < 15; i++) block[i] = splat(0);
+    block[15] = splat(32 * 8);
+    transform(state, block);
+
+    for (int i = 0; i < 8; i++) {
+        store(words, state[i]);
+        for (size_t lane = 0; lane < count && lane < LANES; lane++) writeBE32(hashes + 32*lane + 4*i, words[lane]);
+    }
+}
+
+bool haveShaExtensions()
+{
+#ifdef HAVE_CPUID
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx) || eax < 7) return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 29) & 1;
+#else
+    return false;
+#endif
+}
+
+const bool g_bShaExtensions = haveShaExtensions();
+
+} // namespace
+
+size_t Coin::sha256_multi_lanes()
+{
+    return g_bShaExtensions ? 1 : LANES;
+}
+
+void Coin::sha256_2_80(const unsigned char* data, size_t stride, size_t count, unsigned char* hashes)
+{
+    if (g_bShaExtensions) {
+        for (size_t i = 0; i < count; i++) sha256_2(data + stride * i, 80, hashes + 32 * i);
+        return;
+    }
+    sha256_2_80_multi(data, stride, count, hashes);
+}
+
+void Coin::sha256_2_80_multi(const unsigned char* data, size_t stride, size_t count, unsigned char* hashes)
+{
+    for (size_t i = 0; i < count; i += LANES) {
+        hashLanes(data + stride * i, stride, count - i, hashes + 32 * i);
+    }
+}
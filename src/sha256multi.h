@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// sha256multi.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Multi-buffer SHA-256. Several independent messages are hashed at once, one per
+// SIMD lane: 8 lanes with AVX2, 4 with SSE2, and a plain 4-lane loop otherwise.
+// Build with -mavx2 to get the 8-lane kernel, or define SHA256_MULTI_PORTABLE to
+// get the plain loop on any CPU.
+//
+// CPUs with the SHA extensions hash a single message faster than any of these
+// kernels, so on those the messages are hashed one at a time through OpenSSL.
+
+#ifndef _SHA256_MULTI_H__
+#define _SHA256_MULTI_H__
+
+#include <stddef.h>
+
+namespace Coin
+{
+
+// Number of messages hashed together - 1 when the SHA extensions are used instead.
+size_t sha256_multi_lanes();
+
+// Double SHA-256 of count 80-byte messages (block headers), the first at data and each following
+// one stride bytes after the previous. Writes count raw 32-byte digests to hashes.
+void sha256_2_80(const unsigned char* data, size_t stride, size_t count, unsigned char* hashes);
+
+// Same, but always through the multi-buffer kernel, even where the SHA extensions would be faster.
+void sha256_2_80_multi(const unsigned char* data, size_t stride, size_t count, unsigned char* hashes);
+
+}; // namespace Coin
+
+#endif // _SHA256_MULTI_H__
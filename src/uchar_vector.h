@@ -34,6 +34,9 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <stdexcept>
+
+#include "encodings.h"
 
 const char g_hexBytes[][3] = {
     "00","01","02","03","04","05","06","07","08","09","0a","0b","0c","0d","0e","0f",
@@ -54,7 +57,7 @@ const char g_hexBytes[][3] = {
     "f0","f1","f2","f3","f4","f5","f6","f7","f8","f9","fa","fb","fc","fd","fe","ff"
 };
 
-const char base64chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+const char base64chars[] = BASE64_CHARS;
 
 typedef unsigned int uint;
 
@@ -97,29 +100,39 @@ public:
 
     std::string getHex(bool spaceBytes = false) const
     {
+        if (!spaceBytes) {
+            std::string hex(this->size() * 2, '\0');
+            if (!this->empty()) encodeHex(this->data(), this->size(), &hex[0]);
+            return hex;
+        }
+
         std::string hex;
-        hex.reserve(this->size() * 2);
+        hex.reserve(this->size() * 3);
         for (uint i = 0; i < this->size(); i++) {
-            if (spaceBytes && (i > 0)) hex += " ";
+            if (i > 0) hex += " ";
             hex += g_hexBytes[(*this)[i]];
         }
         return hex;
     }
 
-    void setHex(std::string hex)
-    {
-        this->clear();
+    void setHex(const std::string& hex) { this->setHex(hex.data(), hex.size()); }
 
+    // Throws std::runtime_error, leaving the vector empty, if hex contains anything other than hex digits.
+    void setHex(const char* hex, size_t len)
+    {
         // pad on the left if hex contains an odd number of digits.
-        if (hex.size() % 2 == 1)
-            hex = "0" + hex;
-
-        this->reserve(hex.size() / 2);
-
-        for (uint i = 0; i < hex.size(); i+=2) {
-            uint byte;
-            sscanf(hex.substr(i, 2).c_str(), "%x", &byte);
-            this->push_back(byte);
+        size_t odd = len % 2;
+        this->resize(len / 2 + odd);
+
+        bool bValid = true;
+        if (odd) {
+            int digit = HexTable::get()[hex[0]];
+            bValid = (digit >= 0);
+            (*this)[0] = digit;
+        }
+        if (!bValid || !decodeHex(hex + odd, len - odd, this->data() + odd)) {
+            this->clear();
+            throw std::runtime_error("Invalid hex string.");
         }
     }
 
@@ -151,65 +164,18 @@ public:
 
     std::string getBase64() const
     {
-        unsigned int padding = (3 - (this->size() % 3)) % 3;
-        std::string base64;
-
-        uchar_vector paddedBytes = *this;
-        for (unsigned int i = 1; i <= padding; i++)
-            paddedBytes.push_back(0);
-
-        base64.reserve(4*(paddedBytes.size()) / 3);
-
-        for (unsigned int i = 0; i < paddedBytes.size(); i += 3) {
-            uint32_t triple = ((uint32_t)paddedBytes[i] << 16) | ((uint32_t)paddedBytes[i+1] << 8) | (uint32_t)paddedBytes[i+2];
-            base64 += base64chars[(triple & 0x00fc0000) >> 18];
-            base64 += base64chars[(triple & 0x0003f000) >> 12];
-            base64 += base64chars[(triple & 0x00000fc0) >> 6];
-            base64 += base64chars[triple & 0x0000003f];
-        }
-
-        for (unsigned int i = 1; i <= padding; i++)
-            base64[base64.size() - i] = '=';
-
+        std::string base64(BASE64_ENCODED_SIZE(this->size()), '\0');
+        if (!this->empty()) encodeBase64(this->data(), this->size(), &base64[0]);
         return base64;
     }
 
-    void setBase64(std::string base64)
-    {
-        unsigned int padding = (4 - (base64.size() % 4)) % 4;
-
-        std::string paddedBase64;
-        paddedBase64.reserve(base64.size() + padding);
-        paddedBase64 = base64;
-        paddedBase64.append(padding, '=');
-        padding = 0; // we'll count them again in the loop so we also get any that were already there.
-
-        this->clear();
-        this->reserve(3*paddedBase64.size() / 4);
-
-        bool bEnd = false;
-        for (unsigned int i = 0; (i < paddedBase64.size()) && (!bEnd); i+=4) {
-            uint32_t digits[4];
-            for (unsigned int j = 0; j < 4; j++) {
-                const char* pPos = strchr(base64chars, paddedBase64[i+j]);
-                if (!pPos) bEnd = true;
-                if (bEnd) {
-                    digits[j] = 0;
-                    padding++;
-                }
-                else
-                    digits[j] = (uint32_t)(pPos - base64chars);
-            }
-
-            uint32_t quadruple = (digits[0] << 18) | (digits[1] << 12) | (digits[2] << 6) | digits[3];
+    // Decodes up to the first character that isn't a base64 digit, so padding is optional.
+    void setBase64(const std::string& base64) { this->setBase64(base64.data(), base64.size()); }
 
-            this->push_back((quadruple & 0x00ff0000) >> 16);
-            this->push_back((quadruple & 0x0000ff00) >> 8);
-            this->push_back(quadruple & 0x000000ff);
-        }
-
-        for (unsigned int i = 0; i < padding; i++)
-            this->pop_back();
+    void setBase64(const char* base64, size_t len)
+    {
+        this->resize(BASE64_MAX_DECODED_SIZE(len));
+        this->resize(decodeBase64(base64, len, this->data()));
     }
 };
 
@@ -0,0 +1,282 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// uint256.h
+//
+// Copyright (c) 2011-2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Fixed-width unsigned 256-bit integer for proof-of-work targets and chain work.
+// Lives on the stack - unlike BigInt, nothing is allocated.
+
+#ifndef _UINT256_H__
+#define _UINT256_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+namespace Coin
+{
+
+class uint256
+{
+public:
+    constexpr uint256() : n{0, 0, 0, 0} { }
+    constexpr uint256(uint64_t v) : n{v, 0, 0, 0} { }
+    constexpr uint256(uint64_t n3, uint64_t n2, uint64_t n1, uint64_t n0) : n{n0, n1, n2, n3} { } // most significant first
+
+    // Raw hash bytes (sha256_2 output, least significant byte first).
+    static uint256 fromHash(const unsigned char* hash)
+    {
+        uint256 r;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 7; j >= 0; j--) r.n[i] = (r.n[i] << 8) | hash[8*i + j];
+        }
+        return r;
+    }
+
+    void toHash(unsigned char* hash) const
+    {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 8; j++) hash[8*i + j] = (unsigned char)(n[i] >> (8*j));
+        }
+    }
+
+    // Most significant byte first, like BigInt::getBytes() and getHashLittleEndian(). Leading zeros are kept.
+    std::vector<unsigned char> getBytes() const
+    {
+        std::vector<unsigned char> bytes(32);
+        toHash(&bytes[0]);
+        return std::vector<unsigned char>(bytes.rbegin(), bytes.rend());
+    }
+
+    // At most 32 bytes, most significant byte first.
+    void setBytes(const std::vector<unsigned char>& bytes)
+    {
+        if (bytes.size() > 32) throw std::runtime_error("uint256::setBytes() - too many bytes.");
+        *this = 0;
+        for (std::size_t i = 0; i < bytes.size(); i++) { *this <<= 8; n[0] |= bytes[i]; }
+    }
+
+    std::string getHex() const
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::vector<unsigned char> bytes = getBytes();
+        std::string hex;
+        for (std::size_t i = 0; i < bytes.size(); i++) { hex += digits[bytes[i] >> 4]; hex += digits[bytes[i] & 0x0f]; }
+        return hex;
+    }
+
+    uint64_t getLow64() const { return n[0]; }
+
+    // Number of significant bits.
+    unsigned int bits() const
+    {
+        for (int i = 3; i >= 0; i--) {
+            if (n[i]) {
+                for (int b = 63; b >= 0; b--) { if (n[i] >> b) return 64*i + b + 1; }
+            }
+        }
+        return 0;
+    }
+
+    bool isZero() const { return !(n[0] | n[1] | n[2] | n[3]); }
+
+    // Compact "bits" encoding used in block headers: one byte of exponent and a 23-bit mantissa with a sign bit.
+    uint256& setCompact(uint32_t compact, bool* pNegative = NULL, bool* pOverflow = NULL)
+    {
+        uint32_t nSize = compact >> 24;
+        uint32_t nWord = compact & 0x007fffff;
+        if (nSize <= 3) {
+            nWord >>= 8*(3 - nSize);
+            *this = nWord;
+        }
+        else {
+            *this = nWord;
+            *this <<= 8*(nSize - 3);
+        }
+        if (pNegative) *pNegative = nWord != 0 && (compact & 0x00800000) != 0;
+        if (pOverflow) *pOverflow = nWord != 0 && ((nSize > 34) ||
+                                                   (nWord > 0xff && nSize > 33) ||
+                                                   (nWord > 0xffff && nSize > 32));
+        return *this;
+    }
+
+    uint32_t getCompact(bool bNegative = false) const
+    {
+        uint32_t nSize = (bits() + 7) / 8;
+        uint32_t nCompact;
+        if (nSize <= 3) {
+            nCompact = (uint32_t)(n[0] << 8*(3 - nSize));
+        }
+        else {
+            uint256 shifted = *this;
+            shifted >>= 8*(nSize - 3);
+            nCompact = (uint32_t)shifted.n[0];
+        }
+        // the 0x00800000 bit is the sign, so move the mantissa over if it's set
+        if (nCompact & 0x00800000) {
+            nCompact >>= 8;
+            nSize++;
+        }
+        nCompact |= nSize << 24;
+        if (bNegative && (nCompact & 0x007fffff)) nCompact |= 0x00800000;
+        return nCompact;
+    }
+
+    // Arithmetic - all modulo 2^256
+    uint256& operator+=(const uint256& rhs)
+    {
+        uint64_t carry = 0;
+        for (int i = 0; i < 4; i++) {
+            uint64_t sum = n[i] + carry;
+            carry = (sum < carry);
+            n[i] = sum + rhs.n[i];
+            carry += (n[i] < sum);
+        }
+        return *this;
+    }
+
+    uint256& operator-=(const uint256& rhs) { return *this += -rhs; }
+
+    uint256& operator++() { for (int i = 0; i < 4 && ++n[i] == 0; i++); return *this; }
+
+    uint256& operator<<=(unsigned int shift)
+    {
+        uint256 a = *this;
+        *this = 0;
+        int k = shift / 64;
+        shift %= 64;
+        for (int i = 0; i < 4; i++) {
+            if (i + k + 1 < 4 && shift != 0) n[i + k + 1] |= (a.n[i] >> (64 - shift));
+            if (i + k < 4) n[i + k] |= (a.n[i] << shift);
+        }
+        return *this;
+    }
+
+    uint256& operator>>=(unsigned int shift)
+    {
+        uint256 a = *this;
+        *this = 0;
+        int k = shift / 64;
+        shift %= 64;
+        for (int i = 0; i < 4; i++) {
+            if (i - k - 1 >= 0 && shift != 0) n[i - k - 1] |= (a.n[i] << (64 - shift));
+            if (i - k >= 0) n[i - k] |= (a.n[i] >> shift);
+        }
+        return *this;
+    }
+
+    uint256& operator*=(uint32_t rhs)
+    {
+        uint64_t carry = 0;
+        for (int i = 0; i < 4; i++) {
+            uint64_t lo = (n[i] & 0xffffffff) * rhs + carry;
+            uint64_t hi = (n[i] >> 32) * rhs + (lo >> 32);
+            n[i] = (lo & 0xffffffff) | (hi << 32);
+            carry = hi >> 32;
+        }
+        return *this;
+    }
+
+    // Shift-and-subtract long division - fine for the occasional work calculation.
+    uint256& operator/=(const uint256& divisor)
+    {
+        if (divisor.isZero()) throw std::runtime_error("uint256 division by zero.");
+
+        uint256 num = *this;
+        uint256 div = divisor;
+        *this = 0;
+        int shift = (int)num.bits() - (int)div.bits();
+        if (shift < 0) return *this;
+        div <<= shift;
+        for (; shift >= 0; shift--) {
+            if (num >= div) {
+                num -= div;
+                n[shift / 64] |= (uint64_t)1 << (shift % 64);
+            }
+            div >>= 1;
+        }
+        return *this;
+    }
+
+    const uint256 operator~() const { uint256 r; for (int i = 0; i < 4; i++) r.n[i] = ~n[i]; return r; }
+    const uint256 operator-() const { uint256 r = ~*this; ++r; return r; }
+
+    const uint256 operator+(const uint256& rhs) const { return uint256(*this) += rhs; }
+    const uint256 operator-(const uint256& rhs) const { return uint256(*this) -= rhs; }
+    const uint256 operator*(uint32_t rhs) const { return uint256(*this) *= rhs; }
+    const uint256 operator/(const uint256& rhs) const { return uint256(*this) /= rhs; }
+    const uint256 operator<<(unsigned int shift) const { return uint256(*this) <<= shift; }
+    const uint256 operator>>(unsigned int shift) const { return uint256(*this) >>= shift; }
+
+    int compareTo(const uint256& rhs) const
+    {
+        for (int i = 3; i >= 0; i--) {
+            if (n[i] < rhs.n[i]) return -1;
+            if (n[i] > rhs.n[i]) return 1;
+        }
+        return 0;
+    }
+
+    bool operator==(const uint256& rhs) const { return compareTo(rhs) == 0; }
+    bool operator!=(const uint256& rhs) const { return compareTo(rhs) != 0; }
+    bool operator<(const uint256& rhs) const { return compareTo(rhs) < 0; }
+    bool operator>(const uint256& rhs) const { return compareTo(rhs) > 0; }
+    bool operator<=(const uint256& rhs) const { return compareTo(rhs) <= 0; }
+    bool operator>=(const uint256& rhs) const { return compareTo(rhs) >= 0; }
+
+private:
+    uint64_t n[4]; // least significant first
+};
+
+// Expected number of hashes to find a block with the given target: 2^256 / (target + 1),
+// computed as ~target / (target + 1) + 1 so it fits in 256 bits.
+inline uint256 getWork(const uint256& target)
+{
+    if (target.isZero()) return 0;
+    if ((~target).isZero()) return 1; // target + 1 would wrap around
+    return (~target / (target + 1)) + 1;
+}
+
+inline uint256 getWork(uint32_t bits)
+{
+    bool bNegative, bOverflow;
+    uint256 target;
+    target.setCompact(bits, &bNegative, &bOverflow);
+    if (bNegative || bOverflow) return 0;
+    return getWork(target);
+}
+
+// hash is raw sha256_2 output. Fails for negative, zero or overflowing targets.
+inline bool checkProofOfWork(const unsigned char* hash, uint32_t bits)
+{
+    bool bNegative, bOverflow;
+    uint256 target;
+    target.setCompact(bits, &bNegative, &bOverflow);
+    if (bNegative || bOverflow || target.isZero()) return false;
+    return uint256::fromHash(hash) <= target;
+}
+
+}; // namespace Coin
+
+#endif // _UINT256_H__
@@ -0,0 +1,140 @@
+#include <BlockStore.h>
+#include <MappedFile.h>
+#include <numericdata.h>
+
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <cstdio>
+#include <stdexcept>
+
+#include <unistd.h>
+
+using namespace Coin;
+using namespace std;
+
+const uint32_t MAGIC = 0xd9b4bef9;
+
+Transaction makeTx(uint32_t n)
+{
+    Transaction tx;
+    tx.addInput(TxIn(OutPoint(g_zero32bytes, 0xffffffff), uint_to_vch(n, _BIG_ENDIAN), 0xffffffff));
+    tx.addOutput(TxOut(5000000000ull, uchar_vector("76a914010966776006953d5567439e5e39f86a0d273bee88ac")));
+    return tx;
+}
+
+// Block at height with txCount transactions numbered from firstTx.
+CoinBlock makeBlock(uint32_t height, const uchar_vector& prevHash, uint32_t firstTx, uint32_t txCount)
+{
+    CoinBlock block(1, 1231006505 + height, 0x1d00ffff, prevHash);
+    for (uint32_t i = 0; i < txCount; i++) block.addTransaction(makeTx(firstTx + i));
+    block.updateMerkleRoot();
+    return block;
+}
+
+void appendGarbage(const string& path, size_t n)
+{
+    FILE* f = fopen(path.c_str(), "ab");
+    assert(f);
+    for (size_t i = 0; i < n; i++) fputc(0xab, f);
+    fclose(f);
+}
+
+int main()
+{
+    char dirTemplate[] = "/tmp/blockstoreXXXXXX";
+    string dir = mkdtemp(dirTemplate);
+    dir += "/";
+
+    // Enough transactions to make the tx table grow past its initial size at least once.
+    const uint32_t BLOCKS = 40;
+    const uint32_t TXS_PER_BLOCK = 1000;
+    vector<CoinBlock> blocks;
+    uchar_vector prevHash = g_zero32bytes;
+    for (uint32_t h = 0; h < BLOCKS; h++) {
+        blocks.push_back(makeBlock(h, prevHash, h * TXS_PER_BLOCK, TXS_PER_BLOCK));
+        prevHash = blocks.back().blockHeader.getHash();
+    }
+
+    cout << "adding blocks..." << endl;
+    {
+        BlockStore store(dir, MAGIC, false);
+        assert(store.getBlockCount() == 0 && store.getBestHeight() == BlockStore::NO_RECORD);
+
+        assert(store.addBlock(blocks[0], 0));
+        StoredData first = store.getBlockAtHeight(0);
+        for (uint32_t h = 1; h < BLOCKS; h++) assert(store.addBlock(blocks[h], h));
+        assert(!store.addBlock(blocks[5], 5));
+
+        // held across the table rebuilds and remaps
+        assert(first.getBytes() == blocks[0].getSerialized());
+
+        assert(store.getBlockCount() == BLOCKS && store.getTxCount() == BLOCKS * TXS_PER_BLOCK);
+        assert(store.getBestHeight() == BLOCKS - 1);
+    }
+
+    cout << "lookups after reopening..." << endl;
+    {
+        BlockStore store(dir, MAGIC, false);
+        assert(store.getBlockCount() == BLOCKS && store.getTxCount() == BLOCKS * TXS_PER_BLOCK);
+        for (uint32_t h = 0; h < BLOCKS; h++) {
+            uchar_vector hash = blocks[h].blockHeader.getHashLittleEndian();
+            assert(store.hasBlock(hash) && store.getHeight(hash) == h);
+            assert(store.getBlock(hash).getBytes() == blocks[h].getSerialized());
+            assert(store.getBlockAtHeight(h).getBytes() == blocks[h].getSerialized());
+        }
+        for (uint32_t i = 0; i < BLOCKS * TXS_PER_BLOCK; i += 7) {
+            const Transaction& tx = blocks[i / TXS_PER_BLOCK].txs[i % TXS_PER_BLOCK];
+            assert(store.getTx(tx.getHashLittleEndian()).getBytes() == tx.getSerialized());
+        }
+        uchar_vector missing(32, 0x42);
+        assert(!store.hasBlock(missing) && store.getBlock(missing).isNull() && store.getTx(missing).isNull());
+        assert(store.getHeight(missing) == BlockStore::NO_RECORD && store.getBlockAtHeight(BLOCKS).isNull());
+    }
+
+    cout << "hash tables rebuilt..." << endl;
+    unlink((dir + "txs.hash").c_str());
+    appendGarbage(dir + "blocks.hash", 3);
+    {
+        BlockStore store(dir, MAGIC, false);
+        const Transaction& tx = blocks[BLOCKS - 1].txs[TXS_PER_BLOCK - 1];
+        assert(store.getTx(tx.getHashLittleEndian()).getBytes() == tx.getSerialized());
+        assert(store.getHeight(blocks[3].blockHeader.getHashLittleEndian()) == 3);
+    }
+
+    cout << "partial writes discarded..." << endl;
+    appendGarbage(dir + "blk00000.dat", 1000);
+    appendGarbage(dir + "txs.idx", 30);
+    appendGarbage(dir + "blocks.idx", 20);
+    {
+        BlockStore store(dir, MAGIC, false);
+        assert(store.getBlockCount() == BLOCKS && store.getTxCount() == BLOCKS * TXS_PER_BLOCK);
+
+        CoinBlock next = makeBlock(BLOCKS, prevHash, BLOCKS * TXS_PER_BLOCK, 3);
+        assert(store.addBlock(next, BLOCKS));
+        assert(store.getBlockAtHeight(BLOCKS).getBytes() == next.getSerialized());
+        assert(store.getTx(next.txs[2].getHashLittleEndian()).getBytes() == next.txs[2].getSerialized());
+    }
+
+    cout << "no truncation under a live view..." << endl;
+    {
+        MappedFile file;
+        file.open(dir + "mapped.dat");
+        uchar_vector bytes(100, 7);
+        file.append(&bytes[0], bytes.size());
+        MappedRegionPtr view = file.getView();
+        file.resize(200);
+        bool bThrown = false;
+        try { file.resize(50); } catch (const runtime_error&) { bThrown = true; }
+        assert(bThrown && file.size() == 200 && view->data()[99] == 7);
+        view.reset();
+        file.resize(50);
+        assert(file.size() == 50);
+    }
+
+    string command = "rm -rf " + dir;
+    assert(system(command.c_str()) == 0);
+
+    cout << "passed" << endl;
+    return 0;
+}
@@ -0,0 +1,268 @@
+#include <Base58Check.h>
+#include <BigInt.h>
+
+#include <openssl/rand.h>
+
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <sys/time.h>
+
+using namespace std;
+
+double now()
+{
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+// the BigInt conversion this replaces
+string bigIntBase58(const uchar_vector& data, const char* chars)
+{
+    string leading0s(countLeading0s(data), chars[0]);
+    if (leading0s.size() == data.size()) return leading0s;
+    return leading0s + BigInt(data).getInBase(58, chars);
+}
+
+// the sscanf conversion this replaces
+uchar_vector scanfHex(const string& hex)
+{
+    uchar_vector bytes;
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        unsigned int byte;
+        sscanf(hex.substr(i, 2).c_str(), "%x", &byte);
+        bytes.push_back(byte);
+    }
+    return bytes;
+}
+
+// bit by bit, up to the first character outside the alphabet
+uchar_vector referenceBase64(const string& base64)
+{
+    uchar_vector bytes;
+    uint32_t bits = 0;
+    int nBits = 0;
+    for (size_t i = 0; i < base64.size(); i++) {
+        const char* pos = base64[i] ? strchr(BASE64_CHARS, base64[i]) : NULL;
+        if (!pos) break;
+        bits = (bits << 6) | (pos - BASE64_CHARS);
+        nBits += 6;
+        if (nBits >= 8) { nBits -= 8; bytes.push_back(bits >> nBits); }
+    }
+    return bytes;
+}
+
+string bigIntBase58Check(const uchar_vector& payload, unsigned char version, const char* chars)
+{
+    uchar_vector data(1, version);
+    data += payload;
+    uchar_vector checksum = sha256_2(data);
+    data += uchar_vector(checksum.begin(), checksum.begin() + 4);
+    return bigIntBase58(data, chars);
+}
+
+int main()
+{
+    cout << "known vectors..." << endl;
+    uchar_vector hash("76a914" "a8cf8e9e8a3e9bdc2df1a7b6f9c53ac6a3c01b2d" "88ac");
+    hash.assign(hash.begin() + 3, hash.begin() + 23);
+    uchar_vector secret("0c28fca386c7a227600b2fe50b7cae11ec86d3bf1fbe471be89827e19d72aa1d");
+    assert(toBase58Check(secret, 0x80) == "5HueCGU8rMjxEXxiPuD5BDku4MkFqeZyd4dZ1jvhTVqvbTLvyTJ");
+    assert(toBase58Check(uchar_vector("010966776006953d5567439e5e39f86a0d273bee"), 0x00) == "16UwLL9Risc3QfPqBUvKofHmBQ7wMtjvM");
+    assert(encodeBase58(uchar_vector()) == "");
+    assert(encodeBase58(uchar_vector("00")) == "1");
+    assert(encodeBase58(uchar_vector("000000")) == "111");
+    assert(encodeBase58(uchar_vector("00003a")) == "11" "21");
+    assert(encodeBase58(uchar_vector("61")) == "2g");
+    assert(encodeBase58(uchar_vector("626262")) == "a3gV");
+    assert(encodeBase58(uchar_vector("73696d706c792061206c6f6e6720737472696e67")) == "2cFupjhnEsSn59qHXstmK2ffpLv2");
+
+    vector<unsigned char> payload;
+    unsigned int version;
+    assert(fromBase58Check("5HueCGU8rMjxEXxiPuD5BDku4MkFqeZyd4dZ1jvhTVqvbTLvyTJ", payload, version));
+    assert(version == 0x80 && uchar_vector(payload) == secret);
+    assert(fromBase58Check("16UwLL9Risc3QfPqBUvKofHmBQ7wMtjvM", payload, version));
+    assert(version == 0 && uchar_vector(payload).getHex() == "010966776006953d5567439e5e39f86a0d273bee");
+
+    cout << "invalid strings..." << endl;
+    assert(!isBase58CheckValid("16UwLL9Risc3QfPqBUvKofHmBQ7wMtjvN"));  // checksum
+    assert(!isBase58CheckValid("16UwLL9Risc3QfPqBUvKofHmBQ7wMtjv0"));  // not in the alphabet
+    assert(!isBase58CheckValid("16UwLL9Risc3QfPqBUvKofHmBQ7wMtjvl"));
+    assert(!isBase58CheckValid(""));
+    assert(!fromBase58Check("", payload, version));
+    assert(!isBase58CheckValid("111"));
+    assert(!fromBase58Check("16UwLL9Risc3QfPqBUvKofHmBQ7wMtjvN", payload, version));
+    assert(version == 0 && uchar_vector(payload).getHex() == "010966776006953d5567439e5e39f86a0d273bee");
+
+    cout << "allocation-free api..." << endl;
+    char address[BASE58CHECK_ADDRESS_SIZE];
+    unsigned char decoded[21];
+    size_t decodedLen;
+    unsigned char decodedVersion;
+    for (unsigned int v = 0; v < 256; v++) {
+        size_t len = toBase58Check(&hash[0], 20, (unsigned char)v, address);
+        assert(len == strlen(address) && address == toBase58Check(hash, (unsigned char)v));
+        assert(fromBase58Check(address, len, decoded, sizeof(decoded), decodedLen, decodedVersion));
+        assert(decodedLen == 20 && decodedVersion == v && memcmp(decoded, &hash[0], 20) == 0);
+        assert(!fromBase58Check(address, len, decoded, 19, decodedLen, decodedVersion));
+    }
+
+    cout << "against BigInt..." << endl;
+    for (int i = 0; i < 2000; i++) {
+        uchar_vector data(i % 200, 0);
+        if (!data.empty()) RAND_bytes(&data[0], data.size());
+        for (size_t j = 0; j < data.size() && j < (size_t)(i % 4); j++) data[j] = 0;
+        const char* chars = (i & 1) ? RIPPLE_BASE58_CHARS : BITCOIN_BASE58_CHARS;
+
+        string str = encodeBase58(data, chars);
+        assert(str == bigIntBase58(data, chars));
+        vector<unsigned char> back;
+        assert(decodeBase58(str, back, chars) && uchar_vector(back) == data);
+
+        assert(toBase58Check(data, (unsigned char)i, chars) == bigIntBase58Check(data, (unsigned char)i, chars));
+        assert(fromBase58Check(toBase58Check(data, (unsigned char)i, chars), payload, version, chars));
+        assert(uchar_vector(payload) == data && version == (unsigned char)i);
+    }
+
+    cout << "batch..." << endl;
+    const size_t count = 10000;
+    uchar_vector hashes(20 * count, 0);
+    RAND_bytes(&hashes[0], hashes.size());
+    vector<char> out(count * BASE58CHECK_ADDRESS_SIZE);
+    toBase58CheckBatch(&hashes[0], count, 0x05, &out[0]);
+    vector<uchar_vector> hashList;
+    for (size_t i = 0; i < count; i++) hashList.push_back(uchar_vector(hashes.begin() + 20 * i, hashes.begin() + 20 * (i + 1)));
+    vector<string> addresses = toBase58CheckBatch(hashList, 0x05);
+    assert(addresses.size() == count);
+    for (size_t i = 0; i < count; i++) {
+        assert(addresses[i] == &out[i * BASE58CHECK_ADDRESS_SIZE]);
+        assert(addresses[i] == toBase58Check(hashList[i], 0x05));
+        assert(addresses[i][0] == '3');
+    }
+
+    cout << "hex..." << endl;
+    assert(uchar_vector("").empty());
+    assert(uchar_vector("abc").getHex() == "0abc");
+    assert(uchar_vector("00FFaB10").getHex() == "00ffab10");
+    assert(uchar_vector("0102ff").getHex(true) == "01 02 ff");
+    for (size_t len = 0; len < 300; len++) {
+        uchar_vector data(len, 0);
+        if (len) RAND_bytes(&data[0], len);
+        string hex = data.getHex();
+        assert(hex.size() == 2 * len && uchar_vector(hex) == data && scanfHex(hex) == data);
+        string upper(hex);
+        for (size_t i = 0; i < upper.size(); i++) upper[i] = toupper(upper[i]);
+        assert(uchar_vector(upper) == data);
+
+        // a bad character anywhere is caught, whichever path handles that part of the string
+        for (size_t i = 0; i < hex.size(); i += 1 + i / 8) {
+            const char bad[] = { 'g', 'G', ' ', '/', ':', '@', '`', 'x', '\0', (char)0xb0 };
+            string invalid(hex);
+            invalid[i] = bad[i % sizeof(bad)];
+            uchar_vector bytes;
+            bool bThrown = false;
+            try { bytes.setHex(invalid); } catch (const runtime_error&) { bThrown = true; }
+            assert(bThrown && bytes.empty());
+        }
+    }
+
+    cout << "base64..." << endl;
+    const char* rfc4648[][2] = { { "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" },
+                                 { "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" } };
+    for (size_t i = 0; i < sizeof(rfc4648) / sizeof(rfc4648[0]); i++) {
+        uchar_vector bytes;
+        bytes.setCharsFromString(rfc4648[i][0]);
+        assert(bytes.getBase64() == rfc4648[i][1]);
+        uchar_vector decoded;
+        decoded.setBase64(rfc4648[i][1]);
+        assert(decoded == bytes);
+        decoded.setBase64(string(rfc4648[i][1]) + "\n");
+        assert(decoded == bytes);
+    }
+    {
+        uchar_vector decoded;
+        decoded.setBase64("Zm9vYmE");   // unpadded
+        assert(decoded.getCharsAsString() == "fooba");
+        decoded.setBase64("Zm9v YmFy"); // stops at the space
+        assert(decoded.getCharsAsString() == "foo");
+        decoded.setBase64("Z");
+        assert(decoded.empty());
+    }
+    for (size_t len = 0; len < 300; len++) {
+        uchar_vector data(len, 0);
+        if (len) RAND_bytes(&data[0], len);
+        string base64 = data.getBase64();
+        assert(base64.size() == BASE64_ENCODED_SIZE(len) && referenceBase64(base64) == data);
+        uchar_vector decoded;
+        decoded.setBase64(base64);
+        assert(decoded == data);
+
+        // every possible byte as the terminator, at positions covering both paths
+        size_t pos = (len * 7) % (base64.size() + 1);
+        for (int c = 0; c < 256; c++) {
+            string terminated(base64);
+            if (pos < terminated.size()) terminated[pos] = c;
+            decoded.setBase64(terminated);
+            assert(decoded == referenceBase64(terminated));
+        }
+
+        // streamed in uneven pieces
+        Base64Encoder encoder;
+        string streamed(BASE64_ENCODED_SIZE(len) + 8, '\0');
+        size_t n = 0;
+        for (size_t i = 0, step = 1; i < len; i += step, step = step * 3 % 37 + 1) {
+            n += encoder.update(&data[i], min(step, len - i), &streamed[n]);
+        }
+        n += encoder.finish(&streamed[n]);
+        streamed.resize(n);
+        assert(streamed == base64);
+
+        Base64Decoder decoder;
+        uchar_vector bytes(BASE64_MAX_DECODED_SIZE(base64.size()) + 8, 0);
+        n = 0;
+        for (size_t i = 0, step = 2; i < base64.size(); i += step, step = step * 5 % 41 + 1) {
+            n += decoder.update(&base64[i], min(step, base64.size() - i), &bytes[n]);
+        }
+        n += decoder.finish(&bytes[n]);
+        bytes.resize(n);
+        assert(bytes == data);
+    }
+
+    cout << "timing..." << endl;
+    uchar_vector block(1000000, 0);
+    RAND_bytes(&block[0], block.size());
+    string blockHex = block.getHex();
+    double start = now();
+    scanfHex(blockHex);
+    cout << "  sscanf hex decode: " << (now() - start) * 1e3 << " ms/MB" << endl;
+    start = now();
+    uchar_vector bytes;
+    for (int i = 0; i < 10; i++) bytes.setHex(blockHex);
+    cout << "  hex decode:        " << (now() - start) * 1e2 << " ms/MB" << endl;
+    start = now();
+    for (int i = 0; i < 10; i++) block.getHex();
+    cout << "  hex encode:        " << (now() - start) * 1e2 << " ms/MB" << endl;
+    string blockBase64 = block.getBase64();
+    start = now();
+    for (int i = 0; i < 10; i++) bytes.setBase64(blockBase64);
+    cout << "  base64 decode:     " << (now() - start) * 1e2 << " ms/MB" << endl;
+    start = now();
+    for (int i = 0; i < 10; i++) block.getBase64();
+    cout << "  base64 encode:     " << (now() - start) * 1e2 << " ms/MB" << endl;
+    start = now();
+    for (size_t i = 0; i < count; i++) bigIntBase58(uchar_vector(1, 0) + hashList[i] + uchar_vector(4, 0), BITCOIN_BASE58_CHARS);
+    cout << "  BigInt encode: " << (now() - start) * 1e6 / count << " us" << endl;
+    start = now();
+    toBase58CheckBatch(&hashes[0], count, 0x00, &out[0]);
+    cout << "  encode:        " << (now() - start) * 1e6 / count << " us" << endl;
+    start = now();
+    for (size_t i = 0; i < count; i++) {
+        const char* str = &out[i * BASE58CHECK_ADDRESS_SIZE];
+        fromBase58Check(str, strlen(str), decoded, sizeof(decoded), decodedLen, decodedVersion);
+    }
+    cout << "  decode:        " << (now() - start) * 1e6 / count << " us" << endl;
+
+    cout << "passed" << endl;
+    return 0;
+}
@@ -80,12 +80,36 @@ int main()
             assert(pub);
 
             // We need to make sure child of pub = pub of child for public derivation 
-            if (!isP(CHAIN[k]))
+            if (!isP(CHAIN[k])) {
                 assert(pub == parentpub.getChild(CHAIN[k]));
+                assert(parentpub.deriveRange(CHAIN[k], CHAIN[k] + 1)[0] == pub.pubkey());
+            }
 
             showStep(chainname.str(), pub, prv);
         }
 
+        // Bulk derivation must match one child at a time, however the range is split
+        std::vector<bytes_t> hashes;
+        std::vector<bytes_t> pubkeys = pub.deriveRange(100, 700, &hashes, 3);
+        for (uint32_t i = 100; i < 700; i++) {
+            HDKeychain child = pub.getChild(i);
+            assert(pubkeys[i - 100] == child.pubkey());
+            assert(hashes[i - 100] == child.hash());
+        }
+
+        // Cached derivation must match too, and reuse the intermediate nodes
+        HDKeychainCache cache(100, 4);
+        HDKeychain master(hdSeed.getMasterKey(), hdSeed.getMasterChainCode());
+        std::vector<uint32_t> path(CHAIN, CHAIN + CHAIN_LENGTH);
+        assert(cache.getChild(master, path) == prv);
+        assert(cache.size() == CHAIN_LENGTH);
+        assert(cache.getChild(master, path) == prv);
+        assert(cache.size() == CHAIN_LENGTH);
+        for (uint32_t i = 0; i < 200; i++) {
+            assert(cache.getChild(pub, i) == pub.getChild(i));
+        }
+        assert(cache.size() <= 100);
+
         return 0;
     }
     catch (const exception& e) {
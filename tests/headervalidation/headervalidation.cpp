@@ -0,0 +1,158 @@
+#include <HeaderValidation.h>
+#include <sha256multi.h>
+#include <uint256.h>
+#include <hash.h>
+
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Coin;
+using namespace std;
+
+const uint32_t EASY_BITS = 0x207fffff; // about every other hash meets it
+const uint32_t HARD_BITS = 0x1d00ffff;
+
+void writeLE32(unsigned char* p, uint32_t x) { p[0] = x; p[1] = x >> 8; p[2] = x >> 16; p[3] = x >> 24; }
+
+// Bumps the nonce until the header meets its target.
+void mine(unsigned char* header)
+{
+    unsigned char hash[32];
+    for (uint32_t nonce = 0;; nonce++) {
+        writeLE32(header + 76, nonce);
+        sha256_2(header, 80, hash);
+        if (checkProofOfWork(hash, EASY_BITS)) return;
+    }
+}
+
+// Header i links to header i - 1, and the first one to prevHash.
+vector<unsigned char> makeChain(size_t count, const unsigned char* prevHash)
+{
+    vector<unsigned char> data(80 * count);
+    for (size_t i = 0; i < count; i++) {
+        unsigned char* header = &data[80 * i];
+        writeLE32(header, 2);
+        if (i == 0)
+            memcpy(header + 4, prevHash, 32);
+        else
+            sha256_2(header - 80, 80, header + 4);
+        for (size_t j = 36; j < 68; j++) header[j] = rand();
+        writeLE32(header + 68, 1231006505 + 600 * i);
+        writeLE32(header + 72, EASY_BITS);
+        mine(header);
+    }
+    return data;
+}
+
+int validate(const vector<unsigned char>& data, const unsigned char* prevHash, unsigned int nThreads)
+{
+    vector<unsigned char> hashes(data.size() / 80 * 32);
+    return validateHeaders(&data[0], 80, data.size() / 80, prevHash, &hashes[0], nThreads);
+}
+
+int main()
+{
+    srand(1);
+
+    cout << "multi-buffer kernel (" << sha256_multi_lanes() << " lanes used by sha256_2_80) against sha256_2..." << endl;
+    {
+        // every count up to a few full batches, so that partial batches are covered for 4 and 8 lanes
+        const size_t MAX_COUNT = 20;
+        vector<unsigned char> data(81 * MAX_COUNT);
+        for (size_t i = 0; i < data.size(); i++) data[i] = rand();
+
+        for (size_t stride = 80; stride <= 81; stride++) {
+            for (size_t count = 0; count <= MAX_COUNT; count++) {
+                vector<unsigned char> expected(32 * count + 1, 0xab), multi(expected), dispatched(expected);
+                for (size_t i = 0; i < count; i++) sha256_2(&data[stride * i], 80, &expected[32 * i]);
+                sha256_2_80_multi(&data[0], stride, count, &multi[0]);
+                sha256_2_80(&data[0], stride, count, &dispatched[0]);
+                assert(multi == expected);       // including the guard byte past the end
+                assert(dispatched == expected);
+            }
+        }
+    }
+
+    cout << "validateHeaders..." << endl;
+    {
+        unsigned char genesisHash[32];
+        for (size_t i = 0; i < 32; i++) genesisHash[i] = rand();
+
+        // enough headers for validation to be split into chunks
+        const size_t COUNT = 2 * MIN_HEADERS_PER_THREAD + 500;
+        vector<unsigned char> chain = makeChain(COUNT, genesisHash);
+
+        vector<unsigned char> hashes(32 * COUNT);
+        assert(validateHeaders(&chain[0], 80, COUNT, genesisHash, &hashes[0], 3) == -1);
+        for (size_t i = 0; i < COUNT; i++) {
+            unsigned char hash[32];
+            sha256_2(&chain[80 * i], 80, hash);
+            assert(memcmp(hash, &hashes[32 * i], 32) == 0);
+        }
+        assert(validate(chain, genesisHash, 1) == -1);
+        assert(validate(chain, NULL, 0) == -1);
+        assert(validateHeaders(&chain[0], 80, 0, genesisHash, &hashes[0]) == -1);
+
+        // first header doesn't link to prevHash
+        unsigned char otherHash[32];
+        memcpy(otherHash, genesisHash, 32);
+        otherHash[31] ^= 1;
+        assert(validate(chain, otherHash, 3) == 0);
+
+        // a header that still meets its target but doesn't link to the one before it
+        const size_t UNLINKED = 1700;
+        vector<unsigned char> unlinked(chain);
+        unlinked[80 * UNLINKED + 4] ^= 1;
+        mine(&unlinked[80 * UNLINKED]);
+        assert(validate(unlinked, genesisHash, 1) == (int)UNLINKED);
+        assert(validate(unlinked, genesisHash, 3) == (int)UNLINKED);
+
+        // proof-of-work failures, in each chunk and before and after the linkage failure
+        const size_t FAILURES[] = { 0, 900, 1250, 2100, COUNT - 1 };
+        for (size_t f = 0; f < sizeof(FAILURES) / sizeof(FAILURES[0]); f++) {
+            size_t failure = FAILURES[f];
+            for (int bLinked = 0; bLinked <= 1; bLinked++) {
+                vector<unsigned char> data(bLinked ? chain : unlinked);
+                writeLE32(&data[80 * failure + 72], HARD_BITS);
+                unsigned char hash[32];
+                sha256_2(&data[80 * failure], 80, hash);
+                if (checkProofOfWork(hash, HARD_BITS)) continue; // astronomically unlikely
+
+                size_t expected = (bLinked || failure < UNLINKED) ? failure : UNLINKED;
+                assert(validate(data, genesisHash, 1) == (int)expected);
+                assert(validate(data, genesisHash, 3) == (int)expected);
+            }
+        }
+
+        // a headers payload is 81 bytes per header
+        vector<unsigned char> payload(81 * COUNT, 0);
+        for (size_t i = 0; i < COUNT; i++) memcpy(&payload[81 * i], &chain[80 * i], 80);
+        assert(validateHeaders(&payload[0], 81, COUNT, genesisHash, &hashes[0], 3) == -1);
+        payload[81 * UNLINKED + 4] ^= 1;
+        assert(validateHeaders(&payload[0], 81, COUNT, genesisHash, &hashes[0], 3) == (int)UNLINKED);
+    }
+
+    cout << "validateHeaders on a headers message..." << endl;
+    {
+        vector<unsigned char> chain = makeChain(50, g_zero32bytes.data());
+        HeadersMessage headers;
+        for (size_t i = 0; i < 50; i++) headers.headers.push_back(CoinBlockHeader(uchar_vector(&chain[80 * i], &chain[80 * (i + 1)])));
+
+        vector<uchar_vector> hashes;
+        assert(validateHeaders(headers, g_zero32bytes, &hashes) == -1);
+        assert(hashes.size() == 50);
+        for (size_t i = 0; i < 50; i++) {
+            assert(hashes[i] == headers.headers[i].getHashLittleEndian());
+            if (i + 1 < 50) assert(hashes[i] == headers.headers[i + 1].prevBlockHash);
+        }
+
+        headers.headers[20].prevBlockHash = headers.headers[30].prevBlockHash;
+        assert(validateHeaders(headers, g_zero32bytes, &hashes) == 20);
+        assert(validateHeaders(headers, headers.headers[5].prevBlockHash) == 0);
+    }
+
+    cout << "all tests passed" << endl;
+    return 0;
+}
@@ -0,0 +1,255 @@
+#include <Mempool.h>
+#include <UtxoSet.h>
+#include <numericdata.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+using namespace Coin;
+using namespace std;
+
+const uchar_vector SCRIPT("76a914010966776006953d5567439e5e39f86a0d273bee88ac");
+
+// An outpoint of some confirmed transaction.
+OutPoint confirmed(uint32_t n)
+{
+    uchar_vector hash(32, 0xc0);
+    hash += uint_to_vch(n, _BIG_ENDIAN);
+    return OutPoint(uchar_vector(hash.end() - 32, hash.end()), 0);
+}
+
+TransactionPtr makeTx(const vector<OutPoint>& inputs, size_t nOutputs = 2, uint64_t value = 100000)
+{
+    Transaction* tx = new Transaction();
+    for (size_t i = 0; i < inputs.size(); i++) tx->addInput(TxIn(inputs[i], uchar_vector("51"), 0xffffffff));
+    for (size_t i = 0; i < nOutputs; i++) tx->addOutput(TxOut(value, SCRIPT));
+    return TransactionPtr(tx);
+}
+
+TransactionPtr makeTx(const OutPoint& input, size_t nOutputs = 2, uint64_t value = 100000)
+{
+    return makeTx(vector<OutPoint>(1, input), nOutputs, value);
+}
+
+uchar_vector txid(const TransactionPtr& tx) { return tx->getHashLittleEndian(); }
+OutPoint out(const TransactionPtr& tx, uint32_t index) { return OutPoint(txid(tx), index); }
+
+size_t position(const vector<TransactionPtr>& txs, const TransactionPtr& tx)
+{
+    for (size_t i = 0; i < txs.size(); i++) {
+        if (txid(txs[i]) == txid(tx)) return i;
+    }
+    return txs.size();
+}
+
+// Every transaction's in-pool parents come before it.
+void checkOrder(const Mempool& pool, const vector<TransactionPtr>& txs)
+{
+    for (size_t i = 0; i < txs.size(); i++) {
+        for (size_t j = 0; j < txs[i]->inputs.size(); j++) {
+            uchar_vector parent(txs[i]->inputs[j].previousOut.hash, txs[i]->inputs[j].previousOut.hash + 32);
+            if (pool.contains(parent)) assert(position(txs, pool.getTx(parent)) < i);
+        }
+    }
+}
+
+void testBasics()
+{
+    cout << "adding, looking up and conflicts..." << endl;
+    Mempool pool;
+    TransactionPtr a = makeTx(confirmed(1));
+    TransactionPtr b = makeTx(out(a, 0));
+    TransactionPtr c = makeTx(out(b, 1));
+    assert(pool.addTx(a, 1000) == Mempool::ADDED);
+    assert(pool.addTx(b, 2000) == Mempool::ADDED);
+    assert(pool.addTx(c, 3000) == Mempool::ADDED);
+    assert(pool.addTx(b, 2000) == Mempool::ALREADY_IN_POOL);
+    assert(pool.size() == 3 && pool.getUsage() > 0);
+
+    assert(pool.contains(txid(a)) && pool.getTx(txid(b)) == b && pool.getFee(txid(c)) == 3000);
+    assert(pool.getSpender(confirmed(1)) == a && pool.getSpender(out(a, 0)) == b);
+    assert(!pool.getSpender(out(a, 1)) && !pool.getSpender(confirmed(2)));
+
+    vector<OutPoint> inputs;
+    inputs.push_back(out(a, 0));
+    inputs.push_back(confirmed(1));
+    TransactionPtr doubleSpend = makeTx(inputs, 1);
+    assert(pool.addTx(doubleSpend, 1000000) == Mempool::CONFLICT);
+    vector<TransactionPtr> conflicts = pool.getConflicts(*doubleSpend);
+    assert(conflicts.size() == 2 && position(conflicts, a) < 2 && position(conflicts, b) < 2);
+    assert(pool.size() == 3 && !pool.contains(txid(doubleSpend)));
+
+    cout << "removing..." << endl;
+    size_t usage = pool.getUsage();
+    TransactionPtr d = makeTx(out(a, 1));
+    assert(pool.addTx(d, 500) == Mempool::ADDED);
+    assert(pool.removeTx(txid(d)) == 1 && pool.getUsage() == usage);
+    assert(pool.removeTx(txid(d)) == 0);
+    assert(pool.removeTx(txid(b)) == 2);                 // and its child c
+    assert(pool.size() == 1 && pool.contains(txid(a)) && !pool.contains(txid(c)));
+    assert(!pool.getSpender(out(a, 0)));
+    assert(pool.addTx(b, 2000) == Mempool::ADDED);      // its input is free again
+    assert(pool.removeTx(txid(a)) == 2 && pool.size() == 0 && pool.getUsage() == 0);
+}
+
+void testAncestorLimit()
+{
+    cout << "ancestor limit..." << endl;
+    Mempool pool(DEFAULT_MEMPOOL_MAX_USAGE, 3);
+    TransactionPtr a = makeTx(confirmed(1));
+    TransactionPtr b = makeTx(out(a, 0));
+    TransactionPtr c = makeTx(out(b, 0));
+    TransactionPtr d = makeTx(out(c, 0));
+    TransactionPtr e = makeTx(out(b, 1)); // a sibling of c has the same ancestors
+    assert(pool.addTx(a, 1000) == Mempool::ADDED);
+    assert(pool.addTx(b, 1000) == Mempool::ADDED);
+    assert(pool.addTx(c, 1000) == Mempool::ADDED);
+    assert(pool.addTx(d, 1000) == Mempool::TOO_MANY_ANCESTORS);
+    assert(pool.addTx(e, 1000) == Mempool::ADDED);
+    assert(pool.size() == 4);
+
+    // once a is confirmed, d is within the limit
+    CoinBlock block;
+    block.addTransaction(*a);
+    assert(pool.removeForBlock(block) == 1);
+    assert(pool.addTx(d, 1000) == Mempool::ADDED);
+}
+
+void testBlockTemplate()
+{
+    cout << "block templates..." << endl;
+    Mempool pool;
+    TransactionPtr parent = makeTx(confirmed(1));       // pays almost nothing...
+    TransactionPtr child = makeTx(out(parent, 0));      // ...but its child pays a lot
+    TransactionPtr middle = makeTx(confirmed(2));
+    TransactionPtr low = makeTx(confirmed(3));
+    TransactionPtr lowChild = makeTx(out(low, 0));
+    assert(pool.addTx(parent, 1) == Mempool::ADDED);
+    assert(pool.addTx(child, 100000) == Mempool::ADDED);
+    assert(pool.addTx(middle, 5000) == Mempool::ADDED);
+    assert(pool.addTx(low, 100) == Mempool::ADDED);
+    assert(pool.addTx(lowChild, 100) == Mempool::ADDED);
+
+    vector<TransactionPtr> txs = pool.getBlockTemplateTxs(1000000);
+    assert(txs.size() == 5);
+    checkOrder(pool, txs);
+    assert(position(txs, parent) == 0 && position(txs, child) == 1 && position(txs, middle) == 2);
+    assert(position(txs, low) == 3 && position(txs, lowChild) == 4);
+
+    // room for one transaction only - the parent and child package doesn't fit
+    txs = pool.getBlockTemplateTxs(middle->getSize());
+    assert(txs.size() == 1 && txs[0] == middle);
+
+    assert(pool.getBlockTemplateTxs(0).empty());
+}
+
+void testRemoveForBlock()
+{
+    cout << "removing a block's transactions and double spends..." << endl;
+    Mempool pool;
+    TransactionPtr a = makeTx(confirmed(1));
+    TransactionPtr b = makeTx(out(a, 0));
+    TransactionPtr c = makeTx(confirmed(2));
+    TransactionPtr d = makeTx(out(c, 0));
+    TransactionPtr e = makeTx(out(d, 0));
+    TransactionPtr f = makeTx(confirmed(3));
+    assert(pool.addTx(a, 1) == Mempool::ADDED);
+    assert(pool.addTx(b, 100000) == Mempool::ADDED);
+    assert(pool.addTx(c, 1000) == Mempool::ADDED);
+    assert(pool.addTx(d, 1000) == Mempool::ADDED);
+    assert(pool.addTx(e, 1000) == Mempool::ADDED);
+    assert(pool.addTx(f, 1000) == Mempool::ADDED);
+
+    // a is confirmed and c is double spent by a transaction the pool hasn't seen
+    CoinBlock block;
+    block.addTransaction(*makeTx(confirmed(100), 1));
+    block.addTransaction(*a);
+    block.addTransaction(*makeTx(confirmed(2), 1, 5));
+    assert(pool.removeForBlock(block) == 4);
+    assert(pool.size() == 2 && pool.contains(txid(b)) && pool.contains(txid(f)));
+    assert(!pool.getSpender(confirmed(2)));
+
+    // b no longer counts a as an ancestor
+    vector<TransactionPtr> txs = pool.getBlockTemplateTxs(b->getSize());
+    assert(txs.size() == 1 && txs[0] == b);
+}
+
+void testTrim()
+{
+    cout << "trimming to the memory budget..." << endl;
+    size_t usage;
+    {
+        Mempool pool;
+        pool.addTx(makeTx(confirmed(0)), 0);
+        usage = pool.getUsage(); // all the transactions below are the same size
+    }
+
+    Mempool pool(3 * usage + usage / 2);
+    vector<TransactionPtr> txs;
+    for (uint32_t i = 0; i < 5; i++) txs.push_back(makeTx(confirmed(i)));
+    assert(pool.addTx(txs[0], 1000) == Mempool::ADDED);
+    assert(pool.addTx(txs[1], 3000) == Mempool::ADDED);
+    assert(pool.addTx(txs[2], 2000) == Mempool::ADDED);
+    assert(pool.addTx(txs[3], 4000) == Mempool::ADDED);
+    assert(pool.size() == 3 && pool.getUsage() <= pool.getMaxUsage());
+    assert(!pool.contains(txid(txs[0])));
+    assert(pool.addTx(txs[4], 500) == Mempool::POOL_FULL);
+    assert(pool.size() == 3 && !pool.contains(txid(txs[4])));
+
+    // a low fee parent is kept for a child that pays for both
+    TransactionPtr child = makeTx(out(txs[2], 0));
+    assert(pool.addTx(child, 100000) == Mempool::ADDED);
+    assert(pool.size() == 3 && pool.contains(txid(txs[2])) && !pool.contains(txid(txs[1])));
+}
+
+void testUtxoFees()
+{
+    cout << "fees from the UTXO set..." << endl;
+    char dirTemplate[] = "/tmp/mempoolXXXXXX";
+    string dir = mkdtemp(dirTemplate);
+
+    UtxoStore store(dir);
+    UtxoSet utxos(&store);
+    CoinBlock block(1, 1231006505, 0x1d00ffff, g_zero32bytes);
+    Transaction coinbase;
+    coinbase.addInput(TxIn(OutPoint(g_zero32bytes, 0xffffffff), uchar_vector("0101"), 0xffffffff));
+    coinbase.addOutput(TxOut(5000000000ull, SCRIPT));
+    coinbase.addOutput(TxOut(1000000ull, SCRIPT));
+    block.addTransaction(coinbase);
+    block.updateMerkleRoot();
+    utxos.applyBlock(block, 0);
+    OutPoint funding(coinbase.getHashLittleEndian(), 0);
+
+    Mempool pool;
+    TransactionPtr parent = makeTx(funding, 2, 2000000000ull);
+    assert(pool.addTx(parent, utxos) == Mempool::ADDED);
+    assert(pool.getFee(txid(parent)) == 1000000000ull);
+
+    vector<OutPoint> inputs;
+    inputs.push_back(out(parent, 1));
+    inputs.push_back(OutPoint(coinbase.getHashLittleEndian(), 1));
+    TransactionPtr child = makeTx(inputs, 1, 2000900000ull);
+    assert(pool.addTx(child, utxos) == Mempool::ADDED);
+    assert(pool.getFee(txid(child)) == 100000ull);
+    assert(pool.addTx(child, utxos) == Mempool::ALREADY_IN_POOL);
+
+    assert(pool.addTx(makeTx(confirmed(7)), utxos) == Mempool::MISSING_INPUTS);
+    assert(pool.addTx(makeTx(out(parent, 2)), utxos) == Mempool::MISSING_INPUTS); // parent has two outputs
+    TransactionPtr overspend = makeTx(out(parent, 0), 1, 2000000001ull);
+    assert(pool.addTx(overspend, utxos) == Mempool::NEGATIVE_FEE);
+    assert(pool.size() == 2);
+}
+
+int main()
+{
+    testBasics();
+    testAncestorLimit();
+    testBlockTemplate();
+    testRemoveForBlock();
+    testTrim();
+    testUtxoFees();
+    cout << "all tests passed" << endl;
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include <secp256k1math.h>
+#include <uchar_vector.h>
+#include <hash.h>
+
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/obj_mac.h>
+#include <openssl/rand.h>
+
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <sys/time.h>
+
+using namespace Coin;
+using namespace std;
+
+const uchar_vector CURVE_ORDER("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141");
+
+double now()
+{
+    timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+uchar_vector secret(uint64_t n)
+{
+    uchar_vector k(32, 0);
+    for (int i = 31; n; i--, n >>= 8) k[i] = n & 0xff;
+    return k;
+}
+
+uchar_vector compressed(const uchar_vector& k)
+{
+    secp256k1::PublicKey pubkey;
+    assert(secp256k1::derivePublicKey(&k[0], pubkey));
+    uchar_vector out(33, 0);
+    secp256k1::serializePublicKey(pubkey, true, &out[0]);
+    return out;
+}
+
+uchar_vector uncompressed(const secp256k1::PublicKey& pubkey)
+{
+    uchar_vector out(65, 0);
+    secp256k1::serializePublicKey(pubkey, false, &out[0]);
+    return out;
+}
+
+int main()
+{
+    cout << "generator multiples..." << endl;
+    assert(compressed(secret(1)).getHex() == "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+    assert(compressed(secret(2)).getHex() == "02c6047f9441ed7d6d3045406e95c07cd85c778e4b8cef3ca7abac09b95c709ee5");
+    assert(compressed(secret(3)).getHex() == "02f9308a019258c31049344f85f89d5229b531c845836f99b08601f113bce036f9");
+    uchar_vector nMinusOne(CURVE_ORDER);
+    nMinusOne[31]--;
+    assert(compressed(nMinusOne).getHex() == "0379be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+
+    secp256k1::PublicKey pubkey;
+    assert(!secp256k1::derivePublicKey(&secret(0)[0], pubkey));
+    assert(!secp256k1::derivePublicKey(&CURVE_ORDER[0], pubkey));
+    assert(!secp256k1::isValidSecret(&CURVE_ORDER[0]));
+    assert(secp256k1::isValidSecret(&nMinusOne[0]));
+
+    cout << "public key encodings..." << endl;
+    uchar_vector g = compressed(secret(1));
+    assert(secp256k1::parsePublicKey(&g[0], g.size(), pubkey));
+    uchar_vector gFull = uncompressed(pubkey);
+    secp256k1::PublicKey pubkey2;
+    assert(secp256k1::parsePublicKey(&gFull[0], gFull.size(), pubkey2) && pubkey2 == pubkey);
+    gFull[64] ^= 1;
+    assert(!secp256k1::parsePublicKey(&gFull[0], gFull.size(), pubkey2));
+    g[0] = 0x05;
+    assert(!secp256k1::parsePublicKey(&g[0], g.size(), pubkey2));
+    uchar_vector notOnCurve("02" "0000000000000000000000000000000000000000000000000000000000000005");
+    assert(!secp256k1::parsePublicKey(&notOnCurve[0], notOnCurve.size(), pubkey2));
+
+    cout << "RFC 6979..." << endl;
+    unsigned char sig[64];
+    uchar_vector hash = sha256(uchar_vector((const unsigned char*)"Satoshi Nakamoto", 16));
+    assert(secp256k1::sign(&secret(1)[0], &hash[0], sig));
+    assert(uchar_vector(sig, 64).getHex() ==
+        "934b1ea10a4b3c1757e2b0c017d0b6143ce3c9a7e6a4a49860d7a6ab210ee3d8"
+        "2442ce9d2b916064108014783e923ec36b49743e2ffa1c4496f01a512aafd9e5");
+
+    cout << "against OpenSSL..." << endl;
+    EC_GROUP* group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+    for (int i = 0; i < 500; i++) {
+        uchar_vector k(32, 0);
+        do { RAND_bytes(&k[0], 32); } while (!secp256k1::isValidSecret(&k[0]));
+        assert(secp256k1::derivePublicKey(&k[0], pubkey));
+
+        EC_KEY* key = EC_KEY_new_by_curve_name(NID_secp256k1);
+        BIGNUM* bn = BN_bin2bn(&k[0], 32, NULL);
+        EC_POINT* point = EC_POINT_new(group);
+        EC_POINT_mul(group, point, bn, NULL, NULL, NULL);
+        EC_KEY_set_private_key(key, bn);
+        EC_KEY_set_public_key(key, point);
+        uchar_vector expected(65, 0);
+        EC_POINT_point2oct(group, point, POINT_CONVERSION_UNCOMPRESSED, &expected[0], 65, NULL);
+        assert(uncompressed(pubkey) == expected);
+
+        uchar_vector digest(32, 0);
+        RAND_bytes(&digest[0], 32);
+        int recid;
+        assert(secp256k1::sign(&k[0], &digest[0], sig, &recid));
+        assert(secp256k1::verify(pubkey, &digest[0], sig));
+
+        unsigned char der[SECP256K1_MAX_DER_SIGNATURE_SIZE];
+        size_t derSize = secp256k1::encodeDerSignature(sig, der);
+        assert(ECDSA_verify(0, &digest[0], 32, der, derSize, key) == 1);
+
+        unsigned char decoded[64];
+        assert(secp256k1::decodeDerSignature(der, derSize, decoded) && memcmp(decoded, sig, 64) == 0);
+        assert(!secp256k1::decodeDerSignature(der, derSize - 1, decoded));
+
+        assert(secp256k1::recover(&digest[0], sig, recid, pubkey2) && pubkey2 == pubkey);
+        assert(!secp256k1::recover(&digest[0], sig, recid ^ 1, pubkey2) || pubkey2 != pubkey);
+
+        // OpenSSL doesn't normalize s, so this covers high s too
+        unsigned char opensslDer[80];
+        unsigned int opensslDerSize;
+        assert(ECDSA_sign(0, &digest[0], 32, opensslDer, &opensslDerSize, key));
+        assert(secp256k1::decodeDerSignature(opensslDer, opensslDerSize, decoded));
+        assert(secp256k1::verify(pubkey, &digest[0], decoded));
+
+        digest[i % 32] ^= 1;
+        assert(!secp256k1::verify(pubkey, &digest[0], sig));
+
+        EC_POINT_free(point);
+        BN_free(bn);
+        EC_KEY_free(key);
+
+        // (k + t)G == kG + tG
+        uchar_vector t(32, 0);
+        RAND_bytes(&t[0], 32);
+        uchar_vector kt(k);
+        if (secp256k1::tweakAddSecret(&kt[0], &t[0])) {
+            assert(secp256k1::tweakAddPublic(pubkey, &t[0]));
+            assert(secp256k1::derivePublicKey(&kt[0], pubkey2) && pubkey2 == pubkey);
+        }
+    }
+    EC_GROUP_free(group);
+
+    cout << "batch derivation..." << endl;
+    {
+        const size_t count = 50;
+        uchar_vector seckeys(32 * count, 0);
+        for (size_t i = 0; i < count; i++) seckeys[32 * i + 31] = i;
+        memcpy(&seckeys[32 * 3], &CURVE_ORDER[0], 32);
+        vector<secp256k1::PublicKey> pubkeys(count);
+        unsigned char results[count];
+        assert(!secp256k1::derivePublicKeys(&seckeys[0], count, &pubkeys[0], results));
+        for (size_t i = 0; i < count; i++) {
+            assert(results[i] == (i != 0 && i != 3));
+            if (results[i]) {
+                assert(secp256k1::derivePublicKey(&seckeys[32 * i], pubkey));
+                assert(pubkeys[i] == pubkey);
+            }
+        }
+        assert(secp256k1::derivePublicKeys(&seckeys[32 * 4], count - 4, &pubkeys[0]));
+    }
+
+    cout << "batch verification..." << endl;
+    {
+        const size_t count = 50;
+        vector<secp256k1::PublicKey> pubkeys(count);
+        uchar_vector hashes(32 * count, 0), sigs(64 * count, 0);
+        for (size_t i = 0; i < count; i++) {
+            uchar_vector k = secret(1000 + i);
+            hashes[32 * i] = i;
+            assert(secp256k1::derivePublicKey(&k[0], pubkeys[i]));
+            assert(secp256k1::sign(&k[0], &hashes[32 * i], &sigs[64 * i]));
+        }
+        unsigned char results[count];
+        assert(secp256k1::verifyBatch(&pubkeys[0], &hashes[0], &sigs[0], count, results));
+        hashes[32 * 7] ^= 1;
+        memset(&sigs[64 * 20], 0, 32);
+        assert(!secp256k1::verifyBatch(&pubkeys[0], &hashes[0], &sigs[0], count, results));
+        for (size_t i = 0; i < count; i++) assert(results[i] == (i != 7 && i != 20));
+    }
+
+    cout << "tweaks..." << endl;
+    uchar_vector k = secret(5);
+    assert(!secp256k1::tweakAddSecret(&k[0], &CURVE_ORDER[0]));
+    assert(k == secret(5));
+    uchar_vector minusFive(CURVE_ORDER);
+    minusFive[31] -= 5;
+    assert(!secp256k1::tweakAddSecret(&k[0], &minusFive[0]));
+    assert(secp256k1::derivePublicKey(&k[0], pubkey));
+    assert(!secp256k1::tweakAddPublic(pubkey, &minusFive[0]));
+
+    cout << "timing..." << endl;
+    const int count = 2000;
+    uchar_vector digest(32, 0);
+    double start = now();
+    for (int i = 0; i < count; i++) { k[31] = i; secp256k1::derivePublicKey(&k[0], pubkey); }
+    cout << "  derive: " << (now() - start) * 1e6 / count << " us" << endl;
+    uchar_vector seckeys(32 * count, 0x11);
+    vector<secp256k1::PublicKey> pubkeys(count);
+    start = now();
+    secp256k1::derivePublicKeys(&seckeys[0], count, &pubkeys[0]);
+    cout << "  derive (batch): " << (now() - start) * 1e6 / count << " us" << endl;
+    start = now();
+    for (int i = 0; i < count; i++) { digest[0] = i; secp256k1::sign(&k[0], &digest[0], sig); }
+    cout << "  sign:   " << (now() - start) * 1e6 / count << " us" << endl;
+    start = now();
+    for (int i = 0; i < count; i++) secp256k1::verify(pubkey, &digest[0], sig);
+    cout << "  verify: " << (now() - start) * 1e6 / count << " us" << endl;
+
+    cout << "passed" << endl;
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <SighashEngine.h>
+#include <StandardTransactions.h>
+#include <numericdata.h>
+
+#include <iostream>
+#include <cassert>
+
+using namespace Coin;
+using namespace std;
+
+const uchar_vector SCRIPT("76a914010966776006953d5567439e5e39f86a0d273bee88ac");
+
+// Covers ALL, NONE and SINGLE with and without ANYONECANPAY, plus the unnamed types that hash like ALL.
+const uint32_t HASH_TYPES[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x1f, 0x21, 0x41, 0x81, 0x82, 0x83, 0xff };
+const size_t HASH_TYPE_COUNT = sizeof(HASH_TYPES) / sizeof(HASH_TYPES[0]);
+
+Transaction makeTx(size_t nInputs, size_t nOutputs)
+{
+    Transaction tx;
+    for (size_t i = 0; i < nInputs; i++) {
+        uchar_vector hash(32, (unsigned char)(i + 1));
+        tx.addInput(TxIn(OutPoint(hash, i), uchar_vector(i % 3 + 1, 0x51), 0xfffffffe - i));
+    }
+    for (size_t i = 0; i < nOutputs; i++) tx.addOutput(TxOut(100000 * (i + 1), SCRIPT));
+    tx.lockTime = 12345;
+    return tx;
+}
+
+// Checks every input and hash type of tx against getSignatureHash.
+void check(const Transaction& tx, const uchar_vector& subscript)
+{
+    SighashEngine engine(tx);
+    assert(engine.getInputCount() == tx.inputs.size());
+    for (uint i = 0; i < tx.inputs.size(); i++) {
+        for (size_t j = 0; j < HASH_TYPE_COUNT; j++) {
+            uint32_t hashType = HASH_TYPES[j];
+            uchar_vector expected = getSignatureHash(tx, i, subscript, hashType);
+            assert(engine.getHash(i, subscript, hashType) == expected);
+            if (SighashEngine::isHashAll(hashType)) {
+                uchar_vector hash(32);
+                engine.getHashAll(i, subscript.empty() ? NULL : &subscript[0], subscript.size(), hashType, &hash[0]);
+                assert(hash == expected);
+            }
+        }
+    }
+}
+
+void testHashTypes()
+{
+    cout << "every hash type against getSignatureHash..." << endl;
+    assert(SighashEngine::isHashAll(SIGHASH_ALL));
+    assert(!SighashEngine::isHashAll(SIGHASH_NONE));
+    assert(!SighashEngine::isHashAll(SIGHASH_SINGLE));
+    assert(!SighashEngine::isHashAll(SIGHASH_ALL | SIGHASH_ANYONECANPAY));
+
+    // fewer outputs than inputs, so SINGLE hits both a matching output and the missing output case
+    Transaction tx = makeTx(4, 2);
+    check(tx, SCRIPT);
+    check(tx, uchar_vector());
+    check(makeTx(1, 1), SCRIPT);
+    check(makeTx(3, 0), SCRIPT);
+
+    uchar_vector one(32, 0);
+    one[0] = 1;
+    assert(SighashEngine(tx).getHash(3, SCRIPT, SIGHASH_SINGLE) == one);
+}
+
+void testLengths()
+{
+    cout << "long subscripts and input counts..." << endl;
+    // subscript lengths on both sides of each VarInt size boundary
+    const size_t lengths[] = { 0xfc, 0xfd, 0xffff, 0x10000 };
+    Transaction tx = makeTx(3, 3);
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        check(tx, uchar_vector(lengths[i], 0xac));
+    }
+
+    // an input count that needs a three byte VarInt
+    Transaction big = makeTx(0xfd, 2);
+    SighashEngine engine(big);
+    const uint indices[] = { 0, 1, 0x7e, 0xfc };
+    for (size_t i = 0; i < sizeof(indices) / sizeof(indices[0]); i++) {
+        assert(engine.getHash(indices[i], SCRIPT, SIGHASH_ALL) == getSignatureHash(big, indices[i], SCRIPT, SIGHASH_ALL));
+        assert(engine.getHash(indices[i], SCRIPT, SIGHASH_NONE) == getSignatureHash(big, indices[i], SCRIPT, SIGHASH_NONE));
+    }
+}
+
+void testOutOfRange()
+{
+    cout << "out of range inputs..." << endl;
+    Transaction tx = makeTx(2, 2);
+    SighashEngine engine(tx);
+    bool bThrew = false;
+    try {
+        engine.getHash(2, SCRIPT, SIGHASH_ALL);
+    }
+    catch (const runtime_error&) {
+        bThrew = true;
+    }
+    assert(bThrew);
+
+    bThrew = false;
+    try {
+        unsigned char hash[32];
+        engine.getHashAll(2, &SCRIPT[0], SCRIPT.size(), SIGHASH_ALL, hash);
+    }
+    catch (const runtime_error&) {
+        bThrew = true;
+    }
+    assert(bThrew);
+}
+
+int main()
+{
+    testHashTypes();
+    testLengths();
+    testOutOfRange();
+    cout << "all tests passed." << endl;
+    return 0;
+}
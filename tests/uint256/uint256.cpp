@@ -0,0 +1,78 @@
+#include <uint256.h>
+#include <CoinNodeData.h>
+
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+
+using namespace Coin;
+using namespace std;
+
+// mainnet genesis block header
+const string GENESIS_HEADER("0100000000000000000000000000000000000000000000000000000000000000000000003ba3edfd7a7b12b27ac72c3e67768f617fc81bc3888a51323a9fb8aa4b1e5e4a29ab5f49ffff001d1dac2b7c");
+
+uint256 toUint256(const BigInt& n)
+{
+    uint256 r;
+    r.setBytes(n.getBytes());
+    return r;
+}
+
+int main()
+{
+    cout << "compact..." << endl;
+    uint256 target;
+    target.setCompact(0x1d00ffff);
+    assert(target.getHex() == "00000000ffff0000000000000000000000000000000000000000000000000000");
+    assert(target.getCompact() == 0x1d00ffff);
+    assert(uint256().setCompact(0x01123456).getCompact() == 0x01120000);
+    assert(uint256(0x80).getCompact() == 0x02008000);
+
+    bool bNegative, bOverflow;
+    uint256().setCompact(0x04923456, &bNegative, &bOverflow);
+    assert(bNegative && !bOverflow);
+    uint256().setCompact(0xff123456, &bNegative, &bOverflow);
+    assert(bOverflow);
+    cout << "  target(0x1d00ffff) = " << target.getHex() << endl;
+
+    cout << "work..." << endl;
+    assert(getWork(0x1d00ffff) == uint256(0x100010001ULL));
+    assert(getWork(uint256(0)) == uint256(0));
+    assert(getWork(~uint256(0)) == uint256(1));
+    cout << "  work(0x1d00ffff) = " << getWork(0x1d00ffff).getHex() << endl;
+
+    cout << "arithmetic..." << endl;
+    uint256 a(0xffffffffffffffffULL);
+    a += 1;
+    assert(a == uint256(0, 0, 1, 0));
+    assert(a - 1 == uint256(0xffffffffffffffffULL));
+    assert((a << 130) >> 130 == a);
+    assert((uint256(1) << 255).bits() == 256);
+    assert(uint256(1000000) * 1000000 == uint256(1000000000000ULL));
+    assert(uint256(0, 0, 1, 0) / uint256(0x100000000ULL) == uint256(0x100000000ULL));
+    assert(-uint256(1) == ~uint256(0));
+
+    cout << "against BigInt..." << endl;
+    srand(12345);
+    for (int i = 0; i < 1000; i++) {
+        CoinBlockHeader header(1, 0, (uint32_t)(3 + rand() % 30) << 24 | (rand() & 0x007fffff));
+        assert(toUint256(header.getTarget()) == header.getTarget256());
+        assert(toUint256(header.getWork()) == header.getWork256());
+
+        CoinBlockHeader copy(header);
+        copy.setTarget(header.getTarget());
+        CoinBlockHeader copy256(header);
+        copy256.setTarget256(header.getTarget256());
+        assert(copy.bits == copy256.bits);
+    }
+
+    cout << "proof of work..." << endl;
+    CoinBlockHeader genesis(GENESIS_HEADER);
+    assert(genesis.checkProofOfWork());
+    cout << "  genesis " << genesis.getHashLittleEndian().getHex() << " ok" << endl;
+    genesis.nonce++;
+    assert(!genesis.checkProofOfWork());
+
+    cout << "all tests passed." << endl;
+    return 0;
+}
@@ -0,0 +1,324 @@
+#include <UtxoSet.h>
+#include <UtxoStore.h>
+#include <numericdata.h>
+
+#include <iostream>
+#include <map>
+#include <cassert>
+#include <cstdlib>
+#include <cstdio>
+#include <stdexcept>
+
+#include <unistd.h>
+
+using namespace Coin;
+using namespace std;
+
+string makeDir(const char* name)
+{
+    string path = string("/tmp/") + name + "XXXXXX";
+    vector<char> dirTemplate(path.begin(), path.end());
+    dirTemplate.push_back(0);
+    return string(mkdtemp(&dirTemplate[0])) + "/";
+}
+
+bool exists(const string& path) { return access(path.c_str(), F_OK) == 0; }
+
+void appendGarbage(const string& path, size_t n)
+{
+    FILE* f = fopen(path.c_str(), "ab");
+    assert(f);
+    for (size_t i = 0; i < n; i++) fputc(0xab, f);
+    fclose(f);
+}
+
+UtxoKey makeKey(uint32_t n)
+{
+    unsigned char hash[32];
+    for (int i = 0; i < 32; i++) hash[i] = (unsigned char)(n * 31 + i * 7 + (n >> 8));
+    memcpy(hash, &n, 4);
+    return UtxoKey(hash, n % 5);
+}
+
+uchar_vector makeCoin(uint32_t n, size_t size = 20)
+{
+    uchar_vector coin(size, (unsigned char)n);
+    memcpy(&coin[0], &n, 4);
+    return coin;
+}
+
+// Checks that the store holds exactly the coins in expected among keys [0, n).
+void checkStore(const UtxoStore& store, const map<uint32_t, uchar_vector>& expected, uint32_t n)
+{
+    assert(store.getCount() == expected.size());
+    for (uint32_t i = 0; i < n; i++) {
+        uchar_vector coin;
+        map<uint32_t, uchar_vector>::const_iterator it = expected.find(i);
+        if (it == expected.end()) {
+            assert(!store.get(makeKey(i), coin) && !store.contains(makeKey(i)));
+        }
+        else {
+            assert(store.get(makeKey(i), coin) && coin == it->second);
+        }
+    }
+}
+
+void testStore()
+{
+    cout << "UtxoStore: commits and reopening..." << endl;
+    string dir = makeDir("utxostore");
+    const uint32_t N = 200000; // enough to grow the index a couple of times
+    map<uint32_t, uchar_vector> committed;
+    uchar_vector bestBlock("000000000019d6689c085ae165831e934ff763ae46a2a6c172b3f1b60a8ce26f");
+    {
+        UtxoStore store(dir);
+        assert(store.getCount() == 0 && store.getBestBlock().empty());
+        for (uint32_t i = 0; i < N; i++) {
+            store.put(makeKey(i), makeCoin(i));
+            committed[i] = makeCoin(i);
+        }
+        for (uint32_t i = 0; i < N; i += 3) {
+            store.erase(makeKey(i));
+            committed.erase(i);
+        }
+        store.put(makeKey(1), makeCoin(1000001)); // overwrite
+        committed[1] = makeCoin(1000001);
+        store.commit(bestBlock);
+        checkStore(store, committed, N);
+    }
+    {
+        UtxoStore store(dir);
+        assert(store.getBestBlock() == bestBlock);
+        checkStore(store, committed, N);
+    }
+
+    cout << "UtxoStore: writes after the last commit are discarded..." << endl;
+    {
+        UtxoStore store(dir);
+        for (uint32_t i = N; i < N + 1000; i++) store.put(makeKey(i), makeCoin(i));
+        for (uint32_t i = 1; i < 1000; i += 3) store.erase(makeKey(i));
+        // no commit - the index has already been changed to match the longer log
+    }
+    appendGarbage(dir + "utxo00000.log", 13); // a record cut off partway through
+    {
+        UtxoStore store(dir);
+        assert(store.getBestBlock() == bestBlock);
+        checkStore(store, committed, N + 1000);
+    }
+
+    cout << "UtxoStore: rebuilding a missing index from the log..." << endl;
+    unlink((dir + "utxo.idx").c_str());
+    {
+        UtxoStore store(dir);
+        checkStore(store, committed, N);
+    }
+
+    cout << "UtxoStore: compaction..." << endl;
+    dir = makeDir("utxocompact");
+    {
+        // big coins so that the log passes MIN_UTXO_COMPACT_SIZE quickly
+        const size_t COIN_SIZE = 1000;
+        const uint32_t COUNT = MIN_UTXO_COMPACT_SIZE / COIN_SIZE + 1000;
+        map<uint32_t, uchar_vector> live;
+        {
+            UtxoStore store(dir);
+            for (uint32_t i = 0; i < COUNT; i++) store.put(makeKey(i), makeCoin(i, COIN_SIZE));
+            store.commit(bestBlock);
+            assert(exists(dir + "utxo00000.log") && !exists(dir + "utxo00001.log"));
+
+            for (uint32_t i = 0; i < COUNT; i++) {
+                if (i % 10 == 0)
+                    live[i] = makeCoin(i, COIN_SIZE);
+                else
+                    store.erase(makeKey(i));
+            }
+            uint64_t logSize = store.getLogSize();
+            store.commit(bestBlock);
+            assert(!exists(dir + "utxo00000.log") && exists(dir + "utxo00001.log"));
+            assert(store.getLogSize() < logSize / 5);
+            checkStore(store, live, COUNT);
+
+            // still usable after compacting
+            store.put(makeKey(COUNT), makeCoin(COUNT));
+            live[COUNT] = makeCoin(COUNT);
+            store.erase(makeKey(0));
+            live.erase(0);
+            store.commit(bestBlock);
+        }
+        UtxoStore store(dir);
+        checkStore(store, live, COUNT + 1);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef map<string, UtxoCoin> CoinMap; // outpoint "hash:index" -> coin
+
+uchar_vector payTo(uint32_t n)
+{
+    uchar_vector script("76a914");
+    script += uint_to_vch(n, _BIG_ENDIAN);
+    script += uchar_vector(16, 0x5a);
+    script += uchar_vector("88ac");
+    return script;
+}
+
+// Block at height spending spends - which are removed from coins - and adding its outputs to coins.
+CoinBlock makeBlock(uint32_t height, const uchar_vector& prevHash, const vector<OutPoint>& spends, CoinMap& coins)
+{
+    CoinBlock block(1, 1231006505 + height, 0x1d00ffff, prevHash);
+
+    Transaction coinbase;
+    coinbase.addInput(TxIn(OutPoint(g_zero32bytes, 0xffffffff), uint_to_vch(height, _BIG_ENDIAN), 0xffffffff));
+    coinbase.addOutput(TxOut(5000000000ull, payTo(height)));
+    coinbase.addOutput(TxOut(0, uchar_vector("6a0401020304"))); // unspendable
+    block.addTransaction(coinbase);
+
+    // each spend gets its own transaction with two outputs, the second spent again by the next transaction
+    OutPoint chained;
+    bool bChained = false;
+    for (size_t i = 0; i < spends.size(); i++) {
+        Transaction tx;
+        tx.addInput(TxIn(spends[i], uchar_vector("51"), 0xffffffff));
+        if (bChained) tx.addInput(TxIn(chained, uchar_vector("51"), 0xffffffff));
+        tx.addOutput(TxOut(1000 + height * 100 + i, payTo(height * 100 + i)));
+        tx.addOutput(TxOut(7, payTo(1)));
+        block.addTransaction(tx);
+        chained = OutPoint(tx.getHashLittleEndian(), 1);
+        bChained = true;
+    }
+    block.updateMerkleRoot();
+
+    for (size_t t = 0; t < block.txs.size(); t++) {
+        const Transaction& tx = block.txs[t];
+        if (t > 0) {
+            for (size_t j = 0; j < tx.inputs.size(); j++) coins.erase(tx.inputs[j].previousOut.toDelimited(":"));
+        }
+        for (size_t j = 0; j < tx.outputs.size(); j++) {
+            if (tx.outputs[j].scriptPubKey[0] == 0x6a) continue;
+            coins[OutPoint(tx.getHashLittleEndian(), j).toDelimited(":")] = UtxoCoin(tx.outputs[j], height, t == 0);
+        }
+    }
+    return block;
+}
+
+// Every outpoint in all is in the set exactly when it is in coins.
+void checkSet(UtxoSet& set, const CoinMap& coins, const vector<OutPoint>& all)
+{
+    for (size_t i = 0; i < all.size(); i++) {
+        CoinMap::const_iterator it = coins.find(all[i].toDelimited(":"));
+        UtxoCoin coin;
+        if (it == coins.end()) {
+            assert(!set.getCoin(all[i], coin) && !set.haveCoin(all[i]));
+        }
+        else {
+            assert(set.getCoin(all[i], coin));
+            assert(coin.value == it->second.value && coin.scriptPubKey == it->second.scriptPubKey);
+            assert(coin.height == it->second.height && coin.bCoinbase == it->second.bCoinbase);
+        }
+    }
+}
+
+void addOutPoints(const CoinBlock& block, vector<OutPoint>& all)
+{
+    for (size_t t = 0; t < block.txs.size(); t++) {
+        for (size_t j = 0; j < block.txs[t].outputs.size(); j++) all.push_back(OutPoint(block.txs[t].getHashLittleEndian(), j));
+    }
+}
+
+void testSet()
+{
+    cout << "UtxoSet: applying blocks..." << endl;
+    string dir = makeDir("utxoset");
+    const uint32_t BLOCKS = 40;
+    vector<CoinBlock> blocks;
+    vector<UtxoUndo> undos;
+    vector<CoinMap> history; // coins after each block
+    vector<OutPoint> all;
+    CoinMap coins;
+    {
+        UtxoStore store(dir);
+        UtxoSet set(&store, 16); // small enough that coins keep getting evicted and fetched back
+        uchar_vector prevHash = g_zero32bytes;
+        for (uint32_t h = 0; h < BLOCKS; h++) {
+            // spend a few of the older coins
+            vector<OutPoint> spends;
+            for (CoinMap::iterator it = coins.begin(); it != coins.end() && spends.size() < 3; ++it) {
+                if ((it->first[0] + h) % 4 == 0) {
+                    string hashHex = it->first.substr(0, 64);
+                    spends.push_back(OutPoint(hashHex, atoi(it->first.substr(65).c_str())));
+                }
+            }
+            blocks.push_back(makeBlock(h, prevHash, spends, coins));
+            addOutPoints(blocks.back(), all);
+
+            undos.push_back(UtxoUndo());
+            set.applyBlock(blocks.back(), h, &undos.back(), h % 2 + 1);
+            history.push_back(coins);
+            prevHash = blocks.back().blockHeader.getHashLittleEndian();
+            assert(set.getBestBlock() == prevHash);
+            assert(set.getCacheSize() <= 16);
+            if (h == BLOCKS / 2) set.flush();
+        }
+        checkSet(set, coins, all);
+
+        cout << "UtxoSet: a block with a missing input leaves the set unchanged..." << endl;
+        {
+            CoinMap scratch(coins);
+            vector<OutPoint> spends;
+            spends.push_back(all[0]); // the first coinbase, whether or not it's been spent
+            string first = coins.begin()->first;
+            spends.insert(spends.begin(), OutPoint(first.substr(0, 64), atoi(first.substr(65).c_str())));
+            spends.push_back(OutPoint(uchar_vector(32, 0x77), 3)); // never existed
+            CoinBlock bad = makeBlock(BLOCKS, prevHash, spends, scratch);
+            addOutPoints(bad, all);
+            UtxoUndo undo;
+            bool bThrew = false;
+            try {
+                set.applyBlock(bad, BLOCKS, &undo);
+            }
+            catch (const runtime_error&) {
+                bThrew = true;
+            }
+            assert(bThrew);
+            assert(set.getBestBlock() == prevHash);
+            checkSet(set, coins, all);
+        }
+
+        cout << "UtxoSet: undo round trip..." << endl;
+        for (uint32_t h = BLOCKS; h-- > BLOCKS - 10;) {
+            UtxoUndo undo(undos[h].getSerialized()); // through the serialized form
+            set.undoBlock(blocks[h], undo);
+            assert(set.getBestBlock() == blocks[h].blockHeader.prevBlockHash);
+            checkSet(set, history[h - 1], all);
+        }
+        for (uint32_t h = BLOCKS - 10; h < BLOCKS; h++) {
+            UtxoUndo undo;
+            set.applyBlock(blocks[h], h, &undo);
+            assert(undo.getSerialized() == undos[h].getSerialized());
+        }
+        checkSet(set, coins, all);
+        set.flush();
+        assert(set.getDirtyCount() == 0);
+    }
+
+    cout << "UtxoSet: reopening..." << endl;
+    {
+        UtxoStore store(dir);
+        UtxoSet set(&store);
+        assert(set.getBestBlock() == blocks.back().blockHeader.getHashLittleEndian());
+        checkSet(set, coins, all);
+
+        // undo all the way back to the first block
+        for (uint32_t h = BLOCKS; h-- > 1;) set.undoBlock(blocks[h], undos[h]);
+        checkSet(set, history[0], all);
+    }
+}
+
+int main()
+{
+    testStore();
+    testSet();
+    cout << "all tests passed" << endl;
+    return 0;
+}